@@ -0,0 +1,578 @@
+/**
+ * @file bench_main.c
+ * @brief Throughput, latency and hit-ratio benchmark for the proxy cache.
+ *
+ * Drives proxy_cache_find()/proxy_cache_add() the way a proxy does: look the URL
+ * up, and on a miss "fetch" it and insert it. Keys follow one of three
+ * distributions:
+ *   - zipf:  Zipfian popularity over a fixed key space (theta 0.99 by default).
+ *   - scan:  zipf traffic mixed with a share of one-hit sequential keys, like a
+ *            crawler or backup job sweeping through.
+ *   - trace: keys replayed from a file, either one "<key> [size]" pair per line
+ *            or an access trace dumped by cache_dump_trace() (or --record).
+ *
+ * Every thread count from 1 up to --threads (doubling) runs against a fresh
+ * cache built from the command-line configuration, and one line per run reports
+ * ops/sec, hit ratio, and p50/p99/p999 operation latency. With --mrc the last run
+ * also prints the SHARDS estimate of the hit ratio at other budgets, from the
+ * cache's own sampled trace.
+ *
+ * Build: gcc -O2 -o bench_cache hashmap.c slab.c cache_policy.c cache_histogram.c
+ *        cache_timer.c cache_snapshot.c cache_tier.c cache_codec.c cache_trace.c
+ *        proxy_cache.c bench_main.c -lpthread -lm
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "proxy_cache.h"
+#include "cache_histogram.h"
+#include "cache_platform.h"
+#include "cache_trace.h"
+
+#ifdef _WIN32
+    #include <Windows.h> // For CreateThread
+#else
+    #include <pthread.h> // For pthread_create
+#endif
+
+/*=============================================================================
+ * 1. Configuration
+ *===========================================================================*/
+
+#define BENCH_MAX_THREADS 256
+#define BENCH_URL_SIZE    96
+#define BENCH_TRACE_LOOKAHEAD 8 // Records searched past a missed find for the add that sized it.
+
+typedef enum bench_workload {
+    BENCH_ZIPF,
+    BENCH_SCAN,
+    BENCH_TRACE
+} bench_workload_t;
+
+typedef struct bench_options {
+    bench_workload_t workload;
+    size_t max_threads;
+    size_t ops_per_thread;
+    size_t warmup_ops;     // Untimed operations per thread before measuring.
+    size_t key_count;
+    double theta;          // Zipf skew.
+    double scan_ratio;     // Share of one-hit keys in the scan workload.
+    size_t value_size;     // Object size when the trace does not give one.
+    const char* trace_path;
+    const char* record_path; // Where the last run's access trace is dumped (NULL: nowhere).
+    int mrc;                 // Non-zero to print the estimated curve after the last run.
+    cache_config_t config;
+} bench_options_t;
+
+// A replayed trace: key strings plus optional sizes.
+typedef struct bench_trace {
+    char** keys;
+    size_t* sizes;
+    size_t count;
+} bench_trace_t;
+
+// Precomputed constants for Gray et al.'s Zipfian generator.
+typedef struct bench_zipf {
+    size_t n;
+    double theta, alpha, zetan, eta, half_pow_theta;
+} bench_zipf_t;
+
+typedef struct bench_thread {
+    size_t id;
+    const bench_options_t* options;
+    proxy_cache_t* cache;
+    unsigned long long rng;
+    unsigned long long hits, misses;
+    unsigned long long elapsed_ns; // Wall time of the measured phase.
+    cache_histogram_t latency;
+} bench_thread_t;
+
+static bench_zipf_t g_zipf;
+static bench_trace_t g_trace;
+static char* g_payload;
+
+/*=============================================================================
+ * 2. Key Generation
+ *===========================================================================*/
+
+static unsigned long long next_random(unsigned long long* state) {
+    // xorshift64*
+    unsigned long long x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 0x2545F4914F6CDD1Dull;
+}
+
+static double next_unit(unsigned long long* state) {
+    return (double)(next_random(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static void zipf_init(bench_zipf_t* zipf, size_t n, double theta) {
+    double zeta2 = 1.0 + pow(0.5, theta);
+
+    zipf->n = n;
+    zipf->theta = theta;
+    zipf->zetan = 0.0;
+    for (size_t i = 1; i <= n; i++)
+        zipf->zetan += 1.0 / pow((double)i, theta);
+    zipf->alpha = 1.0 / (1.0 - theta);
+    zipf->eta = (1.0 - pow(2.0 / (double)n, 1.0 - theta)) / (1.0 - zeta2 / zipf->zetan);
+    zipf->half_pow_theta = pow(0.5, theta);
+}
+
+/**
+ * @brief Draws a key rank in [0, n); rank 0 is the most popular.
+ */
+static size_t zipf_next(const bench_zipf_t* zipf, unsigned long long* rng) {
+    double uz = next_unit(rng) * zipf->zetan;
+    if (uz < 1.0)
+        return 0;
+    if (uz < 1.0 + zipf->half_pow_theta)
+        return 1;
+
+    size_t rank = (size_t)((double)zipf->n * pow(zipf->eta * next_unit(rng) - zipf->eta + 1.0, zipf->alpha));
+    return rank < zipf->n ? rank : zipf->n - 1;
+}
+
+/**
+ * @brief Produces the next key of the workload.
+ * @return The object size to insert on a miss.
+ */
+static size_t next_key(bench_thread_t* thread, size_t op, char* url, size_t url_size,
+    const char** trace_key) {
+    const bench_options_t* options = thread->options;
+    *trace_key = NULL;
+
+    if (options->workload == BENCH_TRACE) {
+        // Threads replay the trace from evenly spaced offsets.
+        size_t index = (thread->id * (g_trace.count / options->max_threads + 1) + op) % g_trace.count;
+        *trace_key = g_trace.keys[index];
+        return g_trace.sizes[index] ? g_trace.sizes[index] : options->value_size;
+    }
+
+    if (options->workload == BENCH_SCAN && next_unit(&thread->rng) < options->scan_ratio) {
+        snprintf(url, url_size, "http://bench.example.com/scan/%zu/%zu", thread->id, op);
+        return options->value_size;
+    }
+
+    snprintf(url, url_size, "http://bench.example.com/object/%zu", zipf_next(&g_zipf, &thread->rng));
+    return options->value_size;
+}
+
+/*=============================================================================
+ * 3. Trace Loading
+ *===========================================================================*/
+
+/**
+ * @brief Turns the finds of a dumped access trace into replayable keys.
+ * @details Keys are named after their hash. A missed find has no size of its own, so
+ * it takes the size of the add that follows it, which is how a proxy fills a miss.
+ * Adds are dropped: the benchmark adds on every miss by itself.
+ */
+static int load_binary_trace(const cache_trace_record_t* records, size_t count, bench_trace_t* trace) {
+    trace->keys = malloc((count ? count : 1) * sizeof(char*));
+    trace->sizes = malloc((count ? count : 1) * sizeof(size_t));
+    trace->count = 0;
+    if (!trace->keys || !trace->sizes)
+        return -1;
+
+    for (size_t i = 0; i < count; i++) {
+        if (records[i].op != CACHE_TRACE_FIND)
+            continue;
+        size_t size = records[i].size;
+        for (size_t j = i + 1; size == 0 && j < count && j <= i + BENCH_TRACE_LOOKAHEAD; j++) {
+            if (records[j].op == CACHE_TRACE_ADD && records[j].hash == records[i].hash)
+                size = records[j].size;
+        }
+
+        char key[32];
+        int length = snprintf(key, sizeof(key), "trace:%016llx", records[i].hash);
+        trace->keys[trace->count] = malloc((size_t)length + 1);
+        if (!trace->keys[trace->count])
+            return -1;
+        memcpy(trace->keys[trace->count], key, (size_t)length + 1);
+        trace->sizes[trace->count++] = size;
+    }
+    return 0;
+}
+
+static int load_trace(const char* path, bench_trace_t* trace) {
+    cache_trace_record_t* records = NULL;
+    size_t record_count = 0;
+    if (cache_trace_read(path, &records, &record_count, NULL) == 0) {
+        int result = load_binary_trace(records, record_count, trace);
+        free(records);
+        if (result != 0 || trace->count == 0) {
+            fprintf(stderr, "Trace '%s' holds no finds.\n", path);
+            return -1;
+        }
+        return 0;
+    }
+
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        fprintf(stderr, "Cannot open trace '%s'.\n", path);
+        return -1;
+    }
+
+    size_t capacity = 1024;
+    trace->keys = malloc(capacity * sizeof(char*));
+    trace->sizes = malloc(capacity * sizeof(size_t));
+    trace->count = 0;
+
+    char line[4096];
+    while (trace->keys && trace->sizes && fgets(line, sizeof(line), file)) {
+        char key[4096];
+        size_t size = 0;
+        if (sscanf(line, "%4095s %zu", key, &size) < 1)
+            continue;
+
+        if (trace->count == capacity) {
+            capacity *= 2;
+            char** keys = realloc(trace->keys, capacity * sizeof(char*));
+            size_t* sizes = realloc(trace->sizes, capacity * sizeof(size_t));
+            if (keys)
+                trace->keys = keys;
+            if (sizes)
+                trace->sizes = sizes;
+            if (!keys || !sizes)
+                break;
+        }
+
+        size_t length = strlen(key) + 1;
+        trace->keys[trace->count] = malloc(length);
+        if (!trace->keys[trace->count])
+            break;
+        memcpy(trace->keys[trace->count], key, length);
+        trace->sizes[trace->count++] = size;
+    }
+    fclose(file);
+
+    if (trace->count == 0) {
+        fprintf(stderr, "Trace '%s' holds no keys.\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+static void free_trace(bench_trace_t* trace) {
+    for (size_t i = 0; i < trace->count; i++)
+        free(trace->keys[i]);
+    free(trace->keys);
+    free(trace->sizes);
+}
+
+/*=============================================================================
+ * 4. Benchmark Loop
+ *===========================================================================*/
+
+static void run_ops(bench_thread_t* thread, size_t count, int measure) {
+    char url[BENCH_URL_SIZE];
+
+    for (size_t op = 0; op < count; op++) {
+        const char* trace_key;
+        size_t size = next_key(thread, op + (measure ? thread->options->warmup_ops : 0), url, sizeof(url), &trace_key);
+        const char* key = trace_key ? trace_key : url;
+
+        unsigned long long start = measure ? cache_now_ns() : 0;
+        int hit = proxy_cache_find(thread->cache, key) != NULL;
+        if (!hit)
+            proxy_cache_add(thread->cache, key, g_payload, size);
+
+        if (measure) {
+            cache_histogram_record(&thread->latency, cache_now_ns() - start);
+            if (hit)
+                thread->hits++;
+            else
+                thread->misses++;
+        }
+    }
+}
+
+#ifdef _WIN32
+static DWORD WINAPI bench_worker(LPVOID arg) {
+#else
+static void* bench_worker(void* arg) {
+#endif
+    bench_thread_t* thread = (bench_thread_t*)arg;
+    run_ops(thread, thread->options->warmup_ops, 0);
+
+    unsigned long long start = cache_now_ns();
+    run_ops(thread, thread->options->ops_per_thread, 1);
+    thread->elapsed_ns = cache_now_ns() - start;
+    return 0;
+}
+
+/**
+ * @brief Prints the estimated hit ratio at budgets from an eighth to eight times the configured one.
+ */
+static void print_mrc(const bench_options_t* options, proxy_cache_t* cache) {
+    size_t budget = options->config.max_bytes ? options->config.max_bytes : (size_t)MAX_CACHE_SIZE;
+    size_t budgets[7];
+    double miss_ratios[7];
+    for (int i = 0; i < 7; i++)
+        budgets[i] = i < 3 ? budget >> (3 - i) : budget << (i - 3);
+
+    size_t finds = proxy_cache_estimate_mrc(cache, budgets, 7, miss_ratios);
+    printf("estimated LRU hit ratio (SHARDS, 1 key in %u, %zu sampled finds):\n",
+        options->config.trace_sample, finds);
+    for (int i = 0; i < 7; i++)
+        printf("%14zu %8.2f%%\n", budgets[i], 100.0 * (1.0 - miss_ratios[i]));
+}
+
+/**
+ * @brief Runs one measurement with 'thread_count' threads and prints its summary line.
+ */
+static int run_benchmark(const bench_options_t* options, size_t thread_count) {
+    proxy_cache_t* cache = proxy_cache_create(&options->config);
+    bench_thread_t* threads = calloc(thread_count, sizeof(bench_thread_t));
+    if (!cache || !threads) {
+        fprintf(stderr, "Out of memory.\n");
+        proxy_cache_destroy(cache);
+        free(threads);
+        return -1;
+    }
+
+    #ifdef _WIN32
+        HANDLE handles[BENCH_MAX_THREADS];
+    #else
+        pthread_t handles[BENCH_MAX_THREADS];
+    #endif
+
+    for (size_t i = 0; i < thread_count; i++) {
+        threads[i].id = i;
+        threads[i].options = options;
+        threads[i].cache = cache;
+        threads[i].rng = 0x9E3779B97F4A7C15ull * (i + 1);
+        cache_histogram_reset(&threads[i].latency);
+        #ifdef _WIN32
+            handles[i] = CreateThread(NULL, 0, bench_worker, &threads[i], 0, NULL);
+        #else
+            pthread_create(&handles[i], NULL, bench_worker, &threads[i]);
+        #endif
+    }
+
+    cache_histogram_t latency;
+    cache_histogram_reset(&latency);
+    unsigned long long hits = 0, misses = 0;
+    double ops_per_sec = 0.0;
+    for (size_t i = 0; i < thread_count; i++) {
+        #ifdef _WIN32
+            WaitForSingleObject(handles[i], INFINITE);
+            CloseHandle(handles[i]);
+        #else
+            pthread_join(handles[i], NULL);
+        #endif
+        cache_histogram_merge(&latency, &threads[i].latency);
+        hits += threads[i].hits;
+        misses += threads[i].misses;
+        if (threads[i].elapsed_ns)
+            ops_per_sec += (double)options->ops_per_thread * 1e9 / (double)threads[i].elapsed_ns;
+    }
+
+    printf("%7zu %14.0f %8.2f%% %9llu %9llu %9llu\n", thread_count, ops_per_sec,
+        100.0 * (double)hits / (double)(hits + misses ? hits + misses : 1),
+        cache_histogram_percentile(&latency, 50.0),
+        cache_histogram_percentile(&latency, 99.0),
+        cache_histogram_percentile(&latency, 99.9));
+
+    int status = 0;
+    if (thread_count == options->max_threads) {
+        if (options->mrc)
+            print_mrc(options, cache);
+        if (options->record_path && proxy_cache_dump_trace(cache, options->record_path) != 0) {
+            fprintf(stderr, "Cannot write trace '%s'.\n", options->record_path);
+            status = -1;
+        }
+    }
+
+    proxy_cache_destroy(cache);
+    free(threads);
+    return status;
+}
+
+/*=============================================================================
+ * 5. Command Line
+ *===========================================================================*/
+
+static void print_usage(const char* program) {
+    printf("Usage: %s [options]\n"
+        "  --workload zipf|scan|trace  Key distribution (default zipf)\n"
+        "  --trace PATH                Trace file for --workload trace (\"<key> [size]\" per line,\n"
+        "                              or a dumped access trace)\n"
+        "  --threads N                 Highest thread count; runs 1, 2, 4, ... N (default 8)\n"
+        "  --ops N                     Measured operations per thread (default 1000000)\n"
+        "  --warmup N                  Untimed operations per thread (default ops / 10)\n"
+        "  --keys N                    Key space for zipf and scan (default 100000)\n"
+        "  --theta X                   Zipf skew, not 1.0 (default 0.99)\n"
+        "  --scan-ratio X              Share of one-hit keys for scan (default 0.3)\n"
+        "  --value-size N              Object size in bytes (default 1024)\n"
+        "  --budget BYTES              Cache byte budget (default MAX_CACHE_SIZE)\n"
+        "  --shards N                  Shard count (default 1)\n"
+        "  --shared                    Use CACHE_BUDGET_SHARED\n"
+        "  --read-mostly               Use CACHE_LOOKUP_READ_MOSTLY\n"
+        "  --policy lru|slru|tinylfu|gdsf\n"
+        "  --slab                      Allocate from per-shard slabs\n"
+        "  --footprint                 Charge metadata to the budget (CACHE_ACCOUNT_FOOTPRINT)\n"
+        "  --sample N                  Trace 1 key in N for --record and --mrc (default 1)\n"
+        "  --record PATH               Dump the last run's access trace, for --trace replays\n"
+        "  --mrc                       Print the estimated hit ratio at other budgets after the last run\n", program);
+}
+
+static int parse_policy(const char* name, cache_policy_kind_t* policy) {
+    static const struct { const char* name; cache_policy_kind_t policy; } policies[] = {
+        { "lru", CACHE_POLICY_LRU }, { "slru", CACHE_POLICY_SLRU },
+        { "tinylfu", CACHE_POLICY_TINYLFU }, { "gdsf", CACHE_POLICY_GDSF }
+    };
+    for (size_t i = 0; i < sizeof(policies) / sizeof(policies[0]); i++) {
+        if (strcmp(name, policies[i].name) == 0) {
+            *policy = policies[i].policy;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static int parse_options(int argc, char** argv, bench_options_t* options) {
+    memset(options, 0, sizeof(*options));
+    options->workload = BENCH_ZIPF;
+    options->max_threads = 8;
+    options->ops_per_thread = 1000000;
+    options->warmup_ops = (size_t)-1;
+    options->key_count = 100000;
+    options->theta = 0.99;
+    options->scan_ratio = 0.3;
+    options->value_size = 1024;
+
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+        int takes_value = 1;
+
+        if (strcmp(arg, "--shared") == 0) {
+            options->config.budget_mode = CACHE_BUDGET_SHARED;
+            takes_value = 0;
+        }
+        else if (strcmp(arg, "--read-mostly") == 0) {
+            options->config.lookup_mode = CACHE_LOOKUP_READ_MOSTLY;
+            takes_value = 0;
+        }
+        else if (strcmp(arg, "--slab") == 0) {
+            options->config.use_slab = 1;
+            takes_value = 0;
+        }
+        else if (strcmp(arg, "--footprint") == 0) {
+            options->config.accounting = CACHE_ACCOUNT_FOOTPRINT;
+            takes_value = 0;
+        }
+        else if (strcmp(arg, "--mrc") == 0) {
+            options->mrc = 1;
+            takes_value = 0;
+        }
+        else if (strcmp(arg, "--help") == 0) {
+            return -1;
+        }
+        else if (!value) {
+            fprintf(stderr, "Missing value for '%s'.\n", arg);
+            return -1;
+        }
+        else if (strcmp(arg, "--workload") == 0) {
+            if (strcmp(value, "zipf") == 0) options->workload = BENCH_ZIPF;
+            else if (strcmp(value, "scan") == 0) options->workload = BENCH_SCAN;
+            else if (strcmp(value, "trace") == 0) options->workload = BENCH_TRACE;
+            else return -1;
+        }
+        else if (strcmp(arg, "--trace") == 0) options->trace_path = value;
+        else if (strcmp(arg, "--record") == 0) options->record_path = value;
+        else if (strcmp(arg, "--sample") == 0) options->config.trace_sample = (unsigned int)strtoul(value, NULL, 10);
+        else if (strcmp(arg, "--threads") == 0) options->max_threads = strtoul(value, NULL, 10);
+        else if (strcmp(arg, "--ops") == 0) options->ops_per_thread = strtoul(value, NULL, 10);
+        else if (strcmp(arg, "--warmup") == 0) options->warmup_ops = strtoul(value, NULL, 10);
+        else if (strcmp(arg, "--keys") == 0) options->key_count = strtoul(value, NULL, 10);
+        else if (strcmp(arg, "--theta") == 0) options->theta = atof(value);
+        else if (strcmp(arg, "--scan-ratio") == 0) options->scan_ratio = atof(value);
+        else if (strcmp(arg, "--value-size") == 0) options->value_size = strtoul(value, NULL, 10);
+        else if (strcmp(arg, "--budget") == 0) options->config.max_bytes = strtoul(value, NULL, 10);
+        else if (strcmp(arg, "--shards") == 0) options->config.shard_count = strtoul(value, NULL, 10);
+        else if (strcmp(arg, "--policy") == 0) {
+            if (parse_policy(value, &options->config.policy) != 0)
+                return -1;
+        }
+        else {
+            fprintf(stderr, "Unknown option '%s'.\n", arg);
+            return -1;
+        }
+        i += takes_value;
+    }
+
+    if (options->warmup_ops == (size_t)-1)
+        options->warmup_ops = options->ops_per_thread / 10;
+    if ((options->record_path || options->mrc) && options->config.trace_sample == 0)
+        options->config.trace_sample = 1;
+    if (options->max_threads == 0 || options->max_threads > BENCH_MAX_THREADS
+        || options->key_count < 2 || options->value_size == 0 || options->theta == 1.0)
+        return -1;
+    if (options->workload == BENCH_TRACE && !options->trace_path) {
+        fprintf(stderr, "--workload trace needs --trace PATH.\n");
+        return -1;
+    }
+    return 0;
+}
+
+/*=============================================================================
+ * 6. Entry Point
+ *===========================================================================*/
+
+int main(int argc, char** argv) {
+    bench_options_t options;
+    if (parse_options(argc, argv, &options) != 0) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    size_t max_value = options.value_size;
+    if (options.workload == BENCH_TRACE) {
+        if (load_trace(options.trace_path, &g_trace) != 0)
+            return EXIT_FAILURE;
+        for (size_t i = 0; i < g_trace.count; i++)
+            if (g_trace.sizes[i] > max_value)
+                max_value = g_trace.sizes[i];
+    }
+    else {
+        zipf_init(&g_zipf, options.key_count, options.theta);
+    }
+
+    g_payload = malloc(max_value);
+    if (!g_payload)
+        return EXIT_FAILURE;
+    memset(g_payload, 'x', max_value);
+
+    static const char* workloads[] = { "zipf", "scan", "trace" };
+    printf("workload=%s keys=%zu theta=%.2f value=%zu budget=%zu shards=%zu ops/thread=%zu\n",
+        workloads[options.workload], options.key_count, options.theta, options.value_size,
+        options.config.max_bytes ? options.config.max_bytes : (size_t)MAX_CACHE_SIZE,
+        options.config.shard_count ? options.config.shard_count : 1, options.ops_per_thread);
+    printf("%7s %14s %9s %9s %9s %9s\n", "threads", "ops/sec", "hit", "p50 ns", "p99 ns", "p999 ns");
+
+    int status = EXIT_SUCCESS;
+    for (size_t threads = 1; ; threads *= 2) {
+        if (threads > options.max_threads)
+            threads = options.max_threads;
+        if (run_benchmark(&options, threads) != 0) {
+            status = EXIT_FAILURE;
+            break;
+        }
+        if (threads == options.max_threads)
+            break;
+    }
+
+    free(g_payload);
+    if (options.workload == BENCH_TRACE)
+        free_trace(&g_trace);
+    return status;
+}
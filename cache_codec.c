@@ -0,0 +1,199 @@
+/**
+ * @file cache_codec.c
+ * @brief LZ4 block compression for cached payloads.
+ *
+ * A block is a run of sequences, each
+ *
+ *     token | literal length ext | literals | offset u16 | match length ext
+ *
+ * where the token's high nibble is the literal count and its low nibble the match
+ * length minus 4, either one continued in 255-valued extension bytes when it is 15.
+ * The last sequence has literals only. As the format requires, the last five bytes
+ * are always literals and no match starts within twelve bytes of the end.
+ */
+
+#include "cache_codec.h"
+
+#include <string.h>
+
+/*=============================================================================
+ * 1. Static Helper Functions
+ *===========================================================================*/
+
+#define LZ4_MIN_MATCH     4
+#define LZ4_LAST_LITERALS 5
+#define LZ4_MATCH_LIMIT   12     // Bytes after the start of the last match, at the least.
+#define LZ4_MAX_OFFSET    65535
+#define LZ4_HASH_BITS     12
+#define LZ4_SKIP_SHIFT    6      // Search step grows by one every 64 bytes without a match.
+
+static unsigned int read32(const unsigned char* bytes) {
+    unsigned int value;
+    memcpy(&value, bytes, sizeof(value));
+    return value;
+}
+
+static unsigned int hash4(unsigned int sequence) {
+    return (sequence * 2654435761u) >> (32 - LZ4_HASH_BITS);
+}
+
+static unsigned char* put_length(unsigned char* out, size_t length) {
+    while (length >= 255) {
+        *out++ = 255;
+        length -= 255;
+    }
+    *out++ = (unsigned char)length;
+    return out;
+}
+
+/**
+ * @brief Writes one sequence. A 'match_len' of 0 writes the final, literals-only one.
+ * @return The new output position, or NULL if 'out_end' would be passed.
+ */
+static unsigned char* put_sequence(unsigned char* out, unsigned char* out_end, const unsigned char* literals,
+    size_t literal_len, size_t offset, size_t match_len) {
+    // Token, offset and both length extensions, at their largest.
+    size_t needed = 1 + literal_len + literal_len / 255 + 1 + 2 + match_len / 255 + 1;
+    if ((size_t)(out_end - out) < needed)
+        return NULL;
+
+    unsigned char* token = out++;
+    *token = (unsigned char)((literal_len >= 15 ? 15 : literal_len) << 4);
+    if (literal_len >= 15)
+        out = put_length(out, literal_len - 15);
+    memcpy(out, literals, literal_len);
+    out += literal_len;
+    if (match_len == 0)
+        return out;
+
+    out[0] = (unsigned char)(offset & 0xFF);
+    out[1] = (unsigned char)(offset >> 8);
+    out += 2;
+    size_t extra = match_len - LZ4_MIN_MATCH;
+    *token |= (unsigned char)(extra >= 15 ? 15 : extra);
+    if (extra >= 15)
+        out = put_length(out, extra - 15);
+    return out;
+}
+
+/**
+ * @brief Adds the extension bytes of a length whose nibble was 15.
+ * @return 0 on success, -1 if the block ends first or the length overflows.
+ */
+static int get_length(const unsigned char** in, const unsigned char* in_end, size_t* length) {
+    unsigned char byte;
+    do {
+        if (*in == in_end || *length > (size_t)-1 - 255)
+            return -1;
+        byte = *(*in)++;
+        *length += byte;
+    } while (byte == 255);
+    return 0;
+}
+
+/*=============================================================================
+ * 2. Public API Functions
+ *===========================================================================*/
+
+size_t cache_lz4_compress(const char* source, size_t length, char* dest, size_t capacity) {
+    if (length > CACHE_LZ4_MAX_INPUT)
+        return 0;
+
+    const unsigned char* in = (const unsigned char*)source;
+    const unsigned char* in_end = in + length;
+    const unsigned char* anchor = in;
+    unsigned char* out = (unsigned char*)dest;
+    unsigned char* out_end = out + capacity;
+
+    if (length > LZ4_MATCH_LIMIT) {
+        // Positions relative to 'in'. A stale or zero entry is caught by comparing the bytes.
+        unsigned int table[1u << LZ4_HASH_BITS];
+        memset(table, 0, sizeof(table));
+        const unsigned char* match_start_end = in_end - LZ4_MATCH_LIMIT;
+        const unsigned char* match_end_limit = in_end - LZ4_LAST_LITERALS;
+        const unsigned char* ip = in + 1;
+        table[hash4(read32(in))] = 0;
+
+        while (ip <= match_start_end) {
+            unsigned int sequence = read32(ip);
+            unsigned int slot = hash4(sequence);
+            const unsigned char* candidate = in + table[slot];
+            table[slot] = (unsigned int)(ip - in);
+            if ((size_t)(ip - candidate) > LZ4_MAX_OFFSET || read32(candidate) != sequence) {
+                ip += 1 + ((size_t)(ip - anchor) >> LZ4_SKIP_SHIFT);
+                continue;
+            }
+
+            // Grow the match backwards into the pending literals, then forwards.
+            while (ip > anchor && candidate > in && ip[-1] == candidate[-1]) {
+                ip--;
+                candidate--;
+            }
+            const unsigned char* match_end = ip + LZ4_MIN_MATCH;
+            const unsigned char* reference = candidate + LZ4_MIN_MATCH;
+            while (match_end < match_end_limit && *match_end == *reference) {
+                match_end++;
+                reference++;
+            }
+
+            out = put_sequence(out, out_end, anchor, (size_t)(ip - anchor), (size_t)(ip - candidate),
+                (size_t)(match_end - ip));
+            if (!out)
+                return 0;
+            ip = match_end;
+            anchor = ip;
+            if (ip <= match_start_end)
+                table[hash4(read32(ip - 2))] = (unsigned int)(ip - 2 - in);
+        }
+    }
+
+    out = put_sequence(out, out_end, anchor, (size_t)(in_end - anchor), 0, 0);
+    return out ? (size_t)(out - (unsigned char*)dest) : 0;
+}
+
+int cache_lz4_decompress(const char* source, size_t length, char* dest, size_t raw_length) {
+    const unsigned char* in = (const unsigned char*)source;
+    const unsigned char* in_end = in + length;
+    unsigned char* out = (unsigned char*)dest;
+    unsigned char* out_end = out + raw_length;
+
+    while (in < in_end) {
+        unsigned int token = *in++;
+        size_t literal_len = token >> 4;
+        if (literal_len == 15 && get_length(&in, in_end, &literal_len) != 0)
+            return -1;
+        if ((size_t)(in_end - in) < literal_len || (size_t)(out_end - out) < literal_len)
+            return -1;
+        memcpy(out, in, literal_len);
+        in += literal_len;
+        out += literal_len;
+        if (in == in_end)
+            break; // The final sequence has no match.
+
+        if (in_end - in < 2)
+            return -1;
+        size_t offset = (size_t)in[0] | (size_t)in[1] << 8;
+        in += 2;
+        if (offset == 0 || offset > (size_t)(out - (unsigned char*)dest))
+            return -1;
+
+        size_t match_len = token & 15;
+        if (match_len == 15 && get_length(&in, in_end, &match_len) != 0)
+            return -1;
+        match_len += LZ4_MIN_MATCH;
+        if ((size_t)(out_end - out) < match_len)
+            return -1;
+
+        // A match may overlap its own output (offset < length): it repeats the last 'offset' bytes.
+        const unsigned char* reference = out - offset;
+        if (offset >= match_len) {
+            memcpy(out, reference, match_len);
+            out += match_len;
+        }
+        else {
+            while (match_len--)
+                *out++ = *reference++;
+        }
+    }
+    return out == out_end ? 0 : -1;
+}
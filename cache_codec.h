@@ -0,0 +1,25 @@
+// cache_codec.h
+
+#pragma once
+
+#include <stddef.h> // For size_t
+
+// Inputs larger than this are never compressed (LZ4's own block size limit).
+#define CACHE_LZ4_MAX_INPUT 0x7E000000u
+
+/**
+ * @brief Compresses 'length' bytes into an LZ4 block (the raw format of LZ4_compress_default).
+ * @details Greedy single-pass matching with a 4096-entry hash table on the stack. Any
+ * standard LZ4 block decoder can read the output, given the original size.
+ * @param capacity Room in 'dest'. Pass less than 'length' to only accept a real saving.
+ * @return The compressed size, or 0 if it would not fit in 'capacity'.
+ */
+size_t cache_lz4_compress(const char* source, size_t length, char* dest, size_t capacity);
+
+/**
+ * @brief Decodes an LZ4 block that expands to exactly 'raw_length' bytes.
+ * @details Every length and offset is bounds-checked, so a corrupt block fails
+ * instead of reading or writing outside the buffers.
+ * @return 0 on success, -1 if the block is malformed or decodes to another size.
+ */
+int cache_lz4_decompress(const char* source, size_t length, char* dest, size_t raw_length);
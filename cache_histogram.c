@@ -0,0 +1,155 @@
+/**
+ * @file cache_histogram.c
+ * @brief Fixed-size log-linear histogram for latency percentiles.
+ *
+ * Values below CACHE_HISTOGRAM_SUB_COUNT get a bucket each. Above that, every
+ * power-of-two range [2^k, 2^(k+1)) is split into CACHE_HISTOGRAM_SUB_COUNT
+ * equal buckets, the same layout HdrHistogram uses. Recording is a shift and an
+ * increment, and the whole 64-bit range fits in 15 KiB.
+ */
+
+#include "cache_histogram.h"
+
+#include <string.h>
+
+#if defined(_MSC_VER)
+    #include <Windows.h> // For InterlockedIncrement64
+    #include <intrin.h>  // For _BitScanReverse64
+#endif
+
+/*=============================================================================
+ * 1. Static Helper Functions
+ *===========================================================================*/
+
+static int highest_bit(unsigned long long value) {
+#if defined(_MSC_VER) && defined(_WIN64)
+    unsigned long index;
+    _BitScanReverse64(&index, value);
+    return (int)index;
+#elif defined(_MSC_VER)
+    int index = 0;
+    while (value >>= 1)
+        index++;
+    return index;
+#else
+    return 63 - __builtin_clzll(value);
+#endif
+}
+
+static size_t bucket_for_value(unsigned long long value) {
+    if (value < CACHE_HISTOGRAM_SUB_COUNT)
+        return (size_t)value;
+
+    int exponent = highest_bit(value) - CACHE_HISTOGRAM_SUB_BITS + 1;
+    size_t sub = (size_t)(value >> (exponent - 1)) - CACHE_HISTOGRAM_SUB_COUNT;
+    return (size_t)exponent * CACHE_HISTOGRAM_SUB_COUNT + sub;
+}
+
+/**
+ * @brief Returns the largest value that maps to 'bucket'.
+ */
+static unsigned long long bucket_upper_bound(size_t bucket) {
+    size_t exponent = bucket / CACHE_HISTOGRAM_SUB_COUNT;
+    unsigned long long sub = bucket % CACHE_HISTOGRAM_SUB_COUNT;
+    if (exponent == 0)
+        return sub;
+
+    unsigned long long low = (CACHE_HISTOGRAM_SUB_COUNT + sub) << (exponent - 1);
+    return low + (1ull << (exponent - 1)) - 1;
+}
+
+static void atomic_increment(volatile unsigned long long* target) {
+#if defined(_MSC_VER)
+    InterlockedIncrement64((volatile LONG64*)target);
+#else
+    __atomic_fetch_add(target, 1, __ATOMIC_RELAXED);
+#endif
+}
+
+static unsigned long long atomic_load(const volatile unsigned long long* target) {
+#if defined(_MSC_VER)
+    return *target;
+#else
+    return __atomic_load_n(target, __ATOMIC_RELAXED);
+#endif
+}
+
+static void atomic_store_max(volatile unsigned long long* target, unsigned long long value) {
+    unsigned long long current = atomic_load(target);
+    while (value > current) {
+#if defined(_MSC_VER)
+        unsigned long long seen = (unsigned long long)InterlockedCompareExchange64(
+            (volatile LONG64*)target, (LONG64)value, (LONG64)current);
+        if (seen == current)
+            return;
+        current = seen;
+#else
+        if (__atomic_compare_exchange_n(target, &current, value, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            return;
+#endif
+    }
+}
+
+/*=============================================================================
+ * 2. Public API Functions
+ *===========================================================================*/
+
+void cache_histogram_reset(cache_histogram_t* histogram) {
+    memset(histogram, 0, sizeof(*histogram));
+}
+
+void cache_histogram_record(cache_histogram_t* histogram, unsigned long long value) {
+    histogram->counts[bucket_for_value(value)]++;
+    histogram->total++;
+    if (value > histogram->max)
+        histogram->max = value;
+}
+
+void cache_histogram_record_atomic(cache_histogram_t* histogram, unsigned long long value) {
+    atomic_increment(&histogram->counts[bucket_for_value(value)]);
+    atomic_increment(&histogram->total);
+    atomic_store_max(&histogram->max, value);
+}
+
+void cache_histogram_merge(cache_histogram_t* target, const cache_histogram_t* source) {
+    for (size_t i = 0; i < CACHE_HISTOGRAM_BUCKETS; i++)
+        target->counts[i] += source->counts[i];
+    target->total += source->total;
+    if (source->max > target->max)
+        target->max = source->max;
+}
+
+unsigned long long cache_histogram_percentile(const cache_histogram_t* histogram, double percentile) {
+    if (histogram->total == 0)
+        return 0;
+
+    // Rank of the wanted value, counting from 1.
+    unsigned long long rank = (unsigned long long)(percentile / 100.0 * (double)histogram->total + 0.5);
+    if (rank == 0)
+        rank = 1;
+
+    unsigned long long seen = 0;
+    for (size_t i = 0; i < CACHE_HISTOGRAM_BUCKETS; i++) {
+        seen += histogram->counts[i];
+        if (seen >= rank) {
+            unsigned long long bound = bucket_upper_bound(i);
+            return bound < histogram->max ? bound : histogram->max;
+        }
+    }
+    return histogram->max;
+}
+
+void cache_histogram_merge_atomic(cache_histogram_t* target, const cache_histogram_t* source) {
+    unsigned long long total = 0;
+    for (size_t i = 0; i < CACHE_HISTOGRAM_BUCKETS; i++) {
+        unsigned long long count = atomic_load(&source->counts[i]);
+        target->counts[i] += count;
+        total += count;
+    }
+    // Sum the buckets rather than reading 'total', so percentiles stay self-consistent.
+    target->total += total;
+
+    unsigned long long max = atomic_load(&source->max);
+    if (max > target->max)
+        target->max = max;
+}
@@ -0,0 +1,53 @@
+// cache_histogram.h
+
+#pragma once
+
+#include <stddef.h> // For size_t
+
+// Each power of two is split into 2^CACHE_HISTOGRAM_SUB_BITS linear sub-buckets,
+// so every recorded value is known to within about 3%.
+#define CACHE_HISTOGRAM_SUB_BITS 5
+#define CACHE_HISTOGRAM_SUB_COUNT (1 << CACHE_HISTOGRAM_SUB_BITS)
+#define CACHE_HISTOGRAM_BUCKETS ((64 - CACHE_HISTOGRAM_SUB_BITS + 1) * CACHE_HISTOGRAM_SUB_COUNT)
+
+// Log-linear (HDR-style) histogram of 64-bit values, typically latencies in nanoseconds.
+// The plain functions are not thread-safe: give each thread its own and merge them for
+// reporting. A histogram shared between threads must only be used through the *_atomic ones.
+typedef struct cache_histogram {
+    unsigned long long counts[CACHE_HISTOGRAM_BUCKETS];
+    unsigned long long total;  // Number of recorded values.
+    unsigned long long max;    // Largest recorded value.
+} cache_histogram_t;
+
+/**
+ * @brief Clears every count.
+ */
+void cache_histogram_reset(cache_histogram_t* histogram);
+
+/**
+ * @brief Records one value in O(1).
+ */
+void cache_histogram_record(cache_histogram_t* histogram, unsigned long long value);
+
+/**
+ * @brief Records one value in a histogram other threads record into concurrently.
+ */
+void cache_histogram_record_atomic(cache_histogram_t* histogram, unsigned long long value);
+
+/**
+ * @brief Adds every count of 'source' to 'target'.
+ */
+void cache_histogram_merge(cache_histogram_t* target, const cache_histogram_t* source);
+
+/**
+ * @brief Like cache_histogram_merge(), for a 'source' that is being recorded into concurrently.
+ * @details Each count is read atomically; the snapshot as a whole is not.
+ */
+void cache_histogram_merge_atomic(cache_histogram_t* target, const cache_histogram_t* source);
+
+/**
+ * @brief Returns the value at or below which 'percentile' percent of the values fall.
+ * @param percentile A percentage between 0 and 100 (for example 99.9).
+ * @return The upper bound of the matching bucket, or 0 if the histogram is empty.
+ */
+unsigned long long cache_histogram_percentile(const cache_histogram_t* histogram, double percentile);
@@ -0,0 +1,367 @@
+/**
+ * @file cache_lock.h
+ * @brief Lock primitives behind one interface (internal header).
+ *
+ * cache_mutex_t and cache_cond_t are the OS mutex and condition variable, for
+ * the places that need to sleep on a condition. cache_lock_t guards a shard and
+ * is one of several primitives, picked at initialization (cache_lock_kind_t):
+ *
+ *  - MUTEX:    the OS mutex.
+ *  - RWLOCK:   the OS reader/writer lock; the shared calls take it for reading.
+ *  - SPIN:     a test-and-test-and-set spinlock that yields the CPU after a while.
+ *  - ADAPTIVE: a three-state futex lock (free, held, held with sleepers) that spins
+ *              briefly and then sleeps in the kernel, so an uncontended acquisition
+ *              and release are one atomic each and never enter the kernel.
+ *
+ * Only RWLOCK can be shared; for the other kinds the shared calls are exclusive.
+ */
+
+#ifndef CACHE_LOCK_H
+#define CACHE_LOCK_H
+
+#include "cache_platform.h"
+#include "proxy_cache.h" // For cache_lock_kind_t
+
+#ifdef _WIN32
+    #include <Windows.h> // For CRITICAL_SECTION, SRWLOCK and WaitOnAddress
+    #if defined(_MSC_VER)
+        #pragma comment(lib, "Synchronization.lib") // WaitOnAddress
+    #endif
+#else
+    #include <pthread.h>
+    #include <sched.h>   // For sched_yield
+    #ifdef __linux__
+        #include <linux/futex.h>  // For FUTEX_WAIT_PRIVATE
+        #include <sys/syscall.h>  // For SYS_futex
+        #include <unistd.h>       // For syscall
+    #endif
+#endif
+
+/*=============================================================================
+ * 1. Constants & Types
+ *===========================================================================*/
+
+#define CACHE_LOCK_SPINS 100 // Pause-spins before a waiter yields (SPIN) or sleeps (ADAPTIVE).
+
+#ifdef _WIN32
+typedef CRITICAL_SECTION cache_mutex_t;
+typedef CONDITION_VARIABLE cache_cond_t;
+#else
+typedef pthread_mutex_t cache_mutex_t;
+typedef pthread_cond_t cache_cond_t;
+#endif
+
+typedef struct cache_lock {
+	cache_lock_kind_t kind;  // Never CACHE_LOCK_DEFAULT once initialized.
+	volatile int word;       // SPIN: 0 free, 1 held. ADAPTIVE: 0 free, 1 held, 2 held with sleepers.
+	#ifdef _WIN32
+		CRITICAL_SECTION mutex;
+		SRWLOCK rwlock;
+	#else
+		pthread_mutex_t mutex;
+		pthread_rwlock_t rwlock;
+	#endif
+} cache_lock_t;
+
+/*=============================================================================
+ * 2. Mutexes & Condition Variables
+ *===========================================================================*/
+
+static inline void cache_mutex_init(cache_mutex_t* mutex) {
+#ifdef _WIN32
+	InitializeCriticalSection(mutex);
+#else
+	pthread_mutex_init(mutex, NULL);
+#endif
+}
+
+static inline void cache_mutex_destroy(cache_mutex_t* mutex) {
+#ifdef _WIN32
+	DeleteCriticalSection(mutex);
+#else
+	pthread_mutex_destroy(mutex);
+#endif
+}
+
+static inline void cache_mutex_lock(cache_mutex_t* mutex) {
+#ifdef _WIN32
+	EnterCriticalSection(mutex);
+#else
+	pthread_mutex_lock(mutex);
+#endif
+}
+
+static inline void cache_mutex_unlock(cache_mutex_t* mutex) {
+#ifdef _WIN32
+	LeaveCriticalSection(mutex);
+#else
+	pthread_mutex_unlock(mutex);
+#endif
+}
+
+/**
+ * @brief Initializes a mutex with static storage on first use, for the globals that
+ * have no portable static initializer (CRITICAL_SECTION has none).
+ * @param state Zero-initialized flag owned with the mutex: 0 uninitialized, 1 being initialized, 2 ready.
+ */
+static inline void cache_mutex_init_once(cache_mutex_t* mutex, volatile int* state) {
+	if (cache_atomic_load_int(state) == 2)
+		return;
+	if (cache_atomic_cas_int(state, 0, 1)) {
+		cache_mutex_init(mutex);
+		cache_atomic_store_int(state, 2);
+		return;
+	}
+	while (cache_atomic_load_int(state) != 2)
+		cache_cpu_relax();
+}
+
+static inline void cache_cond_init(cache_cond_t* cond) {
+#ifdef _WIN32
+	InitializeConditionVariable(cond);
+#else
+	pthread_cond_init(cond, NULL);
+#endif
+}
+
+static inline void cache_cond_destroy(cache_cond_t* cond) {
+#ifdef _WIN32
+	(void)cond; // Condition variables need no cleanup on Windows.
+#else
+	pthread_cond_destroy(cond);
+#endif
+}
+
+/**
+ * @brief Releases 'mutex', sleeps until 'cond' is signalled and takes 'mutex' again.
+ */
+static inline void cache_cond_wait(cache_cond_t* cond, cache_mutex_t* mutex) {
+#ifdef _WIN32
+	SleepConditionVariableCS(cond, mutex, INFINITE);
+#else
+	pthread_cond_wait(cond, mutex);
+#endif
+}
+
+static inline void cache_cond_signal(cache_cond_t* cond) {
+#ifdef _WIN32
+	WakeConditionVariable(cond);
+#else
+	pthread_cond_signal(cond);
+#endif
+}
+
+static inline void cache_cond_broadcast(cache_cond_t* cond) {
+#ifdef _WIN32
+	WakeAllConditionVariable(cond);
+#else
+	pthread_cond_broadcast(cond);
+#endif
+}
+
+/*=============================================================================
+ * 3. Spinning & Futexes
+ *===========================================================================*/
+
+static inline void cache_thread_yield(void) {
+#ifdef _WIN32
+	SwitchToThread();
+#else
+	sched_yield();
+#endif
+}
+
+/**
+ * @brief Sleeps while '*word' equals 'value'. May return early; callers re-check.
+ * @details Without a futex-like call the thread only yields, which is still correct.
+ */
+static inline void cache_futex_wait(volatile int* word, int value) {
+#if defined(_WIN32)
+	WaitOnAddress(word, &value, sizeof(value), INFINITE);
+#elif defined(__linux__) && defined(SYS_futex)
+	syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, value, NULL, NULL, 0);
+#else
+	(void)word;
+	(void)value;
+	cache_thread_yield();
+#endif
+}
+
+/**
+ * @brief Wakes one thread sleeping in cache_futex_wait() on 'word'.
+ */
+static inline void cache_futex_wake(volatile int* word) {
+#if defined(_WIN32)
+	WakeByAddressSingle((PVOID)word);
+#elif defined(__linux__) && defined(SYS_futex)
+	syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+#else
+	(void)word;
+#endif
+}
+
+/*=============================================================================
+ * 4. Pluggable Locks
+ *===========================================================================*/
+
+/**
+ * @brief Sets up a lock of the given kind (CACHE_LOCK_DEFAULT selects a mutex).
+ */
+static inline void cache_lock_init(cache_lock_t* lock, cache_lock_kind_t kind) {
+	lock->kind = kind == CACHE_LOCK_DEFAULT ? CACHE_LOCK_MUTEX : kind;
+	lock->word = 0;
+#ifdef _WIN32
+	if (lock->kind == CACHE_LOCK_MUTEX)
+		InitializeCriticalSection(&lock->mutex);
+	else if (lock->kind == CACHE_LOCK_RWLOCK)
+		InitializeSRWLock(&lock->rwlock);
+#else
+	if (lock->kind == CACHE_LOCK_MUTEX)
+		pthread_mutex_init(&lock->mutex, NULL);
+	else if (lock->kind == CACHE_LOCK_RWLOCK)
+		pthread_rwlock_init(&lock->rwlock, NULL);
+#endif
+}
+
+static inline void cache_lock_destroy(cache_lock_t* lock) {
+#ifdef _WIN32
+	if (lock->kind == CACHE_LOCK_MUTEX)
+		DeleteCriticalSection(&lock->mutex); // SRW locks need no cleanup.
+#else
+	if (lock->kind == CACHE_LOCK_MUTEX)
+		pthread_mutex_destroy(&lock->mutex);
+	else if (lock->kind == CACHE_LOCK_RWLOCK)
+		pthread_rwlock_destroy(&lock->rwlock);
+#endif
+}
+
+/**
+ * @brief Takes the lock exclusively if that needs no waiting.
+ * @return Non-zero if the lock is now held.
+ */
+static inline int cache_lock_try(cache_lock_t* lock) {
+	switch (lock->kind) {
+	case CACHE_LOCK_SPIN:
+		return cache_atomic_load_relaxed_int(&lock->word) == 0 && cache_atomic_exchange_int(&lock->word, 1) == 0;
+	case CACHE_LOCK_ADAPTIVE:
+		return cache_atomic_cas_int(&lock->word, 0, 1);
+#ifdef _WIN32
+	case CACHE_LOCK_RWLOCK:
+		return TryAcquireSRWLockExclusive(&lock->rwlock) ? 1 : 0;
+	default:
+		return TryEnterCriticalSection(&lock->mutex) ? 1 : 0;
+#else
+	case CACHE_LOCK_RWLOCK:
+		return pthread_rwlock_trywrlock(&lock->rwlock) == 0;
+	default:
+		return pthread_mutex_trylock(&lock->mutex) == 0;
+#endif
+	}
+}
+
+static inline void cache_lock_acquire(cache_lock_t* lock) {
+	switch (lock->kind) {
+	case CACHE_LOCK_SPIN:
+		// Spin on a plain read so waiters do not bounce the line between them.
+		for (unsigned int spins = 0; !cache_lock_try(lock); ) {
+			while (cache_atomic_load_relaxed_int(&lock->word) != 0) {
+				if (++spins < CACHE_LOCK_SPINS)
+					cache_cpu_relax();
+				else
+					cache_thread_yield();
+			}
+		}
+		return;
+	case CACHE_LOCK_ADAPTIVE:
+		for (unsigned int spins = 0; spins < CACHE_LOCK_SPINS; spins++) {
+			if (cache_lock_try(lock))
+				return;
+			cache_cpu_relax();
+		}
+		// Mark the lock contended so the holder's release wakes a sleeper.
+		while (cache_atomic_exchange_int(&lock->word, 2) != 0)
+			cache_futex_wait(&lock->word, 2);
+		return;
+#ifdef _WIN32
+	case CACHE_LOCK_RWLOCK:
+		AcquireSRWLockExclusive(&lock->rwlock);
+		return;
+	default:
+		EnterCriticalSection(&lock->mutex);
+		return;
+#else
+	case CACHE_LOCK_RWLOCK:
+		pthread_rwlock_wrlock(&lock->rwlock);
+		return;
+	default:
+		pthread_mutex_lock(&lock->mutex);
+		return;
+#endif
+	}
+}
+
+static inline void cache_lock_release(cache_lock_t* lock) {
+	switch (lock->kind) {
+	case CACHE_LOCK_SPIN:
+		cache_atomic_store_int(&lock->word, 0);
+		return;
+	case CACHE_LOCK_ADAPTIVE:
+		if (cache_atomic_exchange_int(&lock->word, 0) == 2)
+			cache_futex_wake(&lock->word);
+		return;
+#ifdef _WIN32
+	case CACHE_LOCK_RWLOCK:
+		ReleaseSRWLockExclusive(&lock->rwlock);
+		return;
+	default:
+		LeaveCriticalSection(&lock->mutex);
+		return;
+#else
+	case CACHE_LOCK_RWLOCK:
+		pthread_rwlock_unlock(&lock->rwlock);
+		return;
+	default:
+		pthread_mutex_unlock(&lock->mutex);
+		return;
+#endif
+	}
+}
+
+/**
+ * @brief Like cache_lock_try(), but shared with other readers for CACHE_LOCK_RWLOCK.
+ */
+static inline int cache_lock_try_shared(cache_lock_t* lock) {
+	if (lock->kind != CACHE_LOCK_RWLOCK)
+		return cache_lock_try(lock);
+#ifdef _WIN32
+	return TryAcquireSRWLockShared(&lock->rwlock) ? 1 : 0;
+#else
+	return pthread_rwlock_tryrdlock(&lock->rwlock) == 0;
+#endif
+}
+
+static inline void cache_lock_acquire_shared(cache_lock_t* lock) {
+	if (lock->kind != CACHE_LOCK_RWLOCK) {
+		cache_lock_acquire(lock);
+		return;
+	}
+#ifdef _WIN32
+	AcquireSRWLockShared(&lock->rwlock);
+#else
+	pthread_rwlock_rdlock(&lock->rwlock);
+#endif
+}
+
+static inline void cache_lock_release_shared(cache_lock_t* lock) {
+	if (lock->kind != CACHE_LOCK_RWLOCK) {
+		cache_lock_release(lock);
+		return;
+	}
+#ifdef _WIN32
+	ReleaseSRWLockShared(&lock->rwlock);
+#else
+	pthread_rwlock_unlock(&lock->rwlock);
+#endif
+}
+
+#endif
@@ -0,0 +1,387 @@
+/**
+ * @file cache_platform.h
+ * @brief Small portability layer shared by the cache sources (internal header).
+ *
+ * Wraps the handful of compiler and OS facilities the cache needs beyond
+ * standard C: atomic counters, reference counts, relaxed flags, cache-line aligned allocation,
+ * NUMA node placement and a monotonic clock.
+ */
+
+#ifndef CACHE_PLATFORM_H
+#define CACHE_PLATFORM_H
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h> // For memset
+
+#ifdef _WIN32
+    #include <Windows.h>
+    #include <malloc.h> // For _aligned_malloc
+#else
+    #include <time.h>     // For clock_gettime
+    #include <sys/mman.h> // For mmap
+    #include <unistd.h>   // For sysconf
+    #ifdef __linux__
+        #include <stdio.h>       // For reading the online node list
+        #include <sys/syscall.h> // For SYS_mbind
+    #endif
+#endif
+
+/*=============================================================================
+ * 1. Constants
+ *===========================================================================*/
+
+#define CACHE_LINE_SIZE 64 // Assumed size of a CPU cache line, used for padding.
+#define CACHE_MPOL_PREFERRED 1 // Linux MPOL_PREFERRED: allocate on the node, or elsewhere if it is full.
+
+/*=============================================================================
+ * 2. Atomic Operations
+ *===========================================================================*/
+
+ /**
+  * @brief Atomically adds 'delta' to '*target' and returns the previous value.
+  */
+static inline size_t cache_atomic_fetch_add_size(volatile size_t* target, size_t delta) {
+#if defined(_MSC_VER) && defined(_WIN64)
+	return (size_t)InterlockedExchangeAdd64((volatile LONG64*)target, (LONG64)delta);
+#elif defined(_MSC_VER)
+	return (size_t)InterlockedExchangeAdd((volatile LONG*)target, (LONG)delta);
+#else
+	return __atomic_fetch_add(target, delta, __ATOMIC_ACQ_REL);
+#endif
+}
+
+/**
+ * @brief Atomically adds 'delta' to a statistics counter (no ordering implied).
+ */
+static inline void cache_atomic_add_relaxed_size(volatile size_t* target, size_t delta) {
+#if defined(_MSC_VER) && defined(_WIN64)
+	InterlockedExchangeAdd64((volatile LONG64*)target, (LONG64)delta);
+#elif defined(_MSC_VER)
+	InterlockedExchangeAdd((volatile LONG*)target, (LONG)delta);
+#else
+	__atomic_fetch_add(target, delta, __ATOMIC_RELAXED);
+#endif
+}
+
+/**
+ * @brief Atomically subtracts 'delta' from '*target' and returns the previous value.
+ */
+static inline size_t cache_atomic_fetch_sub_size(volatile size_t* target, size_t delta) {
+	return cache_atomic_fetch_add_size(target, (size_t)0 - delta);
+}
+
+/**
+ * @brief Reads '*target' with acquire semantics.
+ */
+static inline size_t cache_atomic_load_size(const volatile size_t* target) {
+#if defined(_MSC_VER)
+	size_t value = *target;
+	_ReadWriteBarrier();
+	return value;
+#else
+	return __atomic_load_n(target, __ATOMIC_ACQUIRE);
+#endif
+}
+
+/**
+ * @brief Writes '*target' with release semantics.
+ */
+static inline void cache_atomic_store_size(volatile size_t* target, size_t value) {
+#if defined(_MSC_VER)
+	_ReadWriteBarrier();
+	*target = value;
+#else
+	__atomic_store_n(target, value, __ATOMIC_RELEASE);
+#endif
+}
+
+/**
+ * @brief Atomically adds 'delta' to '*target' and returns the previous value.
+ * @details Full acquire/release ordering, suitable for reference counts.
+ */
+static inline int cache_atomic_fetch_add_int(volatile int* target, int delta) {
+#if defined(_MSC_VER)
+	return (int)InterlockedExchangeAdd((volatile LONG*)target, (LONG)delta);
+#else
+	return __atomic_fetch_add(target, delta, __ATOMIC_ACQ_REL);
+#endif
+}
+
+static inline int cache_atomic_load_int(const volatile int* target) {
+#if defined(_MSC_VER)
+	int value = *target;
+	_ReadWriteBarrier();
+	return value;
+#else
+	return __atomic_load_n(target, __ATOMIC_ACQUIRE);
+#endif
+}
+
+/**
+ * @brief Reads a flag that other threads may set concurrently (no ordering implied).
+ */
+static inline int cache_atomic_load_relaxed_int(const volatile int* target) {
+#if defined(_MSC_VER)
+	return *target;
+#else
+	return __atomic_load_n(target, __ATOMIC_RELAXED);
+#endif
+}
+
+/**
+ * @brief Writes a flag that other threads may read or write concurrently (no ordering implied).
+ */
+static inline void cache_atomic_store_relaxed_int(volatile int* target, int value) {
+#if defined(_MSC_VER)
+	*target = value;
+#else
+	__atomic_store_n(target, value, __ATOMIC_RELAXED);
+#endif
+}
+
+/**
+ * @brief Atomically replaces '*target' with 'value' and returns the previous value.
+ * @details Full acquire/release ordering, suitable for lock words.
+ */
+static inline int cache_atomic_exchange_int(volatile int* target, int value) {
+#if defined(_MSC_VER)
+	return (int)InterlockedExchange((volatile LONG*)target, (LONG)value);
+#else
+	return __atomic_exchange_n(target, value, __ATOMIC_ACQ_REL);
+#endif
+}
+
+/**
+ * @brief Atomically sets '*target' to 'desired' if it holds 'expected'.
+ * @return Non-zero if the value was replaced.
+ */
+static inline int cache_atomic_cas_int(volatile int* target, int expected, int desired) {
+#if defined(_MSC_VER)
+	return InterlockedCompareExchange((volatile LONG*)target, (LONG)desired, (LONG)expected) == (LONG)expected;
+#else
+	return __atomic_compare_exchange_n(target, &expected, desired, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+#endif
+}
+
+/**
+ * @brief Writes '*target' with release semantics.
+ */
+static inline void cache_atomic_store_int(volatile int* target, int value) {
+#if defined(_MSC_VER)
+	_ReadWriteBarrier();
+	*target = value;
+#else
+	__atomic_store_n(target, value, __ATOMIC_RELEASE);
+#endif
+}
+
+static inline void* cache_atomic_load_ptr(void* const volatile* target) {
+#if defined(_MSC_VER)
+	void* value = *target;
+	_ReadWriteBarrier();
+	return value;
+#else
+	return __atomic_load_n(target, __ATOMIC_ACQUIRE);
+#endif
+}
+
+/**
+ * @brief Atomically replaces '*target' with 'value' and returns the previous pointer.
+ */
+static inline void* cache_atomic_exchange_ptr(void* volatile* target, void* value) {
+#if defined(_MSC_VER)
+	return InterlockedExchangePointer((PVOID volatile*)target, value);
+#else
+	return __atomic_exchange_n(target, value, __ATOMIC_ACQ_REL);
+#endif
+}
+
+/**
+ * @brief Atomically sets '*target' to 'desired' if it holds 'expected'.
+ * @return Non-zero if the pointer was replaced.
+ */
+static inline int cache_atomic_cas_ptr(void* volatile* target, void* expected, void* desired) {
+#if defined(_MSC_VER)
+	return InterlockedCompareExchangePointer((PVOID volatile*)target, desired, expected) == expected;
+#else
+	return __atomic_compare_exchange_n(target, &expected, desired, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+#endif
+}
+
+/**
+ * @brief Tells the CPU the caller is spinning, so it can yield to a sibling hyperthread.
+ */
+static inline void cache_cpu_relax(void) {
+#if defined(_MSC_VER)
+	YieldProcessor();
+#elif defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#elif defined(__aarch64__)
+	__asm__ __volatile__("yield");
+#endif
+}
+
+/*=============================================================================
+ * 3. Memory
+ *===========================================================================*/
+
+ /**
+  * @brief Allocates zeroed memory aligned to a cache line.
+  * @return The block, or NULL on failure. Release it with cache_aligned_free().
+  */
+static inline void* cache_aligned_calloc(size_t size) {
+	size = (size + CACHE_LINE_SIZE - 1) & ~(size_t)(CACHE_LINE_SIZE - 1);
+#ifdef _WIN32
+	void* block = _aligned_malloc(size, CACHE_LINE_SIZE);
+#else
+	void* block = NULL;
+	if (posix_memalign(&block, CACHE_LINE_SIZE, size) != 0)
+		block = NULL;
+#endif
+	if (block)
+		memset(block, 0, size);
+	return block;
+}
+
+static inline void cache_aligned_free(void* block) {
+#ifdef _WIN32
+	_aligned_free(block);
+#else
+	free(block);
+#endif
+}
+
+/**
+ * @brief Estimates the heap bytes malloc(size) consumes, headers and rounding included.
+ * @details Models the common general-purpose allocators (glibc, the Windows heap,
+ * jemalloc's small classes): one word of header, 16-byte granularity and a 32-byte
+ * minimum. Computed up front, since budget space is reserved before allocating.
+ */
+static inline size_t cache_malloc_footprint(size_t size) {
+	size_t chunk = (size + sizeof(size_t) + 15) & ~(size_t)15;
+	return chunk < 32 ? 32 : chunk;
+}
+
+/*=============================================================================
+ * 4. NUMA Placement
+ *===========================================================================*/
+
+ /**
+  * @brief Returns the number of NUMA nodes of the machine (1 where it cannot be told).
+  */
+static inline unsigned int cache_numa_node_count(void) {
+#if defined(_WIN32)
+	ULONG highest = 0;
+	return GetNumaHighestNodeNumber(&highest) ? (unsigned int)highest + 1 : 1;
+#elif defined(__linux__)
+	// A list such as "0", "0-1" or "0,2-3": the largest number is the highest node.
+	unsigned int highest = 0, value = 0;
+	FILE* file = fopen("/sys/devices/system/node/online", "r");
+	if (file) {
+		int c;
+		while ((c = fgetc(file)) != EOF) {
+			if (c >= '0' && c <= '9') {
+				value = value * 10 + (unsigned int)(c - '0');
+				continue;
+			}
+			highest = value > highest ? value : highest;
+			value = 0;
+		}
+		highest = value > highest ? value : highest;
+		fclose(file);
+	}
+	return highest + 1;
+#else
+	return 1;
+#endif
+}
+
+/**
+ * @brief Returns the size of a virtual memory page.
+ */
+static inline size_t cache_page_size(void) {
+#ifdef _WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwPageSize;
+#else
+	long size = sysconf(_SC_PAGESIZE);
+	return size > 0 ? (size_t)size : 4096;
+#endif
+}
+
+/**
+ * @brief Reserves 'size' bytes of page-aligned address space, to be backed by cache_numa_place().
+ * @details Every page must be placed before it is first touched: on Windows the
+ * range is only reserved, and on POSIX a page lands wherever it is first touched.
+ * @return The range, zeroed once placed, or NULL on failure. Release it with cache_numa_free().
+ */
+static inline void* cache_numa_reserve(size_t size) {
+#ifdef _WIN32
+	return VirtualAlloc(NULL, size, MEM_RESERVE, PAGE_NOACCESS);
+#else
+	void* block = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	return block == MAP_FAILED ? NULL : block;
+#endif
+}
+
+/**
+ * @brief Backs a page-aligned part of a cache_numa_reserve() range with memory of 'node'.
+ * @details The node is a preference: if it is full, or does not exist, or the platform
+ * has no NUMA support, the pages come from the default node instead.
+ * @return 0 on success, -1 if the range could not be backed at all.
+ */
+static inline int cache_numa_place(void* block, size_t size, unsigned int node) {
+#if defined(_WIN32)
+	if (VirtualAllocExNuma(GetCurrentProcess(), block, size, MEM_COMMIT, PAGE_READWRITE, node))
+		return 0;
+	return VirtualAlloc(block, size, MEM_COMMIT, PAGE_READWRITE) ? 0 : -1;
+#elif defined(__linux__) && defined(SYS_mbind)
+	if (node < sizeof(unsigned long) * 8) {
+		unsigned long mask = 1ul << node;
+		// The kernel reads one bit fewer than 'maxnode'.
+		syscall(SYS_mbind, block, size, CACHE_MPOL_PREFERRED, &mask, sizeof(mask) * 8 + 1, 0);
+	}
+	return 0;
+#else
+	(void)block;
+	(void)size;
+	(void)node;
+	return 0;
+#endif
+}
+
+static inline void cache_numa_free(void* block, size_t size) {
+#ifdef _WIN32
+	(void)size;
+	VirtualFree(block, 0, MEM_RELEASE);
+#else
+	munmap(block, size);
+#endif
+}
+
+/*=============================================================================
+ * 5. Time
+ *===========================================================================*/
+
+ /**
+  * @brief Returns a monotonic timestamp in nanoseconds, for measuring intervals.
+  */
+static inline unsigned long long cache_now_ns(void) {
+#ifdef _WIN32
+	static LARGE_INTEGER frequency;
+	LARGE_INTEGER now;
+	if (frequency.QuadPart == 0)
+		QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&now);
+	return (unsigned long long)(now.QuadPart / frequency.QuadPart) * 1000000000ull
+		+ (unsigned long long)(now.QuadPart % frequency.QuadPart) * 1000000000ull / (unsigned long long)frequency.QuadPart;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000000ull + (unsigned long long)ts.tv_nsec;
+#endif
+}
+
+#endif
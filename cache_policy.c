@@ -0,0 +1,443 @@
+/**
+ * @file cache_policy.c
+ * @brief Eviction policies for cache shards: LRU, segmented LRU, W-TinyLFU and GDSF.
+ *
+ * Every policy orders elements in one or more intrusive lists threaded through
+ * cache_element's next/prev links and picks the element to evict. Plain LRU
+ * keeps a single list. SLRU makes new elements earn their place: they enter a
+ * probation segment and only a second access moves them to the protected one,
+ * so a scan of one-hit objects can only displace other probationary objects.
+ * W-TinyLFU adds a small LRU window in front of an SLRU main space and admits
+ * an element from the window only if a count-min sketch rates it more popular
+ * than the element it would replace. GDSF weighs recency and frequency against
+ * object size, so one large object cannot push out many small popular ones.
+ */
+
+#include "cache_policy.h"
+#include "cache_platform.h"
+
+#include <stdlib.h>
+
+/*=============================================================================
+ * 1. Constants
+ *===========================================================================*/
+
+enum {
+    SEGMENT_PROBATION = 0, // SLRU: probation. W-TinyLFU: window.
+    SEGMENT_PROTECTED = 1,
+    SEGMENT_TINYLFU_WINDOW = 0,
+    SEGMENT_TINYLFU_PROBATION = 1,
+    SEGMENT_TINYLFU_PROTECTED = 2
+};
+
+#define SKETCH_DEPTH       4  // Counters consulted per key.
+#define SKETCH_MIN_WORDS   8
+#define SKETCH_MAX_COUNT   15
+#define SKETCH_RESET_RATIO 10 // Age the counters after this many increments per table word.
+
+/*=============================================================================
+ * 2. Lists
+ *===========================================================================*/
+
+static void list_remove(cache_list_t* list, cache_element* element) {
+    if (element->prev)
+        element->prev->next = element->next;
+    else
+        list->head = element->next;
+
+    if (element->next)
+        element->next->prev = element->prev;
+    else
+        list->tail = element->prev;
+
+    element->next = NULL;
+    element->prev = NULL;
+    list->bytes -= element->len;
+}
+
+static void list_push_head(cache_list_t* list, cache_element* element) {
+    element->next = list->head;
+    element->prev = NULL;
+
+    if (list->head)
+        list->head->prev = element;
+    list->head = element;
+
+    if (!list->tail)
+        list->tail = element; // First element in the list
+    list->bytes += element->len;
+}
+
+/**
+ * @brief Moves an element to the head of segment 'to', wherever it is now.
+ */
+static void move_to_segment(cache_policy_t* policy, cache_element* element, unsigned char to) {
+    list_remove(&policy->segments[element->segment], element);
+    element->segment = to;
+    list_push_head(&policy->segments[to], element);
+}
+
+/**
+ * @brief Demotes protected tail elements to 'probation' until the protected segment fits.
+ * @details The element just promoted ('keep') is never demoted, even if it alone is too large.
+ */
+static void shrink_protected(cache_policy_t* policy, unsigned char protected_segment,
+    unsigned char probation_segment, size_t main_capacity, cache_element* keep) {
+    cache_list_t* protected_list = &policy->segments[protected_segment];
+    size_t target = main_capacity / 100 * CACHE_POLICY_PROTECTED_PERCENT
+        + main_capacity % 100 * CACHE_POLICY_PROTECTED_PERCENT / 100;
+
+    while (protected_list->bytes > target && protected_list->tail && protected_list->tail != keep)
+        move_to_segment(policy, protected_list->tail, probation_segment);
+}
+
+/*=============================================================================
+ * 3. Count-Min Sketch
+ *===========================================================================*/
+
+static const unsigned long long sketch_seeds[SKETCH_DEPTH] = {
+    0x9E3779B97F4A7C15ull, 0xC2B2AE3D27D4EB4Full, 0x165667B19E3779F9ull, 0xD6E8FEB86659FD93ull
+};
+
+static size_t sketch_index(const cache_sketch_t* sketch, unsigned long long hash, int row) {
+    unsigned long long h = (hash + (unsigned long long)row) * sketch_seeds[row];
+    return (size_t)(h >> (64 - sketch->counter_bits));
+}
+
+static int sketch_init(cache_sketch_t* sketch, size_t expected_entries) {
+    size_t words = SKETCH_MIN_WORDS, bits = 7; // 8 words hold 2^7 counters.
+    while (words < expected_entries) {
+        words <<= 1;
+        bits++;
+    }
+
+    sketch->table = calloc(words, sizeof(unsigned long long));
+    if (!sketch->table)
+        return -1;
+    sketch->counter_bits = bits;
+    sketch->additions = 0;
+    sketch->reset_at = words * SKETCH_RESET_RATIO;
+    return 0;
+}
+
+unsigned int cache_sketch_frequency(const cache_sketch_t* sketch, unsigned long long hash) {
+    if (!sketch->table)
+        return 0;
+
+    unsigned int frequency = SKETCH_MAX_COUNT;
+    for (int row = 0; row < SKETCH_DEPTH; row++) {
+        size_t index = sketch_index(sketch, hash, row);
+        unsigned int count = (unsigned int)(sketch->table[index >> 4] >> ((index & 15) * 4)) & 0xF;
+        if (count < frequency)
+            frequency = count;
+    }
+    return frequency;
+}
+
+void cache_sketch_increment(cache_sketch_t* sketch, unsigned long long hash) {
+    if (!sketch->table)
+        return;
+
+    for (int row = 0; row < SKETCH_DEPTH; row++) {
+        size_t index = sketch_index(sketch, hash, row);
+        unsigned long long* word = &sketch->table[index >> 4];
+        unsigned int shift = (unsigned int)(index & 15) * 4;
+        if (((*word >> shift) & 0xF) < SKETCH_MAX_COUNT)
+            *word += 1ull << shift;
+    }
+
+    // Halve every counter periodically so the sketch follows shifts in popularity.
+    if (++sketch->additions >= sketch->reset_at) {
+        size_t words = ((size_t)1 << sketch->counter_bits) / 16;
+        for (size_t i = 0; i < words; i++)
+            sketch->table[i] = (sketch->table[i] >> 1) & 0x7777777777777777ull;
+        sketch->additions /= 2;
+    }
+}
+
+/*=============================================================================
+ * 4. Policies
+ *===========================================================================*/
+
+// --- LRU: one list, evict the tail. ---
+
+static int lru_insert(cache_policy_t* policy, cache_element* element) {
+    element->segment = 0;
+    list_push_head(&policy->segments[0], element);
+    return 0;
+}
+
+static void lru_hit(cache_policy_t* policy, cache_element* element) {
+    move_to_segment(policy, element, 0);
+}
+
+static void lru_remove(cache_policy_t* policy, cache_element* element) {
+    list_remove(&policy->segments[element->segment], element);
+}
+
+static cache_element* lru_victim(cache_policy_t* policy) {
+    return policy->segments[0].tail;
+}
+
+// --- SLRU: new elements on probation, a second access protects them. ---
+
+static int slru_insert(cache_policy_t* policy, cache_element* element) {
+    element->segment = SEGMENT_PROBATION;
+    list_push_head(&policy->segments[SEGMENT_PROBATION], element);
+    return 0;
+}
+
+static void slru_hit(cache_policy_t* policy, cache_element* element) {
+    move_to_segment(policy, element, SEGMENT_PROTECTED);
+    shrink_protected(policy, SEGMENT_PROTECTED, SEGMENT_PROBATION, policy->capacity, element);
+}
+
+static cache_element* slru_victim(cache_policy_t* policy) {
+    cache_element* victim = policy->segments[SEGMENT_PROBATION].tail;
+    return victim ? victim : policy->segments[SEGMENT_PROTECTED].tail;
+}
+
+// --- W-TinyLFU: LRU window, SLRU main space, sketch-based admission. ---
+
+static size_t tinylfu_window_capacity(const cache_policy_t* policy) {
+    size_t window = policy->capacity / 100 * CACHE_POLICY_WINDOW_PERCENT;
+    return window ? window : 1;
+}
+
+static size_t tinylfu_main_capacity(const cache_policy_t* policy) {
+    size_t window = tinylfu_window_capacity(policy);
+    return policy->capacity > window ? policy->capacity - window : 0;
+}
+
+static size_t tinylfu_main_bytes(const cache_policy_t* policy) {
+    return policy->segments[SEGMENT_TINYLFU_PROBATION].bytes + policy->segments[SEGMENT_TINYLFU_PROTECTED].bytes;
+}
+
+static int tinylfu_insert(cache_policy_t* policy, cache_element* element) {
+    cache_sketch_increment(&policy->sketch, element->key_hash);
+    element->segment = SEGMENT_TINYLFU_WINDOW;
+    list_push_head(&policy->segments[SEGMENT_TINYLFU_WINDOW], element);
+
+    // While the main space has room, window overflow moves there without a contest.
+    size_t window_capacity = tinylfu_window_capacity(policy);
+    size_t main_capacity = tinylfu_main_capacity(policy);
+    cache_list_t* window = &policy->segments[SEGMENT_TINYLFU_WINDOW];
+    while (window->bytes > window_capacity && window->tail != element
+        && tinylfu_main_bytes(policy) + window->tail->len <= main_capacity)
+        move_to_segment(policy, window->tail, SEGMENT_TINYLFU_PROBATION);
+    return 0;
+}
+
+static void tinylfu_hit(cache_policy_t* policy, cache_element* element) {
+    cache_sketch_increment(&policy->sketch, element->key_hash);
+    if (element->segment == SEGMENT_TINYLFU_WINDOW) {
+        move_to_segment(policy, element, SEGMENT_TINYLFU_WINDOW);
+        return;
+    }
+
+    move_to_segment(policy, element, SEGMENT_TINYLFU_PROTECTED);
+    shrink_protected(policy, SEGMENT_TINYLFU_PROTECTED, SEGMENT_TINYLFU_PROBATION,
+        tinylfu_main_capacity(policy), element);
+}
+
+static cache_element* tinylfu_victim(cache_policy_t* policy) {
+    cache_element* candidate = policy->segments[SEGMENT_TINYLFU_WINDOW].tail;
+    cache_element* victim = policy->segments[SEGMENT_TINYLFU_PROBATION].tail;
+    if (!victim)
+        victim = policy->segments[SEGMENT_TINYLFU_PROTECTED].tail;
+
+    if (!victim || !candidate)
+        return victim ? victim : candidate;
+
+    // The window's oldest element enters the main space only if it is more popular
+    // than the one it would push out. Ties favour the incumbent, which is what keeps
+    // one-hit scans from flushing the main space.
+    if (cache_sketch_frequency(&policy->sketch, candidate->key_hash)
+        > cache_sketch_frequency(&policy->sketch, victim->key_hash)) {
+        move_to_segment(policy, candidate, SEGMENT_TINYLFU_PROBATION);
+        return victim;
+    }
+    return candidate;
+}
+
+// --- GDSF: evict the lowest L + frequency / size; L rises to each evicted element's priority. ---
+
+static int heap_reserve(cache_policy_t* policy, size_t capacity) {
+    if (capacity < 16)
+        capacity = 16;
+    if (capacity <= policy->heap_capacity)
+        return 0;
+
+    cache_element** heap = realloc(policy->heap, capacity * sizeof(cache_element*));
+    if (!heap)
+        return -1;
+    policy->heap = heap;
+    policy->heap_capacity = capacity;
+    return 0;
+}
+
+static void heap_place(cache_policy_t* policy, size_t index, cache_element* element) {
+    policy->heap[index] = element;
+    element->heap_index = index;
+}
+
+static void heap_sift_up(cache_policy_t* policy, size_t index) {
+    cache_element* element = policy->heap[index];
+    while (index > 0) {
+        size_t parent = (index - 1) / 2;
+        if (policy->heap[parent]->priority <= element->priority)
+            break;
+        heap_place(policy, index, policy->heap[parent]);
+        index = parent;
+    }
+    heap_place(policy, index, element);
+}
+
+static void heap_sift_down(cache_policy_t* policy, size_t index) {
+    cache_element* element = policy->heap[index];
+    for (;;) {
+        size_t child = 2 * index + 1;
+        if (child >= policy->heap_count)
+            break;
+        if (child + 1 < policy->heap_count && policy->heap[child + 1]->priority < policy->heap[child]->priority)
+            child++;
+        if (element->priority <= policy->heap[child]->priority)
+            break;
+        heap_place(policy, index, policy->heap[child]);
+        index = child;
+    }
+    heap_place(policy, index, element);
+}
+
+/**
+ * @brief Computes an element's GDSF priority with a uniform cost of one fetch per object.
+ * @details Dividing by size favours small objects, which maximizes object hits per byte.
+ */
+static double gdsf_priority(const cache_policy_t* policy, const cache_element* element) {
+    return policy->inflation + (double)element->frequency / (double)(element->len ? element->len : 1);
+}
+
+static int gdsf_insert(cache_policy_t* policy, cache_element* element) {
+    if (policy->heap_count == policy->heap_capacity && heap_reserve(policy, policy->heap_capacity * 2) != 0)
+        return -1;
+
+    element->frequency = 1;
+    element->priority = gdsf_priority(policy, element);
+    policy->heap[policy->heap_count] = element;
+    heap_sift_up(policy, policy->heap_count++);
+    return 0;
+}
+
+static void gdsf_hit(cache_policy_t* policy, cache_element* element) {
+    element->frequency++;
+    element->priority = gdsf_priority(policy, element);
+    heap_sift_down(policy, element->heap_index); // Priorities only grow.
+}
+
+static void gdsf_remove(cache_policy_t* policy, cache_element* element) {
+    size_t index = element->heap_index;
+    cache_element* last = policy->heap[--policy->heap_count];
+    if (last == element)
+        return;
+
+    heap_place(policy, index, last);
+    heap_sift_up(policy, index);
+    heap_sift_down(policy, last->heap_index);
+}
+
+static cache_element* gdsf_victim(cache_policy_t* policy) {
+    return policy->heap_count ? policy->heap[0] : NULL;
+}
+
+static void gdsf_evict(cache_policy_t* policy, cache_element* element) {
+    // Aging: later insertions start from the evicted priority, so objects that
+    // were popular long ago eventually lose to recent ones.
+    policy->inflation = element->priority;
+}
+
+static const cache_policy_ops_t lru_ops = { "lru", lru_insert, lru_hit, lru_remove, lru_victim, NULL };
+static const cache_policy_ops_t slru_ops = { "slru", slru_insert, slru_hit, lru_remove, slru_victim, NULL };
+static const cache_policy_ops_t tinylfu_ops = { "w-tinylfu", tinylfu_insert, tinylfu_hit, lru_remove, tinylfu_victim, NULL };
+static const cache_policy_ops_t gdsf_ops = { "gdsf", gdsf_insert, gdsf_hit, gdsf_remove, gdsf_victim, gdsf_evict };
+
+/*=============================================================================
+ * 5. Public API Functions
+ *===========================================================================*/
+
+int cache_policy_init(cache_policy_t* policy, cache_policy_kind_t kind, size_t expected_entries) {
+    for (int i = 0; i < CACHE_POLICY_MAX_SEGMENTS; i++) {
+        policy->segments[i].head = NULL;
+        policy->segments[i].tail = NULL;
+        policy->segments[i].bytes = 0;
+    }
+    policy->capacity = 0;
+    policy->sketch.table = NULL;
+    policy->heap = NULL;
+    policy->heap_count = 0;
+    policy->heap_capacity = 0;
+    policy->inflation = 0.0;
+
+    switch (kind) {
+    case CACHE_POLICY_SLRU:
+        policy->ops = &slru_ops;
+        break;
+    case CACHE_POLICY_TINYLFU:
+        policy->ops = &tinylfu_ops;
+        return sketch_init(&policy->sketch, expected_entries);
+    case CACHE_POLICY_GDSF:
+        policy->ops = &gdsf_ops;
+        return heap_reserve(policy, expected_entries);
+    default:
+        policy->ops = &lru_ops;
+        break;
+    }
+    return 0;
+}
+
+void cache_policy_destroy(cache_policy_t* policy) {
+    free(policy->sketch.table);
+    policy->sketch.table = NULL;
+    free(policy->heap);
+    policy->heap = NULL;
+    policy->heap_count = 0;
+    policy->heap_capacity = 0;
+}
+
+int cache_policy_insert(cache_policy_t* policy, cache_element* element) {
+    cache_atomic_store_relaxed_int(&element->referenced, 0);
+    return policy->ops->insert(policy, element);
+}
+
+void cache_policy_hit(cache_policy_t* policy, cache_element* element) {
+    cache_atomic_store_relaxed_int(&element->referenced, 0);
+    policy->ops->hit(policy, element);
+}
+
+void cache_policy_remove(cache_policy_t* policy, cache_element* element) {
+    policy->ops->remove(policy, element);
+}
+
+cache_element* cache_policy_victim(cache_policy_t* policy) {
+    return policy->ops->victim(policy);
+}
+
+void cache_policy_evict(cache_policy_t* policy, cache_element* element) {
+    if (policy->ops->evict)
+        policy->ops->evict(policy, element);
+}
+
+void cache_policy_for_each(const cache_policy_t* policy, cache_policy_visit_fn visit, void* context) {
+    if (policy->ops == &gdsf_ops) {
+        for (size_t i = 0; i < policy->heap_count; i++)
+            visit(context, policy->heap[i]);
+        return;
+    }
+
+    for (int segment = 0; segment < CACHE_POLICY_MAX_SEGMENTS; segment++) {
+        for (cache_element* element = policy->segments[segment].tail; element; ) {
+            cache_element* prev = element->prev;
+            visit(context, element);
+            element = prev;
+        }
+    }
+}
@@ -0,0 +1,119 @@
+// cache_policy.h
+
+#pragma once
+
+#include <stddef.h> // For size_t
+
+#include "proxy_cache.h" // For cache_element and cache_policy_kind_t
+
+// Most lists a policy splits its elements into (W-TinyLFU: window, probation, protected).
+#define CACHE_POLICY_MAX_SEGMENTS 3
+
+// Share of the main space reserved for the protected segment, in percent.
+#define CACHE_POLICY_PROTECTED_PERCENT 80
+
+// Share of the whole budget given to the W-TinyLFU admission window, in percent.
+#define CACHE_POLICY_WINDOW_PERCENT 1
+
+// A recency-ordered list of elements, linked through cache_element's next/prev.
+typedef struct cache_list {
+    cache_element* head;  // Most recently used.
+    cache_element* tail;  // Least recently used.
+    size_t bytes;         // Sum of 'len' over the list.
+} cache_list_t;
+
+// Count-min sketch of 4-bit counters, 16 to a word, used to estimate key popularity.
+typedef struct cache_sketch {
+    unsigned long long* table;
+    size_t counter_bits;  // log2 of the number of counters.
+    size_t additions;     // Increments since the last aging pass.
+    size_t reset_at;      // Number of increments that triggers aging.
+} cache_sketch_t;
+
+typedef struct cache_policy cache_policy_t;
+
+// Hooks implementing one eviction policy. All run under the owning shard's exclusive lock.
+typedef struct cache_policy_ops {
+    const char* name;
+    int (*insert)(cache_policy_t* policy, cache_element* element);   // Element entered the cache; -1 if out of memory.
+    void (*hit)(cache_policy_t* policy, cache_element* element);     // Element was accessed.
+    void (*remove)(cache_policy_t* policy, cache_element* element);  // Element leaves the cache.
+    cache_element* (*victim)(cache_policy_t* policy);                // Next element to evict, or NULL.
+    void (*evict)(cache_policy_t* policy, cache_element* element);   // The victim is evicted (NULL: nothing to do).
+} cache_policy_ops_t;
+
+// Per-shard policy state.
+struct cache_policy {
+    const cache_policy_ops_t* ops;
+    size_t capacity;                                   // Byte budget the segment targets derive from.
+    cache_list_t segments[CACHE_POLICY_MAX_SEGMENTS];  // Indexed by cache_element::segment.
+    cache_sketch_t sketch;                             // Only allocated for CACHE_POLICY_TINYLFU.
+    cache_element** heap;                              // CACHE_POLICY_GDSF: min-heap on priority.
+    size_t heap_count;
+    size_t heap_capacity;
+    double inflation;                                  // CACHE_POLICY_GDSF: priority of the last evicted element (L).
+};
+
+/**
+ * @brief Sets up the policy state for one shard.
+ * @param policy The state to initialize.
+ * @param kind The policy to use. Unknown values fall back to CACHE_POLICY_LRU.
+ * @param expected_entries Rough number of elements the shard will hold; sizes the sketch or heap.
+ * @return 0 on success, or -1 on allocation failure.
+ */
+int cache_policy_init(cache_policy_t* policy, cache_policy_kind_t kind, size_t expected_entries);
+
+/**
+ * @brief Frees the policy state. The elements themselves are not touched.
+ */
+void cache_policy_destroy(cache_policy_t* policy);
+
+/**
+ * @brief Adds a new (or just rewritten) element to the policy.
+ * @return 0 on success, or -1 if the policy could not grow its index (the element is not linked).
+ */
+int cache_policy_insert(cache_policy_t* policy, cache_element* element);
+
+/**
+ * @brief Records an access to an element and clears its deferred reference bit.
+ */
+void cache_policy_hit(cache_policy_t* policy, cache_element* element);
+
+/**
+ * @brief Removes an element from the policy's lists.
+ */
+void cache_policy_remove(cache_policy_t* policy, cache_element* element);
+
+/**
+ * @brief Chooses the element to evict next. It stays linked until cache_policy_remove().
+ * @return The victim, or NULL if the policy holds no elements.
+ */
+cache_element* cache_policy_victim(cache_policy_t* policy);
+
+/**
+ * @brief Tells the policy that a victim is really being evicted, before cache_policy_remove().
+ * @details A victim given a second chance instead is never passed here, so state that
+ * eviction advances (GDSF's inflation) only moves for elements that leave.
+ */
+void cache_policy_evict(cache_policy_t* policy, cache_element* element);
+
+// Called for each element visited by cache_policy_for_each().
+typedef void (*cache_policy_visit_fn)(void* context, cache_element* element);
+
+/**
+ * @brief Visits every element, roughly from the next victim to the most valuable.
+ * @details List policies walk each segment from tail to head, in segment order;
+ * GDSF walks its heap array, whose first entry is the next victim.
+ * The visitor must not change the policy.
+ */
+void cache_policy_for_each(const cache_policy_t* policy, cache_policy_visit_fn visit, void* context);
+
+/**
+ * @brief Returns the sketch's estimate of how often 'hash' was seen (0 to 15).
+ */
+unsigned int cache_sketch_frequency(const cache_sketch_t* sketch, unsigned long long hash);
+
+/**
+ * @brief Counts one more occurrence of 'hash', aging all counters periodically.
+ */
+void cache_sketch_increment(cache_sketch_t* sketch, unsigned long long hash);
@@ -0,0 +1,350 @@
+/**
+ * @file cache_snapshot.c
+ * @brief Snapshot files for warm restarts, read back through a shared mapping.
+ *
+ * A snapshot is a 32-byte header followed by one record per element:
+ *
+ *     header:  magic[8] | version u32 | byte order u32 | record count u64 | file size u64
+ *     record:  key length u64 | data length u64 | raw length u64 | ttl u64 | key | pad | data | pad
+ *
+ * Every key and payload starts on an 8-byte boundary and all integers are in
+ * the writer's native byte order, so a snapshot is meant to be read back by
+ * the same build on the same machine, which is what a restart needs. A non-zero
+ * raw length marks an LZ4-encoded payload, which is kept encoded.
+ *
+ * Loading maps the file once and lets the cache adopt each payload in place.
+ * The mapping is reference-counted by adopted payloads and unmapped when the
+ * last one is evicted, overwritten or freed with its cache.
+ */
+
+#include "cache_snapshot.h"
+#include "cache_lock.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+    #include <Windows.h> // For CreateFileMapping
+#else
+    #include <fcntl.h>    // For open
+    #include <sys/mman.h> // For mmap
+    #include <sys/stat.h> // For fstat
+    #include <unistd.h>   // For close
+#endif
+
+/*=============================================================================
+ * 1. File Layout
+ *===========================================================================*/
+
+#define SNAPSHOT_BYTE_ORDER 0x01020304u
+#define SNAPSHOT_ALIGN      8
+
+typedef struct snapshot_header {
+    char magic[8];
+    unsigned int version;
+    unsigned int byte_order;     // SNAPSHOT_BYTE_ORDER as written by the producer.
+    unsigned long long count;
+    unsigned long long bytes;    // Size of the whole file; a shorter file was truncated.
+} snapshot_header_t;
+
+typedef struct snapshot_record {
+    unsigned long long key_len;
+    unsigned long long data_len;
+    unsigned long long raw_len;  // Decoded size of an LZ4-encoded payload (0: stored as given).
+    unsigned long long ttl_ms;   // Remaining lifetime when the snapshot was taken (0: never expires).
+} snapshot_record_t;
+
+static size_t padding(unsigned long long length) {
+    return (size_t)((SNAPSHOT_ALIGN - (length & (SNAPSHOT_ALIGN - 1))) & (SNAPSHOT_ALIGN - 1));
+}
+
+/*=============================================================================
+ * 2. Mappings
+ *===========================================================================*/
+
+// A loaded snapshot. Every payload handed out holds one reference.
+typedef struct snapshot_mapping {
+    struct snapshot_mapping* next;
+    char* base;
+    size_t size;
+    size_t refs;
+} snapshot_mapping_t;
+
+static snapshot_mapping_t* g_mappings = NULL;
+static cache_mutex_t g_mappings_lock;
+static volatile int g_mappings_lock_state = 0; // See cache_mutex_init_once().
+
+static void mappings_lock(void) {
+    cache_mutex_init_once(&g_mappings_lock, &g_mappings_lock_state);
+    cache_mutex_lock(&g_mappings_lock);
+}
+
+static void mappings_unlock(void) {
+    cache_mutex_unlock(&g_mappings_lock);
+}
+
+/**
+ * @brief Maps a whole file read-only.
+ * @return The mapping, or NULL if the file cannot be opened or is too short to be a snapshot.
+ */
+static char* map_file(const char* path, size_t* size) {
+    char* base = NULL;
+#ifdef _WIN32
+    // FILE_SHARE_DELETE lets the next snapshot be renamed over this one while it is mapped.
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return NULL;
+
+    LARGE_INTEGER length;
+    if (GetFileSizeEx(file, &length) && length.QuadPart >= (LONGLONG)sizeof(snapshot_header_t)
+        && (unsigned long long)length.QuadPart <= (size_t)-1) {
+        HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mapping) {
+            base = (char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            CloseHandle(mapping); // The view keeps the mapping alive.
+            *size = (size_t)length.QuadPart;
+        }
+    }
+    CloseHandle(file);
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+
+    struct stat info;
+    if (fstat(fd, &info) == 0 && info.st_size >= (off_t)sizeof(snapshot_header_t)) {
+        void* mapped = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped != MAP_FAILED) {
+            base = (char*)mapped;
+            *size = (size_t)info.st_size;
+        #ifdef MADV_WILLNEED
+            madvise(mapped, *size, MADV_WILLNEED); // Start read-ahead; every record is about to be touched.
+        #endif
+        }
+    }
+    close(fd);
+#endif
+    return base;
+}
+
+static void unmap_file(char* base, size_t size) {
+#ifdef _WIN32
+    (void)size;
+    UnmapViewOfFile(base);
+#else
+    munmap(base, size);
+#endif
+}
+
+/**
+ * @brief Free function of adopted snapshot payloads: drops a reference on their mapping.
+ */
+static void release_snapshot_payload(void* buffer) {
+    const char* address = (const char*)buffer;
+    snapshot_mapping_t* unmapped = NULL;
+
+    mappings_lock();
+    for (snapshot_mapping_t** link = &g_mappings; *link; link = &(*link)->next) {
+        snapshot_mapping_t* mapping = *link;
+        if (address >= mapping->base && address < mapping->base + mapping->size) {
+            if (--mapping->refs == 0) {
+                *link = mapping->next;
+                unmapped = mapping;
+            }
+            break;
+        }
+    }
+    mappings_unlock();
+
+    if (unmapped) {
+        unmap_file(unmapped->base, unmapped->size);
+        free(unmapped);
+    }
+}
+
+/**
+ * @brief Checks the header and that every record lies inside the file.
+ */
+static int validate_snapshot(const char* base, size_t size) {
+    const snapshot_header_t* header = (const snapshot_header_t*)base;
+    if (memcmp(header->magic, CACHE_SNAPSHOT_MAGIC, sizeof(header->magic)) != 0
+        || header->version != CACHE_SNAPSHOT_VERSION || header->byte_order != SNAPSHOT_BYTE_ORDER
+        || header->bytes != size || size % SNAPSHOT_ALIGN != 0)
+        return -1;
+
+    // With the size a multiple of the alignment, a length that fits also fits padded.
+    size_t offset = sizeof(snapshot_header_t);
+    for (unsigned long long i = 0; i < header->count; i++) {
+        if (size - offset < sizeof(snapshot_record_t))
+            return -1;
+        const snapshot_record_t* record = (const snapshot_record_t*)(base + offset);
+        offset += sizeof(snapshot_record_t);
+
+        if (record->key_len > size - offset)
+            return -1;
+        offset += (size_t)record->key_len + padding(record->key_len);
+
+        if (record->data_len == 0 || record->data_len > size - offset)
+            return -1;
+        offset += (size_t)record->data_len + padding(record->data_len);
+    }
+    return offset == size ? 0 : -1;
+}
+
+/*=============================================================================
+ * 3. Writing
+ *===========================================================================*/
+
+static void write_bytes(cache_snapshot_writer_t* writer, const void* data, size_t length) {
+    if (writer->failed || length == 0)
+        return;
+    if (fwrite(data, 1, length, writer->file) != length)
+        writer->failed = 1;
+    writer->bytes += length;
+}
+
+static void write_padded(cache_snapshot_writer_t* writer, const void* data, size_t length) {
+    static const char zeros[SNAPSHOT_ALIGN] = { 0 };
+    write_bytes(writer, data, length);
+    write_bytes(writer, zeros, padding(length));
+}
+
+static void write_header(cache_snapshot_writer_t* writer) {
+    snapshot_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CACHE_SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = CACHE_SNAPSHOT_VERSION;
+    header.byte_order = SNAPSHOT_BYTE_ORDER;
+    header.count = writer->count;
+    header.bytes = writer->bytes;
+    if (fwrite(&header, 1, sizeof(header), writer->file) != sizeof(header))
+        writer->failed = 1;
+}
+
+static int replace_file(const char* from, const char* to) {
+#ifdef _WIN32
+    return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING) ? 0 : -1;
+#else
+    return rename(from, to) == 0 ? 0 : -1;
+#endif
+}
+
+static void close_writer(cache_snapshot_writer_t* writer) {
+    free(writer->temp_path);
+    free(writer->path);
+    writer->temp_path = NULL;
+    writer->path = NULL;
+    writer->file = NULL;
+}
+
+/*=============================================================================
+ * 4. Public API Functions
+ *===========================================================================*/
+
+void cache_snapshot_abort(cache_snapshot_writer_t* writer) {
+    fclose(writer->file);
+    remove(writer->temp_path);
+    close_writer(writer);
+}
+
+int cache_snapshot_open(cache_snapshot_writer_t* writer, const char* path) {
+    memset(writer, 0, sizeof(*writer));
+    size_t length = strlen(path);
+    writer->path = (char*)malloc(length + 1);
+    writer->temp_path = (char*)malloc(length + sizeof(".tmp"));
+    if (!writer->path || !writer->temp_path) {
+        close_writer(writer);
+        return -1;
+    }
+    memcpy(writer->path, path, length + 1);
+    memcpy(writer->temp_path, path, length);
+    memcpy(writer->temp_path + length, ".tmp", sizeof(".tmp"));
+
+    writer->file = fopen(writer->temp_path, "wb");
+    if (!writer->file) {
+        close_writer(writer);
+        return -1;
+    }
+
+    // Placeholder until the commit knows the count and size.
+    writer->bytes = sizeof(snapshot_header_t);
+    write_header(writer);
+    if (writer->failed) {
+        cache_snapshot_abort(writer);
+        return -1;
+    }
+    return 0;
+}
+
+int cache_snapshot_write(cache_snapshot_writer_t* writer, const char* key, size_t key_len,
+    const char* data, size_t length, size_t raw_len, unsigned long long ttl_ms) {
+    snapshot_record_t record;
+    record.key_len = key_len;
+    record.data_len = length;
+    record.raw_len = raw_len;
+    record.ttl_ms = ttl_ms;
+
+    write_bytes(writer, &record, sizeof(record));
+    write_padded(writer, key, key_len);
+    write_padded(writer, data, length);
+    writer->count++;
+    return writer->failed ? -1 : 0;
+}
+
+int cache_snapshot_commit(cache_snapshot_writer_t* writer) {
+    if (!writer->failed && fseek(writer->file, 0, SEEK_SET) == 0)
+        write_header(writer);
+    else
+        writer->failed = 1;
+
+    if (fclose(writer->file) != 0)
+        writer->failed = 1;
+
+    int result = -1;
+    if (!writer->failed && replace_file(writer->temp_path, writer->path) == 0)
+        result = 0;
+    else
+        remove(writer->temp_path);
+
+    close_writer(writer);
+    return result;
+}
+
+int cache_snapshot_read(const char* path, cache_snapshot_entry_fn entry, void* context) {
+    size_t size = 0;
+    char* base = map_file(path, &size);
+    if (!base)
+        return -1;
+
+    snapshot_mapping_t* mapping = (snapshot_mapping_t*)malloc(sizeof(snapshot_mapping_t));
+    if (!mapping || validate_snapshot(base, size) != 0) {
+        free(mapping);
+        unmap_file(base, size);
+        return -1;
+    }
+
+    // One reference per record, plus one for this call so early releases cannot unmap it.
+    const snapshot_header_t* header = (const snapshot_header_t*)base;
+    mapping->base = base;
+    mapping->size = size;
+    mapping->refs = (size_t)header->count + 1;
+    mappings_lock();
+    mapping->next = g_mappings;
+    g_mappings = mapping;
+    mappings_unlock();
+
+    size_t offset = sizeof(snapshot_header_t);
+    for (unsigned long long i = 0; i < header->count; i++) {
+        const snapshot_record_t* record = (const snapshot_record_t*)(base + offset);
+        char* key = base + offset + sizeof(snapshot_record_t);
+        char* data = key + record->key_len + padding(record->key_len);
+        offset = (size_t)(data - base) + (size_t)record->data_len + padding(record->data_len);
+
+        entry(context, key, (size_t)record->key_len, data, (size_t)record->data_len,
+            (size_t)record->raw_len, release_snapshot_payload, record->ttl_ms);
+    }
+
+    release_snapshot_payload(base);
+    return 0;
+}
@@ -0,0 +1,65 @@
+// cache_snapshot.h
+
+#pragma once
+
+#include <stddef.h> // For size_t
+#include <stdio.h>  // For FILE
+
+#include "proxy_cache.h" // For cache_free_fn
+
+// Identifies a snapshot file; the version changes with any layout change.
+#define CACHE_SNAPSHOT_MAGIC "PXCSNAP1"
+#define CACHE_SNAPSHOT_VERSION 2
+
+// Streams elements into a new snapshot file. The file only replaces 'path' on commit,
+// so a crash mid-write, or a reader still mapping the previous snapshot, never sees a torn file.
+typedef struct cache_snapshot_writer {
+    FILE* file;
+    char* temp_path;            // Where the file is written until the commit renames it.
+    char* path;
+    unsigned long long count;   // Records written.
+    unsigned long long bytes;   // File size so far.
+    int failed;                 // Non-zero once a write has failed.
+} cache_snapshot_writer_t;
+
+// Called for each record of a snapshot being read. 'data' points into the read-only
+// mapping and must be adopted with 'data_free' (which also releases it on failure).
+// 'raw_len' is the decoded size of an LZ4-encoded payload, or 0.
+typedef void (*cache_snapshot_entry_fn)(void* context, const char* key, size_t key_len,
+    char* data, size_t length, size_t raw_len, cache_free_fn data_free, unsigned long long ttl_ms);
+
+/**
+ * @brief Starts a snapshot that will replace 'path'.
+ * @return 0 on success, -1 if the temporary file could not be created.
+ */
+int cache_snapshot_open(cache_snapshot_writer_t* writer, const char* path);
+
+/**
+ * @brief Appends one element.
+ * @param raw_len Decoded size if 'data' is LZ4-encoded, or 0.
+ * @param ttl_ms Milliseconds the element has left to live, or 0 for never.
+ * @return 0 on success, -1 on a write error (the commit will then fail too).
+ */
+int cache_snapshot_write(cache_snapshot_writer_t* writer, const char* key, size_t key_len,
+    const char* data, size_t length, size_t raw_len, unsigned long long ttl_ms);
+
+/**
+ * @brief Finishes the file and atomically renames it over the target path.
+ * @details The writer is closed either way.
+ * @return 0 on success, -1 if any write, the flush or the rename failed.
+ */
+int cache_snapshot_commit(cache_snapshot_writer_t* writer);
+
+/**
+ * @brief Discards an unfinished snapshot, leaving the target path untouched.
+ */
+void cache_snapshot_abort(cache_snapshot_writer_t* writer);
+
+/**
+ * @brief Maps a snapshot read-only and hands each record to 'entry', in file order.
+ * @details Payloads are not copied: the mapping stays in place until the last
+ * adopted payload is released, so loading costs page faults rather than memcpy.
+ * The whole file is validated before the first record is delivered.
+ * @return 0 on success, -1 if the file is missing, truncated or not a snapshot.
+ */
+int cache_snapshot_read(const char* path, cache_snapshot_entry_fn entry, void* context);
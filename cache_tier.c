@@ -0,0 +1,511 @@
+/**
+ * @file cache_tier.c
+ * @brief Disk-backed second-level store for objects evicted from RAM.
+ *
+ * The file is used as a circular log. Records are appended at the head; when
+ * the head wraps around, records it overwrites simply leave the index, oldest
+ * first, so there is no compaction and every write is sequential. A record is
+ *
+ *     hash u64 | key length u64 | data length u64 | key | data
+ *
+ * The index maps key hashes to records and holds no key bytes: a read checks
+ * the key stored in the record instead.
+ *
+ * Evictions only append an entry to the write queue, under the shard lock, and
+ * a single writer thread does the I/O. Lookups that miss in RAM read the log
+ * with positional reads and no lock held, and re-check afterwards that the head
+ * has not lapped the record in the meantime.
+ */
+
+#include "cache_tier.h"
+#include "cache_lock.h"
+#include "cache_platform.h"
+#include "hashmap.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+    #include <Windows.h> // For CreateFile and CreateThread
+#else
+    #include <fcntl.h>   // For open
+    #include <pthread.h> // For the writer thread
+    #include <unistd.h>  // For pread, pwrite and unlink
+#endif
+
+/*=============================================================================
+ * 1. Type Definitions
+ *===========================================================================*/
+
+typedef struct tier_record {
+    unsigned long long hash;
+    unsigned long long key_len;
+    unsigned long long data_len;
+} tier_record_t;
+
+  /**
+   * @brief One object the tier holds. It is queued until the writer has written it,
+   * then linked into the log list in write order.
+   */
+typedef struct tier_entry {
+    unsigned long long hash;
+    unsigned long long position;  // Absolute log position of the record (offset = position % capacity).
+    size_t key_len;
+    size_t data_len;
+    size_t raw_len;               // Decoded size of an LZ4-encoded payload (0: stored as given).
+    unsigned long long expires_at; // Same clock as cache_element::expires_at (0: never).
+    cache_element* pending;       // The element while queued; NULL once on disk.
+    int cancelled;                // Queued but superseded: the writer discards it.
+    struct tier_entry* next;      // Queue order while queued, then newer record in the log.
+    struct tier_entry* prev;      // Older record in the log.
+} tier_entry_t;
+
+struct cache_tier {
+    #ifdef _WIN32
+        HANDLE file;
+        HANDLE thread;
+    #else
+        int fd;
+        pthread_t thread;
+    #endif
+    cache_mutex_t lock;
+    cache_cond_t wake;
+    cache_tier_release_fn release;
+    unsigned long long capacity;
+    unsigned long long head;      // Absolute log position of the next record.
+    map_t* index;                 // Hash -> live entry, queued or written.
+    tier_entry_t* queue_head;     // Oldest entry waiting for the writer.
+    tier_entry_t* queue_tail;
+    size_t queued_bytes;
+    tier_entry_t* oldest;         // Written records, oldest first.
+    tier_entry_t* newest;
+    int stopping;
+    cache_tier_stats_t stats;
+};
+
+/*=============================================================================
+ * 2. Static Helper Functions
+ *===========================================================================*/
+
+static int write_at(cache_tier_t* tier, const void* data, size_t length, unsigned long long offset) {
+#ifdef _WIN32
+    OVERLAPPED at;
+    memset(&at, 0, sizeof(at));
+    at.Offset = (DWORD)offset;
+    at.OffsetHigh = (DWORD)(offset >> 32);
+    DWORD done = 0;
+    return WriteFile(tier->file, data, (DWORD)length, &done, &at) && done == length ? 0 : -1;
+#else
+    const char* bytes = (const char*)data;
+    while (length > 0) {
+        ssize_t done = pwrite(tier->fd, bytes, length, (off_t)offset);
+        if (done <= 0)
+            return -1;
+        bytes += done;
+        length -= (size_t)done;
+        offset += (unsigned long long)done;
+    }
+    return 0;
+#endif
+}
+
+static int read_at(cache_tier_t* tier, void* data, size_t length, unsigned long long offset) {
+#ifdef _WIN32
+    OVERLAPPED at;
+    memset(&at, 0, sizeof(at));
+    at.Offset = (DWORD)offset;
+    at.OffsetHigh = (DWORD)(offset >> 32);
+    DWORD done = 0;
+    return ReadFile(tier->file, data, (DWORD)length, &done, &at) && done == length ? 0 : -1;
+#else
+    char* bytes = (char*)data;
+    while (length > 0) {
+        ssize_t done = pread(tier->fd, bytes, length, (off_t)offset);
+        if (done <= 0)
+            return -1;
+        bytes += done;
+        length -= (size_t)done;
+        offset += (unsigned long long)done;
+    }
+    return 0;
+#endif
+}
+
+static unsigned long long entry_hash(const void* key) {
+    return ((const tier_entry_t*)key)->hash;
+}
+
+static int entry_compare(const void* key1, const void* key2) {
+    return ((const tier_entry_t*)key1)->hash == ((const tier_entry_t*)key2)->hash ? 0 : 1;
+}
+
+static unsigned long long record_size(size_t key_len, size_t data_len) {
+    return sizeof(tier_record_t) + (unsigned long long)key_len + data_len;
+}
+
+static void log_unlink(cache_tier_t* tier, tier_entry_t* entry) {
+    if (entry->prev)
+        entry->prev->next = entry->next;
+    else
+        tier->oldest = entry->next;
+    if (entry->next)
+        entry->next->prev = entry->prev;
+    else
+        tier->newest = entry->prev;
+}
+
+static void log_push(cache_tier_t* tier, tier_entry_t* entry) {
+    entry->next = NULL;
+    entry->prev = tier->newest;
+    if (tier->newest)
+        tier->newest->next = entry;
+    else
+        tier->oldest = entry;
+    tier->newest = entry;
+}
+
+/**
+ * @brief Takes an entry out of the index. A queued entry stays in the queue, cancelled.
+ */
+static void forget_entry_locked(cache_tier_t* tier, tier_entry_t* entry) {
+    map_erase_entry(tier->index, entry, entry->hash);
+    tier->stats.entries--;
+    if (entry->pending) {
+        entry->cancelled = 1;
+        return;
+    }
+    log_unlink(tier, entry);
+    free(entry);
+}
+
+static tier_entry_t* find_entry_locked(cache_tier_t* tier, unsigned long long hash) {
+    tier_entry_t probe;
+    probe.hash = hash;
+    return (tier_entry_t*)map_find_prehashed(tier->index, &probe, hash);
+}
+
+/**
+ * @brief Claims log space for a record, dropping the records the claim overwrites.
+ * @details A record never straddles the end of the file: if it does not fit before
+ * the end, the head skips to the start of the next lap.
+ * @return The record's absolute position.
+ */
+static unsigned long long reserve_locked(cache_tier_t* tier, unsigned long long size) {
+    unsigned long long offset = tier->head % tier->capacity;
+    if (offset + size > tier->capacity)
+        tier->head += tier->capacity - offset;
+
+    unsigned long long position = tier->head;
+    tier->head += size;
+    while (tier->oldest && tier->oldest->position + tier->capacity < tier->head)
+        forget_entry_locked(tier, tier->oldest);
+    return position;
+}
+
+/**
+ * @brief Returns non-zero if the record at 'position' may have been overwritten.
+ */
+static int lapped_locked(const cache_tier_t* tier, unsigned long long position) {
+    return position + tier->capacity < tier->head;
+}
+
+/**
+ * @brief Writes one queued entry and moves it to the log, unless it was cancelled meanwhile.
+ */
+static void write_entry(cache_tier_t* tier, tier_entry_t* entry) {
+    cache_element* element = entry->pending;
+    unsigned long long size = record_size(entry->key_len, entry->data_len);
+
+    cache_mutex_lock(&tier->lock);
+    int cancelled = entry->cancelled;
+    unsigned long long position = cancelled ? 0 : reserve_locked(tier, size);
+    cache_mutex_unlock(&tier->lock);
+
+    int failed = 0;
+    if (!cancelled) {
+        tier_record_t record;
+        record.hash = entry->hash;
+        record.key_len = entry->key_len;
+        record.data_len = entry->data_len;
+        unsigned long long offset = position % tier->capacity;
+        failed = write_at(tier, &record, sizeof(record), offset) != 0
+            || write_at(tier, element->url, entry->key_len, offset + sizeof(record)) != 0
+            || write_at(tier, element->data, entry->data_len, offset + sizeof(record) + entry->key_len) != 0;
+    }
+
+    cache_mutex_lock(&tier->lock);
+    tier->queued_bytes -= entry->data_len;
+    entry->pending = NULL;
+    if (entry->cancelled) {
+        free(entry);
+    }
+    else if (failed) {
+        entry->pending = element; // Still indexed: forget it like any other entry.
+        forget_entry_locked(tier, entry);
+        free(entry);
+    }
+    else {
+        entry->position = position;
+        log_push(tier, entry);
+        tier->stats.writes++;
+    }
+    cache_mutex_unlock(&tier->lock);
+
+    tier->release(element);
+}
+
+#ifdef _WIN32
+static DWORD WINAPI writer_main(LPVOID argument) {
+#else
+static void* writer_main(void* argument) {
+#endif
+    cache_tier_t* tier = (cache_tier_t*)argument;
+
+    cache_mutex_lock(&tier->lock);
+    for (;;) {
+        while (!tier->queue_head && !tier->stopping)
+            cache_cond_wait(&tier->wake, &tier->lock);
+        if (tier->stopping)
+            break;
+
+        tier_entry_t* entry = tier->queue_head;
+        tier->queue_head = entry->next;
+        if (!tier->queue_head)
+            tier->queue_tail = NULL;
+        cache_mutex_unlock(&tier->lock);
+
+        write_entry(tier, entry);
+        cache_mutex_lock(&tier->lock);
+    }
+    cache_mutex_unlock(&tier->lock);
+    return 0;
+}
+
+static void close_file(cache_tier_t* tier) {
+    #ifdef _WIN32
+        CloseHandle(tier->file); // FILE_FLAG_DELETE_ON_CLOSE removes it.
+    #else
+        close(tier->fd);
+    #endif
+}
+
+/*=============================================================================
+ * 3. Public API Functions
+ *===========================================================================*/
+
+cache_tier_t* cache_tier_create(const char* path, size_t capacity, cache_tier_release_fn release) {
+    if (!path || capacity <= sizeof(tier_record_t) || !release)
+        return NULL;
+
+    cache_tier_t* tier = (cache_tier_t*)calloc(1, sizeof(cache_tier_t));
+    if (!tier)
+        return NULL;
+    tier->capacity = capacity;
+    tier->release = release;
+    tier->index = map_create_hash64(0, 0.0f, entry_hash, entry_compare, NULL, NULL);
+    if (!tier->index) {
+        free(tier);
+        return NULL;
+    }
+
+#ifdef _WIN32
+    tier->file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+        FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, NULL);
+    if (tier->file == INVALID_HANDLE_VALUE) {
+        map_destroy(tier->index);
+        free(tier);
+        return NULL;
+    }
+    cache_mutex_init(&tier->lock);
+    cache_cond_init(&tier->wake);
+    tier->thread = CreateThread(NULL, 0, writer_main, tier, 0, NULL);
+    if (!tier->thread) {
+        cache_mutex_destroy(&tier->lock);
+        cache_cond_destroy(&tier->wake);
+        close_file(tier);
+        map_destroy(tier->index);
+        free(tier);
+        return NULL;
+    }
+#else
+    tier->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (tier->fd < 0) {
+        map_destroy(tier->index);
+        free(tier);
+        return NULL;
+    }
+    unlink(path); // The open descriptor keeps the file; nothing is left behind on exit.
+    cache_mutex_init(&tier->lock);
+    cache_cond_init(&tier->wake);
+    if (pthread_create(&tier->thread, NULL, writer_main, tier) != 0) {
+        cache_mutex_destroy(&tier->lock);
+        cache_cond_destroy(&tier->wake);
+        close_file(tier);
+        map_destroy(tier->index);
+        free(tier);
+        return NULL;
+    }
+#endif
+    return tier;
+}
+
+void cache_tier_destroy(cache_tier_t* tier) {
+    if (!tier)
+        return;
+
+    cache_mutex_lock(&tier->lock);
+    tier->stopping = 1;
+    cache_cond_signal(&tier->wake);
+    cache_mutex_unlock(&tier->lock);
+    #ifdef _WIN32
+        WaitForSingleObject(tier->thread, INFINITE);
+        CloseHandle(tier->thread);
+    #else
+        pthread_join(tier->thread, NULL);
+    #endif
+    cache_mutex_destroy(&tier->lock);
+    cache_cond_destroy(&tier->wake);
+
+    // Whatever is still queued is dropped, not written.
+    while (tier->queue_head) {
+        tier_entry_t* entry = tier->queue_head;
+        tier->queue_head = entry->next;
+        tier->release(entry->pending);
+        free(entry);
+    }
+    while (tier->oldest) {
+        tier_entry_t* entry = tier->oldest;
+        tier->oldest = entry->next;
+        free(entry);
+    }
+    map_destroy(tier->index);
+    close_file(tier);
+    free(tier);
+}
+
+int cache_tier_spill(cache_tier_t* tier, cache_element* element) {
+    if (record_size(element->url_len, element->len) > tier->capacity)
+        return -1;
+
+    tier_entry_t* entry = (tier_entry_t*)calloc(1, sizeof(tier_entry_t));
+    if (!entry)
+        return -1;
+    entry->hash = element->key_hash;
+    entry->key_len = element->url_len;
+    entry->data_len = element->len;
+    entry->raw_len = element->encoding == CACHE_ENCODING_IDENTITY ? 0 : element->raw_len;
+    entry->expires_at = element->expires_at;
+    entry->pending = element;
+
+    cache_mutex_lock(&tier->lock);
+    if (tier->queued_bytes + element->len > CACHE_TIER_QUEUE_BYTES) {
+        tier->stats.dropped++;
+        cache_mutex_unlock(&tier->lock);
+        free(entry);
+        return -1;
+    }
+
+    tier_entry_t* previous = find_entry_locked(tier, entry->hash);
+    if (previous)
+        forget_entry_locked(tier, previous);
+    if (map_insert_prehashed(tier->index, entry, entry, entry->hash) != 0) {
+        cache_mutex_unlock(&tier->lock);
+        free(entry);
+        return -1;
+    }
+    tier->stats.entries++;
+
+    cache_atomic_fetch_add_int(&element->refcount, 1);
+    tier->queued_bytes += entry->data_len;
+    if (tier->queue_tail)
+        tier->queue_tail->next = entry;
+    else
+        tier->queue_head = entry;
+    tier->queue_tail = entry;
+    cache_cond_signal(&tier->wake);
+    cache_mutex_unlock(&tier->lock);
+    return 0;
+}
+
+void cache_tier_invalidate(cache_tier_t* tier, unsigned long long hash) {
+    cache_mutex_lock(&tier->lock);
+    tier_entry_t* entry = find_entry_locked(tier, hash);
+    if (entry)
+        forget_entry_locked(tier, entry);
+    cache_mutex_unlock(&tier->lock);
+}
+
+int cache_tier_take(cache_tier_t* tier, const char* key, size_t key_len, unsigned long long hash,
+    unsigned long long now, char** buffer, size_t* length, size_t* raw_len, unsigned long long* ttl_ms) {
+    cache_mutex_lock(&tier->lock);
+    tier_entry_t* entry = find_entry_locked(tier, hash);
+    if (!entry || entry->key_len != key_len || (entry->expires_at && now >= entry->expires_at)) {
+        // An expired copy is of no further use; a different key with the same hash stays.
+        if (entry && entry->key_len == key_len)
+            forget_entry_locked(tier, entry);
+        cache_mutex_unlock(&tier->lock);
+        return -1;
+    }
+
+    size_t data_len = entry->data_len;
+    *raw_len = entry->raw_len;
+    unsigned long long position = entry->position;
+    *ttl_ms = entry->expires_at ? entry->expires_at - now : 0;
+    char* data = (char*)malloc(data_len);
+
+    // Still queued: the element is pinned by the queue and its bytes never change.
+    if (entry->pending) {
+        int match = data && memcmp(entry->pending->url, key, key_len) == 0;
+        if (match) {
+            memcpy(data, entry->pending->data, data_len);
+            forget_entry_locked(tier, entry);
+            tier->stats.hits++;
+        }
+        cache_mutex_unlock(&tier->lock);
+        if (!match) {
+            free(data);
+            return -1;
+        }
+        *buffer = data;
+        *length = data_len;
+        return 0;
+    }
+
+    // On disk: the copy moves to RAM, so its log space is left to be overwritten.
+    forget_entry_locked(tier, entry);
+    cache_mutex_unlock(&tier->lock);
+
+    size_t size = (size_t)record_size(key_len, 0);
+    char* header = (char*)malloc(size);
+    int ok = data && header
+        && read_at(tier, header, size, position % tier->capacity) == 0
+        && read_at(tier, data, data_len, position % tier->capacity + size) == 0;
+    if (ok) {
+        tier_record_t record;
+        memcpy(&record, header, sizeof(record));
+        ok = record.hash == hash && record.key_len == key_len && record.data_len == data_len
+            && memcmp(header + sizeof(record), key, key_len) == 0;
+    }
+    free(header);
+
+    cache_mutex_lock(&tier->lock);
+    if (ok && lapped_locked(tier, position))
+        ok = 0; // The writer reused the space while we were reading.
+    if (ok)
+        tier->stats.hits++;
+    cache_mutex_unlock(&tier->lock);
+
+    if (!ok) {
+        free(data);
+        return -1;
+    }
+    *buffer = data;
+    *length = data_len;
+    return 0;
+}
+
+void cache_tier_get_stats(cache_tier_t* tier, cache_tier_stats_t* stats) {
+    cache_mutex_lock(&tier->lock);
+    *stats = tier->stats;
+    cache_mutex_unlock(&tier->lock);
+}
@@ -0,0 +1,71 @@
+// cache_tier.h
+
+#pragma once
+
+#include <stddef.h> // For size_t
+
+#include "proxy_cache.h" // For cache_element
+
+// Evicted bytes allowed to wait for the writer thread. Spills beyond this are dropped,
+// so a slow disk bounds the extra memory instead of stalling evictions.
+#define CACHE_TIER_QUEUE_BYTES (8u << 20)
+
+typedef struct cache_tier cache_tier_t;
+
+// Drops the reference the tier took on a spilled element.
+typedef void (*cache_tier_release_fn)(cache_element* element);
+
+// Counters reported by cache_tier_get_stats().
+typedef struct cache_tier_stats {
+    size_t writes;   // Records written to the log.
+    size_t hits;     // Lookups served from the tier.
+    size_t dropped;  // Spills refused because the write queue was full.
+    size_t entries;  // Objects currently held (queued or on disk).
+} cache_tier_stats_t;
+
+/**
+ * @brief Opens a log-structured second-level store of 'capacity' bytes in a scratch file.
+ * @details The file is truncated and removed when the tier is destroyed (on POSIX it is
+ * unlinked right away), so its contents never outlive the process. A background thread
+ * writes spilled elements; the index of what the log holds lives in memory.
+ * @param release Called (from any thread) to drop the reference taken by cache_tier_spill().
+ * @return The tier, or NULL if the file or thread could not be created.
+ */
+cache_tier_t* cache_tier_create(const char* path, size_t capacity, cache_tier_release_fn release);
+
+/**
+ * @brief Stops the writer, drops every queued element and closes the file.
+ */
+void cache_tier_destroy(cache_tier_t* tier);
+
+/**
+ * @brief Queues an element that is leaving RAM to be written to the log.
+ * @details Takes a reference on the element, which the writer drops once the record
+ * is on disk. Never blocks on I/O, so it is safe under a shard lock. Any older copy
+ * of the same key is replaced.
+ * @return 0 if queued, -1 if the queue is full or the element cannot fit the log.
+ */
+int cache_tier_spill(cache_tier_t* tier, cache_element* element);
+
+/**
+ * @brief Forgets any copy of the key with hash 'hash', because a newer version was written.
+ */
+void cache_tier_invalidate(cache_tier_t* tier, unsigned long long hash);
+
+/**
+ * @brief Moves an object out of the tier, for promotion back to RAM.
+ * @details Serves from the write queue if the record is not written yet, otherwise
+ * reads it from the log. The caller must not hold a shard lock: the read is synchronous.
+ * @param now The current time in the element clock (milliseconds).
+ * @param buffer Receives a malloc'd copy of the payload, in the encoding it was spilled with.
+ * @param raw_len Receives its decoded size if it is LZ4-encoded, or 0.
+ * @param ttl_ms Receives the remaining lifetime, or 0 if the object never expires.
+ * @return 0 on a hit, -1 if the tier has no live copy of the key.
+ */
+int cache_tier_take(cache_tier_t* tier, const char* key, size_t key_len, unsigned long long hash,
+    unsigned long long now, char** buffer, size_t* length, size_t* raw_len, unsigned long long* ttl_ms);
+
+/**
+ * @brief Reports the tier's counters.
+ */
+void cache_tier_get_stats(cache_tier_t* tier, cache_tier_stats_t* stats);
@@ -0,0 +1,178 @@
+/**
+ * @file cache_timer.c
+ * @brief Hierarchical timing wheel for element expiry.
+ *
+ * Level 0 has one slot per tick for the current block of 64 ticks; level L has
+ * one slot per 64^L ticks of the current 64^(L+1)-tick block. A timer is filed
+ * at the lowest level whose block it shares with the clock, so every slot at or
+ * above level 1 only holds timers that are not due before the slot's block
+ * starts. When the clock reaches the start of such a block the slot is emptied
+ * and its timers re-filed one level lower ("cascaded"). Filing and cancelling
+ * are O(1) and a timer cascades at most once per level.
+ *
+ * Advancing does not step through every tick: per-level occupancy bitmaps give
+ * the next tick at which anything can happen, so an idle stretch costs at most
+ * one step per level.
+ */
+
+#include "cache_timer.h"
+
+#include <string.h>
+
+#if defined(_MSC_VER)
+    #include <intrin.h> // For _BitScanForward64
+#endif
+
+/*=============================================================================
+ * 1. Static Helper Functions
+ *===========================================================================*/
+
+#define SLOT_MASK ((unsigned long long)(CACHE_TIMER_SLOTS - 1))
+
+static int lowest_bit(unsigned long long value) {
+#if defined(_MSC_VER) && defined(_WIN64)
+    unsigned long index;
+    _BitScanForward64(&index, value);
+    return (int)index;
+#elif defined(_MSC_VER)
+    int index = 0;
+    while (!(value & 1)) {
+        value >>= 1;
+        index++;
+    }
+    return index;
+#else
+    return __builtin_ctzll(value);
+#endif
+}
+
+static size_t slot_index(unsigned long long tick, int level) {
+    return (size_t)((tick >> (CACHE_TIMER_SLOT_BITS * level)) & SLOT_MASK);
+}
+
+static void slot_push(cache_timer_wheel_t* wheel, int level, size_t slot, cache_element* element) {
+    cache_element** head = &wheel->slots[level][slot];
+    element->timer_next = *head;
+    if (*head)
+        (*head)->timer_pprev = &element->timer_next;
+    element->timer_pprev = head;
+    *head = element;
+    wheel->occupied[level] |= 1ull << slot;
+}
+
+static void unlink_timer(cache_element* element) {
+    *element->timer_pprev = element->timer_next;
+    if (element->timer_next)
+        element->timer_next->timer_pprev = element->timer_pprev;
+    element->timer_next = NULL;
+    element->timer_pprev = NULL;
+}
+
+/**
+ * @brief Puts a timer in the lowest level whose current block also holds its due tick.
+ */
+static void file_timer(cache_timer_wheel_t* wheel, cache_element* element) {
+    unsigned long long due = element->expires_at < wheel->now ? wheel->now : element->expires_at;
+    int level = 0;
+    while (level < CACHE_TIMER_LEVELS - 1
+        && (due >> (CACHE_TIMER_SLOT_BITS * (level + 1))) != (wheel->now >> (CACHE_TIMER_SLOT_BITS * (level + 1))))
+        level++;
+    slot_push(wheel, level, slot_index(due, level), element);
+}
+
+/**
+ * @brief Re-files the timers of every slot whose block starts at 'tick'.
+ * @details Each lands at a lower level; those due within the first 64 ticks go
+ * straight to level 0, where the caller fires them.
+ */
+static void cascade(cache_timer_wheel_t* wheel, unsigned long long tick) {
+    int top = 1;
+    while (top < CACHE_TIMER_LEVELS - 1 && slot_index(tick, top) == 0)
+        top++;
+
+    for (int level = top; level >= 1; level--) {
+        size_t slot = slot_index(tick, level);
+        cache_element* element = wheel->slots[level][slot];
+        wheel->slots[level][slot] = NULL;
+        wheel->occupied[level] &= ~(1ull << slot);
+
+        while (element) {
+            cache_element* next = element->timer_next;
+            file_timer(wheel, element);
+            element = next;
+        }
+    }
+}
+
+/**
+ * @brief Returns the first tick after 'tick' at which a slot may fire or cascade.
+ */
+static unsigned long long next_event(const cache_timer_wheel_t* wheel, unsigned long long tick) {
+    for (int level = 0; level < CACHE_TIMER_LEVELS; level++) {
+        int shift = CACHE_TIMER_SLOT_BITS * level;
+        size_t index = slot_index(tick, level);
+        unsigned long long later = index == SLOT_MASK ? 0 : wheel->occupied[level] & (~0ull << (index + 1));
+        if (later) {
+            unsigned long long block = (tick >> (shift + CACHE_TIMER_SLOT_BITS)) << (shift + CACHE_TIMER_SLOT_BITS);
+            return block + ((unsigned long long)lowest_bit(later) << shift);
+        }
+    }
+    // Only timers parked in an earlier top-level slot remain: resume at the next top-level cycle.
+    int span = CACHE_TIMER_SLOT_BITS * CACHE_TIMER_LEVELS;
+    return ((tick >> span) + 1) << span;
+}
+
+/*=============================================================================
+ * 2. Public API Functions
+ *===========================================================================*/
+
+void cache_timer_init(cache_timer_wheel_t* wheel, unsigned long long now) {
+    memset(wheel, 0, sizeof(*wheel));
+    wheel->now = now;
+}
+
+void cache_timer_schedule(cache_timer_wheel_t* wheel, cache_element* element) {
+    file_timer(wheel, element);
+    wheel->count++;
+}
+
+void cache_timer_cancel(cache_timer_wheel_t* wheel, cache_element* element) {
+    if (!element->timer_pprev)
+        return;
+    // The slot's occupancy bit may now be stale; advancing clears it.
+    unlink_timer(element);
+    wheel->count--;
+}
+
+size_t cache_timer_advance(cache_timer_wheel_t* wheel, unsigned long long now, size_t max_expired,
+    cache_timer_expire_fn expire, void* context) {
+    size_t expired = 0;
+
+    while (wheel->now <= now) {
+        if (wheel->count == 0) {
+            wheel->now = now + 1;
+            break;
+        }
+
+        unsigned long long tick = wheel->now;
+        size_t slot = slot_index(tick, 0);
+        if (slot == 0)
+            cascade(wheel, tick); // Repeating this after an early return finds nothing new.
+
+        cache_element** head = &wheel->slots[0][slot];
+        while (*head) {
+            if (expired == max_expired)
+                return expired; // Resume at this tick next time.
+            cache_element* element = *head;
+            unlink_timer(element);
+            wheel->count--;
+            expired++;
+            expire(context, element);
+        }
+        wheel->occupied[0] &= ~(1ull << slot);
+
+        unsigned long long next = next_event(wheel, tick);
+        wheel->now = next <= now ? next : now + 1;
+    }
+    return expired;
+}
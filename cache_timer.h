@@ -0,0 +1,55 @@
+// cache_timer.h
+
+#pragma once
+
+#include <stddef.h> // For size_t
+
+#include "proxy_cache.h" // For cache_element
+
+// Each level of the wheel has 2^CACHE_TIMER_SLOT_BITS slots, one tick per level-0 slot.
+#define CACHE_TIMER_SLOT_BITS 6
+#define CACHE_TIMER_SLOTS (1 << CACHE_TIMER_SLOT_BITS)
+
+// Six levels of 64 slots span 2^36 ticks (about two years of milliseconds).
+// Timers further out park in the top level and are re-filed as time passes.
+#define CACHE_TIMER_LEVELS 6
+
+// Hierarchical timing wheel over cache elements, linked through their timer_next/timer_pprev.
+// Level L slot S holds the timers due in the S-th 64^L-tick block of the current 64^(L+1)-tick
+// block, so filing and cancelling are O(1) and each timer is moved at most once per level.
+// Not thread-safe: a shard uses it under its exclusive lock.
+typedef struct cache_timer_wheel {
+    cache_element* slots[CACHE_TIMER_LEVELS][CACHE_TIMER_SLOTS];
+    unsigned long long occupied[CACHE_TIMER_LEVELS]; // Bit S set if slot S may be non-empty.
+    unsigned long long now;  // First tick not yet processed.
+    size_t count;            // Timers filed.
+} cache_timer_wheel_t;
+
+// Called for each expired element, already unlinked from the wheel.
+typedef void (*cache_timer_expire_fn)(void* context, cache_element* element);
+
+/**
+ * @brief Sets up an empty wheel whose clock starts at tick 'now'.
+ */
+void cache_timer_init(cache_timer_wheel_t* wheel, unsigned long long now);
+
+/**
+ * @brief Files an element under its 'expires_at' tick. Elements already due fire on the next advance.
+ * @details The element must not be filed already.
+ */
+void cache_timer_schedule(cache_timer_wheel_t* wheel, cache_element* element);
+
+/**
+ * @brief Removes an element from the wheel. Does nothing if it is not filed.
+ */
+void cache_timer_cancel(cache_timer_wheel_t* wheel, cache_element* element);
+
+/**
+ * @brief Moves the wheel's clock forward to 'now', expiring every timer due by then.
+ * @details Empty stretches of the wheel are skipped a slot block at a time. At most
+ * 'max_expired' elements are handed to 'expire'; the clock stops where that limit was
+ * reached so the next call picks up the rest.
+ * @return The number of elements expired.
+ */
+size_t cache_timer_advance(cache_timer_wheel_t* wheel, unsigned long long now, size_t max_expired,
+    cache_timer_expire_fn expire, void* context);
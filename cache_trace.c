@@ -0,0 +1,284 @@
+/**
+ * @file cache_trace.c
+ * @brief Sampled access traces and a SHARDS miss-ratio-curve estimator.
+ *
+ * The ring is an array of slots with one shared write position. A writer claims
+ * a position with a fetch-and-add, then bumps the slot's sequence number before
+ * and after filling it, so a slot's sequence is twice the number of completed
+ * writes and odd while one is in progress. A reader knows which lap position P
+ * belongs to and accepts the slot only if the sequence reads 2 * (P / capacity + 1)
+ * both before and after copying it.
+ *
+ * A trace file is a 32-byte header followed by the records as they are in memory:
+ *
+ *     header:  magic[8] | version u32 | byte order u32 | sample u32 | record size u32 | count u64
+ *     record:  hash u64 | size u32 | op u8 | hit u8 | reserved u16
+ *
+ * As with snapshots, integers are in the writer's native byte order.
+ */
+
+#include "cache_trace.h"
+
+#include "cache_platform.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*=============================================================================
+ * 1. Ring
+ *===========================================================================*/
+
+#define TRACE_BYTE_ORDER 0x01020304u
+
+typedef struct trace_slot {
+    volatile size_t seq;          // Two per completed write; odd while one is in progress.
+    cache_trace_record_t record;
+} trace_slot_t;
+
+struct cache_trace {
+    volatile size_t head;         // Next position to claim. Alone on its line: every writer bumps it.
+    char pad[CACHE_LINE_SIZE - sizeof(size_t)];
+    trace_slot_t* slots;
+    size_t mask;                  // Capacity minus one; the capacity is a power of two.
+    unsigned int sample;
+};
+
+cache_trace_t* cache_trace_create(unsigned int sample, size_t capacity) {
+    size_t slots = 1;
+    while (slots < capacity && slots <= ((size_t)-1 / sizeof(trace_slot_t)) / 2)
+        slots <<= 1;
+
+    cache_trace_t* trace = (cache_trace_t*)cache_aligned_calloc(sizeof(cache_trace_t));
+    if (!trace)
+        return NULL;
+    trace->slots = (trace_slot_t*)calloc(slots, sizeof(trace_slot_t));
+    if (!trace->slots) {
+        cache_aligned_free(trace);
+        return NULL;
+    }
+    trace->mask = slots - 1;
+    trace->sample = sample ? sample : 1;
+    return trace;
+}
+
+void cache_trace_destroy(cache_trace_t* trace) {
+    if (!trace)
+        return;
+    free(trace->slots);
+    cache_aligned_free(trace);
+}
+
+void cache_trace_record(cache_trace_t* trace, unsigned long long hash, size_t size, int op, int hit) {
+    size_t position = cache_atomic_fetch_add_size(&trace->head, 1);
+    trace_slot_t* slot = &trace->slots[position & trace->mask];
+
+    // The first bump is acquire-release, so the stores below cannot be seen before it.
+    cache_atomic_fetch_add_size(&slot->seq, 1);
+    slot->record.hash = hash;
+    slot->record.size = size > 0xFFFFFFFFu ? 0xFFFFFFFFu : (unsigned int)size;
+    slot->record.op = (unsigned char)op;
+    slot->record.hit = hit ? 1 : 0;
+    cache_atomic_fetch_add_size(&slot->seq, 1);
+}
+
+size_t cache_trace_collect(cache_trace_t* trace, cache_trace_record_t* records, size_t capacity) {
+    size_t slots = trace->mask + 1;
+    size_t head = cache_atomic_load_size(&trace->head);
+    size_t start = head > slots ? head - slots : 0;
+    if (head - start > capacity)
+        start = head - capacity;
+
+    size_t count = 0;
+    for (size_t position = start; position != head; position++) {
+        trace_slot_t* slot = &trace->slots[position & trace->mask];
+        size_t expected = 2 * (position / slots + 1);
+        if (cache_atomic_load_size(&slot->seq) != expected)
+            continue; // Not written yet, being written, or already overwritten.
+        cache_trace_record_t record = slot->record;
+        // A read-modify-write, so the copy above cannot be reordered after the check.
+        if (cache_atomic_fetch_add_size(&slot->seq, 0) != expected)
+            continue;
+        records[count++] = record;
+    }
+    return count;
+}
+
+size_t cache_trace_capacity(const cache_trace_t* trace) {
+    return trace->mask + 1;
+}
+
+size_t cache_trace_count(cache_trace_t* trace) {
+    return cache_atomic_load_size(&trace->head);
+}
+
+unsigned int cache_trace_sample(const cache_trace_t* trace) {
+    return trace->sample;
+}
+
+/*=============================================================================
+ * 2. Trace Files
+ *===========================================================================*/
+
+typedef struct trace_header {
+    char magic[8];
+    unsigned int version;
+    unsigned int byte_order;     // TRACE_BYTE_ORDER as written by the producer.
+    unsigned int sample;
+    unsigned int record_size;    // sizeof(cache_trace_record_t), checked on read.
+    unsigned long long count;
+} trace_header_t;
+
+int cache_trace_write(const char* path, const cache_trace_record_t* records, size_t count, unsigned int sample) {
+    FILE* file = fopen(path, "wb");
+    if (!file)
+        return -1;
+
+    trace_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CACHE_TRACE_MAGIC, sizeof(header.magic));
+    header.version = CACHE_TRACE_VERSION;
+    header.byte_order = TRACE_BYTE_ORDER;
+    header.sample = sample ? sample : 1;
+    header.record_size = (unsigned int)sizeof(cache_trace_record_t);
+    header.count = count;
+
+    int failed = fwrite(&header, sizeof(header), 1, file) != 1;
+    if (!failed && count > 0)
+        failed = fwrite(records, sizeof(cache_trace_record_t), count, file) != count;
+    if (fclose(file) != 0)
+        failed = 1;
+    return failed ? -1 : 0;
+}
+
+int cache_trace_read(const char* path, cache_trace_record_t** records, size_t* count, unsigned int* sample) {
+    FILE* file = fopen(path, "rb");
+    if (!file)
+        return -1;
+
+    trace_header_t header;
+    if (fread(&header, sizeof(header), 1, file) != 1
+        || memcmp(header.magic, CACHE_TRACE_MAGIC, sizeof(header.magic)) != 0
+        || header.version != CACHE_TRACE_VERSION || header.byte_order != TRACE_BYTE_ORDER
+        || header.record_size != sizeof(cache_trace_record_t)
+        || header.count > (size_t)-1 / sizeof(cache_trace_record_t)) {
+        fclose(file);
+        return -1;
+    }
+
+    size_t total = (size_t)header.count;
+    cache_trace_record_t* loaded = (cache_trace_record_t*)malloc(total ? total * sizeof(cache_trace_record_t) : 1);
+    if (!loaded || fread(loaded, sizeof(cache_trace_record_t), total, file) != total) {
+        free(loaded);
+        fclose(file);
+        return -1;
+    }
+    fclose(file);
+
+    *records = loaded;
+    *count = total;
+    if (sample)
+        *sample = header.sample ? header.sample : 1;
+    return 0;
+}
+
+/*=============================================================================
+ * 3. Miss-Ratio Curves
+ *===========================================================================*/
+
+#define TRACE_NONE ((size_t)-1)
+
+typedef struct trace_occurrence {
+    unsigned long long hash;
+    size_t index;
+} trace_occurrence_t;
+
+static int compare_occurrences(const void* left, const void* right) {
+    const trace_occurrence_t* a = (const trace_occurrence_t*)left;
+    const trace_occurrence_t* b = (const trace_occurrence_t*)right;
+    if (a->hash != b->hash)
+        return a->hash < b->hash ? -1 : 1;
+    return a->index < b->index ? -1 : (a->index > b->index ? 1 : 0);
+}
+
+// Fenwick tree over record positions; position P holds the size of the key last touched at P.
+static void fenwick_add(unsigned long long* tree, size_t count, size_t position, unsigned long long delta) {
+    for (size_t i = position + 1; i <= count; i += i & (0 - i))
+        tree[i - 1] += delta; // Wraps for removals, which is exact in unsigned arithmetic.
+}
+
+// Sum of positions [0, end).
+static unsigned long long fenwick_prefix(const unsigned long long* tree, size_t end) {
+    unsigned long long sum = 0;
+    for (size_t i = end; i > 0; i -= i & (0 - i))
+        sum += tree[i - 1];
+    return sum;
+}
+
+size_t cache_trace_estimate_mrc(const cache_trace_record_t* records, size_t count, unsigned int sample,
+    const size_t* budgets, size_t budget_count, double* miss_ratios) {
+    for (size_t b = 0; b < budget_count; b++)
+        miss_ratios[b] = 1.0;
+    if (count == 0 || budget_count == 0)
+        return 0;
+    if (sample == 0)
+        sample = 1;
+
+    trace_occurrence_t* order = (trace_occurrence_t*)malloc(count * sizeof(trace_occurrence_t));
+    size_t* previous = (size_t*)malloc(count * sizeof(size_t));
+    unsigned long long* sizes = (unsigned long long*)calloc(count, sizeof(unsigned long long));
+    unsigned long long* tree = (unsigned long long*)calloc(count, sizeof(unsigned long long));
+    size_t* misses = (size_t*)calloc(budget_count, sizeof(size_t));
+    size_t finds = 0;
+    if (order && previous && sizes && tree && misses) {
+        // Link each record to the previous one for the same key.
+        for (size_t i = 0; i < count; i++) {
+            order[i].hash = records[i].hash;
+            order[i].index = i;
+        }
+        qsort(order, count, sizeof(trace_occurrence_t), compare_occurrences);
+        for (size_t i = 0; i < count; i++)
+            previous[order[i].index] = i > 0 && order[i - 1].hash == order[i].hash ? order[i - 1].index : TRACE_NONE;
+
+        for (size_t i = 0; i < count; i++) {
+            size_t last = previous[i];
+            unsigned long long known = last != TRACE_NONE ? sizes[last] : 0;
+            unsigned long long size = records[i].size ? records[i].size : known;
+
+            if (records[i].op == CACHE_TRACE_FIND) {
+                finds++;
+                if (last == TRACE_NONE) {
+                    for (size_t b = 0; b < budget_count; b++)
+                        misses[b]++;
+                }
+                else {
+                    // Bytes of the other sampled keys touched since, standing for 'sample' times as many.
+                    unsigned long long distance = fenwick_prefix(tree, i) - fenwick_prefix(tree, last + 1);
+                    unsigned long long needed = distance * sample + size;
+                    for (size_t b = 0; b < budget_count; b++) {
+                        if (needed > budgets[b])
+                            misses[b]++;
+                    }
+                }
+            }
+
+            // The key moves to this position.
+            if (last != TRACE_NONE)
+                fenwick_add(tree, count, last, 0 - known);
+            sizes[i] = size;
+            fenwick_add(tree, count, i, size);
+        }
+
+        if (finds > 0) {
+            for (size_t b = 0; b < budget_count; b++)
+                miss_ratios[b] = (double)misses[b] / (double)finds;
+        }
+    }
+
+    free(order);
+    free(previous);
+    free(sizes);
+    free(tree);
+    free(misses);
+    return finds;
+}
@@ -0,0 +1,115 @@
+// cache_trace.h
+
+#pragma once
+
+#include <stddef.h> // For size_t
+
+// Identifies a trace file; the version changes with any layout change.
+#define CACHE_TRACE_MAGIC "PXCTRAC1"
+#define CACHE_TRACE_VERSION 1
+
+// Ring capacity used when the configuration leaves trace_records at 0.
+#define CACHE_TRACE_DEFAULT_RECORDS 65536
+
+// Sampling compares 24 bits of the key hash against a threshold, so rates go down to 1 in 2^24.
+#define CACHE_TRACE_SAMPLE_BITS 24
+
+// Traced operations.
+#define CACHE_TRACE_FIND 0
+#define CACHE_TRACE_ADD  1
+
+// One sampled operation, as kept in the ring and written to a trace file.
+typedef struct cache_trace_record {
+    unsigned long long hash;  // The cache's 64-bit key hash.
+    unsigned int size;        // Payload bytes: of the object found or added, 0 on a miss.
+    unsigned char op;         // CACHE_TRACE_FIND or CACHE_TRACE_ADD.
+    unsigned char hit;        // Finds: 1 on a hit. Adds: 1 if the object was stored.
+    unsigned char reserved[2];
+} cache_trace_record_t;
+
+typedef struct cache_trace cache_trace_t;
+
+/**
+ * @brief Maps a 1-in-N sampling rate to the threshold cache_trace_selects() compares against.
+ */
+static inline unsigned int cache_trace_threshold(unsigned int sample) {
+    if (sample <= 1)
+        return 1u << CACHE_TRACE_SAMPLE_BITS;
+    return ((1u << CACHE_TRACE_SAMPLE_BITS) + sample / 2) / sample;
+}
+
+/**
+ * @brief Tells whether the key with hash 'hash' is in the sample.
+ * @details The choice depends on the key alone (spatial sampling, as in SHARDS), so a
+ * sampled key has every access traced and the sample's reuse distances stay exact.
+ * Bits 16-39 are used because the low bits already pick the shard and map slot.
+ */
+static inline int cache_trace_selects(unsigned long long hash, unsigned int threshold) {
+    return ((unsigned int)(hash >> 16) & ((1u << CACHE_TRACE_SAMPLE_BITS) - 1)) < threshold;
+}
+
+/**
+ * @brief Creates a ring of 'capacity' records (rounded up to a power of two).
+ * @param sample The 1-in-N rate the caller samples at, stored with dumps and used to scale estimates.
+ * @return The ring, or NULL on allocation failure.
+ */
+cache_trace_t* cache_trace_create(unsigned int sample, size_t capacity);
+
+void cache_trace_destroy(cache_trace_t* trace);
+
+/**
+ * @brief Appends one record, overwriting the oldest once the ring is full.
+ * @details Lock-free and wait-free: one atomic claims the slot and two mark it busy and done.
+ * Safe from any number of threads, including under a shard lock.
+ */
+void cache_trace_record(cache_trace_t* trace, unsigned long long hash, size_t size, int op, int hit);
+
+/**
+ * @brief Copies the records in the ring, oldest first.
+ * @details May run while records are being added: a slot that is being written, or was
+ * overwritten during the copy, is skipped rather than returned torn.
+ * @return The number of records stored in 'records', at most 'capacity'.
+ */
+size_t cache_trace_collect(cache_trace_t* trace, cache_trace_record_t* records, size_t capacity);
+
+/**
+ * @brief Returns the ring capacity, which bounds what cache_trace_collect() can return.
+ */
+size_t cache_trace_capacity(const cache_trace_t* trace);
+
+/**
+ * @brief Returns the number of records appended since creation, overwritten ones included.
+ */
+size_t cache_trace_count(cache_trace_t* trace);
+
+/**
+ * @brief Returns the 1-in-N rate the trace was created with.
+ */
+unsigned int cache_trace_sample(const cache_trace_t* trace);
+
+/**
+ * @brief Writes records to a trace file, replacing 'path'.
+ * @return 0 on success, -1 on an I/O error.
+ */
+int cache_trace_write(const char* path, const cache_trace_record_t* records, size_t count, unsigned int sample);
+
+/**
+ * @brief Reads a trace file written by cache_trace_write().
+ * @param records Receives a malloc'd array the caller frees.
+ * @param sample Receives the rate the trace was sampled at; may be NULL.
+ * @return 0 on success, -1 if the file is missing, truncated or not a trace of this build's byte order.
+ */
+int cache_trace_read(const char* path, cache_trace_record_t** records, size_t* count, unsigned int* sample);
+
+/**
+ * @brief Estimates the miss ratio of an LRU cache of each budget from a sampled trace (SHARDS).
+ * @details Replays the records in order and measures, for every find, the bytes of distinct
+ * sampled keys touched since the key's previous access, scaled by 'sample'. A find misses
+ * under a budget when that distance plus its own size exceeds the budget, or when the key
+ * was not seen before. Adds touch keys without counting as lookups. Budgets are payload
+ * bytes; metadata is not modelled. Runs in O(records * (log records + budgets)) time.
+ * @param miss_ratios Receives one ratio in [0, 1] per budget.
+ * @return The number of finds replayed, or 0 (with every ratio left at 1) if there were none.
+ */
+size_t cache_trace_estimate_mrc(const cache_trace_record_t* records, size_t count, unsigned int sample,
+    const size_t* budgets, size_t budget_count, double* miss_ratios);
@@ -1,98 +1,696 @@
-// hashmap.h
-
-#pragma once
-
-#include <stddef.h> // For size_t
-
-// A single key-value entry stored in the map.
-typedef struct map_entry {
-    void* key;
-    void* value;
-} map_entry_t;
-
-// Linked list node for handling hash collisions.
-typedef struct map_node {
-    map_entry_t entry;
-    struct map_node* next;
-} map_node_t;
-
-// Define function pointers for custom map behavior.
-typedef unsigned int (*hash_func_t)(const void* key, size_t map_capacity);
-typedef int (*key_compare_func_t)(const void* key1, const void* key2);
-typedef void (*free_func_t)(void* data);
-
-// The main map structure.
-typedef struct map {
-    map_node_t** buckets;             // Array of pointers to map nodes (the hash table).
-    size_t capacity;                  // The current capacity of the bucket array.
-    size_t count;                     // The number of elements currently in the map.
-    float load_factor_threshold;      // Threshold to trigger a resize.
-    hash_func_t hash;                 // Hashing function for keys.
-    key_compare_func_t key_compare;   // Comparison function for keys.
-    free_func_t key_free;             // Optional function to free keys.
-    free_func_t value_free;           // Optional function to free values.
-} map_t;
+/**
+ * @file hashmap.c
+ * @brief Open-addressing hash map with grouped control bytes and incremental resize.
+ *
+ * Every slot has a one-byte control word stored in a dense array next to the
+ * slot array. A control byte is either EMPTY, DELETED, or the low 7 bits of the
+ * key's hash (the "tag"). Lookups scan a whole group of MAP_GROUP_WIDTH control
+ * bytes at once and only compare keys for slots whose tag matches, so a typical
+ * lookup reads one line of control bytes and one slot. Each slot also keeps the
+ * key's hash, which filters the remaining tag collisions before the key compare
+ * and lets a resize move entries without hashing them again.
+ *
+ * Growing the map allocates the new table immediately but moves the entries over
+ * a few groups at a time during subsequent inserts and erases, or in larger steps
+ * through map_advance_resize(). While a resize is in flight, lookups consult the
+ * new table first and then the old one.
+ */
+
+#include "hashmap.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_MSC_VER)
+    #include <intrin.h> // For _umul128 and _BitScanForward
+#endif
+
+// Group scans compare all MAP_GROUP_WIDTH control bytes in one vector operation
+// where the target has 16-byte vectors; elsewhere they fall back to a byte loop.
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #include <emmintrin.h> // For _mm_cmpeq_epi8 and _mm_movemask_epi8
+    #define MAP_GROUP_SSE2 1
+#elif defined(__aarch64__) || defined(_M_ARM64)
+    #include <arm_neon.h>  // For vceqq_u8 and vaddv_u8
+    #define MAP_GROUP_NEON 1
+#endif
+
+// Hints the CPU to start loading a cache line; a no-op where the compiler has no such hint.
+#if defined(__GNUC__) || defined(__clang__)
+    #define MAP_PREFETCH(address) __builtin_prefetch((address), 0, 3)
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    #include <xmmintrin.h> // For _mm_prefetch
+    #define MAP_PREFETCH(address) _mm_prefetch((const char*)(address), _MM_HINT_T0)
+#else
+    #define MAP_PREFETCH(address) ((void)(address))
+#endif
+
+/*=============================================================================
+ * 1. Constants
+ *===========================================================================*/
+
+#define CTRL_EMPTY   ((unsigned char)0x80) // Slot never used since the last rehash.
+#define CTRL_DELETED ((unsigned char)0xFE) // Slot erased; probes must continue past it.
+#define CTRL_TAG_MASK ((1u << MAP_TAG_BITS) - 1)
+
+#define MAP_DEFAULT_CAPACITY    64
+#define MAP_DEFAULT_LOAD_FACTOR 0.75f
+#define MAP_MAX_LOAD_FACTOR     0.875f // Keeps at least 1/8 of the slots empty so probes terminate.
+
+#define MAP_MIGRATE_GROUPS 4 // Old-table groups moved per insert/erase while resizing.
+
+#define MAP_NPOS ((size_t)-1)
+
+/*=============================================================================
+ * 2. Default Key Functions
+ *===========================================================================*/
+
+// wyhash's default secret: odd 64-bit constants with balanced bit counts.
+static const unsigned long long hash_secret[4] = {
+    0x2d358dccaa6c78a5ull, 0x8bb84b93962eacc9ull, 0x4b33a62ed433d4a3ull, 0x4d5a2da51de1aa47ull
+};
 
 /**
- * @brief Creates and initializes a new hash map.
- * @param initial_capacity The initial number of buckets in the hash map. If 0, a default is used.
- * @param load_factor The load factor threshold for resizing. If 0, a default is used.
- * @param hash The hashing function. If NULL, a default for string keys is used.
- * @param key_compare The key comparison function. If NULL, a default for string keys is used.
- * @param key_free The function to free keys. Can be NULL if keys don't need freeing.
- * @param value_free The function to free values. Can be NULL if values don't need freeing.
- * @return A pointer to the newly created map, or NULL on allocation failure.
+ * @brief Replaces '*a' and '*b' with the low and high halves of their 128-bit product.
  */
-map_t* map_create(size_t initial_capacity, float load_factor,
-    hash_func_t hash, key_compare_func_t key_compare,
-    free_func_t key_free, free_func_t value_free);
+static void hash_mum(unsigned long long* a, unsigned long long* b) {
+#if defined(__SIZEOF_INT128__)
+    unsigned __int128 r = (unsigned __int128)*a * *b;
+    *a = (unsigned long long)r;
+    *b = (unsigned long long)(r >> 64);
+#elif defined(_MSC_VER) && defined(_M_X64)
+    *a = _umul128(*a, *b, b);
+#else
+    unsigned long long ha = *a >> 32, hb = *b >> 32, la = (unsigned int)*a, lb = (unsigned int)*b;
+    unsigned long long rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+    unsigned long long t = rl + (rm0 << 32), lo = t + (rm1 << 32);
+    unsigned long long carry = (t < rl) + (lo < t);
+    *b = rh + (rm0 >> 32) + (rm1 >> 32) + carry;
+    *a = lo;
+#endif
+}
+
+static unsigned long long hash_mix(unsigned long long a, unsigned long long b) {
+    hash_mum(&a, &b);
+    return a ^ b;
+}
+
+// Unaligned little-endian loads; memcpy compiles to a single move.
+static unsigned long long hash_read8(const unsigned char* p) {
+    unsigned long long v;
+    memcpy(&v, p, sizeof(v));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap64(v);
+#endif
+    return v;
+}
+
+static unsigned long long hash_read4(const unsigned char* p) {
+    unsigned int v;
+    memcpy(&v, p, sizeof(v));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap32(v);
+#endif
+    return v;
+}
+
+unsigned long long map_hash_bytes(const void* data, size_t len, unsigned long long seed) {
+    const unsigned char* p = (const unsigned char*)data;
+    const unsigned long long* s = hash_secret;
+    unsigned long long a, b;
+
+    seed ^= hash_mix(seed ^ s[0], s[1]);
+    if (len <= 16) {
+        if (len >= 4) {
+            size_t shift = (len >> 3) << 2;
+            a = (hash_read4(p) << 32) | hash_read4(p + shift);
+            b = (hash_read4(p + len - 4) << 32) | hash_read4(p + len - 4 - shift);
+        }
+        else if (len > 0) {
+            a = ((unsigned long long)p[0] << 16) | ((unsigned long long)p[len >> 1] << 8) | p[len - 1];
+            b = 0;
+        }
+        else {
+            a = b = 0;
+        }
+    }
+    else {
+        size_t i = len;
+        if (i > 48) {
+            // Three independent lanes keep several multipliers busy on long keys.
+            unsigned long long see1 = seed, see2 = seed;
+            do {
+                seed = hash_mix(hash_read8(p) ^ s[1], hash_read8(p + 8) ^ seed);
+                see1 = hash_mix(hash_read8(p + 16) ^ s[2], hash_read8(p + 24) ^ see1);
+                see2 = hash_mix(hash_read8(p + 32) ^ s[3], hash_read8(p + 40) ^ see2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            seed ^= see1 ^ see2;
+        }
+        while (i > 16) {
+            seed = hash_mix(hash_read8(p) ^ s[1], hash_read8(p + 8) ^ seed);
+            p += 16;
+            i -= 16;
+        }
+        // The last 16 bytes, overlapping the previous block if needed.
+        a = hash_read8(p + i - 16);
+        b = hash_read8(p + i - 8);
+    }
 
+    a ^= s[1];
+    b ^= seed;
+    hash_mum(&a, &b);
+    return hash_mix(a ^ s[0] ^ len, b ^ s[1]);
+}
+
+unsigned long long map_hash_string(const void* key) {
+    const char* str = (const char*)key;
+    return map_hash_bytes(str, strlen(str), 0);
+}
+
+static int default_string_compare(const void* key1, const void* key2) {
+    return strcmp((const char*)key1, (const char*)key2);
+}
+
+/*=============================================================================
+ * 3. Table Helpers
+ *===========================================================================*/
+
+#if defined(MAP_GROUP_NEON)
 /**
- * @brief Destroys the map, freeing all allocated memory for nodes, keys, and values.
- * @param map The map to destroy. Does nothing if map is NULL.
+ * @brief Packs a NEON compare result (0x00 or 0xFF per byte) into one bit per byte.
  */
-void map_destroy(map_t* map);
+static unsigned int neon_movemask(uint8x16_t bytes) {
+    static const unsigned char weights[16] = { 1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128 };
+    uint8x16_t bits = vandq_u8(bytes, vld1q_u8(weights));
+    return (unsigned int)vaddv_u8(vget_low_u8(bits)) | (unsigned int)vaddv_u8(vget_high_u8(bits)) << 8;
+}
+#endif
 
 /**
- * @brief Inserts a key-value pair into the map.
- * @details If the key already exists, the existing value is freed (if value_free is set)
- * and replaced with the new value. The map takes ownership of both the key and
- * value pointers.
- * @note If the key already exists, the *new* key pointer provided is freed (if key_free is set),
- * as the original key is kept.
- * @param map The map to insert into.
- * @param key The key pointer. The map takes ownership.
- * @param value The value pointer. The map takes ownership.
+ * @brief Returns a bitmask with bit i set when ctrl[i] equals 'value'.
  */
-void map_insert(map_t* map, void* key, void* value);
+static unsigned int group_match(const unsigned char* ctrl, unsigned char value) {
+#if defined(MAP_GROUP_SSE2)
+    __m128i group = _mm_loadu_si128((const __m128i*)ctrl);
+    return (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8((char)value)));
+#elif defined(MAP_GROUP_NEON)
+    return neon_movemask(vceqq_u8(vld1q_u8(ctrl), vdupq_n_u8(value)));
+#else
+    unsigned int mask = 0;
+    for (unsigned int i = 0; i < MAP_GROUP_WIDTH; i++) {
+        if (ctrl[i] == value)
+            mask |= 1u << i;
+    }
+    return mask;
+#endif
+}
 
 /**
- * @brief Finds an entry by its key and returns the associated value.
- * @param map The map to search in.
- * @param key The key to find.
- * @return A pointer to the value, or NULL if the key is not found. The pointer is
- * owned by the map and should not be freed by the caller.
+ * @brief Returns a bitmask of the slots in a group that can take a new entry.
+ * @details EMPTY and DELETED both have the high bit set, tags never do.
  */
-void* map_find(const map_t* map, const void* key);
+static unsigned int group_match_free(const unsigned char* ctrl) {
+#if defined(MAP_GROUP_SSE2)
+    return (unsigned int)_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)ctrl));
+#elif defined(MAP_GROUP_NEON)
+    return neon_movemask(vcltq_s8(vreinterpretq_s8_u8(vld1q_u8(ctrl)), vdupq_n_s8(0)));
+#else
+    unsigned int mask = 0;
+    for (unsigned int i = 0; i < MAP_GROUP_WIDTH; i++) {
+        if (ctrl[i] & CTRL_EMPTY)
+            mask |= 1u << i;
+    }
+    return mask;
+#endif
+}
+
+static unsigned int lowest_bit_index(unsigned int mask) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return (unsigned int)index;
+#elif defined(__GNUC__) || defined(__clang__)
+    return (unsigned int)__builtin_ctz(mask);
+#else
+    unsigned int i = 0;
+    while (!(mask & 1u)) {
+        mask >>= 1;
+        i++;
+    }
+    return i;
+#endif
+}
+
+static size_t round_up_capacity(size_t requested) {
+    size_t capacity = MAP_GROUP_WIDTH;
+    while (capacity < requested)
+        capacity <<= 1;
+    return capacity;
+}
+
+static int table_alloc(map_table_t* table, size_t capacity) {
+    // Slots first so the control bytes that follow stay 16-byte aligned.
+    char* block = malloc(capacity * sizeof(map_entry_t) + capacity);
+    if (!block)
+        return -1;
+
+    table->slots = (map_entry_t*)block;
+    table->ctrl = (unsigned char*)(block + capacity * sizeof(map_entry_t));
+    memset(table->ctrl, CTRL_EMPTY, capacity);
+    table->capacity = capacity;
+    table->used = 0;
+    table->tombstones = 0;
+    return 0;
+}
+
+static void table_release(map_table_t* table) {
+    free(table->slots); // The control bytes share this allocation.
+    memset(table, 0, sizeof(*table));
+}
+
+/**
+ * @brief Returns the full hash of 'key', or 0 for a map with a capacity-reduced hash.
+ */
+static unsigned long long full_hash(const map_t* map, const void* key) {
+    return map->hash64 ? map->hash64(key) : 0;
+}
+
+/**
+ * @brief Returns the hash stored with 'key' in a particular table.
+ * @details For 64-bit hashes that is 'full' itself. A capacity-reduced hash has to be
+ * recomputed for every table size.
+ */
+static unsigned long long table_key_hash(const map_t* map, const map_table_t* table,
+    const void* key, unsigned long long full) {
+    if (map->hash64)
+        return full;
+    return map->hash(key, (table->capacity / MAP_GROUP_WIDTH) << MAP_TAG_BITS);
+}
 
 /**
- * @brief Removes a key-value pair from the map.
- * @details Frees the key and value using the provided free functions if they are set.
- * @param map The map to remove from.
- * @param key The key of the element to remove.
+ * @brief Splits a table hash into the home group and the slot tag.
  */
-void map_erase(map_t* map, const void* key);
+static void table_split_hash(const map_table_t* table, unsigned long long h,
+    size_t* group, unsigned char* tag) {
+    *tag = (unsigned char)(h & CTRL_TAG_MASK);
+    *group = (size_t)(h >> MAP_TAG_BITS) & (table->capacity / MAP_GROUP_WIDTH - 1);
+}
 
 /**
- * @brief Returns the number of elements in the map.
- * @param map The map.
- * @return The current element count.
+ * @brief Finds the slot holding 'key' in one table.
+ * @param full The key's full hash (ignored unless the map uses a 64-bit hash).
+ * @param exact Non-zero to match only the slot whose key is the pointer 'key'.
+ * @return The slot index, or MAP_NPOS if the key is not in this table.
  */
-size_t map_size(const map_t* map);
+static size_t table_find(const map_t* map, const map_table_t* table, const void* key,
+    unsigned long long full, int exact) {
+    if (table->capacity == 0 || table->used == 0)
+        return MAP_NPOS;
+
+    size_t group, group_mask = table->capacity / MAP_GROUP_WIDTH - 1;
+    unsigned char tag;
+    unsigned long long h = table_key_hash(map, table, key, full);
+    table_split_hash(table, h, &group, &tag);
+
+    // Triangular probing over groups visits every group exactly once.
+    for (size_t step = 1; step <= group_mask + 1; step++) {
+        const unsigned char* ctrl = table->ctrl + group * MAP_GROUP_WIDTH;
+        unsigned int match = group_match(ctrl, tag);
+
+        while (match) {
+            unsigned int i = lowest_bit_index(match);
+            size_t index = group * MAP_GROUP_WIDTH + i;
+            // The stored hash rejects tag collisions without touching the key, and
+            // the same pointer is the same key without comparing at all.
+            const void* stored = table->slots[index].key;
+            if (table->slots[index].hash == h
+                && (stored == key || (!exact && map->key_compare(key, stored) == 0)))
+                return index;
+            match &= match - 1;
+        }
+
+        if (group_match(ctrl, CTRL_EMPTY))
+            return MAP_NPOS; // An empty slot ends every probe chain through this group.
+
+        group = (group + step) & group_mask;
+    }
+    return MAP_NPOS;
+}
 
 /**
- * @brief Checks if the map is empty.
- * @param map The map.
- * @return 1 (true) if the map has no elements, 0 (false) otherwise.
+ * @brief Stores an entry that is known not to be present in the table.
+ * @details The caller guarantees there is at least one free slot.
  */
-int map_is_empty(const map_t* map);
\ No newline at end of file
+static void table_place(const map_t* map, map_table_t* table, void* key, void* value,
+    unsigned long long full) {
+    size_t group, group_mask = table->capacity / MAP_GROUP_WIDTH - 1;
+    unsigned char tag;
+    unsigned long long h = table_key_hash(map, table, key, full);
+    table_split_hash(table, h, &group, &tag);
+
+    for (size_t step = 1; ; step++) {
+        unsigned char* ctrl = table->ctrl + group * MAP_GROUP_WIDTH;
+        unsigned int free_mask = group_match_free(ctrl);
+
+        if (free_mask) {
+            unsigned int i = lowest_bit_index(free_mask);
+            if (ctrl[i] == CTRL_DELETED)
+                table->tombstones--;
+            ctrl[i] = tag;
+            table->slots[group * MAP_GROUP_WIDTH + i].key = key;
+            table->slots[group * MAP_GROUP_WIDTH + i].value = value;
+            table->slots[group * MAP_GROUP_WIDTH + i].hash = h;
+            table->used++;
+            return;
+        }
+        group = (group + step) & group_mask;
+    }
+}
+
+/**
+ * @brief Marks a slot as free without touching its key or value.
+ */
+static void table_clear_slot(map_table_t* table, size_t index) {
+    unsigned char* group_ctrl = table->ctrl + (index & ~(size_t)(MAP_GROUP_WIDTH - 1));
+
+    // If the group still has an empty slot, no probe chain ever continued past it,
+    // so the slot can become EMPTY again instead of leaving a tombstone.
+    if (group_match(group_ctrl, CTRL_EMPTY)) {
+        table->ctrl[index] = CTRL_EMPTY;
+    }
+    else {
+        table->ctrl[index] = CTRL_DELETED;
+        table->tombstones++;
+    }
+    table->used--;
+}
+
+/*=============================================================================
+ * 4. Incremental Resize
+ *===========================================================================*/
+
+ /**
+  * @brief Moves up to 'groups' groups from the old table into the active table.
+  * @details Releases the old table once its last group has been moved.
+  */
+static void map_migrate(map_t* map, size_t groups) {
+    map_table_t* old = &map->old_table;
+    if (old->capacity == 0)
+        return;
+
+    size_t old_groups = old->capacity / MAP_GROUP_WIDTH;
+    while (groups-- > 0 && map->migrate_pos < old_groups) {
+        size_t base = map->migrate_pos * MAP_GROUP_WIDTH;
+        for (size_t i = base; i < base + MAP_GROUP_WIDTH; i++) {
+            if (old->ctrl[i] & CTRL_EMPTY)
+                continue;
+            // A stored 64-bit hash moves with the entry, so migration never rehashes keys.
+            table_place(map, &map->table, old->slots[i].key, old->slots[i].value, old->slots[i].hash);
+            // Leave a tombstone so the remaining old entries stay reachable.
+            old->ctrl[i] = CTRL_DELETED;
+            old->used--;
+        }
+        map->migrate_pos++;
+    }
+
+    if (map->migrate_pos == old_groups || old->used == 0) {
+        table_release(old);
+        map->migrate_pos = 0;
+    }
+}
+
+/**
+ * @brief Makes room for one more entry in the active table.
+ * @details Starts an incremental resize when the load factor would be exceeded.
+ * Tombstone-heavy tables are rebuilt at the same size instead of doubling.
+ * @return 0 if the active table can take another entry, -1 otherwise.
+ */
+static int map_reserve_one(map_t* map) {
+    map_table_t* table = &map->table;
+    double limit = (double)table->capacity * map->load_factor_threshold;
+
+    if ((double)(table->used + table->tombstones + 1) <= limit)
+        return 0;
+
+    // A second resize cannot start until the previous one has finished.
+    if (map->old_table.capacity)
+        map_migrate(map, (size_t)-1);
+
+    size_t new_capacity = table->capacity;
+    if ((double)(table->used + 1) * 2.0 > limit)
+        new_capacity *= 2;
+
+    map_table_t fresh;
+    if (table_alloc(&fresh, new_capacity) != 0) {
+        // Could not grow; keep using the current table while it still has a free slot.
+        return (table->used + table->tombstones < table->capacity - 1) ? 0 : -1;
+    }
+
+    map->old_table = *table;
+    map->table = fresh;
+    map->migrate_pos = 0;
+    map_migrate(map, MAP_MIGRATE_GROUPS);
+    return 0;
+}
+
+/*=============================================================================
+ * 5. Public API Functions
+ *===========================================================================*/
+
+map_t* map_create(size_t initial_capacity, float load_factor,
+    hash_func_t hash, key_compare_func_t key_compare,
+    free_func_t key_free, free_func_t value_free) {
+    map_t* map = calloc(1, sizeof(map_t));
+    if (!map)
+        return NULL;
+
+    if (initial_capacity == 0)
+        initial_capacity = MAP_DEFAULT_CAPACITY;
+    if (load_factor <= 0.0f)
+        load_factor = MAP_DEFAULT_LOAD_FACTOR;
+    if (load_factor > MAP_MAX_LOAD_FACTOR)
+        load_factor = MAP_MAX_LOAD_FACTOR;
+
+    if (table_alloc(&map->table, round_up_capacity(initial_capacity)) != 0) {
+        free(map);
+        return NULL;
+    }
+
+    map->load_factor_threshold = load_factor;
+    map->hash = hash;
+    map->hash64 = hash ? NULL : map_hash_string;
+    map->key_compare = key_compare ? key_compare : default_string_compare;
+    map->key_free = key_free;
+    map->value_free = value_free;
+    return map;
+}
+
+map_t* map_create_hash64(size_t initial_capacity, float load_factor,
+    hash64_func_t hash64, key_compare_func_t key_compare,
+    free_func_t key_free, free_func_t value_free) {
+    map_t* map = map_create(initial_capacity, load_factor, NULL, key_compare, key_free, value_free);
+    if (map && hash64)
+        map->hash64 = hash64;
+    return map;
+}
+
+static void table_free_entries(const map_t* map, map_table_t* table) {
+    for (size_t i = 0; i < table->capacity; i++) {
+        if (table->ctrl[i] & CTRL_EMPTY)
+            continue;
+        if (map->key_free)
+            map->key_free(table->slots[i].key);
+        if (map->value_free)
+            map->value_free(table->slots[i].value);
+    }
+    table_release(table);
+}
+
+void map_destroy(map_t* map) {
+    if (!map)
+        return;
+
+    table_free_entries(map, &map->table);
+    if (map->old_table.capacity)
+        table_free_entries(map, &map->old_table);
+    free(map);
+}
+
+unsigned long long map_hash(const map_t* map, const void* key) {
+    return map ? full_hash(map, key) : 0;
+}
+
+int map_insert(map_t* map, void* key, void* value) {
+    return map ? map_insert_prehashed(map, key, value, full_hash(map, key)) : -1;
+}
+
+int map_insert_prehashed(map_t* map, void* key, void* value, unsigned long long hash) {
+    if (!map)
+        return -1;
+
+    map_migrate(map, MAP_MIGRATE_GROUPS);
+
+    // The key lives in exactly one table; replace it wherever it is.
+    map_table_t* tables[2] = { &map->table, &map->old_table };
+    for (int t = 0; t < 2; t++) {
+        size_t index = table_find(map, tables[t], key, hash, 0);
+        if (index == MAP_NPOS)
+            continue;
+
+        map_entry_t* slot = &tables[t]->slots[index];
+        if (map->value_free && slot->value != value)
+            map->value_free(slot->value);
+        if (map->key_free && slot->key != key)
+            map->key_free(key);
+        slot->value = value;
+        return 0;
+    }
+
+    if (map_reserve_one(map) != 0)
+        return -1;
+
+    table_place(map, &map->table, key, value, hash);
+    map->count++;
+    return 0;
+}
+
+void* map_find(const map_t* map, const void* key) {
+    return map ? map_find_prehashed(map, key, full_hash(map, key)) : NULL;
+}
+
+void* map_find_prehashed(const map_t* map, const void* key, unsigned long long hash) {
+    if (!map)
+        return NULL;
+
+    size_t index = table_find(map, &map->table, key, hash, 0);
+    if (index != MAP_NPOS)
+        return map->table.slots[index].value;
+
+    index = table_find(map, &map->old_table, key, hash, 0);
+    if (index != MAP_NPOS)
+        return map->old_table.slots[index].value;
+
+    return NULL;
+}
+
+static void table_prefetch(const map_table_t* table, unsigned long long hash) {
+    if (table->capacity == 0)
+        return;
+    size_t group;
+    unsigned char tag;
+    table_split_hash(table, hash, &group, &tag);
+    MAP_PREFETCH(table->ctrl + group * MAP_GROUP_WIDTH);
+}
+
+void map_prefetch(const map_t* map, unsigned long long hash) {
+    if (!map || !map->hash64)
+        return;
+    table_prefetch(&map->table, hash);
+    if (map->old_table.capacity)
+        table_prefetch(&map->old_table, hash);
+}
+
+void map_erase(map_t* map, const void* key) {
+    if (map)
+        map_erase_prehashed(map, key, full_hash(map, key));
+}
+
+/**
+ * @brief Removes the entry matching 'key', by value or (if 'exact') by pointer identity.
+ */
+static void map_erase_matching(map_t* map, const void* key, unsigned long long hash, int exact) {
+    map_table_t* tables[2] = { &map->table, &map->old_table };
+    for (int t = 0; t < 2; t++) {
+        size_t index = table_find(map, tables[t], key, hash, exact);
+        if (index == MAP_NPOS)
+            continue;
+
+        map_entry_t entry = tables[t]->slots[index];
+        table_clear_slot(tables[t], index);
+        map->count--;
+
+        if (map->key_free)
+            map->key_free(entry.key);
+        if (map->value_free)
+            map->value_free(entry.value);
+        break;
+    }
+
+    map_migrate(map, MAP_MIGRATE_GROUPS);
+}
+
+void map_erase_prehashed(map_t* map, const void* key, unsigned long long hash) {
+    if (map)
+        map_erase_matching(map, key, hash, 0);
+}
+
+void map_erase_entry(map_t* map, const void* key, unsigned long long hash) {
+    if (map)
+        map_erase_matching(map, key, map->hash64 ? hash : 0, 1);
+}
+
+size_t map_size(const map_t* map) {
+    return map ? map->count : 0;
+}
+
+int map_is_empty(const map_t* map) {
+    return map_size(map) == 0;
+}
+
+/**
+ * @brief Adds one table's entries and probe lengths to 'stats'.
+ */
+static void table_add_stats(const map_table_t* table, map_stats_t* stats, size_t* probe_total) {
+    if (table->capacity == 0)
+        return;
+
+    size_t group_mask = table->capacity / MAP_GROUP_WIDTH - 1;
+    stats->capacity += table->capacity;
+    stats->tombstones += table->tombstones;
+
+    for (size_t i = 0; i < table->capacity; i++) {
+        if (table->ctrl[i] & CTRL_EMPTY)
+            continue;
+
+        size_t group;
+        unsigned char tag;
+        table_split_hash(table, table->slots[i].hash, &group, &tag);
+
+        // Follow the same triangular sequence as table_find() until the entry's group.
+        size_t target = i / MAP_GROUP_WIDTH, probes = 1;
+        for (size_t step = 1; group != target; step++, probes++)
+            group = (group + step) & group_mask;
+
+        if (probes > 1)
+            stats->displaced++;
+        if (probes > stats->max_probe_groups)
+            stats->max_probe_groups = probes;
+        *probe_total += probes;
+    }
+}
+
+void map_get_stats(const map_t* map, map_stats_t* stats) {
+    if (!stats)
+        return;
+
+    memset(stats, 0, sizeof(*stats));
+    if (!map)
+        return;
+
+    size_t probe_total = 0;
+    table_add_stats(&map->table, stats, &probe_total);
+    table_add_stats(&map->old_table, stats, &probe_total);
+
+    stats->count = map->count;
+    stats->resizing = map->old_table.capacity != 0;
+    stats->mean_probe_groups = map->count ? (double)probe_total / (double)map->count : 0.0;
+}
+
+size_t map_advance_resize(map_t* map, size_t groups) {
+    if (!map)
+        return 0;
+    map_migrate(map, groups);
+    return map->old_table.capacity ? map->old_table.capacity / MAP_GROUP_WIDTH - map->migrate_pos : 0;
+}
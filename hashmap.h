@@ -4,30 +4,56 @@
 
 #include <stddef.h> // For size_t
 
+// Number of slots probed together as one group. A group's control bytes fill
+// 16 contiguous bytes, so one probe step touches a single cache line of metadata.
+#define MAP_GROUP_WIDTH 16
+
+// Number of low hash bits kept in a control byte as the slot's tag.
+#define MAP_TAG_BITS 7
+
 // A single key-value entry stored in the map.
 typedef struct map_entry {
     void* key;
     void* value;
+    unsigned long long hash;          // The key's hash as used by the table holding the entry.
 } map_entry_t;
 
-// Linked list node for handling hash collisions.
-typedef struct map_node {
-    map_entry_t entry;
-    struct map_node* next;
-} map_node_t;
+// One open-addressing table. Slots and control bytes are parallel arrays of
+// 'capacity' elements that live in a single allocation.
+typedef struct map_table {
+    unsigned char* ctrl;              // Per-slot control byte: empty, deleted, or a 7-bit hash tag.
+    map_entry_t* slots;               // Key/value slots, indexed like 'ctrl'.
+    size_t capacity;                  // Number of slots (a power of two, multiple of MAP_GROUP_WIDTH).
+    size_t used;                      // Number of live entries stored in this table.
+    size_t tombstones;                // Number of deleted slots that still break probe chains.
+} map_table_t;
+
+// Occupancy and probe-length figures reported by map_get_stats().
+typedef struct map_stats {
+    size_t count;                // Live entries.
+    size_t capacity;             // Slots in the active table and, while resizing, the old one.
+    size_t tombstones;           // Deleted slots still lengthening probe chains.
+    size_t displaced;            // Entries stored outside their home group (collisions).
+    size_t max_probe_groups;     // Most groups a lookup must scan to reach any entry.
+    double mean_probe_groups;    // Average groups scanned to reach an entry (1.0 is ideal).
+    int resizing;                // Non-zero while an incremental resize is in flight.
+} map_stats_t;
 
 // Define function pointers for custom map behavior.
 typedef unsigned int (*hash_func_t)(const void* key, size_t map_capacity);
+typedef unsigned long long (*hash64_func_t)(const void* key);
 typedef int (*key_compare_func_t)(const void* key1, const void* key2);
 typedef void (*free_func_t)(void* data);
 
 // The main map structure.
 typedef struct map {
-    map_node_t** buckets;             // Array of pointers to map nodes (the hash table).
-    size_t capacity;                  // The current capacity of the bucket array.
+    map_table_t table;                // Active table. All new entries are inserted here.
+    map_table_t old_table;            // Table being drained by an incremental resize (capacity 0 when idle).
+    size_t migrate_pos;               // Index of the next old_table group to migrate.
     size_t count;                     // The number of elements currently in the map.
     float load_factor_threshold;      // Threshold to trigger a resize.
-    hash_func_t hash;                 // Hashing function for keys.
+    hash_func_t hash;                 // Capacity-reduced hashing function (used when 'hash64' is NULL).
+    hash64_func_t hash64;             // Full 64-bit hashing function, or NULL.
     key_compare_func_t key_compare;   // Comparison function for keys.
     free_func_t key_free;             // Optional function to free keys.
     free_func_t value_free;           // Optional function to free values.
@@ -35,10 +61,20 @@ typedef struct map {
 
 /**
  * @brief Creates and initializes a new hash map.
- * @param initial_capacity The initial number of buckets in the hash map. If 0, a default is used.
+ * @details The map uses open addressing: slots are probed a group of MAP_GROUP_WIDTH
+ * at a time, and each slot's control byte holds a 7-bit tag of its key's hash so most
+ * non-matching slots are rejected without touching the key. When the load factor is
+ * reached, the entries are moved to a larger table a few groups at a time during later
+ * inserts and erases, so no single call pays for rehashing the whole map.
+ * @param initial_capacity The initial number of slots in the hash map. If 0, a default is used.
  * @param load_factor The load factor threshold for resizing. If 0, a default is used.
- * @param hash The hashing function. If NULL, a default for string keys is used.
- * @param key_compare The key comparison function. If NULL, a default for string keys is used.
+ * @param hash The hashing function. If NULL, map_hash_string() is used as a full 64-bit
+ * hash (see map_create_hash64()). Otherwise the map passes the size of the range it
+ * needs as 'map_capacity' (always a power of two) and expects a value below it; the low
+ * MAP_TAG_BITS bits become the slot tag and the remaining bits select the home group.
+ * Such a hash has to be recomputed for every key on each resize.
+ * @param key_compare The key comparison function. Must return 0 for equal keys. If NULL,
+ * a default for string keys is used.
  * @param key_free The function to free keys. Can be NULL if keys don't need freeing.
  * @param value_free The function to free values. Can be NULL if values don't need freeing.
  * @return A pointer to the newly created map, or NULL on allocation failure.
@@ -48,7 +84,21 @@ map_t* map_create(size_t initial_capacity, float load_factor,
     free_func_t key_free, free_func_t value_free);
 
 /**
- * @brief Destroys the map, freeing all allocated memory for nodes, keys, and values.
+ * @brief Creates a map whose hash function returns a full 64-bit hash.
+ * @details The hash is stored in each slot, so resizing never calls the hash function
+ * again and a lookup only compares keys whose stored hash matches. The low MAP_TAG_BITS
+ * bits become the slot tag and the bits above them select the home group, so all 64 bits
+ * should be well mixed. Such a map also accepts the *_prehashed entry points.
+ * @param hash64 The hashing function. If NULL, map_hash_string() is used.
+ * @return A pointer to the newly created map, or NULL on allocation failure.
+ * The other parameters are as for map_create().
+ */
+map_t* map_create_hash64(size_t initial_capacity, float load_factor,
+    hash64_func_t hash64, key_compare_func_t key_compare,
+    free_func_t key_free, free_func_t value_free);
+
+/**
+ * @brief Destroys the map, freeing all allocated memory for slots, keys, and values.
  * @param map The map to destroy. Does nothing if map is NULL.
  */
 void map_destroy(map_t* map);
@@ -63,11 +113,15 @@ void map_destroy(map_t* map);
  * @param map The map to insert into.
  * @param key The key pointer. The map takes ownership.
  * @param value The value pointer. The map takes ownership.
+ * @return 0 on success, or -1 if the map could not grow to hold a new key. On failure
+ * ownership of 'key' and 'value' stays with the caller.
  */
-void map_insert(map_t* map, void* key, void* value);
+int map_insert(map_t* map, void* key, void* value);
 
 /**
  * @brief Finds an entry by its key and returns the associated value.
+ * @details Never modifies the map, so concurrent finds are safe as long as no
+ * insert or erase runs at the same time.
  * @param map The map to search in.
  * @param key The key to find.
  * @return A pointer to the value, or NULL if the key is not found. The pointer is
@@ -75,6 +129,32 @@ void map_insert(map_t* map, void* key, void* value);
  */
 void* map_find(const map_t* map, const void* key);
 
+/**
+ * @brief Returns the hash the map uses for 'key', for the *_prehashed entry points.
+ * @return The 64-bit hash, or 0 if the map was created with a capacity-reduced hash.
+ */
+unsigned long long map_hash(const map_t* map, const void* key);
+
+/**
+ * @brief Like map_insert(), with 'hash' computed up front by the map's 64-bit hash.
+ * @details Lets a caller hash a key once and reuse it for several operations (and for
+ * its own purposes, such as picking a shard). On a map with a capacity-reduced hash
+ * 'hash' is ignored.
+ */
+int map_insert_prehashed(map_t* map, void* key, void* value, unsigned long long hash);
+
+/**
+ * @brief Like map_find(), with 'hash' as for map_insert_prehashed().
+ */
+void* map_find_prehashed(const map_t* map, const void* key, unsigned long long hash);
+
+/**
+ * @brief Starts loading the control bytes a lookup of 'hash' will probe first.
+ * @details Issuing this for a batch of keys before probing any of them overlaps
+ * their cache misses. Only a hint: it does nothing on a map with a capacity-reduced hash.
+ */
+void map_prefetch(const map_t* map, unsigned long long hash);
+
 /**
  * @brief Removes a key-value pair from the map.
  * @details Frees the key and value using the provided free functions if they are set.
@@ -83,6 +163,22 @@ void* map_find(const map_t* map, const void* key);
  */
 void map_erase(map_t* map, const void* key);
 
+/**
+ * @brief Like map_erase(), with 'hash' as for map_insert_prehashed().
+ */
+void map_erase_prehashed(map_t* map, const void* key, unsigned long long hash);
+
+/**
+ * @brief Removes the entry whose key is the pointer 'key' itself.
+ * @details For maps keyed by the objects they index (an object is its own key,
+ * and often its own value): given the object, the probe matches slots by stored
+ * hash and pointer only, so it never calls key_compare() or touches another
+ * entry's key. An equal key stored under a different pointer is left alone.
+ * Frees the key and value as map_erase() does.
+ * @param hash As for map_insert_prehashed().
+ */
+void map_erase_entry(map_t* map, const void* key, unsigned long long hash);
+
 /**
  * @brief Returns the number of elements in the map.
  * @param map The map.
@@ -95,4 +191,35 @@ size_t map_size(const map_t* map);
  * @param map The map.
  * @return 1 (true) if the map has no elements, 0 (false) otherwise.
  */
-int map_is_empty(const map_t* map);
\ No newline at end of file
+int map_is_empty(const map_t* map);
+
+/**
+ * @brief Measures how well the map's entries are placed.
+ * @details Walks every slot and replays each entry's probe sequence, so it costs
+ * O(capacity) and is meant for diagnostics, not the hot path.
+ * @param map The map.
+ * @param stats Receives the figures.
+ */
+void map_get_stats(const map_t* map, map_stats_t* stats);
+
+/**
+ * @brief Moves up to 'groups' groups of an in-flight resize into the new table.
+ * @details Inserts and erases already move a few groups each. This lets a map that
+ * stops receiving writes, or a helper thread holding the owner's lock, finish the
+ * resize so lookups stop probing two tables. Needs the same exclusion as map_insert().
+ * @param groups Groups to move; 0 only reports progress.
+ * @return Old-table groups still to move (0 once no resize is in flight).
+ */
+size_t map_advance_resize(map_t* map, size_t groups);
+
+/**
+ * @brief Hashes 'len' bytes to 64 bits (wyhash).
+ * @details Mixes 16 bytes per multiply, running three independent lanes over long
+ * inputs, so URL-length keys hash several times faster than with a byte-at-a-time hash.
+ */
+unsigned long long map_hash_bytes(const void* data, size_t len, unsigned long long seed);
+
+/**
+ * @brief The default hash: map_hash_bytes() over a NUL-terminated string.
+ */
+unsigned long long map_hash_string(const void* key);
@@ -5,10 +5,32 @@
  * This file implements a Least Recently Used (LRU) cache using a hash map
  * for O(1) lookups and a doubly-linked list to maintain the usage order.
  * It is designed for use in a multithreaded proxy server.
+ *
+ * Each proxy_cache_t instance is split into one or more independent shards.
+ * Every URL hashes to one shard, and each shard has its own map, LRU list,
+ * size and lock, so threads working on different shards never wait for each
+ * other. The cache_* functions without an instance argument operate on a
+ * default instance created by cache_init().
+ *
+ * Which element a shard evicts is up to its policy (cache_policy.c): plain LRU
+ * by default, the scan-resistant SLRU and W-TinyLFU, or the size-aware GDSF.
+ *
+ * In read-mostly mode, hits run under a shared lock and merely set the element's
+ * reference bit; the eviction loop turns those bits into policy hits later.
  */
 
 #include "proxy_cache.h"
 #include "hashmap.h"
+#include "cache_platform.h"
+#include "cache_lock.h"
+#include "slab.h"
+#include "cache_policy.h"
+#include "cache_histogram.h"
+#include "cache_timer.h"
+#include "cache_codec.h"
+#include "cache_snapshot.h"
+#include "cache_tier.h"
+#include "cache_trace.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -16,9 +38,9 @@
 #include <assert.h> // For defensive programming assertions
 
 #ifdef _WIN32
-    #include <Windows.h> // For CRITICAL_SECTION on Windows
+    #include <Windows.h> // For CreateThread on Windows
 #else
-    #include <pthread.h> // For pthread_mutex_t on POSIX (Linux, macOS)
+    #include <pthread.h> // For pthread_create on POSIX (Linux, macOS)
 #endif
 
 
@@ -26,286 +48,2955 @@
   * 1. Type Definitions & Static Globals
   *===========================================================================*/
 
+#define CACHE_DEFAULT_MAP_CAPACITY 1024
+#define CACHE_DEFAULT_LOAD_FACTOR  0.75f
+#define CACHE_SHRINK_BATCH         8 // Extra evictions per write while over a shrunk budget.
+#define CACHE_EXPIRE_BATCH         8 // Expired elements reclaimed per write.
+#define CACHE_MAINTAIN_EXPIRE_BATCH 256 // Expired elements reclaimed per shard by proxy_cache_maintain().
+#define CACHE_BATCH_CHUNK          64 // Keys hashed and grouped by shard at a time by the batch calls.
+#define CACHE_RECLAIM_BATCH        32 // Elements the reclaimer evicts per shard lock hold.
+#define CACHE_RECLAIM_BACKLOG   65536 // Dead elements queued for the reclaimer before writers free their own.
+#define CACHE_RESIZE_BATCH         64 // Map groups migrated per shard lock hold by the reclaimer and maintain().
+#define CACHE_DEFAULT_WATERMARK_GAP 10 // Percent between the high and the default low watermark.
+#define CACHE_FRONT_STRIPES      1024 // Generation counters keys are striped over, for front caches.
+#define CACHE_FRONT_MAX_SCORE      15 // Lead a front cache resident can build up over conflicting keys.
+#define CACHE_WRITER_MIN_BYTES   4096 // First buffer of a streamed add whose size is not known.
+
+  /**
+   * @brief Event counters of one shard, bumped with relaxed atomics.
+   * @details Read-mostly lookups update them under a shared lock, so plain increments would race.
+   */
+typedef struct cache_shard_stats {
+	volatile size_t hits;
+	volatile size_t misses;
+	volatile size_t inserts;
+	volatile size_t updates;
+	volatile size_t evictions;
+	volatile size_t bytes_evicted;
+	volatile size_t lock_contended; // Acquisitions that found the lock taken.
+	volatile size_t lock_wait_ns;   // Time spent waiting in those acquisitions.
+	volatile size_t expirations;    // Elements reclaimed by the timer wheel.
+	volatile size_t loads;          // Loader calls made by cache_get_or_load().
+	volatile size_t coalesced;      // cache_get_or_load() misses served by another caller's load.
+	volatile size_t pre_evictions;  // Evictions made by the reclaimer ahead of writes.
+	volatile size_t busy;           // Try lookups that found the lock held.
+} cache_shard_stats_t;
+
+#define SHARD_STAT_ADD(shard, field, amount) cache_atomic_add_relaxed_size(&(shard)->stats.field, (amount))
+
   /**
-   * @brief Internal state of the cache system.
+   * @brief A load in progress for one key, shared by every caller that misses on it.
+   * @details Guarded by the owning shard's flight_mutex. The leader unlinks it once the
+   * load is stored; the last caller to leave frees it.
    */
-typedef struct {
+typedef struct cache_flight {
+	struct cache_flight* next;
+	const char* key;              // The leader's key bytes, valid while the flight is linked.
+	size_t key_len;
+	unsigned long long hash;
+	int done;                     // Set when 'result' is final.
+	int waiters;                  // Callers blocked on this flight.
+	cache_element* result;        // Loaded element with one reference held for the waiters, or NULL.
+} cache_flight_t;
+
+  /**
+   * @brief Internal state of one cache shard.
+   */
+typedef struct cache_shard {
 	map_t* map;          // Maps URL -> cache_element* for O(1) lookups.
-	cache_element* head; // Head of the list (Most Recently Used).
-	cache_element* tail; // Tail of the list (Least Recently Used).
+	cache_policy_t policy; // Eviction order of the shard's elements (LRU list by default).
+
+	size_t current_size; // Bytes the shard's elements are charged against the budget.
+	size_t overhead_size; // Metadata bytes of those elements (footprint minus payload).
+	size_t reserved_size; // Budget held by open streaming writers, counted as used.
+	slab_t* slab;        // Allocator for elements and payloads, or NULL to use malloc.
+	proxy_cache_t* owner; // Instance this shard belongs to.
+	int read_mostly;     // Copy of owner's lookup mode, used by the lock helpers.
+	cache_shard_stats_t stats;
+	cache_histogram_t* latency; // Lookup latency, or NULL unless the instance tracks it.
+	cache_flight_t* flights;    // Loads in progress, guarded by flight_mutex.
+	cache_timer_wheel_t timers; // Expiry times of the shard's elements that have a TTL.
+	cache_element* graveyard;   // Removed during the current exclusive hold; freed once it ends.
+
+	cache_lock_t lock;          // Guards everything above; shared by read-mostly lookups on an RWLOCK.
+	cache_mutex_t flight_mutex; // Taken before 'lock', never after.
+	cache_cond_t flight_done;   // Signalled when any of the shard's flights completes.
+} cache_shard_t;
+
+  /**
+   * @brief Background thread that frees removed elements and evicts ahead of writes.
+   * @details Guarded by its own mutex, which may be taken under a shard lock but never
+   * the other way round.
+   */
+typedef struct cache_reclaimer {
+	#ifdef _WIN32
+		HANDLE thread;
+	#else
+		pthread_t thread;
+	#endif
+	cache_mutex_t mutex;
+	cache_cond_t wake;
+	cache_element* dead;          // Elements to free, linked through 'next'.
+	size_t dead_count;
+	volatile int evict_pending;   // A shard went over the high watermark.
+	volatile int resize_pending;  // A shard's map started an incremental resize.
+	volatile int stopping;
+	volatile size_t reclaimed;    // Elements freed by the thread.
+} cache_reclaimer_t;
 
-	size_t current_size; // Current total size of all data in cache.
+  /**
+   * @brief An add queued by cache_add_async() for a shard owner thread.
+   */
+typedef struct cache_async_add {
+	struct cache_async_add* next;
+	char* data;                   // Copy of the payload, adopted by the add.
+	size_t length;
+	unsigned long long ttl_ms;
+	cache_add_done_fn done;       // Called on the owner thread with the result (may be NULL).
+	void* context;
+	size_t key_len;               // The key follows the struct, in the same allocation.
+} cache_async_add_t;
 
+  /**
+   * @brief A thread that applies the queued adds of the shards assigned to it.
+   * @details Producers push onto 'queue' with a compare-and-swap and never block. The
+   * owner takes the whole stack in one exchange and applies it oldest first. 'mutex'
+   * only guards sleeping: a producer that finds the queue empty takes it to wake the owner.
+   */
+typedef struct cache_owner {
 	#ifdef _WIN32
-        CRITICAL_SECTION mutex; // Mutex for Windows
-    #else
-        pthread_mutex_t mutex;  // Mutex for POSIX
-    #endif
-} proxy_cache_t;
+		HANDLE thread;
+	#else
+		pthread_t thread;
+	#endif
+	proxy_cache_t* cache;
+	void* volatile queue;         // cache_async_add_t stack, newest first.
+	cache_mutex_t mutex;
+	cache_cond_t wake;            // Signalled when the queue stops being empty, or to stop.
+	cache_cond_t drained;         // Broadcast after every batch, for cache_flush_async().
+	volatile size_t submitted;    // Adds queued so far.
+	volatile size_t completed;    // Adds applied so far.
+	int stopping;                 // Guarded by 'mutex'.
+} cache_owner_t;
+
+/**
+ * @brief A cache instance: the set of shards plus the configuration they share.
+ */
+struct proxy_cache {
+	char* shards;                    // 'shard_count' cache-line aligned cache_shard_t slots.
+	size_t shard_stride;             // Distance in bytes between consecutive shards.
+	size_t shard_bytes;              // Size of the 'shards' allocation.
+	unsigned int numa_nodes;         // Nodes shards are placed on, round-robin (0: no NUMA placement).
+	size_t shard_count;
+	cache_budget_mode_t budget_mode;
+	cache_lookup_mode_t lookup_mode;
+	cache_accounting_t accounting;   // What elements are charged against the budget.
+	size_t slot_footprint;           // Map bytes one element accounts for (see element_footprint()).
+	volatile size_t max_bytes;       // Byte budget of the whole instance (changed by set_budget).
+	volatile size_t shard_budget;    // Per-shard byte limit (CACHE_BUDGET_SPLIT).
+	volatile size_t total_size;      // Bytes reserved across all shards (CACHE_BUDGET_SHARED).
+	volatile size_t rejections;      // Adds that could not be cached.
+	volatile size_t compressed;      // Adds stored compressed.
+	cache_encoding_t compression;    // Encoding adds try (CACHE_ENCODING_IDENTITY: none).
+	unsigned long long default_ttl_ms; // TTL of adds that do not give one (0: never expire).
+	cache_tier_t* tier;              // Disk tier evicted elements spill to (NULL: none).
+	cache_reclaimer_t* reclaimer;    // Background reclaimer (NULL: writers free their own evictions).
+	unsigned int high_watermark;     // Percent of the budget that wakes the reclaimer (0: no pre-eviction).
+	unsigned int low_watermark;      // Percent of the budget the reclaimer evicts down to.
+	volatile size_t* generations;    // CACHE_FRONT_STRIPES counters bumped by updates and removals (NULL: no front caches).
+	cache_owner_t** owners;          // Shard owner threads; shard i belongs to owners[i % owner_count].
+	unsigned int owner_count;        // 0: cache_add_async() is unavailable.
+	cache_trace_t* trace;            // Sampled access trace (NULL: tracing off).
+	unsigned int trace_threshold;    // Keys whose hash passes cache_trace_selects() with this are traced.
+};
+
+  /**
+   * @brief One front cache slot: a pinned handle and the stripe generation it was taken at.
+   */
+typedef struct front_slot {
+	cache_element* element;          // NULL if the slot is empty.
+	cache_element* replica;          // Thread-local copy of 'element' handed out instead (NULL: none).
+	size_t generation;
+	unsigned int score;              // Hits minus conflicting misses; another key may take the slot at 0.
+} front_slot_t;
+
+struct cache_front {
+	proxy_cache_t* cache;
+	front_slot_t* slots;             // 'mask' + 1 slots, in the same allocation.
+	size_t mask;
+	cache_front_stats_t stats;
+};
+
+  /**
+   * @brief A streamed add: the buffer being filled and the budget held for it.
+   */
+struct cache_writer {
+	proxy_cache_t* cache;
+	cache_shard_t* shard;            // Shard of the key, which holds the reservation.
+	unsigned long long hash;
+	unsigned long long ttl_ms;
+	char* buffer;                    // Becomes the element's payload on commit.
+	size_t length;                   // Bytes appended so far.
+	size_t capacity;
+	size_t reserved;                 // Budget bytes held until commit or abort.
+	int failed;                      // An append failed; commit rejects the object.
+	size_t key_len;                  // The key follows the struct, in the same allocation.
+};
 
 /**
- * @brief The single, global instance of the cache.
+ * @brief The default instance used by the instance-less API (cache_init(), cache_find(), ...).
  */
-static proxy_cache_t g_cache;
+static proxy_cache_t* g_cache;
 
 /*=============================================================================
  * 2. Static Helper Functions (Internal Logic)
  *===========================================================================*/
 
- /**
-  * @brief Detaches a node from the doubly-linked list.
-  * @details This function is not thread-safe and must be called from
-  * within a locked critical section.
-  * @param element The element to detach.
-  */
+/**
+ * @brief Returns the current time in timer wheel ticks (milliseconds).
+ */
+static unsigned long long now_ms(void) {
+	return cache_now_ns() / 1000000ull;
+}
+
+static cache_shard_t* shard_at(proxy_cache_t* cache, size_t index) {
+	return (cache_shard_t*)(cache->shards + index * cache->shard_stride);
+}
 
-static void detach_node_unlocked(cache_element* element) {
-	if (!element)
+/**
+ * @brief Hashes a key once for the shard pick, the map and the eviction policy.
+ */
+static unsigned long long hash_key(const char* key, size_t key_len) {
+	return map_hash_bytes(key, key_len, 0);
+}
+
+/**
+ * @brief Appends a find or add to the access trace if the key is in the sample.
+ * @param size Payload bytes found or added (0 on a miss).
+ */
+static void trace_access(proxy_cache_t* cache, unsigned long long hash, size_t size, int op, int hit) {
+	if (cache->trace && cache_trace_selects(hash, cache->trace_threshold))
+		cache_trace_record(cache->trace, hash, size, op, hit);
+}
+
+/**
+ * @brief Map hash function. Map keys are the elements themselves.
+ * @details Only reached by the incremental resize bookkeeping; the cache always
+ * passes the hash it computed with hash_key().
+ */
+static unsigned long long element_key_hash(const void* key) {
+	const cache_element* element = (const cache_element*)key;
+	return hash_key(element->url, element->url_len);
+}
+
+/**
+ * @brief Map key comparison: a length check, then memcmp (keys may contain NUL bytes).
+ */
+static int element_key_compare(const void* key1, const void* key2) {
+	const cache_element* a = (const cache_element*)key1;
+	const cache_element* b = (const cache_element*)key2;
+	if (a->url_len != b->url_len)
+		return 1;
+	return memcmp(a->url, b->url, a->url_len);
+}
+
+/**
+ * @brief Points a stack element at a caller's key, for use as a map lookup key.
+ * @details Only 'url' and 'url_len' are read by the map's key functions.
+ */
+static void init_probe(cache_element* probe, const char* key, size_t key_len) {
+	probe->url = (char*)key;
+	probe->url_len = key_len;
+}
+
+static volatile size_t* generation_for_hash(proxy_cache_t* cache, unsigned long long hash) {
+	return &cache->generations[(size_t)(hash >> 8) & (CACHE_FRONT_STRIPES - 1)];
+}
+
+/**
+ * @brief Makes front cache handles of a key stale. Called under the shard lock,
+ * whenever the key's element is replaced or leaves the map.
+ */
+static void bump_generation(proxy_cache_t* cache, unsigned long long hash) {
+	if (cache->generations)
+		cache_atomic_fetch_add_size(generation_for_hash(cache, hash), 1);
+}
+
+/**
+ * @brief Picks the shard that owns a URL hash.
+ * @details Reduced with a multiply-shift over the top 32 bits. The map takes its
+ * tag and group from the low bits, so keys that land in one shard still spread
+ * evenly over that shard's map.
+ */
+static size_t shard_index_for_hash(const proxy_cache_t* cache, unsigned long long h) {
+	return (size_t)(((h >> 32) * cache->shard_count) >> 32);
+}
+
+static cache_shard_t* shard_for_hash(proxy_cache_t* cache, unsigned long long h) {
+	return shard_at(cache, shard_index_for_hash(cache, h));
+}
+
+static int shard_trylock(cache_shard_t* shard) {
+	return cache_lock_try(&shard->lock);
+}
+
+/**
+ * @brief Counts a contended acquisition that started waiting at 'start'.
+ */
+static void record_lock_wait(cache_shard_t* shard, unsigned long long start) {
+	SHARD_STAT_ADD(shard, lock_contended, 1);
+	SHARD_STAT_ADD(shard, lock_wait_ns, (size_t)(cache_now_ns() - start));
+}
+
+/**
+ * @brief Takes the shard lock exclusively.
+ * @details Tries once without blocking first, so only contended acquisitions read the clock.
+ */
+static void shard_lock(cache_shard_t* shard) {
+	if (shard_trylock(shard))
+		return;
+
+	unsigned long long start = cache_now_ns();
+	cache_lock_acquire(&shard->lock);
+	record_lock_wait(shard, start);
+}
+
+static void reclaim_elements(proxy_cache_t* cache, cache_element* dead);
+
+/**
+ * @brief Releases an exclusive hold, then frees what it removed.
+ * @details Removal only unlinks elements; the map erases, payload frees and slab
+ * returns of a whole critical section happen here, after other threads can get in.
+ */
+static void shard_unlock(cache_shard_t* shard) {
+	cache_element* dead = shard->graveyard;
+	shard->graveyard = NULL;
+	cache_lock_release(&shard->lock);
+	if (dead)
+		reclaim_elements(shard->owner, dead);
+}
+
+/**
+ * @brief Takes the shard lock for a lookup: shared in read-mostly mode, exclusive otherwise.
+ * @details Only an RWLOCK can actually be shared; other lock kinds run read-mostly
+ * lookups exclusively, which the CLOCK bookkeeping they do is equally correct under.
+ */
+static void shard_lock_lookup(cache_shard_t* shard) {
+	if (shard->read_mostly ? cache_lock_try_shared(&shard->lock) : cache_lock_try(&shard->lock))
 		return;
 
-	if (element->prev)
-		element->prev->next = element->next;
+	unsigned long long start = cache_now_ns();
+	if (shard->read_mostly)
+		cache_lock_acquire_shared(&shard->lock);
 	else
-		g_cache.head = element->next;
+		cache_lock_acquire(&shard->lock);
+	record_lock_wait(shard, start);
+}
 
-	if (element->next)
-		element->next->prev = element->prev;
+static void shard_unlock_lookup(cache_shard_t* shard) {
+	// Lookups never remove elements, so there is no graveyard to hand off.
+	if (shard->read_mostly)
+		cache_lock_release_shared(&shard->lock);
 	else
-		g_cache.tail = element->prev;
+		cache_lock_release(&shard->lock);
 }
 
 /**
- * @brief Attaches a node to the front (head) of the list.
- * @details This function is not thread-safe and must be called from
- * within a locked critical section.
- * @param element The element to attach.
+ * @brief Returns what an element counts against the budget under the instance's accounting.
  */
+static size_t element_charge(const proxy_cache_t* cache, const cache_element* element) {
+	return cache->accounting == CACHE_ACCOUNT_FOOTPRINT ? element->footprint : element->len;
+}
 
-static void attach_node_to_head_unlocked(cache_element* element) {
-	if (!element)
-		return;
+/**
+ * @brief Computes the footprint of an element before it is allocated.
+ * @details Counts the header-and-key allocation and the payload as their allocator
+ * hands them out (the slab's size class, or a malloc model for heap and adopted
+ * buffers), plus the entry's share of the map table. The share is that of a table
+ * that just doubled, the most slots per entry the map ever holds.
+ */
+static size_t element_footprint(const proxy_cache_t* cache, slab_t* slab, size_t key_len, size_t length,
+	int adopt) {
+	size_t header = sizeof(cache_element) + key_len + 1;
+	size_t footprint = slab ? slab_chunk_size(slab, header) : cache_malloc_footprint(header);
+	footprint += slab && !adopt ? slab_chunk_size(slab, length) : cache_malloc_footprint(length);
+	return footprint + cache->slot_footprint;
+}
 
-	element->next = g_cache.head;
-	element->prev = NULL;
+/**
+ * @brief Adds a stored element's bytes to its shard's totals.
+ */
+static void charge_element_unlocked(cache_shard_t* shard, const cache_element* element) {
+	shard->current_size += element_charge(shard->owner, element);
+	shard->overhead_size += element->footprint - element->len;
+}
 
-	if (g_cache.head) {
-		g_cache.head->prev = element;
-	}
+/**
+ * @brief Takes an element's bytes out of its shard's totals.
+ * @return The bytes it was charged, which the caller returns to a shared budget.
+ */
+static size_t uncharge_element_unlocked(cache_shard_t* shard, const cache_element* element) {
+	size_t charge = element_charge(shard->owner, element);
+	shard->current_size -= charge;
+	shard->overhead_size -= element->footprint - element->len;
+	return charge;
+}
+
+/**
+ * @brief Returns the payload bytes of a shard whose lock the caller holds.
+ */
+static size_t shard_payload_unlocked(const cache_shard_t* shard) {
+	return shard->owner->accounting == CACHE_ACCOUNT_FOOTPRINT
+		? shard->current_size - shard->overhead_size : shard->current_size;
+}
+
+/**
+ * @brief Takes an element out of a locked shard.
+ * @details Unlinks it from the policy, the timer wheel and the map and gives its bytes
+ * back to the budget. The cache's reference moves to the shard's graveyard, so the
+ * element is freed after the lock is released (unless a reader still holds a handle).
+ */
+static void remove_element_unlocked(cache_shard_t* shard, cache_element* element) {
+	cache_policy_remove(&shard->policy, element);
+	cache_timer_cancel(&shard->timers, element);
+	size_t freed = uncharge_element_unlocked(shard, element);
+	if (shard->owner->budget_mode == CACHE_BUDGET_SHARED)
+		cache_atomic_fetch_sub_size(&shard->owner->total_size, freed);
 
-	g_cache.head = element;
+	bump_generation(shard->owner, element->key_hash);
 
-	if (!g_cache.tail) {
-		g_cache.tail = element; //First element in the list
-	}
+	// The map drops a reference when erasing; take one for the graveyard first.
+	cache_atomic_fetch_add_int(&element->refcount, 1);
+	map_erase_entry(shard->map, element, element->key_hash);
+	element->next = shard->graveyard;
+	shard->graveyard = element;
 }
 
 /**
- * @brief Evicts the least-recently-used element from the cache.
+ * @brief Evicts the element chosen by the shard's policy.
  * @details This function is not thread-safe and must be called from
- * within a locked critical section.
+ * within the shard's locked critical section. In read-mostly mode, victims
+ * hit since the policy last saw them are first given that deferred hit
+ * and another victim is chosen; since each hit clears the bit, the loop
+ * ends after at most one pass over the shard.
+ * @return The number of bytes freed, or 0 if the shard was empty.
  */
 
-static void remove_lru_element_unlocked() {
-	cache_element* lru_element = g_cache.tail;
+static size_t remove_lru_element_unlocked(cache_shard_t* shard) {
+	cache_element* lru_element = cache_policy_victim(&shard->policy);
 	if (!lru_element)
-		return;  // Cache is empty, nothing to evict
+		return 0;  // Shard is empty, nothing to evict
+
+	while (cache_atomic_load_relaxed_int(&lru_element->referenced)) {
+		cache_policy_hit(&shard->policy, lru_element);
+		lru_element = cache_policy_victim(&shard->policy);
+	}
 
-	// 1. Unlink from the list and map.
-	detach_node_unlocked(lru_element);
-	g_cache.current_size -= lru_element->len;
+	size_t freed = element_charge(shard->owner, lru_element);
+	SHARD_STAT_ADD(shard, evictions, 1);
+	SHARD_STAT_ADD(shard, bytes_evicted, lru_element->len);
 
-	// Now, just erase from the map. The map will automatically call 'free' on the key (URL)
-	// and 'free_cache_element' on the value, cleaning everything up.
-	map_erase(g_cache.map, lru_element->url);
+	// The disk tier only queues the element here; its writer thread does the I/O.
+	cache_tier_t* tier = shard->owner->tier;
+	if (tier && (lru_element->expires_at == 0 || lru_element->expires_at > now_ms()))
+		cache_tier_spill(tier, lru_element);
+	cache_policy_evict(&shard->policy, lru_element);
+	remove_element_unlocked(shard, lru_element);
+	return freed;
 }
 
+/**
+ * @brief Timer wheel callback: reclaims an element whose TTL has passed.
+ */
+static void expire_element(void* context, cache_element* element) {
+	cache_shard_t* shard = (cache_shard_t*)context;
+	SHARD_STAT_ADD(shard, expirations, 1);
+	remove_element_unlocked(shard, element);
+}
 
 /**
- * @brief Custom free function for the hash map to completely destroy a cache element.
+ * @brief Reclaims up to 'limit' expired elements of a locked shard.
+ * @details Until then, expired elements still count against the budget; lookups
+ * already treat them as misses.
  */
-static void free_cache_element(void* data) {
-	if (!data) return;
-	cache_element* element = (cache_element*)data;
-	free(element->data); // Free the cached content
-	free(element);       // Free the struct itself
+static void expire_due_unlocked(cache_shard_t* shard, unsigned long long now, size_t limit) {
+	cache_timer_advance(&shard->timers, now, limit, expire_element, shard);
 }
 
-/*=============================================================================
- * 3. Public API Functions
- *===========================================================================*/
+/**
+ * @brief Returns how many bytes are in use and allowed under the instance's budget mode.
+ * @details In split mode both refer to the shard alone; in shared mode to the whole instance.
+ */
+static void shard_usage(cache_shard_t* shard, size_t* used, size_t* limit) {
+	proxy_cache_t* cache = shard->owner;
+	if (cache->budget_mode == CACHE_BUDGET_SPLIT) {
+		*used = shard->current_size + shard->reserved_size;
+		*limit = cache_atomic_load_size(&cache->shard_budget);
+	}
+	else {
+		*used = cache_atomic_load_size(&cache->total_size);
+		*limit = cache_atomic_load_size(&cache->max_bytes);
+	}
+}
 
-void cache_init() {
-	g_cache.head = NULL;
-	g_cache.tail = NULL;
-	g_cache.current_size = 0;
+/**
+ * @brief Evicts one element on behalf of 'shard'.
+ * @details Prefers the shard itself. With a shared budget, once the shard is empty it
+ * takes the LRU element of another shard that can be locked without waiting, since
+ * we already hold our own lock.
+ * @return Bytes freed, or 0 if nothing could be evicted right now.
+ */
+static size_t evict_for_shard_unlocked(cache_shard_t* shard, size_t* next_victim) {
+	proxy_cache_t* cache = shard->owner;
+	size_t freed = remove_lru_element_unlocked(shard);
+	if (freed || cache->budget_mode == CACHE_BUDGET_SPLIT)
+		return freed;
 
-	#ifdef _WIN32
-        InitializeCriticalSection(&g_cache.mutex);
-    #else
-        pthread_mutex_init(&g_cache.mutex, NULL);
-    #endif
-
-	g_cache.map = map_create(1024, 0.75f, NULL, NULL, free, free_cache_element);
-	if (g_cache.map == NULL) {
-		fprintf(stderr, "Fatal: Failed to initialize proxy cache map.\n\n");
-		exit(EXIT_FAILURE);
+	for (size_t tries = 0; tries < cache->shard_count && !freed; tries++) {
+		cache_shard_t* victim = shard_at(cache, *next_victim);
+		*next_victim = (*next_victim + 1) % cache->shard_count;
+
+		if (victim != shard && shard_trylock(victim)) {
+			freed = remove_lru_element_unlocked(victim);
+			shard_unlock(victim);
+		}
 	}
+	return freed;
 }
 
+/**
+ * @brief Makes room for 'extra' more bytes in a shard, evicting LRU elements as needed.
+ * @details Must be called with the shard locked. With a shared budget the bytes are
+ * reserved in the global pool first. If the budget was shrunk below current usage,
+ * the write only has to be net-neutral: it frees at least 'extra' bytes plus up to
+ * CACHE_SHRINK_BATCH more elements, so the excess drains over several writes instead
+ * of stalling one of them.
+ * @return 0 if the space is available (and reserved), -1 if it cannot be freed.
+ */
+static int reserve_space_unlocked(cache_shard_t* shard, size_t extra) {
+	proxy_cache_t* cache = shard->owner;
+	int shared = cache->budget_mode == CACHE_BUDGET_SHARED;
+	if (shared)
+		cache_atomic_fetch_add_size(&cache->total_size, extra);
+
+	size_t used, limit, freed = 0, shrink_evictions = 0, next_victim = 0;
+	shard_usage(shard, &used, &limit);
+	if (!shared)
+		used += extra;
 
-void cache_destroy() {
-	#ifdef _WIN32
-        EnterCriticalSection(&g_cache.mutex);
-    #else
-        pthread_mutex_lock(&g_cache.mutex);
-    #endif
+	while (used > limit) {
+		if (used - extra > limit && freed >= extra) {
+			// Over a shrunk budget: this write has paid for itself; drain a little more.
+			if (shrink_evictions++ >= CACHE_SHRINK_BATCH)
+				break;
+		}
 
-	// Destroying the map will call 'free' on all URL keys it contains.
-	map_destroy(g_cache.map);
+		size_t evicted = evict_for_shard_unlocked(shard, &next_victim);
+		if (!evicted) {
+			if (shared)
+				cache_atomic_fetch_sub_size(&cache->total_size, extra);
+			return -1;
+		}
+		freed += evicted;
 
-	// Reset cache state
-	g_cache.head = NULL;
-	g_cache.tail = NULL;
-	g_cache.current_size = 0;
-	g_cache.map = NULL;
+		shard_usage(shard, &used, &limit);
+		if (!shared)
+			used += extra;
+	}
+	return 0;
+}
 
-	// Now, delete the synchronization object
-	#ifdef _WIN32
-        LeaveCriticalSection(&g_cache.mutex);
-        DeleteCriticalSection(&g_cache.mutex);
-    #else
-        pthread_mutex_unlock(&g_cache.mutex);
-        pthread_mutex_destroy(&g_cache.mutex);
-    #endif
+/**
+ * @brief Returns the largest object a shard can hold under the current budget mode.
+ */
+static size_t max_object_size(proxy_cache_t* cache) {
+	return cache->budget_mode == CACHE_BUDGET_SPLIT
+		? cache_atomic_load_size(&cache->shard_budget)
+		: cache_atomic_load_size(&cache->max_bytes);
 }
 
+/**
+ * @brief Returns what storing an object will charge against the budget, before it is allocated.
+ * @details Compared with max_object_size() before the shard lock is taken. With
+ * CACHE_ACCOUNT_FOOTPRINT the charge exceeds the payload, and an object that passes on
+ * its length alone would make the eviction loop empty the shard before it is turned away.
+ * @param adopt Non-zero if the payload buffer is adopted rather than copied.
+ */
+static size_t object_charge(const proxy_cache_t* cache, const cache_shard_t* shard, size_t key_len,
+	size_t length, int adopt) {
+	if (cache->accounting != CACHE_ACCOUNT_FOOTPRINT)
+		return length;
+	return element_footprint(cache, shard->slab, key_len, length, adopt);
+}
 
-//Safe lookup
-cache_element* cache_find(const char* url) {
-	if (!url)
-		return NULL;
-	
-	#ifdef _WIN32
-        EnterCriticalSection(&g_cache.mutex);
-    #else
-        pthread_mutex_lock(&g_cache.mutex);
-    #endif
+/**
+ * @brief Returns bytes reserved by reserve_space_unlocked() that ended up unused.
+ */
+static void release_space_unlocked(cache_shard_t* shard, size_t bytes) {
+	if (shard->owner->budget_mode == CACHE_BUDGET_SHARED)
+		cache_atomic_fetch_sub_size(&shard->owner->total_size, bytes);
+}
 
-	// 1. Find in map (O(1) average)
-	cache_element* element = (cache_element*)map_find(g_cache.map, url);
+/**
+ * @brief Returns bytes a streaming writer held since cache_begin_add() to the budget.
+ */
+static void release_reservation_unlocked(cache_shard_t* shard, size_t bytes) {
+	shard->reserved_size -= bytes;
+	release_space_unlocked(shard, bytes);
+}
 
-	if (element) {
-		// 2. Found! Move it to the front of the list to mark it as most-recently-used.
-		detach_node_unlocked(element);
-		attach_node_to_head_unlocked(element);
+
+/**
+ * @brief Releases a payload buffer with the function that owns it (NULL means free()).
+ */
+static void free_payload(char* data, cache_free_fn data_free) {
+	if (data_free)
+		data_free(data);
+	else
+		free(data);
+}
+
+/**
+ * @brief Releases an element's current payload, whoever allocated it.
+ */
+static void release_payload(cache_element* element) {
+	if (element->data_free)
+		element->data_free(element->data);    // Adopted buffer
+	else if (element->slab)
+		slab_free(element->slab, element->data, element->len);
+	else
+		free(element->data);
+	element->data = NULL;
+}
+
+/**
+ * @brief Points an element at its new payload.
+ * @details Adopted buffers are used as-is; otherwise the bytes are copied into a
+ * buffer the cache allocates, from the element's slab when it has one. Any
+ * previous payload must already be released.
+ * @param raw_len Decoded size of an LZ4-encoded payload, or 0 if 'data' is stored as given.
+ * @return 0 on success, -1 if the copy could not be allocated.
+ */
+static int install_payload(cache_element* element, const char* data, size_t length, size_t raw_len,
+	int adopt, cache_free_fn data_free) {
+	if (adopt) {
+		element->data = (char*)data;
+		element->data_free = data_free ? data_free : free;
+	}
+	else {
+		element->data = element->slab ? slab_alloc(element->slab, length) : malloc(length);
+		element->data_free = NULL;
+		if (element->data == NULL)
+			return -1;
+		memcpy(element->data, data, length); //Copying data from *data to the element
 	}
+	element->len = length;
+	element->raw_len = raw_len ? raw_len : length;
+	element->encoding = raw_len ? CACHE_ENCODING_LZ4 : CACHE_ENCODING_IDENTITY;
+	return 0;
+}
 
-	// 3. Release lock and return
-    #ifdef _WIN32
-        LeaveCriticalSection(&g_cache.mutex);
-    #else
-        pthread_mutex_unlock(&g_cache.mutex);
-    #endif
+/**
+ * @brief Allocates a zeroed element with its key stored right behind the header.
+ * @details One allocation holds both, taken from 'slab' when it is not NULL.
+ * The key is NUL-terminated after its 'key_len' bytes so text URLs can still be printed.
+ */
+static cache_element* alloc_element(slab_t* slab, const char* key, size_t key_len,
+	unsigned long long hash) {
+	size_t size = sizeof(cache_element) + key_len + 1;
+
+	cache_element* element = slab ? slab_alloc(slab, size) : malloc(size);
+	if (!element)
+		return NULL;
+
+	memset(element, 0, sizeof(cache_element));
+	element->slab = slab;
+	element->key_hash = hash;
+	element->url = (char*)(element + 1);
+	element->url_len = key_len;
+	memcpy(element->url, key, key_len);
+	element->url[key_len] = '\0';
 	return element;
 }
 
+/**
+ * @brief Completely destroys a cache element.
+ */
+static void free_cache_element(void* data) {
+	if (!data) return;
+	cache_element* element = (cache_element*)data;
+	if (element->data)
+		release_payload(element); // Free the cached content
 
-void cache_add(const char* url, const char* data, size_t length) {
-	//Pre-condition checks (fail fast).
-	if (url == NULL || data == NULL || length == 0 || length > MAX_CACHE_SIZE) {
-		return;
-	}
+	// The URL lives in the same allocation as the struct.
+	if (element->slab)
+		slab_free(element->slab, element, sizeof(cache_element) + element->url_len + 1);
+	else
+		free(element);
+}
 
-	// Acquire lock to modify the shared cache structure.
-	#ifdef _WIN32
-        EnterCriticalSection(&g_cache.mutex);
-    #else
-        pthread_mutex_lock(&g_cache.mutex);
-    #endif
+/**
+ * @brief Custom value free function for the hash map: drops the cache's own reference.
+ * @details The element is destroyed only when no acquired handle is outstanding.
+ */
+static void release_cache_element(void* data) {
+	if (!data) return;
+	cache_element* element = (cache_element*)data;
+	if (cache_atomic_fetch_add_int(&element->refcount, -1) == 1)
+		free_cache_element(element);
+}
 
-	cache_element* existing_element = (cache_element*)map_find(g_cache.map, url);
+static void release_tier_element(cache_element* element) {
+	release_cache_element(element);
+}
 
-	// CASE 1: The item already exists. We need to UPDATE it.
-	if (existing_element) {
-		// Step 1: Account for the change in size BEFORE eviction.
-		g_cache.current_size -= existing_element->len;
+static void reclaimer_lock(cache_reclaimer_t* reclaimer) {
+	cache_mutex_lock(&reclaimer->mutex);
+}
 
-		// Step 2: Evict other elements if the new data requires more space than is available.
-		while (g_cache.current_size + length > MAX_CACHE_SIZE) {
-			remove_lru_element_unlocked();
-		}
+static void reclaimer_unlock(cache_reclaimer_t* reclaimer) {
+	cache_mutex_unlock(&reclaimer->mutex);
+}
+
+static void reclaimer_wait(cache_reclaimer_t* reclaimer) {
+	cache_cond_wait(&reclaimer->wake, &reclaimer->mutex);
+}
 
-		detach_node_unlocked(existing_element);
+static void reclaimer_signal(cache_reclaimer_t* reclaimer) {
+	cache_cond_signal(&reclaimer->wake);
+}
 
-		// Step 3: Free the old data, allocate for new data, and update metadata.
-		free(existing_element->data);
-		existing_element->data = malloc(length);
-		if (existing_element->data == NULL) {
-			// Severe issue: couldn't allocate. Remove the corrupt element.
-			map_erase(g_cache.map, existing_element->url);
-			// --- Unlock Mutex ---
-			#ifdef _WIN32
-				LeaveCriticalSection(&g_cache.mutex);
-			#else
-				pthread_mutex_unlock(&g_cache.mutex);
-			#endif
-			return;
+/**
+ * @brief Frees a shard's graveyard, or hands it to the reclaimer thread in one piece.
+ * @details If the thread has fallen CACHE_RECLAIM_BACKLOG elements behind, the caller
+ * frees the list itself, so a stalled reclaimer cannot let memory grow without bound.
+ */
+static void reclaim_elements(proxy_cache_t* cache, cache_element* dead) {
+	cache_reclaimer_t* reclaimer = cache->reclaimer;
+	if (reclaimer) {
+		size_t count = 1;
+		cache_element* tail = dead;
+		while (tail->next) {
+			tail = tail->next;
+			count++;
 		}
-		memcpy(existing_element->data, data, length);
-		existing_element->len = length;
 
-		// Step 4: Add the updated size back and attach the node to the head (making it MRU).
-		g_cache.current_size += length;
-		attach_node_to_head_unlocked(existing_element);
-	}
-	// CASE 2: The item is new. We need to INSERT it.
-	else {
-		// Step 1: Evict old elements until there is enough space for the new one.
-		while (g_cache.current_size + length > MAX_CACHE_SIZE) {
-			remove_lru_element_unlocked();
+		reclaimer_lock(reclaimer);
+		int queued = !reclaimer->stopping && reclaimer->dead_count < CACHE_RECLAIM_BACKLOG;
+		if (queued) {
+			tail->next = reclaimer->dead;
+			reclaimer->dead = dead;
+			reclaimer->dead_count += count;
+			reclaimer_signal(reclaimer);
 		}
-		cache_element* new_element = calloc(1, sizeof(cache_element));
-
-		if (new_element == NULL) {
-			// --- Unlock Mutex ---
-			#ifdef _WIN32
-				LeaveCriticalSection(&g_cache.mutex);
-			#else
-				pthread_mutex_unlock(&g_cache.mutex);
-			#endif
+		reclaimer_unlock(reclaimer);
+		if (queued)
 			return;
-		}
+	}
+
+	while (dead) {
+		cache_element* next = dead->next;
+		release_cache_element(dead);
+		dead = next;
+	}
+}
 
-		new_element->url = strdup(url);
-		new_element->data = malloc(length);
+static size_t percent_of(size_t value, unsigned int percent) {
+	return value / 100 * percent + value % 100 * percent / 100;
+}
 
-		if (!new_element->url || !new_element->data) {
-			// Allocation failed, clean up and exit.
-			free(new_element->url);
-			free(new_element->data);
-			free(new_element);
-			
-			#ifdef _WIN32
-				LeaveCriticalSection(&g_cache.mutex);
-			#else
-				pthread_mutex_unlock(&g_cache.mutex);
-			#endif
-			return;
+/**
+ * @brief Wakes the reclaimer once a write takes a locked shard over the high watermark.
+ */
+static void check_high_watermark(cache_shard_t* shard) {
+	proxy_cache_t* cache = shard->owner;
+	cache_reclaimer_t* reclaimer = cache->reclaimer;
+	if (!reclaimer || !cache->high_watermark || cache_atomic_load_relaxed_int(&reclaimer->evict_pending))
+		return;
+
+	size_t used, limit;
+	shard_usage(shard, &used, &limit);
+	if (used <= percent_of(limit, cache->high_watermark))
+		return;
+
+	reclaimer_lock(reclaimer);
+	cache_atomic_store_relaxed_int(&reclaimer->evict_pending, 1);
+	reclaimer_signal(reclaimer);
+	reclaimer_unlock(reclaimer);
+}
+
+/**
+ * @brief Wakes the reclaimer once a write leaves a locked shard's map in the middle of a resize.
+ */
+static void check_resize(cache_shard_t* shard) {
+	cache_reclaimer_t* reclaimer = shard->owner->reclaimer;
+	if (!reclaimer || cache_atomic_load_relaxed_int(&reclaimer->resize_pending)
+		|| map_advance_resize(shard->map, 0) == 0)
+		return;
+
+	reclaimer_lock(reclaimer);
+	cache_atomic_store_relaxed_int(&reclaimer->resize_pending, 1);
+	reclaimer_signal(reclaimer);
+	reclaimer_unlock(reclaimer);
+}
+
+/**
+ * @brief Finishes every shard's in-flight map resize, CACHE_RESIZE_BATCH groups per lock hold.
+ * @details Writers move a few groups per insert anyway; this finishes the job for
+ * shards whose writes stop, so their lookups do not keep probing two tables.
+ */
+static void finish_resizes(proxy_cache_t* cache) {
+	int busy = 1;
+	while (busy && !cache_atomic_load_relaxed_int(&cache->reclaimer->stopping)) {
+		busy = 0;
+		for (size_t i = 0; i < cache->shard_count; i++) {
+			cache_shard_t* shard = shard_at(cache, i);
+			shard_lock(shard);
+			if (map_advance_resize(shard->map, CACHE_RESIZE_BATCH) != 0)
+				busy = 1;
+			shard_unlock(shard);
 		}
+	}
+}
+
+/**
+ * @brief Evicts every shard down to the low watermark, CACHE_RECLAIM_BATCH elements per lock hold.
+ * @details Writers only wait for one batch at a time, and the frees happen after each unlock.
+ */
+static void pre_evict(proxy_cache_t* cache) {
+	int busy = 1;
+	while (busy && !cache_atomic_load_relaxed_int(&cache->reclaimer->stopping)) {
+		busy = 0;
+		for (size_t i = 0; i < cache->shard_count; i++) {
+			cache_shard_t* shard = shard_at(cache, i);
+			size_t used, limit, evicted = 0;
 
-		memcpy(new_element->data, data, length); //Copying data from *data to new->element of length size
-		new_element->len = length;
+			shard_lock(shard);
+			shard_usage(shard, &used, &limit);
+			while (evicted < CACHE_RECLAIM_BATCH && used > percent_of(limit, cache->low_watermark)
+				&& remove_lru_element_unlocked(shard) != 0) {
+				evicted++;
+				shard_usage(shard, &used, &limit);
+			}
+			SHARD_STAT_ADD(shard, pre_evictions, evicted);
+			shard_unlock(shard);
 
-		// 2. Add the new element to the map and the front of the list.
-		attach_node_to_head_unlocked(new_element);
-		map_insert(g_cache.map, new_element->url, new_element);
-		g_cache.current_size += length;
+			if (evicted == CACHE_RECLAIM_BATCH)
+				busy = 1; // Possibly more to do; come back after the other shards.
+		}
 	}
+}
 
-	// --- Unlock Mutex ---
-    #ifdef _WIN32
-        LeaveCriticalSection(&g_cache.mutex);
-    #else
-        pthread_mutex_unlock(&g_cache.mutex);
-    #endif
+#ifdef _WIN32
+static DWORD WINAPI reclaimer_main(LPVOID argument) {
+#else
+static void* reclaimer_main(void* argument) {
+#endif
+	proxy_cache_t* cache = (proxy_cache_t*)argument;
+	cache_reclaimer_t* reclaimer = cache->reclaimer;
+
+	reclaimer_lock(reclaimer);
+	for (;;) {
+		while (!reclaimer->dead && !reclaimer->stopping && !cache_atomic_load_relaxed_int(&reclaimer->evict_pending)
+			&& !cache_atomic_load_relaxed_int(&reclaimer->resize_pending))
+			reclaimer_wait(reclaimer);
+		cache_element* dead = reclaimer->dead;
+		int stopping = reclaimer->stopping;
+		int evict = !stopping && cache_atomic_load_relaxed_int(&reclaimer->evict_pending);
+		int resize = !stopping && cache_atomic_load_relaxed_int(&reclaimer->resize_pending);
+		reclaimer->dead = NULL;
+		reclaimer->dead_count = 0;
+		reclaimer_unlock(reclaimer);
+
+		size_t freed = 0;
+		while (dead) {
+			cache_element* next = dead->next;
+			release_cache_element(dead);
+			dead = next;
+			freed++;
+		}
+		cache_atomic_add_relaxed_size(&reclaimer->reclaimed, freed);
+
+		// Writers skip the wake-up while the flag is set, so clear it only when done.
+		if (evict) {
+			pre_evict(cache);
+			cache_atomic_store_relaxed_int(&reclaimer->evict_pending, 0);
+		}
+		// Cleared first: a resize that starts during the pass must wake the thread again.
+		if (resize) {
+			cache_atomic_store_relaxed_int(&reclaimer->resize_pending, 0);
+			finish_resizes(cache);
+		}
+		if (stopping)
+			break;
+		reclaimer_lock(reclaimer);
+	}
+	return 0;
+}
+
+/**
+ * @brief Starts the reclaimer thread of a new instance.
+ * @return 0 on success, -1 if the thread could not be created.
+ */
+static int start_reclaimer(proxy_cache_t* cache) {
+	cache_reclaimer_t* reclaimer = calloc(1, sizeof(cache_reclaimer_t));
+	if (!reclaimer)
+		return -1;
+
+	cache_mutex_init(&reclaimer->mutex);
+	cache_cond_init(&reclaimer->wake);
+	cache->reclaimer = reclaimer;
+
+	#ifdef _WIN32
+		reclaimer->thread = CreateThread(NULL, 0, reclaimer_main, cache, 0, NULL);
+		int failed = reclaimer->thread == NULL;
+	#else
+		int failed = pthread_create(&reclaimer->thread, NULL, reclaimer_main, cache) != 0;
+	#endif
+	if (!failed)
+		return 0;
+
+	cache_mutex_destroy(&reclaimer->mutex);
+	cache_cond_destroy(&reclaimer->wake);
+	cache->reclaimer = NULL;
+	free(reclaimer);
+	return -1;
+}
+
+/**
+ * @brief Stops the reclaimer after it has freed everything handed to it.
+ * @details From then on every writer frees its own graveyard.
+ */
+static void stop_reclaimer(proxy_cache_t* cache) {
+	cache_reclaimer_t* reclaimer = cache->reclaimer;
+	if (!reclaimer)
+		return;
+
+	reclaimer_lock(reclaimer);
+	cache_atomic_store_relaxed_int(&reclaimer->stopping, 1);
+	reclaimer_signal(reclaimer);
+	reclaimer_unlock(reclaimer);
+	#ifdef _WIN32
+		WaitForSingleObject(reclaimer->thread, INFINITE);
+		CloseHandle(reclaimer->thread);
+	#else
+		pthread_join(reclaimer->thread, NULL);
+	#endif
+	cache_mutex_destroy(&reclaimer->mutex);
+	cache_cond_destroy(&reclaimer->wake);
+	cache->reclaimer = NULL;
+	free(reclaimer);
+}
+
+/**
+ * @brief Looks up a key in a shard whose lookup lock the caller holds, and records the hit with its policy.
+ * @param pin Non-zero to take a reference on the element before the lock is dropped.
+ */
+static cache_element* find_locked(cache_shard_t* shard, const cache_element* probe,
+	unsigned long long hash, int pin) {
+	// 1. Find in map (O(1) average), reusing the hash computed outside the lock.
+	cache_element* element = (cache_element*)map_find_prehashed(shard->map, probe, hash);
+
+	// An expired element is a miss even before the timer wheel reclaims it.
+	if (element && element->expires_at && now_ms() >= element->expires_at)
+		element = NULL;
+
+	if (element) {
+		// 2. Found! Mark it as most-recently-used.
+		if (shard->read_mostly) {
+			// Only readers hold the lock: record the hit and let eviction promote it.
+			// Skip the store when the bit is already set to keep the line shared.
+			if (!cache_atomic_load_relaxed_int(&element->referenced))
+				cache_atomic_store_relaxed_int(&element->referenced, 1);
+		}
+		else {
+			cache_policy_hit(&shard->policy, element);
+		}
+
+		// The map still holds its reference here, so this cannot race with the final free.
+		if (pin)
+			cache_atomic_fetch_add_int(&element->refcount, 1);
+	}
+	return element;
+}
+
+/**
+ * @brief Looks up a key in one shard under its lookup lock.
+ * @param pin Non-zero to take a reference on the element before the lock is dropped.
+ */
+static cache_element* find_in_shard(cache_shard_t* shard, const cache_element* probe,
+	unsigned long long hash, int pin) {
+	shard_lock_lookup(shard);
+	cache_element* element = find_locked(shard, probe, hash, pin);
+	shard_unlock_lookup(shard);
+	return element;
+}
+
+static int add_locked(proxy_cache_t* cache, cache_shard_t* shard, const char* key, size_t key_len,
+	unsigned long long hash, const char* data, size_t length, size_t raw_len, int adopt,
+	cache_free_fn data_free, unsigned long long ttl_ms, cache_element** pinned);
+static cache_element* detached_element(const char* key, size_t key_len, unsigned long long hash,
+	char* buffer, size_t length, cache_free_fn buffer_free);
+
+/**
+ * @brief Brings a key that missed in RAM back from the disk tier.
+ * @details The disk read happens before the shard lock is taken. If another thread
+ * stored the key in the meantime, its newer version wins and the copy is dropped.
+ * @param pin Non-zero to return the element with a reference taken for the caller.
+ */
+static cache_element* promote_from_tier(proxy_cache_t* cache, cache_shard_t* shard, const char* key,
+	size_t key_len, unsigned long long hash, int pin) {
+	char* buffer = NULL;
+	size_t length = 0, raw_len = 0;
+	unsigned long long ttl_ms = 0;
+	if (cache_tier_take(cache->tier, key, key_len, hash, now_ms(), &buffer, &length, &raw_len, &ttl_ms) != 0)
+		return NULL;
+	if (object_charge(cache, shard, key_len, length, 1) > max_object_size(cache)) {
+		free(buffer);
+		return NULL;
+	}
+
+	cache_element probe;
+	init_probe(&probe, key, key_len);
+	cache_element* element = NULL;
+
+	shard_lock(shard);
+	cache_element* existing = find_locked(shard, &probe, hash, 1);
+	if (existing)
+		element = existing;
+	else if (add_locked(cache, shard, key, key_len, hash, buffer, length, raw_len, 1, NULL, ttl_ms, &element) != 0)
+		element = NULL; // add_locked() released the buffer.
+	shard_unlock(shard);
+
+	if (!existing && !element)
+		cache_atomic_add_relaxed_size(&cache->rejections, 1);
+	if (!existing)
+		trace_access(cache, hash, length, CACHE_TRACE_ADD, element != NULL); // The promotion refills RAM.
+
+	if (existing)
+		free(buffer);
+	if (element && !pin)
+		release_cache_element(element); // The cache still holds its own reference.
+	return element;
+}
+
+/**
+ * @brief Looks up a key and records the hit.
+ * @param pin Non-zero to take a reference on the element before the lock is dropped.
+ */
+static cache_element* lookup_element(proxy_cache_t* cache, const char* key, size_t key_len, int pin) {
+	unsigned long long hash = hash_key(key, key_len);
+	cache_shard_t* shard = shard_for_hash(cache, hash);
+	cache_element probe;
+	init_probe(&probe, key, key_len);
+	unsigned long long start = shard->latency ? cache_now_ns() : 0;
+
+	// The trace reads the size under the lock: an unpinned element may be freed right after.
+	shard_lock_lookup(shard);
+	cache_element* element = find_locked(shard, &probe, hash, pin);
+	trace_access(cache, hash, element ? element->len : 0, CACHE_TRACE_FIND, element != NULL);
+	shard_unlock_lookup(shard);
+
+	if (element)
+		SHARD_STAT_ADD(shard, hits, 1);
+	else
+		SHARD_STAT_ADD(shard, misses, 1);
+	if (shard->latency)
+		cache_histogram_record_atomic(shard->latency, cache_now_ns() - start);
+
+	if (!element && cache->tier)
+		element = promote_from_tier(cache, shard, key, key_len, hash, pin);
+	return element;
+}
+
+/**
+ * @brief Copies a small element for a front cache of a NUMA-aware instance.
+ * @details The copy is detached (in no map, freed by its last release) and allocated
+ * by the front's own thread, so it lives on that thread's node while the original
+ * stays on its shard's node.
+ * @return The copy, or NULL if the instance has one node or the payload is too large.
+ */
+static cache_element* replicate_element(proxy_cache_t* cache, const cache_element* element) {
+	if (cache->numa_nodes < 2 || element->len > CACHE_FRONT_REPLICA_BYTES)
+		return NULL;
+
+	char* buffer = malloc(element->len);
+	if (!buffer)
+		return NULL;
+	memcpy(buffer, element->data, element->len);
+	cache_element* replica = detached_element(element->url, element->url_len, element->key_hash,
+		buffer, element->len, NULL);
+	if (replica) {
+		replica->raw_len = element->raw_len;
+		replica->encoding = element->encoding;
+		replica->expires_at = element->expires_at;
+	}
+	return replica;
+}
+
+/**
+ * @brief Empties a front cache slot, dropping its handle and replica.
+ */
+static void clear_front_slot(front_slot_t* slot) {
+	release_cache_element(slot->element);
+	release_cache_element(slot->replica);
+	slot->element = NULL;
+	slot->replica = NULL;
+}
+
+/**
+ * @brief Looks up a key through a front cache, refilling its slot from the shared cache.
+ * @details The stripe generation is read before the shared lookup: a change that
+ * lands after that read shows up as a newer generation at the next hit, so a handle
+ * is never trusted past an update or removal it might have missed.
+ * @param pin Non-zero to take a reference for the caller as well.
+ */
+static cache_element* front_lookup(cache_front_t* front, const char* key, size_t key_len, int pin) {
+	proxy_cache_t* cache = front->cache;
+	unsigned long long hash = hash_key(key, key_len);
+	front_slot_t* slot = &front->slots[(size_t)(hash >> 32) & front->mask];
+	volatile size_t* generation = generation_for_hash(cache, hash);
+	cache_element* element = slot->element;
+
+	if (element) {
+		// The handle is pinned, so its key can be compared without any lock.
+		int same_key = element->key_hash == hash && element->url_len == key_len
+			&& memcmp(element->url, key, key_len) == 0;
+		if (same_key && slot->generation == cache_atomic_load_size(generation)
+			&& (element->expires_at == 0 || now_ms() < element->expires_at)) {
+			if (slot->score < CACHE_FRONT_MAX_SCORE)
+				slot->score++;
+			// Stands in for the hit the policy does not see; written only when it was clear.
+			if (!cache_atomic_load_relaxed_int(&element->referenced))
+				cache_atomic_store_relaxed_int(&element->referenced, 1);
+			if (slot->replica)
+				element = slot->replica;
+			if (pin)
+				cache_atomic_fetch_add_int(&element->refcount, 1);
+			front->stats.hits++;
+			trace_access(cache, hash, element->len, CACHE_TRACE_FIND, 1);
+			return element;
+		}
+
+		if (!same_key && slot->score > 1) {
+			slot->score--; // The resident keeps its slot while it is the hotter key.
+			front->stats.misses++;
+			return lookup_element(cache, key, key_len, pin);
+		}
+		if (same_key)
+			front->stats.stale++;
+		clear_front_slot(slot);
+	}
+
+	front->stats.misses++;
+	size_t taken_at = cache_atomic_load_size(generation);
+	element = lookup_element(cache, key, key_len, 1);
+	if (element) {
+		slot->element = element;
+		slot->replica = replicate_element(cache, element);
+		slot->generation = taken_at;
+		slot->score = 1;
+		if (slot->replica)
+			element = slot->replica;
+		if (pin)
+			cache_atomic_fetch_add_int(&element->refcount, 1);
+	}
+	return element;
+}
+
+/**
+ * @brief Stores one element in a shard whose exclusive lock the caller holds.
+ * @details On failure an adopted buffer has already been released.
+ * @param raw_len Decoded size of an LZ4-encoded payload, or 0 if 'data' is stored as given.
+ */
+static int add_locked(proxy_cache_t* cache, cache_shard_t* shard, const char* key, size_t key_len,
+	unsigned long long hash, const char* data, size_t length, size_t raw_len, int adopt,
+	cache_free_fn data_free, unsigned long long ttl_ms, cache_element** pinned) {
+	cache_element probe;
+	init_probe(&probe, key, key_len);
+
+	size_t footprint = element_footprint(cache, shard->slab, key_len, length, adopt);
+	size_t charge = cache->accounting == CACHE_ACCOUNT_FOOTPRINT ? footprint : length;
+	if (charge > max_object_size(cache)) {
+		// Callers check first; this catches a budget lowered since. Nothing is evicted for it.
+		if (adopt)
+			free_payload((char*)data, data_free);
+		return -1;
+	}
+
+	// Any copy on disk is older than what is being written now.
+	if (cache->tier)
+		cache_tier_invalidate(cache->tier, hash);
+
+	shard->policy.capacity = cache_atomic_load_size(&cache->shard_budget);
+
+	// Reclaim a few expired elements first; they are the cheapest room there is.
+	unsigned long long now = 0;
+	if (ttl_ms || shard->timers.count) {
+		now = now_ms();
+		expire_due_unlocked(shard, now, CACHE_EXPIRE_BATCH);
+	}
+
+	cache_element* existing_element = (cache_element*)map_find_prehashed(shard->map, &probe, hash);
+	int is_update = existing_element != NULL;
+	cache_element* stored = NULL;
+	if (is_update)
+		bump_generation(cache, hash);
+
+	// Readers hold handles to this version, so its buffer must not change under them.
+	// Retire it (they keep it alive until they release it) and publish a new element.
+	// No one can take a new handle meanwhile, since that needs the shard lock.
+	if (existing_element && cache_atomic_load_int(&existing_element->refcount) > 1) {
+		cache_policy_remove(&shard->policy, existing_element);
+		cache_timer_cancel(&shard->timers, existing_element);
+		release_space_unlocked(shard, uncharge_element_unlocked(shard, existing_element));
+		map_erase_entry(shard->map, existing_element, hash);
+		existing_element = NULL;
+	}
+
+	// CASE 1: The item already exists. We need to UPDATE it.
+	if (existing_element) {
+		// Step 1: Account for the change in size BEFORE eviction, and take the element
+		// out of the policy so the eviction below cannot pick it.
+		release_space_unlocked(shard, uncharge_element_unlocked(shard, existing_element));
+		cache_policy_remove(&shard->policy, existing_element);
+		cache_timer_cancel(&shard->timers, existing_element);
+
+		// Step 2: Evict other elements if the new data requires more space than is available.
+		if (reserve_space_unlocked(shard, charge) != 0) {
+			// The new data does not fit; the stale version cannot stay either.
+			map_erase_entry(shard->map, existing_element, hash);
+			if (adopt)
+				free_payload((char*)data, data_free);
+			return -1;
+		}
+
+		// Step 3: Release the old data and install the new one. For adopted buffers
+		// this is just a pointer swap.
+		release_payload(existing_element);
+		if (install_payload(existing_element, data, length, raw_len, adopt, data_free) != 0) {
+			// Severe issue: couldn't allocate. Remove the corrupt element.
+			release_space_unlocked(shard, charge);
+			map_erase_entry(shard->map, existing_element, hash);
+			return -1;
+		}
+
+		// Step 4: Hand the element back to the policy (making it MRU) and add the updated size back.
+		existing_element->footprint = footprint;
+		if (cache_policy_insert(&shard->policy, existing_element) != 0) {
+			release_space_unlocked(shard, charge);
+			map_erase_entry(shard->map, existing_element, hash);
+			return -1;
+		}
+		charge_element_unlocked(shard, existing_element);
+		stored = existing_element;
+	}
+	// CASE 2: The item is new. We need to INSERT it.
+	else {
+		// Step 1: Evict old elements until there is enough space for the new one.
+		if (reserve_space_unlocked(shard, charge) != 0) {
+			if (adopt)
+				free_payload((char*)data, data_free);
+			return -1;
+		}
+		cache_element* new_element = alloc_element(shard->slab, key, key_len, hash);
+
+		if (new_element == NULL) {
+			release_space_unlocked(shard, charge);
+			if (adopt)
+				free_payload((char*)data, data_free);
+			return -1;
+		}
+
+		if (install_payload(new_element, data, length, raw_len, adopt, data_free) != 0) {
+			// Allocation failed, clean up and exit.
+			free_cache_element(new_element);
+
+			release_space_unlocked(shard, charge);
+			return -1;
+		}
+
+		new_element->refcount = 1; // The cache's own reference
+		new_element->footprint = footprint;
+
+		// 2. Add the new element to the map and the front of the list.
+		if (map_insert_prehashed(shard->map, new_element, new_element, hash) != 0) {
+			// The map could not grow; the element was never published.
+			free_cache_element(new_element);
+			release_space_unlocked(shard, charge);
+			return -1;
+		}
+
+		if (cache_policy_insert(&shard->policy, new_element) != 0) {
+			// Erasing drops the only reference, which frees the element.
+			map_erase_entry(shard->map, new_element, hash);
+			release_space_unlocked(shard, charge);
+			return -1;
+		}
+		charge_element_unlocked(shard, new_element);
+		stored = new_element;
+	}
+
+	stored->expires_at = ttl_ms ? now + ttl_ms : 0;
+	if (ttl_ms)
+		cache_timer_schedule(&shard->timers, stored);
+
+	if (is_update)
+		SHARD_STAT_ADD(shard, updates, 1);
+	else
+		SHARD_STAT_ADD(shard, inserts, 1);
+
+	if (pinned) {
+		cache_atomic_fetch_add_int(&stored->refcount, 1);
+		*pinned = stored;
+	}
+
+	check_high_watermark(shard);
+	check_resize(shard);
+	return 0;
+}
+
+/**
+ * @brief Replaces a payload with its LZ4 encoding when that saves at least an eighth.
+ * @details Runs before the shard lock is taken. Once the encoded copy exists an
+ * adopted original is released; otherwise the payload is left as it was.
+ * @return The payload's decoded size if it was encoded, or 0.
+ */
+static size_t compress_payload(proxy_cache_t* cache, const char** data, size_t* length, int* adopt,
+	cache_free_fn* data_free) {
+	if (cache->compression != CACHE_ENCODING_LZ4 || *length < CACHE_COMPRESS_MIN_BYTES)
+		return 0;
+
+	size_t capacity = *length - *length / 8;
+	char* encoded = malloc(capacity);
+	if (!encoded)
+		return 0;
+	size_t encoded_len = cache_lz4_compress(*data, *length, encoded, capacity);
+	if (encoded_len == 0) {
+		free(encoded);
+		return 0;
+	}
+	char* shrunk = realloc(encoded, encoded_len);
+	if (shrunk)
+		encoded = shrunk;
+
+	size_t raw_len = *length;
+	if (*adopt)
+		free_payload((char*)*data, *data_free);
+	*data = encoded;
+	*length = encoded_len;
+	*adopt = 1;
+	*data_free = NULL;
+	cache_atomic_add_relaxed_size(&cache->compressed, 1);
+	return raw_len;
+}
+
+/**
+ * @brief Inserts or updates a key. Shared by the add and add_adopt entry points.
+ * @param raw_len Decoded size if 'data' is already LZ4-encoded, or 0 to let the
+ * instance's compression setting decide.
+ * @param adopt Non-zero if 'data' is a heap buffer whose ownership moves to the cache.
+ * On every failure path an adopted buffer is released with 'data_free'.
+ * @param ttl_ms Milliseconds until the element expires, or 0 for never.
+ * @param pinned If not NULL, receives the stored element with a reference taken for the caller.
+ * @return 0 if the object is cached, -1 otherwise.
+ */
+static int add_element(proxy_cache_t* cache, const char* key, size_t key_len, const char* data,
+	size_t length, size_t raw_len, int adopt, cache_free_fn data_free, unsigned long long ttl_ms,
+	cache_element** pinned) {
+	//Pre-condition checks (fail fast).
+	if (cache == NULL || key == NULL || data == NULL || length == 0) {
+		if (adopt && data)
+			free_payload((char*)data, data_free);
+		return -1;
+	}
+
+	// The budget counts stored bytes, so the size limit applies after compression.
+	if (raw_len == 0)
+		raw_len = compress_payload(cache, &data, &length, &adopt, &data_free);
+	unsigned long long hash = hash_key(key, key_len);
+	cache_shard_t* shard = shard_for_hash(cache, hash);
+	if (object_charge(cache, shard, key_len, length, adopt) > max_object_size(cache)) {
+		if (adopt)
+			free_payload((char*)data, data_free);
+		return -1;
+	}
+
+	// Acquire lock to modify the shared cache structure.
+	shard_lock(shard);
+	int result = add_locked(cache, shard, key, key_len, hash, data, length, raw_len, adopt, data_free,
+		ttl_ms, pinned);
+	// --- Unlock Mutex ---
+	shard_unlock(shard);
+	trace_access(cache, hash, length, CACHE_TRACE_ADD, result == 0);
+	return result;
+}
+
+/**
+ * @brief Applies one queued add on its owner thread and reports the result.
+ */
+static void apply_async_add(proxy_cache_t* cache, cache_async_add_t* add) {
+	int result = add_element(cache, (const char*)(add + 1), add->key_len, add->data, add->length, 0, 1,
+		NULL, add->ttl_ms, NULL);
+	if (result != 0)
+		cache_atomic_add_relaxed_size(&cache->rejections, 1);
+	if (add->done)
+		add->done(add->context, result);
+	free(add);
+}
+
+#ifdef _WIN32
+static DWORD WINAPI owner_main(LPVOID argument) {
+#else
+static void* owner_main(void* argument) {
+#endif
+	cache_owner_t* owner = (cache_owner_t*)argument;
+
+	for (;;) {
+		cache_async_add_t* batch = (cache_async_add_t*)cache_atomic_exchange_ptr(&owner->queue, NULL);
+		if (!batch) {
+			// Queue everything that was pushed before stopping: only leave once it is empty.
+			cache_mutex_lock(&owner->mutex);
+			while (!cache_atomic_load_ptr(&owner->queue) && !owner->stopping)
+				cache_cond_wait(&owner->wake, &owner->mutex);
+			int done = owner->stopping && !cache_atomic_load_ptr(&owner->queue);
+			cache_mutex_unlock(&owner->mutex);
+			if (done)
+				break;
+			continue;
+		}
+
+		// The stack is newest first; reverse it so adds to one key land in queue order.
+		cache_async_add_t* oldest = NULL;
+		while (batch) {
+			cache_async_add_t* next = batch->next;
+			batch->next = oldest;
+			oldest = batch;
+			batch = next;
+		}
+		size_t applied = 0;
+		while (oldest) {
+			cache_async_add_t* next = oldest->next;
+			apply_async_add(owner->cache, oldest);
+			oldest = next;
+			applied++;
+		}
+
+		cache_atomic_fetch_add_size(&owner->completed, applied);
+		cache_mutex_lock(&owner->mutex);
+		cache_cond_broadcast(&owner->drained);
+		cache_mutex_unlock(&owner->mutex);
+	}
+	return 0;
+}
+
+/**
+ * @brief Stops and frees the first 'count' owner threads, after they applied everything queued.
+ */
+static void stop_owners(proxy_cache_t* cache, unsigned int count) {
+	for (unsigned int i = 0; i < count; i++) {
+		cache_owner_t* owner = cache->owners[i];
+		cache_mutex_lock(&owner->mutex);
+		owner->stopping = 1;
+		cache_cond_signal(&owner->wake);
+		cache_mutex_unlock(&owner->mutex);
+		#ifdef _WIN32
+			WaitForSingleObject(owner->thread, INFINITE);
+			CloseHandle(owner->thread);
+		#else
+			pthread_join(owner->thread, NULL);
+		#endif
+		cache_mutex_destroy(&owner->mutex);
+		cache_cond_destroy(&owner->wake);
+		cache_cond_destroy(&owner->drained);
+		cache_aligned_free(owner);
+	}
+	free(cache->owners);
+	cache->owners = NULL;
+	cache->owner_count = 0;
+}
+
+/**
+ * @brief Starts 'count' owner threads (at most one per shard) for a new instance.
+ * @details Each owner gets its own cache lines, so producers pushing to one owner's
+ * queue do not disturb another's.
+ * @return 0 on success, -1 if memory or a thread could not be had.
+ */
+static int start_owners(proxy_cache_t* cache, unsigned int count) {
+	if (count > cache->shard_count)
+		count = (unsigned int)cache->shard_count;
+	cache->owners = calloc(count, sizeof(cache_owner_t*));
+	if (!cache->owners)
+		return -1;
+
+	for (unsigned int i = 0; i < count; i++) {
+		cache_owner_t* owner = cache_aligned_calloc(sizeof(cache_owner_t));
+		if (!owner) {
+			stop_owners(cache, i);
+			return -1;
+		}
+		owner->cache = cache;
+		cache_mutex_init(&owner->mutex);
+		cache_cond_init(&owner->wake);
+		cache_cond_init(&owner->drained);
+		#ifdef _WIN32
+			owner->thread = CreateThread(NULL, 0, owner_main, owner, 0, NULL);
+			int failed = owner->thread == NULL;
+		#else
+			int failed = pthread_create(&owner->thread, NULL, owner_main, owner) != 0;
+		#endif
+		if (failed) {
+			cache_mutex_destroy(&owner->mutex);
+			cache_cond_destroy(&owner->wake);
+			cache_cond_destroy(&owner->drained);
+			cache_aligned_free(owner);
+			stop_owners(cache, i);
+			return -1;
+		}
+		cache->owners[i] = owner;
+	}
+	cache->owner_count = count;
+	return 0;
+}
+
+/**
+ * @brief Looks up a key only if its shard lock is free right now.
+ */
+static int try_lookup(proxy_cache_t* cache, const char* key, size_t key_len, int pin, cache_element** element) {
+	unsigned long long hash = hash_key(key, key_len);
+	cache_shard_t* shard = shard_for_hash(cache, hash);
+	cache_element probe;
+	init_probe(&probe, key, key_len);
+
+	if (!(shard->read_mostly ? cache_lock_try_shared(&shard->lock) : cache_lock_try(&shard->lock))) {
+		SHARD_STAT_ADD(shard, busy, 1);
+		return CACHE_BUSY;
+	}
+	*element = find_locked(shard, &probe, hash, pin);
+	trace_access(cache, hash, *element ? (*element)->len : 0, CACHE_TRACE_FIND, *element != NULL);
+	shard_unlock_lookup(shard);
+
+	if (*element)
+		SHARD_STAT_ADD(shard, hits, 1);
+	else
+		SHARD_STAT_ADD(shard, misses, 1);
+	return 0;
+}
+
+/**
+ * @brief Returns a writer's reservation to the budget and frees it, with its buffer if still owned.
+ */
+static void close_writer(cache_writer_t* writer) {
+	if (writer->reserved) {
+		shard_lock(writer->shard);
+		release_reservation_unlocked(writer->shard, writer->reserved);
+		shard_unlock(writer->shard);
+	}
+	free(writer->buffer);
+	free(writer);
+}
+
+/**
+ * @brief Looks up a batch of keys, taking each shard's lock once per chunk.
+ * @details Keys are hashed up front and grouped by shard. Within a group every
+ * home bucket is prefetched before the first probe, so the cache misses overlap.
+ * @return The number of keys found.
+ */
+static size_t lookup_many(proxy_cache_t* cache, const cache_key_t* keys, size_t count,
+	cache_element** results, int pin) {
+	size_t found = 0;
+
+	for (size_t base = 0; base < count; base += CACHE_BATCH_CHUNK) {
+		size_t n = count - base < CACHE_BATCH_CHUNK ? count - base : CACHE_BATCH_CHUNK;
+		unsigned long long hashes[CACHE_BATCH_CHUNK];
+		cache_shard_t* shards[CACHE_BATCH_CHUNK];
+
+		for (size_t i = 0; i < n; i++) {
+			const cache_key_t* key = &keys[base + i];
+			results[base + i] = NULL;
+			shards[i] = NULL;
+			if (!key->data)
+				continue;
+			hashes[i] = hash_key(key->data, key->len);
+			shards[i] = shard_for_hash(cache, hashes[i]);
+		}
+
+		// Each pass serves the first key not yet served and every later key of the same shard.
+		for (size_t i = 0; i < n; i++) {
+			cache_shard_t* shard = shards[i];
+			if (!shard)
+				continue;
+			size_t hits = 0, misses = 0;
+
+			shard_lock_lookup(shard);
+			for (size_t j = i; j < n; j++) {
+				if (shards[j] == shard)
+					map_prefetch(shard->map, hashes[j]);
+			}
+			for (size_t j = i; j < n; j++) {
+				if (shards[j] != shard)
+					continue;
+				cache_element probe;
+				init_probe(&probe, keys[base + j].data, keys[base + j].len);
+				results[base + j] = find_locked(shard, &probe, hashes[j], pin);
+				if (results[base + j])
+					hits++;
+				else
+					misses++;
+				trace_access(cache, hashes[j], results[base + j] ? results[base + j]->len : 0,
+					CACHE_TRACE_FIND, results[base + j] != NULL);
+				shards[j] = NULL;
+			}
+			shard_unlock_lookup(shard);
+
+			SHARD_STAT_ADD(shard, hits, hits);
+			SHARD_STAT_ADD(shard, misses, misses);
+			found += hits;
+		}
+
+		// Disk reads happen after every shard lock of the chunk is released.
+		for (size_t i = 0; cache->tier && i < n; i++) {
+			const cache_key_t* key = &keys[base + i];
+			if (results[base + i] || !key->data)
+				continue;
+			results[base + i] = promote_from_tier(cache, shard_for_hash(cache, hashes[i]), key->data,
+				key->len, hashes[i], pin);
+			if (results[base + i])
+				found++;
+		}
+	}
+	return found;
+}
+
+/**
+ * @brief Inserts or updates a batch of items, taking each shard's lock once per chunk.
+ * @return The number of items cached.
+ */
+static size_t add_many(proxy_cache_t* cache, const cache_item_t* items, size_t count) {
+	size_t stored = 0;
+	size_t limit = max_object_size(cache);
+
+	for (size_t base = 0; base < count; base += CACHE_BATCH_CHUNK) {
+		size_t n = count - base < CACHE_BATCH_CHUNK ? count - base : CACHE_BATCH_CHUNK;
+		unsigned long long hashes[CACHE_BATCH_CHUNK];
+		cache_shard_t* shards[CACHE_BATCH_CHUNK];
+		const char* payloads[CACHE_BATCH_CHUNK];
+		size_t lengths[CACHE_BATCH_CHUNK], raw_lens[CACHE_BATCH_CHUNK];
+
+		// Compression, like hashing, happens before any lock is taken.
+		for (size_t i = 0; i < n; i++) {
+			const cache_item_t* item = &items[base + i];
+			shards[i] = NULL;
+			if (!item->key || !item->data || item->length == 0)
+				continue;
+			int encoded = 0;
+			cache_free_fn encoded_free = NULL;
+			payloads[i] = item->data;
+			lengths[i] = item->length;
+			raw_lens[i] = compress_payload(cache, &payloads[i], &lengths[i], &encoded, &encoded_free);
+			hashes[i] = hash_key(item->key, item->key_len);
+			cache_shard_t* shard = shard_for_hash(cache, hashes[i]);
+			if (object_charge(cache, shard, item->key_len, lengths[i], encoded) > limit) {
+				if (encoded)
+					free((char*)payloads[i]);
+				continue;
+			}
+			shards[i] = shard;
+		}
+
+		for (size_t i = 0; i < n; i++) {
+			cache_shard_t* shard = shards[i];
+			if (!shard)
+				continue;
+
+			shard_lock(shard);
+			for (size_t j = i; j < n; j++) {
+				if (shards[j] == shard)
+					map_prefetch(shard->map, hashes[j]);
+			}
+			for (size_t j = i; j < n; j++) {
+				if (shards[j] != shard)
+					continue;
+				const cache_item_t* item = &items[base + j];
+				// An encoded copy is the batch's own buffer: the cache adopts it.
+				int result = add_locked(cache, shard, item->key, item->key_len, hashes[j], payloads[j],
+					lengths[j], raw_lens[j], raw_lens[j] != 0, NULL, item->ttl_ms, NULL);
+				if (result == 0)
+					stored++;
+				trace_access(cache, hashes[j], lengths[j], CACHE_TRACE_ADD, result == 0);
+				shards[j] = NULL;
+			}
+			shard_unlock(shard);
+		}
+	}
+
+	if (stored < count)
+		cache_atomic_add_relaxed_size(&cache->rejections, count - stored);
+	return stored;
+}
+
+static void flight_lock(cache_shard_t* shard) {
+	cache_mutex_lock(&shard->flight_mutex);
+}
+
+static void flight_unlock(cache_shard_t* shard) {
+	cache_mutex_unlock(&shard->flight_mutex);
+}
+
+/**
+ * @brief Blocks until some flight of the shard completes. Called with flight_mutex held.
+ */
+static void flight_wait(cache_shard_t* shard) {
+	cache_cond_wait(&shard->flight_done, &shard->flight_mutex);
+}
+
+static void flight_broadcast(cache_shard_t* shard) {
+	cache_cond_broadcast(&shard->flight_done);
+}
+
+/**
+ * @brief Returns the linked flight loading 'key', or NULL. Called with flight_mutex held.
+ */
+static cache_flight_t* find_flight(cache_shard_t* shard, const char* key, size_t key_len,
+	unsigned long long hash) {
+	for (cache_flight_t* flight = shard->flights; flight; flight = flight->next) {
+		if (flight->hash == hash && flight->key_len == key_len && memcmp(flight->key, key, key_len) == 0)
+			return flight;
+	}
+	return NULL;
+}
+
+/**
+ * @brief Wraps a loaded buffer in an element that is not in the cache.
+ * @details Used when the object is larger than the cache may hold, so the callers
+ * that waited for it still get the data. The last cache_release() frees it.
+ * @return The element with one reference, or NULL (the buffer is released).
+ */
+static cache_element* detached_element(const char* key, size_t key_len, unsigned long long hash,
+	char* buffer, size_t length, cache_free_fn buffer_free) {
+	cache_element* element = alloc_element(NULL, key, key_len, hash);
+	if (!element) {
+		free_payload(buffer, buffer_free);
+		return NULL;
+	}
+	install_payload(element, buffer, length, 0, 1, buffer_free); // Adopting cannot fail.
+	element->refcount = 1;
+	return element;
+}
+
+/**
+ * @brief Runs the loader for a key and stores its result.
+ * @return The element with a reference for the caller, or NULL if the load failed.
+ */
+static cache_element* load_element(proxy_cache_t* cache, cache_shard_t* shard, const char* key,
+	size_t key_len, unsigned long long hash, cache_loader_fn loader, void* context) {
+	char* buffer = NULL;
+	size_t length = 0;
+	cache_free_fn buffer_free = NULL;
+
+	SHARD_STAT_ADD(shard, loads, 1);
+	if (loader(context, key, key_len, &buffer, &length, &buffer_free) != 0 || buffer == NULL)
+		return NULL;
+	if (length == 0) {
+		free_payload(buffer, buffer_free);
+		return NULL;
+	}
+
+	cache_element* element = NULL;
+	if (object_charge(cache, shard, key_len, length, 1) <= max_object_size(cache)) {
+		if (add_element(cache, key, key_len, buffer, length, 0, 1, buffer_free, cache->default_ttl_ms,
+			&element) == 0)
+			return element;
+		cache_atomic_add_relaxed_size(&cache->rejections, 1);
+		return NULL; // add_element() released the buffer.
+	}
+
+	cache_atomic_add_relaxed_size(&cache->rejections, 1);
+	return detached_element(key, key_len, hash, buffer, length, buffer_free);
+}
+
+/**
+ * @brief Drops a waiter's claim on a completed flight, freeing it after the last one.
+ * @param last Non-zero if the caller was the last waiter (decided under flight_mutex).
+ */
+static void leave_flight(cache_flight_t* flight, int last) {
+	if (!last)
+		return;
+	release_cache_element(flight->result); // The reference held for the waiters.
+	free(flight);
+}
+
+// Elements of one shard pinned for writing to a snapshot outside the lock.
+typedef struct snapshot_batch {
+	cache_element** elements;
+	size_t count;
+	size_t capacity;
+	int failed;              // Non-zero if the array could not grow.
+} snapshot_batch_t;
+
+static void collect_element(void* context, cache_element* element) {
+	snapshot_batch_t* batch = (snapshot_batch_t*)context;
+	if (batch->failed)
+		return;
+	if (batch->count == batch->capacity) {
+		size_t capacity = batch->capacity ? batch->capacity * 2 : 256;
+		cache_element** elements = (cache_element**)realloc(batch->elements, capacity * sizeof(cache_element*));
+		if (!elements) {
+			batch->failed = 1;
+			return;
+		}
+		batch->elements = elements;
+		batch->capacity = capacity;
+	}
+	cache_atomic_fetch_add_int(&element->refcount, 1);
+	batch->elements[batch->count++] = element;
+}
+
+/**
+ * @brief Snapshot reader callback: adopts a payload that lives in the snapshot mapping.
+ * @details Compressed payloads stay compressed, whatever the loading instance's setting.
+ */
+static void load_snapshot_entry(void* context, const char* key, size_t key_len, char* data,
+	size_t length, size_t raw_len, cache_free_fn data_free, unsigned long long ttl_ms) {
+	proxy_cache_t* cache = (proxy_cache_t*)context;
+	if (add_element(cache, key, key_len, data, length, raw_len, 1, data_free, ttl_ms, NULL) != 0)
+		cache_atomic_add_relaxed_size(&cache->rejections, 1);
+}
+
+/**
+ * @brief Copies the trace ring, oldest record first.
+ * @return A malloc'd array of '*count' records, or NULL if tracing is off or memory ran out.
+ */
+static cache_trace_record_t* collect_trace(proxy_cache_t* cache, size_t* count) {
+	if (!cache->trace)
+		return NULL;
+	size_t capacity = cache_trace_capacity(cache->trace);
+	cache_trace_record_t* records = malloc(capacity * sizeof(cache_trace_record_t));
+	if (records)
+		*count = cache_trace_collect(cache->trace, records, capacity);
+	return records;
+}
+
+/**
+ * @brief Releases the shard array, however it was allocated.
+ */
+static void free_shards(proxy_cache_t* cache) {
+	if (cache->numa_nodes)
+		cache_numa_free(cache->shards, cache->shard_bytes);
+	else
+		cache_aligned_free(cache->shards);
+}
+
+/**
+ * @brief Sets an instance budget and divides it between the shards.
+ */
+static void apply_budget(proxy_cache_t* cache, size_t max_bytes) {
+	cache_atomic_store_size(&cache->max_bytes, max_bytes);
+	cache_atomic_store_size(&cache->shard_budget, max_bytes / cache->shard_count);
+}
+
+/*=============================================================================
+ * 3. Public API Functions (Instances)
+ *===========================================================================*/
+
+proxy_cache_t* proxy_cache_create(const cache_config_t* config) {
+	cache_config_t defaults = { 0 };
+	if (!config)
+		config = &defaults;
+
+	size_t shard_count = config->shard_count;
+	if (shard_count == 0)
+		shard_count = 1;
+	if (shard_count > CACHE_MAX_SHARDS)
+		shard_count = CACHE_MAX_SHARDS;
+
+	size_t map_capacity = config->initial_capacity ? config->initial_capacity : CACHE_DEFAULT_MAP_CAPACITY;
+	float load_factor = config->load_factor > 0.0f ? config->load_factor : CACHE_DEFAULT_LOAD_FACTOR;
+
+	proxy_cache_t* cache = calloc(1, sizeof(proxy_cache_t));
+	if (cache == NULL)
+		return NULL;
+
+	// Pad every shard to its own cache lines so one shard's lock traffic
+	// does not invalidate its neighbour's. With NUMA placement, to its own pages.
+	cache->numa_nodes = config->numa_nodes == CACHE_NUMA_ALL_NODES ? cache_numa_node_count() : config->numa_nodes;
+	size_t align = cache->numa_nodes ? cache_page_size() : CACHE_LINE_SIZE;
+	cache->shard_stride = (sizeof(cache_shard_t) + align - 1) & ~(align - 1);
+	cache->shard_bytes = cache->shard_stride * shard_count;
+	if (cache->numa_nodes) {
+		cache->shards = cache_numa_reserve(cache->shard_bytes);
+		for (size_t i = 0; cache->shards && i < shard_count; i++) {
+			if (cache_numa_place(shard_at(cache, i), cache->shard_stride, (unsigned int)(i % cache->numa_nodes)) != 0) {
+				free_shards(cache);
+				cache->shards = NULL;
+			}
+		}
+	}
+	else
+		cache->shards = cache_aligned_calloc(cache->shard_bytes);
+	if (cache->shards == NULL) {
+		free(cache);
+		return NULL;
+	}
+
+	if (config->front_caches) {
+		cache->generations = cache_aligned_calloc(CACHE_FRONT_STRIPES * sizeof(size_t));
+		if (cache->generations == NULL) {
+			free_shards(cache);
+			free(cache);
+			return NULL;
+		}
+	}
+
+	cache->shard_count = shard_count;
+	cache->budget_mode = config->budget_mode;
+	cache->lookup_mode = config->lookup_mode;
+	cache->accounting = config->accounting;
+	cache->slot_footprint = (size_t)(2.0f * (float)(sizeof(map_entry_t) + 1) / load_factor + 0.999f);
+	cache->total_size = 0;
+	cache->default_ttl_ms = config->default_ttl_ms;
+	cache->compression = config->compression;
+	apply_budget(cache, config->max_bytes ? config->max_bytes : MAX_CACHE_SIZE);
+
+	for (size_t i = 0; i < shard_count; i++) {
+		cache_shard_t* shard = shard_at(cache, i);
+		shard->current_size = 0;
+		shard->overhead_size = 0;
+		shard->reserved_size = 0;
+		shard->owner = cache;
+		shard->read_mostly = config->lookup_mode == CACHE_LOOKUP_READ_MOSTLY;
+		cache_timer_init(&shard->timers, now_ms());
+
+		// Read-mostly lookups share the lock, so by default they get one that can be shared.
+		cache_lock_kind_t lock_kind = config->lock_kind;
+		if (lock_kind == CACHE_LOCK_DEFAULT)
+			lock_kind = shard->read_mostly ? CACHE_LOCK_RWLOCK : CACHE_LOCK_MUTEX;
+		cache_lock_init(&shard->lock, lock_kind);
+		cache_mutex_init(&shard->flight_mutex);
+		cache_cond_init(&shard->flight_done);
+
+		if (config->use_slab) {
+			shard->slab = slab_create(config->slab_page_size, 0.0f);
+			if (shard->slab && cache->numa_nodes)
+				slab_set_node(shard->slab, (int)(i % cache->numa_nodes));
+		}
+
+		int latency_failed = 0;
+		if (config->track_latency) {
+			shard->latency = malloc(sizeof(cache_histogram_t));
+			if (shard->latency)
+				cache_histogram_reset(shard->latency);
+			latency_failed = shard->latency == NULL;
+		}
+
+		int policy_failed = cache_policy_init(&shard->policy, config->policy, map_capacity / shard_count) != 0;
+		shard->policy.capacity = cache->shard_budget;
+
+		shard->map = map_create_hash64(map_capacity / shard_count, load_factor,
+			element_key_hash, element_key_compare, NULL, release_cache_element);
+		if (shard->map == NULL || policy_failed || latency_failed || (config->use_slab && shard->slab == NULL)) {
+			// Later shards were never initialized; tear down only the first i + 1.
+			cache->shard_count = i + 1;
+			proxy_cache_destroy(cache);
+			return NULL;
+		}
+	}
+
+	if (config->trace_sample) {
+		size_t records = config->trace_records ? config->trace_records : CACHE_TRACE_DEFAULT_RECORDS;
+		cache->trace = cache_trace_create(config->trace_sample, records);
+		if (cache->trace == NULL) {
+			proxy_cache_destroy(cache);
+			return NULL;
+		}
+		cache->trace_threshold = cache_trace_threshold(config->trace_sample);
+	}
+
+	if (config->tier_path && config->tier_bytes) {
+		cache->tier = cache_tier_create(config->tier_path, config->tier_bytes, release_tier_element);
+		if (cache->tier == NULL) {
+			proxy_cache_destroy(cache);
+			return NULL;
+		}
+	}
+
+	if (config->background_reclaim) {
+		unsigned int high = config->high_watermark < 100 ? config->high_watermark : 100;
+		unsigned int low = config->low_watermark ? config->low_watermark
+			: (high > CACHE_DEFAULT_WATERMARK_GAP ? high - CACHE_DEFAULT_WATERMARK_GAP : 0);
+		cache->high_watermark = high;
+		cache->low_watermark = low < high ? low : high;
+		if (start_reclaimer(cache) != 0) {
+			proxy_cache_destroy(cache);
+			return NULL;
+		}
+	}
+
+	if (config->owner_threads && start_owners(cache, config->owner_threads) != 0) {
+		proxy_cache_destroy(cache);
+		return NULL;
+	}
+	return cache;
+}
+
+
+void proxy_cache_destroy(proxy_cache_t* cache) {
+	if (!cache)
+		return;
+
+	// Owners apply what is still queued before they stop. The reclaimer may still be
+	// evicting into the tier, and queued spills and dead elements may live in the shard
+	// slabs, so both go next.
+	if (cache->owners)
+		stop_owners(cache, cache->owner_count);
+	stop_reclaimer(cache);
+	cache_tier_destroy(cache->tier);
+
+	for (size_t i = 0; i < cache->shard_count; i++) {
+		cache_shard_t* shard = shard_at(cache, i);
+		shard_lock(shard);
+
+		// Destroying the map drops the cache's reference on every element it contains.
+		map_destroy(shard->map);
+
+		// Reset shard state
+		cache_policy_destroy(&shard->policy);
+		shard->current_size = 0;
+		shard->overhead_size = 0;
+		shard->map = NULL;
+
+		// Pages still referenced by pinned handles are released by their last cache_release().
+		slab_destroy(shard->slab);
+		shard->slab = NULL;
+		free(shard->latency);
+		shard->latency = NULL;
+
+		// Now, delete the synchronization objects
+		shard_unlock(shard);
+		cache_lock_destroy(&shard->lock);
+		cache_mutex_destroy(&shard->flight_mutex);
+		cache_cond_destroy(&shard->flight_done);
+	}
+
+	if (cache->generations)
+		cache_aligned_free((void*)cache->generations);
+	cache_trace_destroy(cache->trace);
+	free_shards(cache);
+	free(cache);
+}
+
+
+//Safe lookup
+cache_element* proxy_cache_find(proxy_cache_t* cache, const char* url) {
+	if (!cache || !url)
+		return NULL;
+
+	return lookup_element(cache, url, strlen(url), 0);
+}
+
+
+cache_element* proxy_cache_find_key(proxy_cache_t* cache, const char* key, size_t key_len) {
+	if (!cache || !key)
+		return NULL;
+
+	return lookup_element(cache, key, key_len, 0);
+}
+
+
+cache_element* proxy_cache_acquire(proxy_cache_t* cache, const char* url) {
+	if (!cache || !url)
+		return NULL;
+
+	return lookup_element(cache, url, strlen(url), 1);
+}
+
+
+cache_element* proxy_cache_acquire_key(proxy_cache_t* cache, const char* key, size_t key_len) {
+	if (!cache || !key)
+		return NULL;
+
+	return lookup_element(cache, key, key_len, 1);
+}
+
+
+void proxy_cache_add(proxy_cache_t* cache, const char* url, const char* data, size_t length) {
+	proxy_cache_add_key(cache, url, url ? strlen(url) : 0, data, length);
+}
+
+
+void proxy_cache_add_key(proxy_cache_t* cache, const char* key, size_t key_len,
+	const char* data, size_t length) {
+	proxy_cache_add_ttl(cache, key, key_len, data, length, cache ? cache->default_ttl_ms : 0);
+}
+
+
+void proxy_cache_add_ttl(proxy_cache_t* cache, const char* key, size_t key_len,
+	const char* data, size_t length, unsigned long long ttl_ms) {
+	if (add_element(cache, key, key_len, data, length, 0, 0, NULL, ttl_ms, NULL) != 0 && cache)
+		cache_atomic_add_relaxed_size(&cache->rejections, 1);
+}
+
+
+int proxy_cache_add_adopt(proxy_cache_t* cache, const char* url, char* buffer, size_t length,
+	cache_free_fn buffer_free) {
+	return proxy_cache_add_adopt_key(cache, url, url ? strlen(url) : 0, buffer, length, buffer_free);
+}
+
+
+int proxy_cache_add_adopt_key(proxy_cache_t* cache, const char* key, size_t key_len,
+	char* buffer, size_t length, cache_free_fn buffer_free) {
+	return proxy_cache_add_adopt_ttl(cache, key, key_len, buffer, length, buffer_free,
+		cache ? cache->default_ttl_ms : 0);
+}
+
+
+int proxy_cache_add_adopt_ttl(proxy_cache_t* cache, const char* key, size_t key_len,
+	char* buffer, size_t length, cache_free_fn buffer_free, unsigned long long ttl_ms) {
+	int result = add_element(cache, key, key_len, buffer, length, 0, 1, buffer_free, ttl_ms, NULL);
+	if (result != 0 && cache)
+		cache_atomic_add_relaxed_size(&cache->rejections, 1);
+	return result;
+}
+
+
+size_t proxy_cache_find_many(proxy_cache_t* cache, const cache_key_t* keys, size_t count,
+	cache_element** results) {
+	if (!cache || !keys || !results)
+		return 0;
+
+	return lookup_many(cache, keys, count, results, 0);
+}
+
+
+size_t proxy_cache_acquire_many(proxy_cache_t* cache, const cache_key_t* keys, size_t count,
+	cache_element** results) {
+	if (!cache || !keys || !results)
+		return 0;
+
+	return lookup_many(cache, keys, count, results, 1);
+}
+
+
+size_t proxy_cache_add_many(proxy_cache_t* cache, const cache_item_t* items, size_t count) {
+	if (!cache || !items)
+		return 0;
+
+	return add_many(cache, items, count);
+}
+
+
+cache_front_t* proxy_cache_front_create(proxy_cache_t* cache, size_t slots) {
+	if (!cache || !cache->generations)
+		return NULL;
+
+	size_t count = 1;
+	size_t wanted = slots ? slots : CACHE_FRONT_DEFAULT_SLOTS;
+	while (count < wanted)
+		count <<= 1;
+
+	cache_front_t* front = calloc(1, sizeof(cache_front_t) + count * sizeof(front_slot_t));
+	if (!front)
+		return NULL;
+	front->cache = cache;
+	front->slots = (front_slot_t*)(front + 1);
+	front->mask = count - 1;
+	return front;
+}
+
+
+void cache_front_destroy(cache_front_t* front) {
+	if (!front)
+		return;
+	for (size_t i = 0; i <= front->mask; i++)
+		clear_front_slot(&front->slots[i]);
+	free(front);
+}
+
+
+cache_element* cache_front_find(cache_front_t* front, const char* key, size_t key_len) {
+	if (!front || !key)
+		return NULL;
+	return front_lookup(front, key, key_len, 0);
+}
+
+
+cache_element* cache_front_acquire(cache_front_t* front, const char* key, size_t key_len) {
+	if (!front || !key)
+		return NULL;
+	return front_lookup(front, key, key_len, 1);
+}
+
+
+void cache_front_get_stats(const cache_front_t* front, cache_front_stats_t* stats) {
+	if (!stats)
+		return;
+	if (front)
+		*stats = front->stats;
+	else
+		memset(stats, 0, sizeof(*stats));
+}
+
+
+cache_writer_t* proxy_cache_begin_add(proxy_cache_t* cache, const char* key, size_t key_len,
+	size_t expected_len, unsigned long long ttl_ms) {
+	if (!cache || !key)
+		return NULL;
+	// The committed buffer is adopted, so that is what the reservation is charged as.
+	unsigned long long hash = hash_key(key, key_len);
+	cache_shard_t* home = shard_for_hash(cache, hash);
+	size_t reservation = expected_len ? object_charge(cache, home, key_len, expected_len, 1) : 0;
+	if (reservation > max_object_size(cache)) {
+		cache_atomic_add_relaxed_size(&cache->rejections, 1);
+		return NULL;
+	}
+
+	size_t capacity = expected_len;
+	if (!capacity)
+		capacity = max_object_size(cache) < CACHE_WRITER_MIN_BYTES ? max_object_size(cache) : CACHE_WRITER_MIN_BYTES;
+	cache_writer_t* writer = malloc(sizeof(cache_writer_t) + key_len);
+	char* buffer = writer ? malloc(capacity) : NULL;
+	if (!buffer) {
+		free(writer);
+		return NULL;
+	}
+	memset(writer, 0, sizeof(*writer));
+	writer->cache = cache;
+	writer->hash = hash;
+	writer->shard = home;
+	writer->ttl_ms = ttl_ms;
+	writer->buffer = buffer;
+	writer->capacity = capacity;
+	writer->key_len = key_len;
+	memcpy(writer + 1, key, key_len);
+
+	// Hold the room now: the payload takes a while to arrive and other adds must not claim it.
+	if (expected_len) {
+		cache_shard_t* shard = writer->shard;
+		shard_lock(shard);
+		shard->policy.capacity = cache_atomic_load_size(&cache->shard_budget);
+		int reserved = reserve_space_unlocked(shard, reservation) == 0;
+		if (reserved)
+			shard->reserved_size += reservation;
+		shard_unlock(shard);
+
+		if (!reserved) {
+			cache_atomic_add_relaxed_size(&cache->rejections, 1);
+			close_writer(writer);
+			return NULL;
+		}
+		writer->reserved = reservation;
+	}
+	return writer;
+}
+
+
+cache_element* proxy_cache_get_or_load(proxy_cache_t* cache, const char* key, size_t key_len,
+	cache_loader_fn loader, void* context) {
+	if (!cache || !key || !loader)
+		return NULL;
+
+	cache_element* element = lookup_element(cache, key, key_len, 1);
+	if (element)
+		return element;
+
+	unsigned long long hash = hash_key(key, key_len);
+	cache_shard_t* shard = shard_for_hash(cache, hash);
+	cache_element probe;
+	init_probe(&probe, key, key_len);
+
+	flight_lock(shard);
+	cache_flight_t* flight = find_flight(shard, key, key_len, hash);
+	if (flight) {
+		// Someone is already fetching this key: wait for their result instead.
+		flight->waiters++;
+		while (!flight->done)
+			flight_wait(shard);
+		element = flight->result;
+		if (element)
+			cache_atomic_fetch_add_int(&element->refcount, 1);
+		int last = --flight->waiters == 0;
+		flight_unlock(shard);
+
+		SHARD_STAT_ADD(shard, coalesced, 1);
+		leave_flight(flight, last);
+		return element;
+	}
+
+	// A load that finished since the lookup above has already stored its result.
+	element = find_in_shard(shard, &probe, hash, 1);
+	if (element) {
+		flight_unlock(shard);
+		return element;
+	}
+
+	flight = calloc(1, sizeof(cache_flight_t));
+	if (flight) {
+		flight->key = key;
+		flight->key_len = key_len;
+		flight->hash = hash;
+		flight->next = shard->flights;
+		shard->flights = flight;
+	}
+	flight_unlock(shard);
+
+	// Without a flight record the load still works, just without coalescing.
+	element = load_element(cache, shard, key, key_len, hash, loader, context);
+	if (!flight)
+		return element;
+
+	flight_lock(shard);
+	cache_flight_t** link = &shard->flights;
+	while (*link != flight)
+		link = &(*link)->next;
+	*link = flight->next;
+
+	flight->done = 1;
+	flight->result = element;
+	int waiters = flight->waiters;
+	if (element && waiters)
+		cache_atomic_fetch_add_int(&element->refcount, 1); // Handed out by the waiters.
+	flight_broadcast(shard);
+	flight_unlock(shard);
+
+	if (!waiters)
+		free(flight);
+	return element;
+}
+
+
+int proxy_cache_try_find_key(proxy_cache_t* cache, const char* key, size_t key_len, cache_element** element) {
+	if (element)
+		*element = NULL;
+	if (!cache || !key || !element)
+		return 0;
+
+	return try_lookup(cache, key, key_len, 0, element);
+}
+
+
+int proxy_cache_try_acquire_key(proxy_cache_t* cache, const char* key, size_t key_len, cache_element** element) {
+	if (element)
+		*element = NULL;
+	if (!cache || !key || !element)
+		return 0;
+
+	return try_lookup(cache, key, key_len, 1, element);
+}
+
+
+int proxy_cache_add_async(proxy_cache_t* cache, const char* key, size_t key_len, const char* data,
+	size_t length, unsigned long long ttl_ms, cache_add_done_fn done, void* context) {
+	if (!cache || !cache->owner_count || !key || !data || length == 0)
+		return -1;
+	// Compressed payloads are checked on the owner, once their stored size is known.
+	unsigned long long hash = hash_key(key, key_len);
+	if (cache->compression == CACHE_ENCODING_IDENTITY
+		&& object_charge(cache, shard_for_hash(cache, hash), key_len, length, 1) > max_object_size(cache)) {
+		cache_atomic_add_relaxed_size(&cache->rejections, 1);
+		return -1;
+	}
+
+	cache_async_add_t* add = malloc(sizeof(cache_async_add_t) + key_len);
+	char* copy = malloc(length);
+	if (!add || !copy) {
+		free(add);
+		free(copy);
+		return -1;
+	}
+	memcpy(add + 1, key, key_len);
+	memcpy(copy, data, length);
+	add->data = copy;
+	add->length = length;
+	add->ttl_ms = ttl_ms;
+	add->done = done;
+	add->context = context;
+	add->key_len = key_len;
+
+	cache_owner_t* owner = cache->owners[shard_index_for_hash(cache, hash) % cache->owner_count];
+	cache_atomic_fetch_add_size(&owner->submitted, 1);
+	void* head;
+	do {
+		head = cache_atomic_load_ptr(&owner->queue);
+		add->next = (cache_async_add_t*)head;
+	} while (!cache_atomic_cas_ptr(&owner->queue, head, add));
+
+	// Only the push that ends an empty spell can find the owner asleep.
+	if (!head) {
+		cache_mutex_lock(&owner->mutex);
+		cache_cond_signal(&owner->wake);
+		cache_mutex_unlock(&owner->mutex);
+	}
+	return 0;
+}
+
+
+void proxy_cache_flush_async(proxy_cache_t* cache) {
+	if (!cache)
+		return;
+
+	for (unsigned int i = 0; i < cache->owner_count; i++) {
+		cache_owner_t* owner = cache->owners[i];
+		size_t target = cache_atomic_load_size(&owner->submitted);
+		cache_mutex_lock(&owner->mutex);
+		while (cache_atomic_load_size(&owner->completed) < target)
+			cache_cond_wait(&owner->drained, &owner->mutex);
+		cache_mutex_unlock(&owner->mutex);
+	}
+}
+
+
+void proxy_cache_set_budget(proxy_cache_t* cache, size_t max_bytes) {
+	if (!cache || max_bytes == 0)
+		return;
+
+	// Growing takes effect immediately. Shrinking is enforced gradually by later
+	// writes and by proxy_cache_maintain().
+	apply_budget(cache, max_bytes);
+}
+
+
+size_t proxy_cache_get_budget(proxy_cache_t* cache) {
+	return cache ? cache_atomic_load_size(&cache->max_bytes) : 0;
+}
+
+
+size_t proxy_cache_maintain(proxy_cache_t* cache) {
+	if (!cache)
+		return 0;
+
+	size_t excess = 0;
+	for (size_t i = 0; i < cache->shard_count; i++) {
+		cache_shard_t* shard = shard_at(cache, i);
+		size_t used, limit;
+
+		shard_lock(shard);
+		if (shard->timers.count)
+			expire_due_unlocked(shard, now_ms(), CACHE_MAINTAIN_EXPIRE_BATCH);
+		shard_usage(shard, &used, &limit);
+		for (int n = 0; n < CACHE_SHRINK_BATCH && used > limit; n++) {
+			if (!remove_lru_element_unlocked(shard))
+				break;
+			shard_usage(shard, &used, &limit);
+		}
+		map_advance_resize(shard->map, CACHE_RESIZE_BATCH);
+		shard_unlock(shard);
+
+		// In shared mode every shard reports the same instance-wide figure.
+		if (cache->budget_mode == CACHE_BUDGET_SPLIT)
+			excess += used > limit ? used - limit : 0;
+		else
+			excess = used > limit ? used - limit : 0;
+	}
+	return excess;
+}
+
+
+int proxy_cache_snapshot(proxy_cache_t* cache, const char* path) {
+	if (!cache || !path)
+		return -1;
+
+	cache_snapshot_writer_t writer;
+	if (cache_snapshot_open(&writer, path) != 0)
+		return -1;
+
+	snapshot_batch_t batch = { NULL, 0, 0, 0 };
+	int result = 0;
+	for (size_t i = 0; i < cache->shard_count && result == 0; i++) {
+		cache_shard_t* shard = shard_at(cache, i);
+
+		// Only pin under the lock; the file I/O happens with the shard open for business.
+		batch.count = 0;
+		shard_lock(shard);
+		cache_policy_for_each(&shard->policy, collect_element, &batch);
+		shard_unlock(shard);
+		if (batch.failed)
+			result = -1;
+
+		// A pinned element never changes, so its fields can be read without the lock.
+		unsigned long long now = now_ms();
+		for (size_t j = 0; j < batch.count; j++) {
+			cache_element* element = batch.elements[j];
+			if (result == 0 && (element->expires_at == 0 || element->expires_at > now)) {
+				unsigned long long ttl_ms = element->expires_at ? element->expires_at - now : 0;
+				size_t raw_len = element->encoding == CACHE_ENCODING_IDENTITY ? 0 : element->raw_len;
+				if (cache_snapshot_write(&writer, element->url, element->url_len, element->data,
+					element->len, raw_len, ttl_ms) != 0)
+					result = -1;
+			}
+			release_cache_element(element);
+		}
+	}
+	free(batch.elements);
+
+	if (result != 0) {
+		cache_snapshot_abort(&writer);
+		return -1;
+	}
+	return cache_snapshot_commit(&writer);
+}
+
+
+int proxy_cache_load(proxy_cache_t* cache, const char* path) {
+	if (!cache || !path)
+		return -1;
+
+	return cache_snapshot_read(path, load_snapshot_entry, cache);
+}
+
+
+int proxy_cache_dump_trace(proxy_cache_t* cache, const char* path) {
+	if (!cache || !path)
+		return -1;
+
+	size_t count = 0;
+	cache_trace_record_t* records = collect_trace(cache, &count);
+	if (!records)
+		return -1;
+	int result = cache_trace_write(path, records, count, cache_trace_sample(cache->trace));
+	free(records);
+	return result;
+}
+
+
+size_t proxy_cache_estimate_mrc(proxy_cache_t* cache, const size_t* budgets, size_t count, double* miss_ratios) {
+	for (size_t i = 0; i < count; i++)
+		miss_ratios[i] = 1.0;
+	if (!cache)
+		return 0;
+
+	size_t records_count = 0;
+	cache_trace_record_t* records = collect_trace(cache, &records_count);
+	if (!records)
+		return 0;
+	size_t finds = cache_trace_estimate_mrc(records, records_count, cache_trace_sample(cache->trace),
+		budgets, count, miss_ratios);
+	free(records);
+	return finds;
+}
+
+
+void proxy_cache_get_memory_stats(proxy_cache_t* cache, cache_memory_stats_t* stats) {
+	if (!stats)
+		return;
+
+	memset(stats, 0, sizeof(*stats));
+	if (!cache)
+		return;
+
+	for (size_t i = 0; i < cache->shard_count; i++) {
+		cache_shard_t* shard = shard_at(cache, i);
+
+		shard_lock_lookup(shard);
+		stats->payload_bytes += shard_payload_unlocked(shard);
+		stats->overhead_bytes += shard->overhead_size;
+		stats->element_count += map_size(shard->map);
+		shard_unlock_lookup(shard);
+
+		slab_stats_t slab_stats;
+		if (shard->slab) {
+			slab_get_stats(shard->slab, &slab_stats);
+			stats->slab_reserved_bytes += slab_stats.reserved_bytes;
+			stats->slab_used_bytes += slab_stats.used_bytes;
+			stats->slab_requested_bytes += slab_stats.requested_bytes;
+		}
+	}
+}
+
+
+void proxy_cache_get_stats(proxy_cache_t* cache, cache_stats_t* stats) {
+	if (!stats)
+		return;
+
+	memset(stats, 0, sizeof(*stats));
+	if (!cache)
+		return;
+
+	cache_histogram_t* latency = NULL;
+	if (shard_at(cache, 0)->latency) {
+		latency = malloc(sizeof(cache_histogram_t));
+		if (latency)
+			cache_histogram_reset(latency);
+	}
+
+	// The mean probe length is averaged over shards weighted by their entry counts.
+	double probe_weighted = 0.0;
+	size_t probe_entries = 0;
+	for (size_t i = 0; i < cache->shard_count; i++) {
+		cache_shard_t* shard = shard_at(cache, i);
+
+		stats->hits += cache_atomic_load_size(&shard->stats.hits);
+		stats->misses += cache_atomic_load_size(&shard->stats.misses);
+		stats->inserts += cache_atomic_load_size(&shard->stats.inserts);
+		stats->updates += cache_atomic_load_size(&shard->stats.updates);
+		stats->evictions += cache_atomic_load_size(&shard->stats.evictions);
+		stats->bytes_evicted += cache_atomic_load_size(&shard->stats.bytes_evicted);
+		stats->lock_contended += cache_atomic_load_size(&shard->stats.lock_contended);
+		stats->lock_wait_ns += cache_atomic_load_size(&shard->stats.lock_wait_ns);
+		stats->expirations += cache_atomic_load_size(&shard->stats.expirations);
+		stats->loads += cache_atomic_load_size(&shard->stats.loads);
+		stats->coalesced += cache_atomic_load_size(&shard->stats.coalesced);
+		stats->pre_evictions += cache_atomic_load_size(&shard->stats.pre_evictions);
+		stats->busy += cache_atomic_load_size(&shard->stats.busy);
+
+		map_stats_t map_stats;
+		shard_lock_lookup(shard);
+		stats->element_count += map_size(shard->map);
+		stats->payload_bytes += shard_payload_unlocked(shard);
+		stats->overhead_bytes += shard->overhead_size;
+		stats->reserved_bytes += shard->reserved_size;
+		map_get_stats(shard->map, &map_stats);
+		shard_unlock_lookup(shard);
+
+		stats->map_capacity += map_stats.capacity;
+		stats->map_tombstones += map_stats.tombstones;
+		stats->map_displaced += map_stats.displaced;
+		stats->map_resizing += map_stats.resizing != 0;
+		if (map_stats.max_probe_groups > stats->map_max_probe_groups)
+			stats->map_max_probe_groups = map_stats.max_probe_groups;
+		probe_weighted += map_stats.mean_probe_groups * (double)map_stats.count;
+		probe_entries += map_stats.count;
+
+		if (latency)
+			cache_histogram_merge_atomic(latency, shard->latency);
+	}
+
+	stats->rejections = cache_atomic_load_size(&cache->rejections);
+	stats->compressed = cache_atomic_load_size(&cache->compressed);
+	if (cache->trace)
+		stats->traced = cache_trace_count(cache->trace);
+	for (unsigned int i = 0; i < cache->owner_count; i++) {
+		// Read 'completed' first, so the pending count never goes negative.
+		size_t completed = cache_atomic_load_size(&cache->owners[i]->completed);
+		stats->async_adds += completed;
+		stats->async_pending += cache_atomic_load_size(&cache->owners[i]->submitted) - completed;
+	}
+	if (cache->reclaimer)
+		stats->reclaimed = cache_atomic_load_size(&cache->reclaimer->reclaimed);
+	stats->budget_bytes = cache_atomic_load_size(&cache->max_bytes);
+	stats->map_mean_probe_groups = probe_entries ? probe_weighted / (double)probe_entries : 0.0;
+
+	if (cache->tier) {
+		cache_tier_stats_t tier;
+		cache_tier_get_stats(cache->tier, &tier);
+		stats->tier_writes = tier.writes;
+		stats->tier_hits = tier.hits;
+		stats->tier_dropped = tier.dropped;
+		stats->tier_entries = tier.entries;
+	}
+
+	if (latency) {
+		stats->lookup_samples = (size_t)latency->total;
+		stats->lookup_p50_ns = cache_histogram_percentile(latency, 50.0);
+		stats->lookup_p99_ns = cache_histogram_percentile(latency, 99.0);
+		stats->lookup_p999_ns = cache_histogram_percentile(latency, 99.9);
+		stats->lookup_max_ns = latency->max;
+		free(latency);
+	}
+}
+
+
+// Running totals of one shard's eviction order, checked against its map by proxy_cache_check().
+typedef struct shard_check {
+	const proxy_cache_t* cache;
+	const map_t* map;
+	size_t count;
+	size_t bytes;            // Charged against the budget.
+	size_t overhead;
+	int failed;
+} shard_check_t;
+
+static void check_element(void* context, cache_element* element) {
+	shard_check_t* check = (shard_check_t*)context;
+	check->count++;
+	check->bytes += element_charge(check->cache, element);
+	check->overhead += element->footprint - element->len;
+	// The map must return this very element, and the cache's own reference must still be there.
+	if (map_find_prehashed(check->map, element, element->key_hash) != element
+		|| cache_atomic_load_relaxed_int(&element->refcount) < 1)
+		check->failed = 1;
+}
+
+int proxy_cache_check(proxy_cache_t* cache) {
+	if (!cache)
+		return -1;
+
+	int result = 0;
+	for (size_t i = 0; i < cache->shard_count; i++) {
+		cache_shard_t* shard = shard_at(cache, i);
+		shard_lock(shard);
+		shard_check_t check = { cache, shard->map, 0, 0, 0, 0 };
+		cache_policy_for_each(&shard->policy, check_element, &check);
+		if (check.failed || check.count != map_size(shard->map) || check.bytes != shard->current_size
+			|| check.overhead != shard->overhead_size)
+			result = -1;
+		shard_unlock(shard);
+	}
+	return result;
+}
+
+void cache_release(cache_element* element) {
+	release_cache_element(element);
+}
+
+
+size_t cache_element_decode(const cache_element* element, char* buffer, size_t capacity) {
+	if (!element || !buffer || capacity < element->raw_len)
+		return 0;
+
+	if (element->encoding == CACHE_ENCODING_IDENTITY) {
+		memcpy(buffer, element->data, element->len);
+		return element->len;
+	}
+	if (cache_lz4_decompress(element->data, element->len, buffer, element->raw_len) != 0)
+		return 0;
+	return element->raw_len;
+}
+
+
+int cache_append(cache_writer_t* writer, const char* chunk, size_t length) {
+	if (!writer || writer->failed || (!chunk && length))
+		return -1;
+
+	if (length > writer->capacity - writer->length) {
+		// Grow geometrically, but never past what the budget could ever hold.
+		size_t limit = max_object_size(writer->cache);
+		char* grown = NULL;
+		if (length <= limit && writer->length <= limit - length) {
+			size_t needed = writer->length + length;
+			size_t capacity = writer->capacity < limit / 2 ? writer->capacity * 2 : limit;
+			grown = realloc(writer->buffer, capacity > needed ? capacity : needed);
+			if (grown) {
+				writer->buffer = grown;
+				writer->capacity = capacity > needed ? capacity : needed;
+			}
+		}
+		if (!grown) {
+			writer->failed = 1;
+			return -1;
+		}
+	}
+	memcpy(writer->buffer + writer->length, chunk, length);
+	writer->length += length;
+	return 0;
+}
+
+
+int cache_commit(cache_writer_t* writer) {
+	if (!writer)
+		return -1;
+
+	proxy_cache_t* cache = writer->cache;
+	int result = -1;
+	if (!writer->failed && writer->length) {
+		const char* data = writer->buffer;
+		size_t length = writer->length;
+		int adopt = 1;
+		cache_free_fn data_free = NULL;
+		writer->buffer = NULL; // From here on the payload is released by the add path.
+
+		if (length < writer->capacity) {
+			// Hand back what an overstated expected_len or the last doubling left unused.
+			char* trimmed = realloc((char*)data, length);
+			if (trimmed)
+				data = trimmed;
+		}
+		size_t raw_len = compress_payload(cache, &data, &length, &adopt, &data_free);
+
+		cache_shard_t* shard = writer->shard;
+		if (object_charge(cache, shard, writer->key_len, length, adopt) <= max_object_size(cache)) {
+			// Swap the reservation for the real size within one lock hold.
+			shard_lock(shard);
+			release_reservation_unlocked(shard, writer->reserved);
+			writer->reserved = 0;
+			result = add_locked(cache, shard, (const char*)(writer + 1), writer->key_len, writer->hash,
+				data, length, raw_len, adopt, data_free, writer->ttl_ms, NULL);
+			shard_unlock(shard);
+			trace_access(cache, writer->hash, length, CACHE_TRACE_ADD, result == 0);
+		}
+		else
+			free_payload((char*)data, data_free);
+	}
+
+	if (result != 0)
+		cache_atomic_add_relaxed_size(&cache->rejections, 1);
+	close_writer(writer);
+	return result;
+}
+
+
+void cache_abort(cache_writer_t* writer) {
+	if (writer)
+		close_writer(writer);
+}
+
+/*=============================================================================
+ * 4. Public API Functions (Default Instance)
+ *===========================================================================*/
+
+void cache_init() {
+	cache_init_config(NULL);
+}
+
+
+void cache_init_sharded(size_t shard_count, cache_budget_mode_t budget_mode) {
+	cache_config_t config = { 0 };
+	config.shard_count = shard_count;
+	config.budget_mode = budget_mode;
+	cache_init_config(&config);
+}
+
+
+void cache_init_config(const cache_config_t* config) {
+	g_cache = proxy_cache_create(config);
+	if (g_cache == NULL) {
+		fprintf(stderr, "Fatal: Failed to initialize proxy cache.\n\n");
+		exit(EXIT_FAILURE);
+	}
+}
+
+
+void cache_destroy() {
+	proxy_cache_destroy(g_cache);
+	g_cache = NULL;
+}
+
+
+proxy_cache_t* cache_default() {
+	return g_cache;
+}
+
+
+cache_element* cache_find(const char* url) {
+	return proxy_cache_find(g_cache, url);
+}
+
+
+cache_element* cache_find_key(const char* key, size_t key_len) {
+	return proxy_cache_find_key(g_cache, key, key_len);
+}
+
+
+cache_element* cache_acquire(const char* url) {
+	return proxy_cache_acquire(g_cache, url);
+}
+
+
+cache_element* cache_acquire_key(const char* key, size_t key_len) {
+	return proxy_cache_acquire_key(g_cache, key, key_len);
+}
+
+
+void cache_add(const char* url, const char* data, size_t length) {
+	proxy_cache_add(g_cache, url, data, length);
+}
+
+
+void cache_add_key(const char* key, size_t key_len, const char* data, size_t length) {
+	proxy_cache_add_key(g_cache, key, key_len, data, length);
+}
+
+
+void cache_add_ttl(const char* key, size_t key_len, const char* data, size_t length,
+	unsigned long long ttl_ms) {
+	proxy_cache_add_ttl(g_cache, key, key_len, data, length, ttl_ms);
+}
+
+
+int cache_add_adopt_ttl(const char* key, size_t key_len, char* buffer, size_t length,
+	cache_free_fn buffer_free, unsigned long long ttl_ms) {
+	return proxy_cache_add_adopt_ttl(g_cache, key, key_len, buffer, length, buffer_free, ttl_ms);
+}
+
+
+size_t cache_find_many(const cache_key_t* keys, size_t count, cache_element** results) {
+	return proxy_cache_find_many(g_cache, keys, count, results);
+}
+
+
+size_t cache_acquire_many(const cache_key_t* keys, size_t count, cache_element** results) {
+	return proxy_cache_acquire_many(g_cache, keys, count, results);
+}
+
+
+size_t cache_add_many(const cache_item_t* items, size_t count) {
+	return proxy_cache_add_many(g_cache, items, count);
+}
+
+
+cache_element* cache_get_or_load(const char* key, size_t key_len, cache_loader_fn loader, void* context) {
+	return proxy_cache_get_or_load(g_cache, key, key_len, loader, context);
+}
+
+
+int cache_try_find_key(const char* key, size_t key_len, cache_element** element) {
+	return proxy_cache_try_find_key(g_cache, key, key_len, element);
+}
+
+
+int cache_try_acquire_key(const char* key, size_t key_len, cache_element** element) {
+	return proxy_cache_try_acquire_key(g_cache, key, key_len, element);
+}
+
+
+int cache_add_async(const char* key, size_t key_len, const char* data, size_t length,
+	cache_add_done_fn done, void* context) {
+	return proxy_cache_add_async(g_cache, key, key_len, data, length, g_cache ? g_cache->default_ttl_ms : 0,
+		done, context);
+}
+
+
+void cache_flush_async() {
+	proxy_cache_flush_async(g_cache);
+}
+
+
+int cache_add_adopt(const char* url, char* buffer, size_t length, cache_free_fn buffer_free) {
+	return proxy_cache_add_adopt(g_cache, url, buffer, length, buffer_free);
+}
+
+
+int cache_add_adopt_key(const char* key, size_t key_len, char* buffer, size_t length,
+	cache_free_fn buffer_free) {
+	return proxy_cache_add_adopt_key(g_cache, key, key_len, buffer, length, buffer_free);
+}
+
+
+cache_writer_t* cache_begin_add(const char* url, size_t expected_len) {
+	return proxy_cache_begin_add(g_cache, url, url ? strlen(url) : 0, expected_len,
+		g_cache ? g_cache->default_ttl_ms : 0);
+}
+
+
+int cache_snapshot(const char* path) {
+	return proxy_cache_snapshot(g_cache, path);
+}
+
+
+int cache_load(const char* path) {
+	return proxy_cache_load(g_cache, path);
+}
+
+
+int cache_dump_trace(const char* path) {
+	return proxy_cache_dump_trace(g_cache, path);
+}
+
+
+size_t cache_estimate_mrc(const size_t* budgets, size_t count, double* miss_ratios) {
+	return proxy_cache_estimate_mrc(g_cache, budgets, count, miss_ratios);
+}
+
+
+cache_front_t* cache_front_create(size_t slots) {
+	return proxy_cache_front_create(g_cache, slots);
+}
+
+
+void cache_get_memory_stats(cache_memory_stats_t* stats) {
+	proxy_cache_get_memory_stats(g_cache, stats);
+}
+
+
+void cache_get_stats(cache_stats_t* stats) {
+	proxy_cache_get_stats(g_cache, stats);
 }
@@ -7,27 +7,511 @@
  * 1. Constants
  *===========================================================================*/
 
-#define MAX_CACHE_SIZE 100 // 10 MiB: The total maximum size of all objects in the cache.
-//10485760
+#ifndef MAX_CACHE_SIZE
+#define MAX_CACHE_SIZE 10485760 // 10 MiB: Default byte budget when a config leaves max_bytes at 0.
+#endif
+
+#define CACHE_MAX_SHARDS 256 // Upper bound accepted by cache_init_sharded().
+
+#define CACHE_COMPRESS_MIN_BYTES 128 // Smaller payloads are always stored as given.
+
+#define CACHE_FRONT_DEFAULT_SLOTS 256 // Slots of a front cache created with 'slots' 0.
+
+#define CACHE_FRONT_REPLICA_BYTES 16384 // Largest payload a NUMA-aware front cache copies to its thread.
+
+#define CACHE_NUMA_ALL_NODES 0xFFFFFFFFu // 'numa_nodes' value that spreads shards over every online node.
+
+#define CACHE_BUSY 1 // Returned by the try lookups when the shard lock is held by another thread.
+
  /*=============================================================================
   * 2. Public Data Structures
   *===========================================================================*/
 
+  /**
+   * @brief Releases a payload buffer handed to cache_add_adopt(). 'free' itself qualifies.
+   */
+typedef void (*cache_free_fn)(void* buffer);
+
+  /**
+   * @brief Fetches the object for a key that missed in cache_get_or_load().
+   * @details Stores a heap buffer in '*buffer' and its size in '*length'. The cache
+   * adopts the buffer as with cache_add_adopt() and releases it with '*buffer_free'
+   * (left NULL, free() is used).
+   * @return 0 on success, or non-zero if the object could not be fetched.
+   */
+typedef int (*cache_loader_fn)(void* context, const char* key, size_t key_len,
+    char** buffer, size_t* length, cache_free_fn* buffer_free);
+
+  /**
+   * @brief Completion of a cache_add_async(), called on the shard owner thread.
+   * @param result 0 if the object was cached, -1 if it was rejected.
+   */
+typedef void (*cache_add_done_fn)(void* context, int result);
+
+  /**
+   * @brief Opaque cache instance. Each instance has its own shards, budget and configuration.
+   */
+typedef struct proxy_cache proxy_cache_t;
+
+  /**
+   * @brief How an instance's byte budget is distributed across shards.
+   */
+typedef enum cache_budget_mode {
+    CACHE_BUDGET_SPLIT,  // Each shard owns a fixed max_bytes / shard_count bytes.
+    CACHE_BUDGET_SHARED  // Shards draw from one max_bytes pool and evict to stay under it.
+} cache_budget_mode_t;
+
+/**
+ * @brief How cache_find() records a hit.
+ */
+typedef enum cache_lookup_mode {
+    CACHE_LOOKUP_EXCLUSIVE,  // Hits lock the shard exclusively and move the element to the LRU head.
+    CACHE_LOOKUP_READ_MOSTLY // Hits take a shared lock and only set a reference bit (CLOCK).
+} cache_lookup_mode_t;
+
+/**
+ * @brief What an element is charged against the byte budget.
+ */
+typedef enum cache_accounting {
+    CACHE_ACCOUNT_PAYLOAD,   // Its payload bytes ('len') only.
+    CACHE_ACCOUNT_FOOTPRINT  // Everything it occupies: header, key, payload and map slot, as allocated.
+} cache_accounting_t;
+
+/**
+ * @brief Which primitive guards each shard.
+ */
+typedef enum cache_lock_kind {
+    CACHE_LOCK_DEFAULT,  // RWLOCK with CACHE_LOOKUP_READ_MOSTLY, MUTEX otherwise.
+    CACHE_LOCK_MUTEX,    // The OS mutex.
+    CACHE_LOCK_RWLOCK,   // The OS reader/writer lock; only read-mostly lookups share it.
+    CACHE_LOCK_SPIN,     // A spinlock that yields the CPU after a while. For short, uncontended sections.
+    CACHE_LOCK_ADAPTIVE  // Spins briefly, then sleeps on a futex (WaitOnAddress on Windows).
+} cache_lock_kind_t;
+
+/**
+ * @brief Which element each shard evicts when it needs room.
+ */
+typedef enum cache_policy_kind {
+    CACHE_POLICY_LRU,     // One LRU list; the least recently used element goes first.
+    CACHE_POLICY_SLRU,    // Segmented LRU: new elements are probationary until hit again.
+    CACHE_POLICY_TINYLFU, // W-TinyLFU: LRU window plus SLRU, admission by a frequency sketch.
+    CACHE_POLICY_GDSF     // GreedyDual-Size-Frequency: evicts the lowest frequency / size, with aging.
+} cache_policy_kind_t;
+
+/**
+ * @brief How an element's bytes are stored. Also selects the compression applied by adds.
+ */
+typedef enum cache_encoding {
+    CACHE_ENCODING_IDENTITY, // Stored as given.
+    CACHE_ENCODING_LZ4       // An LZ4 block (the raw format, without a frame header).
+} cache_encoding_t;
+
+/**
+ * @brief Options for proxy_cache_create() and cache_init_config(). A zeroed struct selects the defaults.
+ */
+typedef struct cache_config {
+    size_t max_bytes;                // Byte budget of the instance (0 selects MAX_CACHE_SIZE).
+    size_t shard_count;              // Number of shards (0 selects a single shard).
+    cache_budget_mode_t budget_mode; // How max_bytes is distributed across shards.
+    cache_lookup_mode_t lookup_mode; // How hits update the eviction order.
+    cache_policy_kind_t policy;      // Eviction policy of every shard (default CACHE_POLICY_LRU).
+    int use_slab;                    // Non-zero to allocate elements and payloads from per-shard slabs.
+    size_t slab_page_size;           // Slab page size in bytes (0 selects SLAB_DEFAULT_PAGE_SIZE).
+    size_t initial_capacity;         // Map slots reserved up front, over all shards (0 selects a default).
+    float load_factor;               // Map load factor that triggers a resize (0 selects a default).
+    int track_latency;               // Non-zero to record lookup latency (two clock reads per lookup).
+    unsigned long long default_ttl_ms; // Lifetime of adds that do not pass a TTL (0: never expire).
+    const char* tier_path;           // Scratch file of the disk tier evictions spill to (NULL: no tier).
+    size_t tier_bytes;               // Size of that file; the log wraps around when it is full.
+    int background_reclaim;          // Non-zero to free removed elements and finish map resizes on a background thread.
+    unsigned int high_watermark;     // With background_reclaim: percent of the budget that starts pre-eviction (0: off).
+    unsigned int low_watermark;      // Percent of the budget pre-eviction stops at (0: 10 below high_watermark).
+    cache_encoding_t compression;    // Encoding adds try on payloads (IDENTITY: store them as given).
+    int front_caches;                // Non-zero to allow per-thread front caches (proxy_cache_front_create()).
+    unsigned int numa_nodes;         // NUMA nodes to place shards and their slabs on, round-robin (0: no placement).
+    cache_lock_kind_t lock_kind;     // Primitive guarding each shard.
+    cache_accounting_t accounting;   // What counts against max_bytes (default: payload bytes only).
+    unsigned int owner_threads;      // Shard owner threads applying cache_add_async(), round-robin (0: none).
+    unsigned int trace_sample;       // Trace finds and adds of 1 key in this many (0: no tracing; 1: every key).
+    size_t trace_records;            // Records the trace ring keeps before overwriting (0 selects a default).
+} cache_config_t;
+
+/**
+ * @brief Memory accounting reported by cache_get_memory_stats().
+ */
+typedef struct cache_memory_stats {
+    size_t element_count;        // Elements currently cached.
+    size_t payload_bytes;        // Sum of 'len' over cached elements.
+    size_t overhead_bytes;       // Their metadata: headers, keys, map slots and allocator rounding.
+    size_t slab_reserved_bytes;  // Bytes the slab allocators hold from the system.
+    size_t slab_used_bytes;      // Slab bytes handed out, rounded up to size classes.
+    size_t slab_requested_bytes; // Slab bytes actually requested (headers, URLs, payloads).
+} cache_memory_stats_t;
+
+/**
+ * @brief Counters and diagnostics reported by cache_get_stats(), summed over all shards.
+ * @details Event counters are cumulative since the instance was created.
+ */
+typedef struct cache_stats {
+    size_t hits;                    // Lookups that found the URL.
+    size_t misses;                  // Lookups that did not.
+    size_t inserts;                 // Adds of a URL that was not cached.
+    size_t updates;                 // Adds that replaced a cached URL's data.
+    size_t rejections;              // Adds that could not be cached (too large, out of memory).
+    size_t evictions;               // Elements evicted to make room.
+    size_t bytes_evicted;           // Payload bytes of those elements.
+    size_t lock_contended;          // Shard lock acquisitions that had to wait.
+    size_t lock_wait_ns;            // Total time spent waiting for shard locks.
+    size_t expirations;             // Elements reclaimed because their TTL passed.
+    size_t loads;                   // Loader calls made by cache_get_or_load().
+    size_t coalesced;               // cache_get_or_load() misses that waited for another caller's load.
+    size_t reclaimed;               // Removed elements freed by the background reclaimer.
+    size_t pre_evictions;           // Evictions made ahead of writes by the reclaimer (also in 'evictions').
+    size_t compressed;              // Adds stored compressed.
+    size_t busy;                    // Try lookups that returned CACHE_BUSY.
+    size_t async_adds;              // Queued adds applied by the shard owner threads.
+    size_t async_pending;           // Queued adds not applied yet.
+    size_t traced;                  // Sampled finds and adds written to the access trace.
+
+    size_t element_count;           // Elements currently cached.
+    size_t payload_bytes;           // Sum of 'len' over cached elements.
+    size_t overhead_bytes;          // Their metadata (also charged to the budget with CACHE_ACCOUNT_FOOTPRINT).
+    size_t budget_bytes;            // Current byte budget.
+    size_t reserved_bytes;          // Budget held for streaming adds not yet committed.
+
+    size_t map_capacity;            // Hash map slots over all shards.
+    size_t map_tombstones;          // Deleted slots still lengthening probe chains.
+    size_t map_displaced;           // Entries stored outside their home group.
+    size_t map_max_probe_groups;    // Longest probe sequence, in 16-slot groups.
+    double map_mean_probe_groups;   // Average probe length, in groups (1.0 is ideal).
+    size_t map_resizing;            // Shards whose map is in the middle of an incremental resize.
+
+    size_t tier_writes;             // Evicted elements written to the disk tier.
+    size_t tier_hits;               // RAM misses served from the disk tier and promoted.
+    size_t tier_dropped;            // Evictions not spilled because the tier's write queue was full.
+    size_t tier_entries;            // Objects the disk tier currently holds.
+
+    size_t lookup_samples;          // Lookups timed (0 unless track_latency is set).
+    unsigned long long lookup_p50_ns;
+    unsigned long long lookup_p99_ns;
+    unsigned long long lookup_p999_ns;
+    unsigned long long lookup_max_ns;
+} cache_stats_t;
+
   /**
    * @brief Represents a single element in the cache.
-   * @details This is an opaque handle returned by cache_find(). The user should
-   * not modify its contents directly.
+   * @details This is an opaque handle returned by cache_find() and cache_acquire().
+   * The user should not modify its contents directly. Once published, an element's
+   * url, data and len never change; updating a URL that readers still hold creates
+   * a new element instead. With compression on, 'data' may hold encoded bytes: see
+   * 'encoding', and cache_element_decode() for the original payload.
    */
 typedef struct cache_element {
-    char* url;
-    char* data;
-    size_t len;
+    // The first 64 bytes hold what the cache reads or writes on a hit: the key check,
+    // the expiry check, the LRU/SLRU/W-TinyLFU relink (links, size, segment, sketch hash)
+    // and the CLOCK bit. The payload pointer and reference count, which the caller's
+    // read and cache_acquire() touch, open the second line with the other cold fields.
+    char* url;               // The key. May contain NUL bytes; always followed by a terminating NUL.
+    size_t url_len;          // Length of 'url' in bytes, excluding the terminator.
+    unsigned long long key_hash; // Internal: 64-bit hash of 'url', shared by the shard pick, map and policy.
+    unsigned long long expires_at;        // Internal: expiry time in milliseconds of the monotonic clock (0: never).
     struct cache_element* next;
     struct cache_element* prev;
+    size_t len;              // Stored size of 'data', which is what the byte budget counts by default.
+    volatile int referenced; // Internal: CLOCK reference bit set by read-mostly hits.
+    unsigned char segment;   // Internal: eviction policy list holding the element.
+    char* data;
+    volatile int refcount;   // Internal: one reference held by the cache plus one per acquired handle.
+    cache_encoding_t encoding; // How 'data' is stored.
+    size_t raw_len;          // Size of the payload once decoded ('len' for CACHE_ENCODING_IDENTITY).
+    unsigned int frequency;  // Internal: GDSF hits since the element was inserted, plus one.
+    cache_free_fn data_free; // Internal: releases 'data' when it was adopted (NULL: cache-owned).
+    struct slab* slab;       // Internal: allocator owning this element and its payload (NULL: malloc).
+    size_t heap_index;       // Internal: GDSF position in the shard's priority heap.
+    double priority;         // Internal: GDSF priority (inflation + frequency / len).
+    struct cache_element* timer_next;     // Internal: timer wheel slot list.
+    struct cache_element** timer_pprev;   // Internal: link pointing at this element (NULL: no timer).
+    size_t footprint;        // Internal: bytes the element occupies, metadata included (CACHE_ACCOUNT_FOOTPRINT charge).
 } cache_element;
 
+  /**
+   * @brief One key of a cache_find_many() batch.
+   */
+typedef struct cache_key {
+    const char* data; // The key bytes, as for cache_find_key(). NULL entries are skipped.
+    size_t len;
+} cache_key_t;
+
+  /**
+   * @brief One object of a cache_add_many() batch. The data is copied, as by cache_add_key().
+   */
+typedef struct cache_item {
+    const char* key;
+    size_t key_len;
+    const char* data;
+    size_t length;
+    unsigned long long ttl_ms; // Milliseconds until the element expires, or 0 for never.
+} cache_item_t;
+
+  /**
+   * @brief A small direct-mapped cache of pinned handles, private to one thread.
+   */
+typedef struct cache_front cache_front_t;
+
+  /**
+   * @brief Counters of one front cache, reported by cache_front_get_stats().
+   */
+typedef struct cache_front_stats {
+    size_t hits;    // Lookups answered without touching a shard.
+    size_t misses;  // Lookups passed on to the shared cache.
+    size_t stale;   // Handles dropped because their key was updated or removed.
+} cache_front_stats_t;
+
+  /**
+   * @brief An add in progress whose payload arrives in chunks, from cache_begin_add().
+   */
+typedef struct cache_writer cache_writer_t;
+
+/*=============================================================================
+ * 3. Public API Functions (Instances)
+ *===========================================================================*/
+
+/**
+ * @brief Creates an independent cache instance.
+ *
+ * @details Instances share nothing: each has its own shards, locks, byte budget and
+ * configuration, so one process can run several caches (for example one per
+ * upstream or per tenant) side by side. All proxy_cache_* functions are thread-safe.
+ *
+ * @param config The options to use, or NULL for the defaults.
+ * @return The new instance, or NULL on allocation failure.
+ */
+proxy_cache_t* proxy_cache_create(const cache_config_t* config);
+
+/**
+ * @brief Destroys an instance and everything it caches. Does nothing if NULL.
+ * @details Elements still pinned by proxy_cache_acquire() stay valid until released.
+ */
+void proxy_cache_destroy(proxy_cache_t* cache);
+
+/**
+ * @brief Instance form of cache_find().
+ */
+cache_element* proxy_cache_find(proxy_cache_t* cache, const char* url);
+
+/**
+ * @brief Instance form of cache_find_key().
+ */
+cache_element* proxy_cache_find_key(proxy_cache_t* cache, const char* key, size_t key_len);
+
+/**
+ * @brief Instance form of cache_acquire(). Release the handle with cache_release().
+ */
+cache_element* proxy_cache_acquire(proxy_cache_t* cache, const char* url);
+
+/**
+ * @brief Instance form of cache_acquire_key().
+ */
+cache_element* proxy_cache_acquire_key(proxy_cache_t* cache, const char* key, size_t key_len);
+
+/**
+ * @brief Instance form of cache_add().
+ */
+void proxy_cache_add(proxy_cache_t* cache, const char* url, const char* data, size_t length);
+
+/**
+ * @brief Instance form of cache_add_key().
+ */
+void proxy_cache_add_key(proxy_cache_t* cache, const char* key, size_t key_len,
+    const char* data, size_t length);
+
+/**
+ * @brief Instance form of cache_add_adopt().
+ */
+int proxy_cache_add_adopt(proxy_cache_t* cache, const char* url, char* buffer, size_t length,
+    cache_free_fn buffer_free);
+
+/**
+ * @brief Instance form of cache_add_adopt_key().
+ */
+int proxy_cache_add_adopt_key(proxy_cache_t* cache, const char* key, size_t key_len,
+    char* buffer, size_t length, cache_free_fn buffer_free);
+
+/**
+ * @brief Instance form of cache_add_ttl().
+ */
+void proxy_cache_add_ttl(proxy_cache_t* cache, const char* key, size_t key_len,
+    const char* data, size_t length, unsigned long long ttl_ms);
+
+/**
+ * @brief Instance form of cache_add_adopt_ttl().
+ */
+int proxy_cache_add_adopt_ttl(proxy_cache_t* cache, const char* key, size_t key_len,
+    char* buffer, size_t length, cache_free_fn buffer_free, unsigned long long ttl_ms);
+
+/**
+ * @brief Instance form of cache_try_find_key().
+ */
+int proxy_cache_try_find_key(proxy_cache_t* cache, const char* key, size_t key_len, cache_element** element);
+
+/**
+ * @brief Instance form of cache_try_acquire_key().
+ */
+int proxy_cache_try_acquire_key(proxy_cache_t* cache, const char* key, size_t key_len, cache_element** element);
+
+/**
+ * @brief Instance form of cache_add_async(), with an explicit TTL (0: never expire).
+ */
+int proxy_cache_add_async(proxy_cache_t* cache, const char* key, size_t key_len, const char* data,
+    size_t length, unsigned long long ttl_ms, cache_add_done_fn done, void* context);
+
+/**
+ * @brief Instance form of cache_flush_async().
+ */
+void proxy_cache_flush_async(proxy_cache_t* cache);
+
+/**
+ * @brief Instance form of cache_get_or_load().
+ */
+cache_element* proxy_cache_get_or_load(proxy_cache_t* cache, const char* key, size_t key_len,
+    cache_loader_fn loader, void* context);
+
+/**
+ * @brief Instance form of cache_find_many().
+ */
+size_t proxy_cache_find_many(proxy_cache_t* cache, const cache_key_t* keys, size_t count,
+    cache_element** results);
+
+/**
+ * @brief Instance form of cache_acquire_many().
+ */
+size_t proxy_cache_acquire_many(proxy_cache_t* cache, const cache_key_t* keys, size_t count,
+    cache_element** results);
+
+/**
+ * @brief Instance form of cache_add_many().
+ */
+size_t proxy_cache_add_many(proxy_cache_t* cache, const cache_item_t* items, size_t count);
+
+/**
+ * @brief Creates a front cache (L0) of an instance for the calling thread.
+ *
+ * @details Holds pinned handles to the keys the thread looks up most. Each slot
+ * keeps the handle of one key; a key that keeps missing in an occupied slot takes
+ * it over once the resident has lost its lead, so one-off lookups do not displace
+ * hot keys. A hit compares the key with the pinned element and checks that the
+ * generation counter of the key's stripe has not moved since the handle was
+ * taken: no lock, no shared write. Writers bump that counter whenever they
+ * update or remove a key, which makes every front copy of it stale.
+ *
+ * A front cache is not thread-safe: give each thread its own, and destroy it
+ * before the instance. Requires front_caches in the instance's configuration.
+ *
+ * @param slots Number of slots, rounded up to a power of two (0 selects CACHE_FRONT_DEFAULT_SLOTS).
+ * @return The front cache, or NULL if the instance does not allow them or allocation failed.
+ */
+cache_front_t* proxy_cache_front_create(proxy_cache_t* cache, size_t slots);
+
+/**
+ * @brief Drops every handle a front cache holds and frees it.
+ * @param front The front cache. Does nothing if NULL.
+ */
+void cache_front_destroy(cache_front_t* front);
+
+/**
+ * @brief Looks up a key through a front cache, falling back to its instance.
+ * @details The element stays valid until the next call on this front cache, even
+ * if the shared cache evicts it meanwhile.
+ * @return The element, or NULL if the key is not cached.
+ */
+cache_element* cache_front_find(cache_front_t* front, const char* key, size_t key_len);
+
+/**
+ * @brief Like cache_front_find(), but pins the element for the caller as cache_acquire() does.
+ */
+cache_element* cache_front_acquire(cache_front_t* front, const char* key, size_t key_len);
+
+/**
+ * @brief Reports a front cache's counters.
+ */
+void cache_front_get_stats(const cache_front_t* front, cache_front_stats_t* stats);
+
+/**
+ * @brief Instance form of cache_begin_add(), with a length-delimited key and a lifetime.
+ * @param ttl_ms Lifetime in milliseconds once committed, or 0 for an element that never expires.
+ */
+cache_writer_t* proxy_cache_begin_add(proxy_cache_t* cache, const char* key, size_t key_len,
+    size_t expected_len, unsigned long long ttl_ms);
+
+/**
+ * @brief Changes an instance's byte budget at runtime.
+ *
+ * @details A larger budget takes effect immediately. A smaller one is enforced
+ * gradually rather than by one long eviction pass under the lock: every later
+ * write frees at least as much as it adds plus a small batch more, and
+ * proxy_cache_maintain() drains the rest in bounded steps.
+ *
+ * @param max_bytes The new budget in bytes. 0 is ignored.
+ */
+void proxy_cache_set_budget(proxy_cache_t* cache, size_t max_bytes);
+
+/**
+ * @brief Returns an instance's current byte budget.
+ */
+size_t proxy_cache_get_budget(proxy_cache_t* cache);
+
+/**
+ * @brief Reclaims expired elements and evicts a bounded batch from every shard that is over budget.
+ * @details Meant to be called periodically (for example from a housekeeping thread),
+ * both to free the memory of expired elements between writes and after
+ * proxy_cache_set_budget() lowered the budget. It also moves a batch of every
+ * in-flight map resize, so shards that stopped receiving writes finish growing.
+ * @return The number of bytes still over budget (0 once the instance fits).
+ */
+size_t proxy_cache_maintain(proxy_cache_t* cache);
+
+/**
+ * @brief Instance form of cache_snapshot().
+ */
+int proxy_cache_snapshot(proxy_cache_t* cache, const char* path);
+
+/**
+ * @brief Instance form of cache_load().
+ */
+int proxy_cache_load(proxy_cache_t* cache, const char* path);
+
+/**
+ * @brief Instance form of cache_dump_trace().
+ */
+int proxy_cache_dump_trace(proxy_cache_t* cache, const char* path);
+
+/**
+ * @brief Instance form of cache_estimate_mrc().
+ */
+size_t proxy_cache_estimate_mrc(proxy_cache_t* cache, const size_t* budgets, size_t count, double* miss_ratios);
+
+/**
+ * @brief Instance form of cache_get_memory_stats().
+ */
+void proxy_cache_get_memory_stats(proxy_cache_t* cache, cache_memory_stats_t* stats);
+
+/**
+ * @brief Instance form of cache_get_stats().
+ */
+void proxy_cache_get_stats(proxy_cache_t* cache, cache_stats_t* stats);
+
+/**
+ * @brief Verifies every shard's bookkeeping, one shard lock at a time.
+ * @details Checks that the eviction order and the map hold the same elements, that
+ * each of those is referenced by the cache, and that the shard's byte counts are the
+ * sums of their budget charges and metadata. Safe to call while other threads use the
+ * instance; meant for tests and debug builds.
+ * @return 0 if every shard is consistent, -1 otherwise.
+ */
+int proxy_cache_check(proxy_cache_t* cache);
+
 /*=============================================================================
- * 3. Public API Functions
+ * 4. Public API Functions (Default Instance)
  *===========================================================================*/
 
  /**
@@ -35,11 +519,62 @@ typedef struct cache_element {
   */
 void cache_init();
 
+/**
+ * @brief Initializes the cache as 'shard_count' independent shards.
+ *
+ * @details Each shard has its own map, LRU list, byte budget and lock, and a URL
+ * always maps to the same shard, so operations on different shards never contend.
+ * LRU order is maintained per shard. cache_init() is equivalent to
+ * cache_init_sharded(1, CACHE_BUDGET_SPLIT).
+ *
+ * @param shard_count Number of shards (1 to CACHE_MAX_SHARDS). 0 selects a single shard.
+ * @param budget_mode Whether the byte budget is split evenly across shards or shared.
+ * With CACHE_BUDGET_SPLIT an object larger than one shard's share is never cached.
+ */
+void cache_init_sharded(size_t shard_count, cache_budget_mode_t budget_mode);
+
+/**
+ * @brief Initializes the cache from a configuration struct.
+ *
+ * @details With CACHE_LOOKUP_READ_MOSTLY, cache_find() takes each shard's lock in
+ * shared mode, so concurrent hits no longer serialize, and a hit only sets the
+ * element's reference bit. LRU order is applied lazily at eviction time: a
+ * referenced element at the tail gets its bit cleared and a second chance at the
+ * head instead of being evicted (the CLOCK / second-chance approximation of LRU).
+ *
+ * With a tier_path, evicted elements are not dropped but queued for a disk tier:
+ * a log-structured file of tier_bytes written by a background thread, indexed in
+ * memory. A lookup that misses in RAM checks that index and, on a hit, reads the
+ * object back and promotes it, so a local disk read replaces an origin fetch.
+ * Hits in RAM never touch the tier. Writing a key drops its copy on disk.
+ *
+ * With compression set to CACHE_ENCODING_LZ4, adds of CACHE_COMPRESS_MIN_BYTES or
+ * more are compressed before the shard lock is taken, and kept that way if that
+ * saves at least an eighth. Budgets count stored bytes, so compressible objects
+ * take proportionally less room. Lookups return the stored bytes; cache_element_decode()
+ * expands them on demand.
+ *
+ * With background_reclaim, removed elements are freed by a reclaimer thread
+ * after the shard lock is dropped. A non-zero high_watermark also has that thread
+ * evict each shard down to low_watermark (percent of its budget) once a write
+ * takes it over the high mark, in batches of a few dozen evictions per lock hold.
+ *
+ * @param config The options to use, or NULL for the defaults.
+ */
+void cache_init_config(const cache_config_t* config);
+
 /**
  * @brief Frees all memory used by the cache. Must be called once at shutdown.
  */
 void cache_destroy();
 
+/**
+ * @brief Returns the default instance used by the cache_* functions, or NULL before cache_init().
+ * @details Lets code written against the default cache use the proxy_cache_* API,
+ * for example proxy_cache_set_budget(cache_default(), bytes).
+ */
+proxy_cache_t* cache_default();
+
 /**
  * @brief Finds an element in the cache by its URL.
  *
@@ -50,10 +585,247 @@ void cache_destroy();
  * @param url The URL to search for (null-terminated string).
  * @return A read-only pointer to the cache_element if found, or NULL otherwise.
  * NOTE: This is an internal pointer. Do NOT free or modify it.
- * The data is valid until it is evicted by the cache.
+ * The data is valid until it is evicted by the cache, which another thread can
+ * do at any time; use cache_acquire() when other threads may add to the cache.
  */
 cache_element* cache_find(const char* url);
 
+/**
+ * @brief Finds an element by a length-delimited key.
+ *
+ * @details Same as cache_find(), but the key is 'key_len' bytes at 'key' and need not
+ * be NUL-terminated, so a URL can be looked up straight from a request buffer. Keys
+ * are compared by length and memcmp, so they may contain NUL bytes. cache_find(url)
+ * is cache_find_key(url, strlen(url)).
+ *
+ * @param key The key bytes.
+ * @param key_len The number of bytes in 'key'.
+ * @return As for cache_find().
+ */
+cache_element* cache_find_key(const char* key, size_t key_len);
+
+/**
+ * @brief Finds an element and pins it so it stays valid after the lock is dropped.
+ *
+ * @details Works like cache_find(), but also takes a reference on the element.
+ * Until the matching cache_release(), the element and its data stay allocated
+ * even if another thread evicts or replaces the URL in the meantime, so the
+ * caller can serve straight from the cached buffer without copying it.
+ *
+ * @param url The URL to search for (null-terminated string).
+ * @return A pinned, read-only element, or NULL if the URL is not cached.
+ */
+cache_element* cache_acquire(const char* url);
+
+/**
+ * @brief Like cache_acquire(), with a length-delimited key as for cache_find_key().
+ */
+cache_element* cache_acquire_key(const char* key, size_t key_len);
+
+/**
+ * @brief Returns the element for a key, loading it on a miss with at most one loader call.
+ *
+ * @details On a hit this is cache_acquire_key(). On a miss, the first caller runs
+ * 'loader' and stores the result with cache_add_adopt_key(), so it gets the
+ * instance's default_ttl_ms. Callers that miss on
+ * the same key while that load runs do not call their loader: they block until the
+ * first load finishes and share its result. So a popular object that was just evicted
+ * costs the origin one fetch, and the cache stores one copy. An object too large to
+ * cache is still handed to every waiting caller, then freed after its last release.
+ * The loader runs without any cache lock held, so it may block on the network.
+ *
+ * @param key The key bytes, as for cache_find_key().
+ * @param key_len The number of bytes in 'key'.
+ * @param loader Fetches the object on a miss.
+ * @param context Passed through to 'loader'.
+ * @return A pinned element to release with cache_release(), or NULL if the load failed
+ * (every caller waiting on that load gets NULL as well).
+ */
+cache_element* cache_get_or_load(const char* key, size_t key_len, cache_loader_fn loader, void* context);
+
+/**
+ * @brief Looks up a key without ever waiting for a shard lock, for event-loop threads.
+ *
+ * @details Behaves like cache_find_key() if the shard's lock can be taken right away
+ * (shared, in read-mostly mode). If another thread holds it, returns CACHE_BUSY at
+ * once, and the caller can retry on a later loop iteration or treat it as a miss.
+ * A RAM miss is final: the disk tier is not consulted, since reading it blocks.
+ *
+ * @param element Receives the element, or NULL on a miss or when busy.
+ * @return 0 on a hit or a miss, CACHE_BUSY if the lock was held.
+ */
+int cache_try_find_key(const char* key, size_t key_len, cache_element** element);
+
+/**
+ * @brief Like cache_try_find_key(), but pins the element found as cache_acquire() does.
+ */
+int cache_try_acquire_key(const char* key, size_t key_len, cache_element** element);
+
+/**
+ * @brief Queues an add for the thread that owns the key's shard and returns at once.
+ *
+ * @details Needs owner_threads in cache_config_t. Shards are assigned to the owner
+ * threads round-robin, and each owner applies the adds queued for its shards in the
+ * order they were queued, so with one owner per core writes are message-passed to
+ * their shard instead of contending for it. Queuing copies the key and the data and
+ * costs one compare-and-swap; the caller never touches a shard lock. The add gets the
+ * default TTL. 'done', if not NULL, is called on the owner thread once the add has
+ * been applied (an event loop would wake itself from there, for example through an
+ * eventfd). It must not block or call cache_flush_async().
+ *
+ * @return 0 if queued, -1 if the cache has no owner threads, the object can never
+ * fit or memory ran out ('done' is then not called).
+ */
+int cache_add_async(const char* key, size_t key_len, const char* data, size_t length,
+    cache_add_done_fn done, void* context);
+
+/**
+ * @brief Waits until every add queued by cache_add_async() before the call is applied.
+ */
+void cache_flush_async();
+
+/**
+ * @brief Looks up a batch of keys, locking each shard once instead of once per key.
+ *
+ * @details Equivalent to calling cache_find_key() for every key, but the keys are
+ * hashed up front and grouped by shard, and each group is probed under a single
+ * lock acquisition after prefetching all of its buckets. A multiplexed front end
+ * that collects the keys of many concurrent requests pays one lock round trip per
+ * shard rather than one per request. Batches are processed 64 keys at a time.
+ *
+ * @param keys The keys to look up.
+ * @param count The number of entries in 'keys'.
+ * @param results Receives, at the same index as each key, its element or NULL on a miss.
+ * The elements are not pinned; see cache_acquire_many().
+ * @return The number of keys found.
+ */
+size_t cache_find_many(const cache_key_t* keys, size_t count, cache_element** results);
+
+/**
+ * @brief Like cache_find_many(), but pins every element found as cache_acquire() does.
+ * @details Each non-NULL result must be handed to cache_release().
+ */
+size_t cache_acquire_many(const cache_key_t* keys, size_t count, cache_element** results);
+
+/**
+ * @brief Stores a batch of objects, locking each shard once instead of once per object.
+ *
+ * @details Equivalent to calling cache_add_ttl() for every item in order, so a key
+ * that appears twice ends up with its last data. Items that cannot be cached count
+ * as rejections and do not affect the others.
+ *
+ * @param items The objects to store.
+ * @param count The number of entries in 'items'.
+ * @return The number of items cached.
+ */
+size_t cache_add_many(const cache_item_t* items, size_t count);
+
+/**
+ * @brief Drops a reference taken by cache_acquire().
+ * @details The last release of an element that has already left the cache frees it.
+ * @param element The handle to release. Does nothing if NULL.
+ */
+void cache_release(cache_element* element);
+
+/**
+ * @brief Copies an element's original payload into 'buffer', decompressing it if needed.
+ * @details Clients that accept the stored encoding can send 'data' as-is instead.
+ * @param capacity Size of 'buffer'; 'raw_len' bytes are enough.
+ * @return The number of bytes written ('raw_len'), or 0 if 'capacity' is too small
+ * or the stored block is corrupt.
+ */
+size_t cache_element_decode(const cache_element* element, char* buffer, size_t capacity);
+
+/**
+ * @brief Creates a front cache of the default instance; see proxy_cache_front_create().
+ */
+cache_front_t* cache_front_create(size_t slots);
+
+/**
+ * @brief Writes every live element to a snapshot file for a later cache_load().
+ *
+ * @details Each shard is walked from its next victim to its most valuable element,
+ * so a load, which inserts in file order, restores roughly the same eviction order.
+ * Shards are only locked long enough to pin their elements; the file is written
+ * afterwards. The snapshot is built next to 'path' and renamed over it when complete,
+ * so 'path' always holds either the previous snapshot or the new one. Expired elements
+ * are skipped and the others keep their remaining TTL. The file uses native byte
+ * order and is meant for restarting the same build on the same machine.
+ *
+ * @param path The file to create or replace.
+ * @return 0 on success, -1 if the file could not be written (the old one is kept).
+ */
+int cache_snapshot(const char* path);
+
+/**
+ * @brief Fills the cache from a file written by cache_snapshot().
+ *
+ * @details The file is memory-mapped and validated, and each payload is adopted
+ * in place rather than copied, so loading costs about one page fault per page
+ * instead of a read and a copy per object. An element serves from the mapping
+ * until it is overwritten or evicted; the mapping is unmapped once no element
+ * uses it. Elements that do not fit the budget evict earlier ones as usual and
+ * count as rejections.
+ *
+ * @param path The snapshot file.
+ * @return 0 on success, -1 if the file is missing, truncated or not a snapshot.
+ */
+int cache_load(const char* path);
+
+/**
+ * @brief Writes the sampled access trace to a file for offline analysis or replay.
+ *
+ * @details Needs trace_sample in cache_config_t. Keys are sampled by hash, so a
+ * traced key has all of its finds and adds recorded: the 64-bit key hash, the payload
+ * size and whether the find hit or the add was stored. Records go to a lock-free ring
+ * of trace_records entries that keeps the most recent ones; tracing costs a hash test
+ * per operation and three atomics per sampled one. The file holds the records oldest
+ * first in native byte order (see cache_trace.h), and the benchmark replays it.
+ *
+ * @param path The file to create or replace.
+ * @return 0 on success, -1 if tracing is off or the file could not be written.
+ */
+int cache_dump_trace(const char* path);
+
+/**
+ * @brief Estimates the miss ratio the cache would have at other byte budgets.
+ *
+ * @details Replays the sampled trace through the SHARDS estimator: each find's reuse
+ * distance, the payload bytes of distinct keys accessed since its key was last used,
+ * is measured over the sample and scaled up by the sampling rate, and a find misses
+ * under a budget its distance does not fit. The result is the miss-ratio curve of an
+ * LRU cache over the traced window, which is what sizing a cache needs; it ignores
+ * metadata and the configured eviction policy. Its accuracy grows with the number
+ * of sampled finds, so lower rates want a larger ring.
+ *
+ * @param budgets Budgets in bytes to evaluate.
+ * @param count The number of budgets.
+ * @param miss_ratios Receives the estimated miss ratio for each budget.
+ * @return The number of sampled finds the estimate is based on (0: no estimate, every ratio is 1).
+ */
+size_t cache_estimate_mrc(const size_t* budgets, size_t count, double* miss_ratios);
+
+/**
+ * @brief Reports how much memory the cache is using, summed over all shards.
+ * @details The slab fields are only non-zero when the cache was configured with use_slab.
+ * @param stats Receives the totals.
+ */
+void cache_get_memory_stats(cache_memory_stats_t* stats);
+
+/**
+ * @brief Reports hit/miss/eviction counters, lock contention, map probe lengths and,
+ * when the cache was configured with track_latency, lookup latency percentiles.
+ *
+ * @details Counters are kept per shard with relaxed atomic increments and summed here,
+ * so the hot path never shares a counter across shards. Lock wait time is only measured
+ * for acquisitions that find the lock taken. Lookup latency goes into an HDR-style
+ * histogram per shard. Walking the maps for probe lengths costs O(capacity) under each
+ * shard's lock, so call this from a monitoring thread, not per request.
+ *
+ * @param stats Receives the totals.
+ */
+void cache_get_stats(cache_stats_t* stats);
+
 /**
  * @brief Adds a new data object to the cache.
  *
@@ -68,4 +840,95 @@ cache_element* cache_find(const char* url);
  */
 void cache_add(const char* url, const char* data, size_t length);
 
-#endif
\ No newline at end of file
+/**
+ * @brief Like cache_add(), with a length-delimited key as for cache_find_key().
+ * @details The key bytes are copied into the element along with their length.
+ */
+void cache_add_key(const char* key, size_t key_len, const char* data, size_t length);
+
+/**
+ * @brief Adds a data object by taking ownership of the caller's heap buffer.
+ *
+ * @details Same semantics as cache_add(), but the buffer itself becomes the
+ * cached copy, so no allocation or memcpy of the payload takes place. Updating
+ * an existing URL swaps the buffer pointer. The buffer is released with
+ * 'buffer_free' once the element leaves the cache and its last handle is
+ * released. Ownership always moves to the cache: if the object cannot be
+ * cached, the buffer is released before this function returns.
+ *
+ * @param url The URL of the object (acts as the key).
+ * @param buffer A heap buffer holding the data. Must not be used by the caller afterwards.
+ * @param length The size of the data in bytes.
+ * @param buffer_free Releases 'buffer'. If NULL, free() is used.
+ * @return 0 if the object was cached, -1 if it was rejected (and 'buffer' released).
+ */
+int cache_add_adopt(const char* url, char* buffer, size_t length, cache_free_fn buffer_free);
+
+/**
+ * @brief Like cache_add_adopt(), with a length-delimited key as for cache_find_key().
+ */
+int cache_add_adopt_key(const char* key, size_t key_len, char* buffer, size_t length,
+    cache_free_fn buffer_free);
+
+/**
+ * @brief Like cache_add_key(), with a lifetime (for example from Cache-Control: max-age).
+ *
+ * @details After 'ttl_ms' milliseconds the element is no longer returned by lookups.
+ * Its memory stays charged to the budget until it is reclaimed. A per-shard
+ * hierarchical timer wheel does the reclaiming in O(1) amortized time per element: a
+ * few expired elements at each write to the shard, more from proxy_cache_maintain().
+ * The other add functions use the instance's default_ttl_ms.
+ *
+ * @param ttl_ms Lifetime in milliseconds, or 0 for an element that never expires.
+ */
+void cache_add_ttl(const char* key, size_t key_len, const char* data, size_t length,
+    unsigned long long ttl_ms);
+
+/**
+ * @brief Like cache_add_adopt_key(), with a lifetime as for cache_add_ttl().
+ */
+int cache_add_adopt_ttl(const char* key, size_t key_len, char* buffer, size_t length,
+    cache_free_fn buffer_free, unsigned long long ttl_ms);
+
+/**
+ * @brief Starts adding an object whose payload arrives in chunks (a streamed upstream response).
+ *
+ * @details The payload is appended straight into the buffer the element will keep,
+ * which is allocated once at 'expected_len' bytes and adopted on commit, so a large
+ * response is neither assembled by the caller first nor copied by the cache. The
+ * budget for 'expected_len' bytes (their whole footprint with CACHE_ACCOUNT_FOOTPRINT)
+ * is reserved, evicting as needed, before the first chunk arrives, so concurrent adds
+ * cannot claim it meanwhile. Lookups do not see
+ * the object until cache_commit(). Each writer must end in exactly one
+ * cache_commit() or cache_abort(), before the instance is destroyed.
+ *
+ * @param url The URL of the object (acts as the key).
+ * @param expected_len The payload size if known (for example from Content-Length), or 0.
+ * An object may still end up larger or smaller.
+ * @return The writer, or NULL if 'expected_len' cannot fit the budget or allocation failed.
+ */
+cache_writer_t* cache_begin_add(const char* url, size_t expected_len);
+
+/**
+ * @brief Appends the next chunk of a streamed payload.
+ * @details Growing past the expected size reallocates the buffer. Once an append
+ * fails the writer only accepts cache_abort(), or a cache_commit() that rejects it.
+ * @return 0 on success, -1 if the object can no longer fit the budget or allocation failed.
+ */
+int cache_append(cache_writer_t* writer, const char* chunk, size_t length);
+
+/**
+ * @brief Publishes a streamed object and frees the writer.
+ * @details Behaves like cache_add_adopt_ttl() with the appended bytes, including
+ * compression, and returns the writer's reservation to the budget.
+ * @return 0 if the object was cached, -1 if it was rejected (empty, failed or too large).
+ */
+int cache_commit(cache_writer_t* writer);
+
+/**
+ * @brief Discards a streamed object (for example when the upstream connection drops) and frees the writer.
+ * @param writer The writer. Does nothing if NULL.
+ */
+void cache_abort(cache_writer_t* writer);
+
+#endif
@@ -0,0 +1,245 @@
+/**
+ * @file slab.c
+ * @brief Size-class slab allocator for cache elements, keys and payloads.
+ *
+ * Memory is obtained in fixed-size pages. Each page belongs to one size class
+ * and is carved into equal chunks on demand; freed chunks are kept on a
+ * per-class free list. Because chunks never move between classes, memory use
+ * is fully described by the page count and the per-class occupancy.
+ */
+
+#include "slab.h"
+#include "cache_lock.h"
+#include "cache_platform.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/*=============================================================================
+ * 1. Type Definitions
+ *===========================================================================*/
+
+// Header at the start of every page, linking all pages for release.
+typedef struct slab_page {
+    struct slab_page* next;
+} slab_page_t;
+
+// A free chunk stores the link to the next free chunk in its first bytes.
+typedef struct slab_chunk {
+    struct slab_chunk* next;
+} slab_chunk_t;
+
+typedef struct slab_class {
+    size_t chunk_size;        // Size of every chunk in this class.
+    slab_chunk_t* free_list;  // Chunks returned by slab_free().
+    char* carve_pos;          // Next uncarved chunk in the newest page.
+    char* carve_end;          // End of the newest page.
+} slab_class_t;
+
+struct slab {
+    size_t page_size;
+    size_t class_count;
+    slab_class_t classes[SLAB_MAX_CLASSES];
+    slab_page_t* pages;       // Every page ever allocated.
+    slab_stats_t stats;
+    size_t live_chunks;       // Chunks and large objects not yet freed.
+    int destroyed;            // slab_destroy() was called while chunks were live.
+    int node;                 // NUMA node pages are placed on (-1: wherever malloc() puts them).
+    cache_mutex_t mutex;
+};
+
+// Chunks start after the page header, kept pointer-aligned.
+#define SLAB_PAGE_HEADER ((sizeof(slab_page_t) + 15) & ~(size_t)15)
+
+/*=============================================================================
+ * 2. Static Helper Functions
+ *===========================================================================*/
+
+/**
+ * @brief Finds the smallest class that fits 'size'.
+ * @return The class index, or class_count if the request must go to malloc().
+ */
+static size_t class_for_size(const slab_t* slab, size_t size) {
+    size_t lo = 0, hi = slab->class_count;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (slab->classes[mid].chunk_size < size)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+static void release_pages(slab_t* slab) {
+    slab_page_t* page = slab->pages;
+    while (page) {
+        slab_page_t* next = page->next;
+        if (slab->node >= 0)
+            cache_numa_free(page, SLAB_PAGE_HEADER + slab->page_size);
+        else
+            free(page);
+        page = next;
+    }
+    cache_mutex_destroy(&slab->mutex);
+    free(slab);
+}
+
+/**
+ * @brief Gives a class a fresh page to carve from. Called with the lock held.
+ */
+static int add_page(slab_t* slab, slab_class_t* cls) {
+    slab_page_t* page;
+    if (slab->node >= 0) {
+        page = cache_numa_reserve(SLAB_PAGE_HEADER + slab->page_size);
+        if (page && cache_numa_place(page, SLAB_PAGE_HEADER + slab->page_size, (unsigned int)slab->node) != 0) {
+            cache_numa_free(page, SLAB_PAGE_HEADER + slab->page_size);
+            page = NULL;
+        }
+    }
+    else
+        page = malloc(SLAB_PAGE_HEADER + slab->page_size);
+    if (!page)
+        return -1;
+
+    page->next = slab->pages;
+    slab->pages = page;
+    cls->carve_pos = (char*)page + SLAB_PAGE_HEADER;
+    cls->carve_end = cls->carve_pos + slab->page_size;
+
+    slab->stats.page_count++;
+    slab->stats.reserved_bytes += slab->page_size;
+    return 0;
+}
+
+/*=============================================================================
+ * 3. Public API Functions
+ *===========================================================================*/
+
+slab_t* slab_create(size_t page_size, float growth_factor) {
+    slab_t* slab = calloc(1, sizeof(slab_t));
+    if (!slab)
+        return NULL;
+
+    if (page_size < SLAB_MIN_CHUNK_SIZE)
+        page_size = SLAB_DEFAULT_PAGE_SIZE;
+    if (growth_factor <= 1.0f)
+        growth_factor = SLAB_DEFAULT_GROWTH_FACTOR;
+    slab->page_size = page_size;
+    slab->node = -1;
+
+    // Classes grow geometrically; the last one holds a single chunk per page.
+    size_t size = SLAB_MIN_CHUNK_SIZE;
+    while (slab->class_count < SLAB_MAX_CLASSES - 1 && size < page_size) {
+        slab->classes[slab->class_count++].chunk_size = size;
+        size_t next = ((size_t)((double)size * growth_factor) + 7) & ~(size_t)7;
+        size = next > size ? next : size + 8;
+    }
+    slab->classes[slab->class_count++].chunk_size = page_size;
+    cache_mutex_init(&slab->mutex);
+    return slab;
+}
+
+void slab_set_node(slab_t* slab, int node) {
+    cache_mutex_lock(&slab->mutex);
+    if (!slab->pages)
+        slab->node = node < 0 ? -1 : node;
+    cache_mutex_unlock(&slab->mutex);
+}
+
+void slab_destroy(slab_t* slab) {
+    if (!slab)
+        return;
+
+    cache_mutex_lock(&slab->mutex);
+    if (slab->live_chunks > 0) {
+        // Outstanding chunks still point into our pages; the last slab_free() cleans up.
+        slab->destroyed = 1;
+        cache_mutex_unlock(&slab->mutex);
+        return;
+    }
+    cache_mutex_unlock(&slab->mutex);
+    release_pages(slab);
+}
+
+void* slab_alloc(slab_t* slab, size_t size) {
+    if (!slab || size == 0)
+        return NULL;
+
+    size_t index = class_for_size(slab, size);
+    void* chunk = NULL;
+
+    cache_mutex_lock(&slab->mutex);
+    if (index == slab->class_count) {
+        chunk = malloc(size);
+        if (chunk) {
+            slab->stats.large_count++;
+            slab->stats.reserved_bytes += size;
+            slab->stats.used_bytes += size;
+        }
+    }
+    else {
+        slab_class_t* cls = &slab->classes[index];
+        if (cls->free_list) {
+            chunk = cls->free_list;
+            cls->free_list = cls->free_list->next;
+        }
+        else if ((size_t)(cls->carve_end - cls->carve_pos) >= cls->chunk_size || add_page(slab, cls) == 0) {
+            chunk = cls->carve_pos;
+            cls->carve_pos += cls->chunk_size;
+        }
+        if (chunk)
+            slab->stats.used_bytes += cls->chunk_size;
+    }
+
+    if (chunk) {
+        slab->stats.requested_bytes += size;
+        slab->live_chunks++;
+    }
+    cache_mutex_unlock(&slab->mutex);
+    return chunk;
+}
+
+void slab_free(slab_t* slab, void* ptr, size_t size) {
+    if (!slab || !ptr)
+        return;
+
+    size_t index = class_for_size(slab, size);
+
+    cache_mutex_lock(&slab->mutex);
+    if (index == slab->class_count) {
+        free(ptr);
+        slab->stats.large_count--;
+        slab->stats.reserved_bytes -= size;
+        slab->stats.used_bytes -= size;
+    }
+    else {
+        slab_class_t* cls = &slab->classes[index];
+        slab_chunk_t* chunk = (slab_chunk_t*)ptr;
+        chunk->next = cls->free_list;
+        cls->free_list = chunk;
+        slab->stats.used_bytes -= cls->chunk_size;
+    }
+    slab->stats.requested_bytes -= size;
+    slab->live_chunks--;
+
+    int release = slab->destroyed && slab->live_chunks == 0;
+    cache_mutex_unlock(&slab->mutex);
+
+    if (release)
+        release_pages(slab);
+}
+
+size_t slab_chunk_size(const slab_t* slab, size_t size) {
+    size_t index = class_for_size(slab, size);
+    return index == slab->class_count ? size : slab->classes[index].chunk_size;
+}
+
+void slab_get_stats(slab_t* slab, slab_stats_t* stats) {
+    if (!slab || !stats)
+        return;
+
+    cache_mutex_lock(&slab->mutex);
+    *stats = slab->stats;
+    cache_mutex_unlock(&slab->mutex);
+}
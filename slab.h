@@ -0,0 +1,73 @@
+// slab.h
+
+#pragma once
+
+#include <stddef.h> // For size_t
+
+#define SLAB_DEFAULT_PAGE_SIZE     (1024 * 1024) // Bytes carved into chunks of one size class.
+#define SLAB_DEFAULT_GROWTH_FACTOR 1.25f         // Ratio between consecutive size classes.
+#define SLAB_MIN_CHUNK_SIZE        64            // Smallest size class.
+#define SLAB_MAX_CLASSES           64
+
+// Opaque allocator handle.
+typedef struct slab slab_t;
+
+// Memory accounting snapshot for one allocator.
+typedef struct slab_stats {
+    size_t reserved_bytes;  // Bytes obtained from the system (whole pages plus large objects).
+    size_t used_bytes;      // Bytes handed out, rounded up to each chunk's size class.
+    size_t requested_bytes; // Bytes callers asked for.
+    size_t page_count;      // Pages carved into chunks.
+    size_t large_count;     // Objects too big for any class, allocated individually.
+} slab_stats_t;
+
+/**
+ * @brief Creates a size-class slab allocator.
+ * @details Requests are rounded up to the nearest size class and served from pages
+ * dedicated to that class, memcached-style. Freed chunks go back to their class's
+ * free list and are reused for the same class, so fragmentation is bounded by the
+ * gap between classes. Requests larger than one page fall back to malloc().
+ * All functions are thread-safe.
+ * @param page_size Bytes per page. If 0, SLAB_DEFAULT_PAGE_SIZE is used.
+ * @param growth_factor Ratio between consecutive class sizes. If <= 1, the default is used.
+ * @return The allocator, or NULL on allocation failure.
+ */
+slab_t* slab_create(size_t page_size, float growth_factor);
+
+/**
+ * @brief Places the allocator's pages on a NUMA node (as a preference) instead of wherever malloc() puts them.
+ * @details Only takes effect before the first page is allocated. Objects too large
+ * for a page still come from malloc().
+ * @param node The node, or -1 for malloc() pages.
+ */
+void slab_set_node(slab_t* slab, int node);
+
+/**
+ * @brief Destroys the allocator.
+ * @details If chunks are still allocated (for example, held by readers), the pages are
+ * released when the last of them is freed instead of immediately.
+ * @param slab The allocator. Does nothing if NULL.
+ */
+void slab_destroy(slab_t* slab);
+
+/**
+ * @brief Allocates 'size' bytes from the matching size class.
+ * @return The chunk, or NULL on allocation failure or if size is 0.
+ */
+void* slab_alloc(slab_t* slab, size_t size);
+
+/**
+ * @brief Returns a chunk to its size class.
+ * @param size The size passed to slab_alloc() for this chunk.
+ */
+void slab_free(slab_t* slab, void* ptr, size_t size);
+
+/**
+ * @brief Returns the number of bytes slab_alloc(size) actually consumes.
+ */
+size_t slab_chunk_size(const slab_t* slab, size_t size);
+
+/**
+ * @brief Fills 'stats' with the allocator's current accounting.
+ */
+void slab_get_stats(slab_t* slab, slab_stats_t* stats);
@@ -1,14 +1,93 @@
 #include <stdio.h>
+#include <stddef.h> // For offsetof
 #include <string.h>
 #include <assert.h>
-#include <windows.h>      // Required for threading functions (CreateThread, etc.)
+#ifdef _WIN32
+    #include <windows.h>  // Required for threading functions (CreateThread, etc.)
+#else
+    #include <pthread.h>
+    #include <unistd.h>   // For usleep
+
+    // POSIX spellings of the Windows calls the tests use.
+    #define sprintf_s snprintf
+    #define _strdup strdup
+    #define Sleep(ms) usleep((useconds_t)(ms) * 1000)
+    #define InterlockedIncrement(target) __atomic_add_fetch((target), 1, __ATOMIC_SEQ_CST)
+    typedef long LONG;
+#endif
 
 #include "proxy_cache.h"  // Your cache's public API
+#include "hashmap.h"      // For the map-level tests
+#include "slab.h"         // For the allocator-level tests
+#include "cache_histogram.h" // For the latency histogram tests
+#include "cache_timer.h"     // For the timer wheel tests
+#include "cache_codec.h"     // For the LZ4 codec tests
+#include "cache_policy.h"    // For the GDSF aging test
+#include "cache_platform.h"  // For the stress suite's clock
+#include "cache_trace.h"     // For reading dumped access traces
 
 // --- Configuration for the Thread Safety Test ---
 #define NUM_THREADS 8
 #define OPERATIONS_PER_THREAD 500
 
+// --- Configuration for the Stress Test: few keys and a small budget, so threads collide and evict ---
+#define STRESS_OPERATIONS 10000
+#define STRESS_KEYS 48
+#define STRESS_CACHE_BYTES (8 * 1024)
+
+// Byte budget every test cache is created with; the eviction tests are sized for it.
+#define TEST_CACHE_BYTES 100
+
+/*--- Test threads, on either platform ---*/
+
+typedef void (*test_thread_fn)(void* arg);
+
+typedef struct test_thread {
+    test_thread_fn fn;
+    void* arg;
+#ifdef _WIN32
+    HANDLE handle;
+#else
+    pthread_t handle;
+#endif
+} test_thread_t;
+
+#ifdef _WIN32
+static DWORD WINAPI test_thread_main(LPVOID param) {
+    test_thread_t* thread = (test_thread_t*)param;
+    thread->fn(thread->arg);
+    return 0;
+}
+#else
+static void* test_thread_main(void* param) {
+    test_thread_t* thread = (test_thread_t*)param;
+    thread->fn(thread->arg);
+    return NULL;
+}
+#endif
+
+static void start_thread(test_thread_t* thread, test_thread_fn fn, void* arg) {
+    thread->fn = fn;
+    thread->arg = arg;
+#ifdef _WIN32
+    thread->handle = CreateThread(NULL, 0, test_thread_main, thread, 0, NULL);
+    assert(thread->handle != NULL);
+#else
+    int created = pthread_create(&thread->handle, NULL, test_thread_main, thread);
+    assert(created == 0);
+    (void)created;
+#endif
+}
+
+static void join_thread(test_thread_t* thread) {
+#ifdef _WIN32
+    WaitForSingleObject(thread->handle, INFINITE);
+    CloseHandle(thread->handle);
+#else
+    pthread_join(thread->handle, NULL);
+#endif
+}
+
 /**
  * @brief Tests basic add and find functionality.
  */
@@ -42,10 +121,10 @@ void test_add_and_find() {
 
 /**
  * @brief Tests if the Least Recently Used (LRU) item is evicted correctly.
- * @note This test requires MAX_CACHE_SIZE in proxy_cache.h to be set to a small value (e.g., 100).
+ * @note Expects a budget of TEST_CACHE_BYTES = 100.
  */
 void test_lru_eviction() {
-    printf("Running test: test_lru_eviction (expects MAX_CACHE_SIZE = 100)...\n");
+    printf("Running test: test_lru_eviction (expects TEST_CACHE_BYTES = 100)...\n");
 
     const char* url1 = "http://item1.com"; // Oldest item (LRU)
     const char* data1 = "I am the first data block."; // length = 26
@@ -126,92 +205,2190 @@ void test_update_item() {
 }
 
 /**
- * @brief The function executed by each concurrent thread to hammer the cache.
+ * @brief Tests that the map keeps every key reachable while it grows and erases.
+ * @details Starts from the smallest table so several incremental resizes are in
+ * flight while keys are being inserted, looked up, and removed.
  */
-DWORD WINAPI thread_worker(LPVOID lpParam) {
-    int thread_id = *(int*)lpParam;
+void test_map_growth_and_erase() {
+    printf("Running test: test_map_growth_and_erase...\n");
 
-    for (int i = 0; i < OPERATIONS_PER_THREAD; i++) {
-        char url[64];
-        char data[64];
+    map_t* map = map_create(16, 0.75f, NULL, NULL, free, NULL);
+    assert(map != NULL);
 
-        // Create a unique URL and data for each operation to avoid collisions between threads
-        sprintf_s(url, sizeof(url), "http://thread%d-item%d.com", thread_id, i);
-        sprintf_s(data, sizeof(data), "data from thread %d, op %d", thread_id, i);
+    char key[32];
+    for (int i = 0; i < 5000; i++) {
+        sprintf_s(key, sizeof(key), "key-%d", i);
+        assert(map_insert(map, _strdup(key), (void*)(size_t)(i + 1)) == 0);
+    }
+    assert(map_size(map) == 5000);
+    printf("  - Inserted 5000 keys across several resizes.\n");
 
-        // Hammer the cache with add and find operations
-        cache_add(url, data, strlen(data));
-        cache_find(url);
+    // Erase every even key, leaving tombstones behind.
+    for (int i = 0; i < 5000; i += 2) {
+        sprintf_s(key, sizeof(key), "key-%d", i);
+        map_erase(map, key);
     }
-    return 0;
+    assert(map_size(map) == 2500);
+
+    for (int i = 0; i < 5000; i++) {
+        sprintf_s(key, sizeof(key), "key-%d", i);
+        void* value = map_find(map, key);
+        if (i % 2 == 0)
+            assert(value == NULL);
+        else
+            assert(value == (void*)(size_t)(i + 1));
+    }
+    printf("  - Erased keys are gone and the rest are still reachable.\n");
+
+    // Stop inserting right after a resize starts; the remaining groups move on request.
+    map_stats_t stats;
+    int next = 5000;
+    do {
+        sprintf_s(key, sizeof(key), "key-%d", next);
+        assert(map_insert(map, _strdup(key), (void*)(size_t)(next + 1)) == 0);
+        next++;
+        map_get_stats(map, &stats);
+    } while (!stats.resizing);
+    size_t left = map_advance_resize(map, 0);
+    assert(left > 1 && map_advance_resize(map, 1) == left - 1);
+    sprintf_s(key, sizeof(key), "key-%d", next - 1);
+    assert(map_find(map, key) == (void*)(size_t)next);
+    assert(map_advance_resize(map, (size_t)-1) == 0);
+    map_get_stats(map, &stats);
+    assert(!stats.resizing && map_size(map) == 2500 + (size_t)(next - 5000));
+    assert(map_find(map, "key-4999") == (void*)(size_t)5000 && map_find(map, key) == (void*)(size_t)next);
+    printf("  - map_advance_resize() finishes a resize without further writes.\n");
+
+    map_destroy(map);
+    printf("Test Passed!\n\n");
+}
+
+// Sends every key to the same group, so lookups must rely on the stored hash and key compare.
+static unsigned long long colliding_hash(const void* key) {
+    return map_hash_string(key) & ~(unsigned long long)0xFFFFFF80u;
+}
+
+// A capacity-reduced hash in the original callback style.
+static unsigned int reduced_hash(const void* key, size_t map_capacity) {
+    return (unsigned int)(map_hash_string(key) & (map_capacity - 1));
 }
 
 /**
- * @brief Spawns multiple threads to test concurrent access to the cache.
+ * @brief Tests the prehashed entry points and both hash function styles.
  */
-void test_thread_safety() {
-    printf("Running test: test_thread_safety with %d threads...\n", NUM_THREADS);
+void test_map_prehashed() {
+    printf("Running test: test_map_prehashed...\n");
 
-    HANDLE threads[NUM_THREADS];
-    int thread_ids[NUM_THREADS];
+    map_t* map = map_create(16, 0.75f, NULL, NULL, free, NULL);
+    assert(map != NULL);
+    assert(map_hash(map, "some-key") == map_hash_string("some-key"));
+    assert(map_hash_bytes("abc", 3, 0) != map_hash_bytes("abd", 3, 0));
+    assert(map_hash_bytes("abc", 3, 0) != map_hash_bytes("abc", 3, 1));
 
-    // Launch all threads
-    for (int i = 0; i < NUM_THREADS; i++) {
-        thread_ids[i] = i;
-        threads[i] = CreateThread(NULL, 0, thread_worker, &thread_ids[i], 0, NULL);
-        assert(threads[i] != NULL);
+    char key[80];
+    for (int i = 0; i < 1000; i++) {
+        sprintf_s(key, sizeof(key), "http://example.com/a/fairly/long/path/to/resource-%d", i);
+        unsigned long long hash = map_hash(map, key);
+        assert(map_insert_prehashed(map, _strdup(key), (void*)(size_t)(i + 1), hash) == 0);
+        assert(map_find_prehashed(map, key, hash) == (void*)(size_t)(i + 1));
+    }
+    for (int i = 0; i < 1000; i += 2) {
+        sprintf_s(key, sizeof(key), "http://example.com/a/fairly/long/path/to/resource-%d", i);
+        map_erase_prehashed(map, key, map_hash(map, key));
+    }
+    for (int i = 0; i < 1000; i++) {
+        sprintf_s(key, sizeof(key), "http://example.com/a/fairly/long/path/to/resource-%d", i);
+        assert(map_find(map, key) == (i % 2 ? (void*)(size_t)(i + 1) : NULL));
     }
+    map_destroy(map);
+    printf("  - Prehashed and plain calls agree across resizes.\n");
 
-    // Wait for all threads to complete their execution
-    WaitForMultipleObjects(NUM_THREADS, threads, TRUE, INFINITE);
+    map = map_create_hash64(16, 0.75f, colliding_hash, NULL, free, NULL);
+    assert(map != NULL);
+    for (int i = 0; i < 100; i++) {
+        sprintf_s(key, sizeof(key), "collide-%d", i);
+        assert(map_insert(map, _strdup(key), (void*)(size_t)(i + 1)) == 0);
+    }
+    for (int i = 0; i < 100; i++) {
+        sprintf_s(key, sizeof(key), "collide-%d", i);
+        assert(map_find(map, key) == (void*)(size_t)(i + 1));
+    }
+    map_destroy(map);
+    printf("  - Keys sharing one home group stay distinct.\n");
 
-    printf("  - All threads finished execution.\n");
+    map = map_create(16, 0.75f, reduced_hash, NULL, free, NULL);
+    assert(map != NULL && map_hash(map, "key") == 0);
+    for (int i = 0; i < 1000; i++) {
+        sprintf_s(key, sizeof(key), "reduced-%d", i);
+        assert(map_insert(map, _strdup(key), (void*)(size_t)(i + 1)) == 0);
+    }
+    for (int i = 0; i < 1000; i++) {
+        sprintf_s(key, sizeof(key), "reduced-%d", i);
+        assert(map_find(map, key) == (void*)(size_t)(i + 1));
+    }
+    map_destroy(map);
+    printf("  - Capacity-reduced hash functions still work.\n");
 
-    // The primary success condition is that the program did not crash due to race conditions
-    // or deadlock. A more advanced test could verify the final cache size or item count,
-    // but a crash-free run is a very strong indicator of correct locking.
+    // Objects that are their own keys can be erased by identity.
+    map = map_create(16, 0.75f, NULL, NULL, NULL, NULL);
+    assert(map != NULL);
+    char stored[] = "same-key", twin[] = "same-key";
+    unsigned long long hash = map_hash(map, stored);
+    assert(map_insert_prehashed(map, stored, stored, hash) == 0);
+    map_erase_entry(map, twin, hash); // Equal bytes, different object.
+    assert(map_find(map, twin) == stored);
+    map_erase_entry(map, stored, hash);
+    assert(map_find(map, twin) == NULL && map_size(map) == 0);
+    map_destroy(map);
+    printf("  - Identity erase removes only the object itself.\n");
 
-    // Clean up thread handles
-    for (int i = 0; i < NUM_THREADS; i++) {
-        CloseHandle(threads[i]);
+    printf("Test Passed!\n\n");
+}
+
+/**
+ * @brief Tests that an acquired handle survives eviction and replacement of its URL.
+ * @note Expects TEST_CACHE_BYTES = 100.
+ */
+void test_acquire_release() {
+    printf("Running test: test_acquire_release...\n");
+
+    cache_add("http://pinned.com", "pinned payload", 14);
+    cache_element* pinned = cache_acquire("http://pinned.com");
+    assert(pinned != NULL);
+    printf("  - Acquired a handle.\n");
+
+    // Replacing the URL publishes a new element; the handle keeps the old bytes.
+    cache_add("http://pinned.com", "replacement payload", 19);
+    assert(pinned->len == 14 && memcmp(pinned->data, "pinned payload", 14) == 0);
+
+    cache_element* current = cache_acquire("http://pinned.com");
+    assert(current != NULL && current != pinned);
+    assert(current->len == 19 && memcmp(current->data, "replacement payload", 19) == 0);
+    cache_release(current);
+    printf("  - Update left the pinned version untouched.\n");
+
+    // Push everything else out of the cache; the pinned version is still readable.
+    char filler[90];
+    memset(filler, 'f', sizeof(filler));
+    cache_add("http://filler.com", filler, sizeof(filler));
+    assert(cache_find("http://pinned.com") == NULL);
+    assert(memcmp(pinned->data, "pinned payload", 14) == 0);
+    printf("  - Handle stayed valid after its URL was evicted.\n");
+
+    cache_release(pinned);
+    cache_release(NULL); // Releasing NULL is a no-op.
+
+    printf("Test Passed!\n\n");
+}
+
+static int adopted_frees = 0;
+
+static void count_adopted_free(void* buffer) {
+    adopted_frees++;
+    free(buffer);
+}
+
+static char* make_heap_buffer(const char* text) {
+    size_t len = strlen(text);
+    char* buffer = malloc(len);
+    assert(buffer != NULL);
+    memcpy(buffer, text, len);
+    return buffer;
+}
+
+/**
+ * @brief Tests that cache_add_adopt() serves the caller's buffer and releases it exactly once.
+ * @note Expects TEST_CACHE_BYTES = 100.
+ */
+void test_add_adopt() {
+    printf("Running test: test_add_adopt...\n");
+    adopted_frees = 0;
+
+    char* first = make_heap_buffer("adopted body");
+    assert(cache_add_adopt("http://adopt.com", first, 12, count_adopted_free) == 0);
+
+    cache_element* found = cache_find("http://adopt.com");
+    assert(found != NULL && found->data == first); // No copy was made.
+    printf("  - Cached element points at the adopted buffer.\n");
+
+    // Updating swaps the buffer and releases the old one.
+    char* second = make_heap_buffer("second adopted body");
+    assert(cache_add_adopt("http://adopt.com", second, 19, count_adopted_free) == 0);
+    assert(adopted_frees == 1);
+    found = cache_find("http://adopt.com");
+    assert(found != NULL && found->data == second && found->len == 19);
+    printf("  - Update swapped the buffer pointer.\n");
+
+    // A rejected object still transfers ownership.
+    char* too_big = malloc(TEST_CACHE_BYTES + 1);
+    assert(too_big != NULL);
+    assert(cache_add_adopt("http://too-big.com", too_big, TEST_CACHE_BYTES + 1, count_adopted_free) == -1);
+    assert(adopted_frees == 2);
+    printf("  - Rejected buffer was released.\n");
+
+    // Eviction releases the adopted buffer through the callback.
+    char filler[90];
+    memset(filler, 'f', sizeof(filler));
+    cache_add("http://filler.com", filler, sizeof(filler));
+    assert(cache_find("http://adopt.com") == NULL);
+    assert(adopted_frees == 3);
+    printf("  - Eviction released the buffer with its callback.\n");
+
+    printf("Test Passed!\n\n");
+}
+
+/**
+ * @brief Tests length-delimited keys, including keys with embedded NUL bytes.
+ * @note Expects TEST_CACHE_BYTES = 100.
+ */
+void test_binary_keys() {
+    printf("Running test: test_binary_keys...\n");
+
+    // The URL is a slice of a larger request buffer, with no terminator of its own.
+    const char* request = "GET http://slice.com/page HTTP/1.1";
+    cache_add_key(request + 4, 21, "page", 4);
+    cache_element* found = cache_find("http://slice.com/page");
+    assert(found != NULL && found->url_len == 21 && strcmp(found->url, "http://slice.com/page") == 0);
+    assert(cache_find_key(request + 4, 21) == found);
+    assert(cache_find_key(request + 4, 20) == NULL); // A prefix is a different key.
+    printf("  - A (ptr, len) slice matches the same NUL-terminated URL.\n");
+
+    // Keys that differ only after an embedded NUL are distinct.
+    cache_add_key("key\0a", 5, "first", 5);
+    cache_add_key("key\0b", 5, "second", 6);
+    cache_add("key", "third", 5);
+    found = cache_find_key("key\0a", 5);
+    assert(found != NULL && found->len == 5 && memcmp(found->data, "first", 5) == 0);
+    found = cache_find_key("key\0b", 5);
+    assert(found != NULL && found->len == 6 && memcmp(found->data, "second", 6) == 0);
+    found = cache_find("key");
+    assert(found != NULL && found->len == 5 && memcmp(found->data, "third", 5) == 0);
+    printf("  - Keys with embedded NULs are compared by length and bytes.\n");
+
+    cache_element* pinned = cache_acquire_key("key\0b", 5);
+    assert(pinned != NULL && pinned->url_len == 5 && memcmp(pinned->url, "key\0b", 5) == 0);
+    cache_release(pinned);
+
+    char* buffer = make_heap_buffer("adopted");
+    assert(cache_add_adopt_key("adopt\0key", 9, buffer, 7, NULL) == 0);
+    found = cache_find_key("adopt\0key", 9);
+    assert(found != NULL && found->data == buffer);
+    printf("  - Acquire and adopt accept binary keys.\n");
+
+    printf("Test Passed!\n\n");
+}
+
+/**
+ * @brief Tests the batched lookups and adds across shards.
+ * @note Expects TEST_CACHE_BYTES = 100 shared by 4 shards.
+ */
+void test_batch_api() {
+    printf("Running test: test_batch_api...\n");
+
+    char urls[70][32];
+    cache_key_t keys[70];
+    for (int i = 0; i < 70; i++) {
+        snprintf(urls[i], sizeof(urls[i]), "http://batch-%d.com", i);
+        keys[i].data = urls[i];
+        keys[i].len = strlen(urls[i]);
+    }
+
+    // Five keys, a repeat of the first and one item that cannot be cached.
+    cache_item_t items[7];
+    memset(items, 0, sizeof(items));
+    for (int i = 0; i < 5; i++) {
+        items[i].key = urls[i];
+        items[i].key_len = keys[i].len;
+        items[i].data = "data";
+        items[i].length = 4;
     }
+    items[5] = items[0];
+    items[5].data = "last";
+    items[6].key = urls[6];
+    items[6].key_len = keys[6].len;
+
+    cache_stats_t before, after;
+    cache_get_stats(&before);
+    assert(cache_add_many(items, 7) == 6);
+    cache_get_stats(&after);
+    assert(after.rejections == before.rejections + 1);
+    assert(after.element_count == 5);
+    printf("  - Items are stored in order; invalid ones are rejected on their own.\n");
+
+    // More keys than one chunk, with a skipped NULL entry.
+    cache_element* results[70];
+    keys[69].data = NULL;
+    assert(cache_find_many(keys, 70, results) == 5);
+    for (int i = 0; i < 70; i++) {
+        if (i < 5)
+            assert(results[i] != NULL && results[i]->url_len == keys[i].len && memcmp(results[i]->url, urls[i], keys[i].len) == 0);
+        else
+            assert(results[i] == NULL);
+    }
+    assert(memcmp(results[0]->data, "last", 4) == 0);
+    cache_get_stats(&before);
+    assert(before.hits == after.hits + 5 && before.misses == after.misses + 64);
+    printf("  - Lookups land at their key's index, across shards and chunks.\n");
+
+    assert(cache_acquire_many(keys, 5, results) == 5);
+    for (int i = 0; i < 5; i++) {
+        assert(results[i]->refcount == 2);
+        cache_release(results[i]);
+    }
+    printf("  - Batch acquires pin every element found.\n");
 
     printf("Test Passed!\n\n");
 }
 
+/**
+ * @brief Tests that read-mostly hits give an element a second chance at eviction time.
+ * @note Expects TEST_CACHE_BYTES = 100 and a cache in CACHE_LOOKUP_READ_MOSTLY mode.
+ */
+void test_read_mostly_second_chance() {
+    printf("Running test: test_read_mostly_second_chance...\n");
+
+    cache_add("http://item1.com", "I am the first data block.", 26);
+    cache_add("http://item2.com", "I am the second data block.", 27);
+    cache_add("http://item3.com", "I am the third data block.", 26);
+
+    // item1 is the LRU element, but this hit sets its reference bit.
+    assert(cache_find("http://item1.com") != NULL);
+    printf("  - Hit recorded on the oldest item.\n");
+
+    // 79 + 36 > 100: one eviction is needed. item1 is promoted instead, so item2 goes.
+    cache_add("http://item4.com", "This final block will trigger eviction.", 36);
+
+    assert(cache_find("http://item4.com") != NULL);
+    assert(cache_find("http://item3.com") != NULL);
+    assert(cache_find("http://item1.com") != NULL);
+    assert(cache_find("http://item2.com") == NULL);
+    printf("  - Referenced item survived; the next oldest was evicted.\n");
+
+    printf("Test Passed!\n\n");
+}
 
 /**
- * @brief Main entry point for the test executable.
+ * @brief Counts how many of the keys "http://shard-item<i>.com" (0 <= i < count) are cached.
  */
-int main(void) {
-    printf("--- Cache Test Suite Initializing ---\n");
-    printf("NOTE: Eviction and Update tests require MAX_CACHE_SIZE in proxy_cache.h to be set to 100.\n\n");
+static int count_cached_shard_items(int count) {
+    int found = 0;
+    char url[64];
+    for (int i = 0; i < count; i++) {
+        sprintf_s(url, sizeof(url), "http://shard-item%d.com", i);
+        if (cache_find(url) != NULL)
+            found++;
+    }
+    return found;
+}
 
-    // Initialize the cache system
-    cache_init();
+/**
+ * @brief Tests that a sharded cache keeps items reachable and respects its budget.
+ * @note Expects TEST_CACHE_BYTES = 100 and a cache set up with 4 shards.
+ */
+void test_sharded_budget(cache_budget_mode_t mode) {
+    printf("Running test: test_sharded_budget (%s)...\n",
+        mode == CACHE_BUDGET_SPLIT ? "split" : "shared");
 
-    // Run all our tests in a clean environment for each test group
-    test_add_and_find();
+    char url[64];
+    const char* data = "0123456789"; // 10 bytes per item
 
-    // Re-initialize the cache to ensure eviction tests start with an empty state
-    cache_destroy();
-    cache_init();
-    test_lru_eviction();
+    // Ten 10-byte items fit exactly in the 100-byte budget when it is shared,
+    // and every item added must be immediately findable in either mode.
+    for (int i = 0; i < 40; i++) {
+        sprintf_s(url, sizeof(url), "http://shard-item%d.com", i);
+        cache_add(url, data, 10);
+        assert(cache_find(url) != NULL);
+    }
+    printf("  - Every item was findable right after it was added.\n");
 
-    // Re-initialize again for the update test
-    cache_destroy();
-    cache_init();
-    test_update_item();
+    int found = count_cached_shard_items(40);
+    if (mode == CACHE_BUDGET_SPLIT)
+        assert(found <= 4 * 2); // 25 bytes per shard holds two 10-byte items.
+    else
+        assert(found == 10);
+    printf("  - %d items cached; the byte budget was respected.\n", found);
 
-    // Re-initialize for the final thread-safety test
-    cache_destroy();
-    cache_init();
-    test_thread_safety();
+    // An object larger than one shard's share is only cacheable with a shared budget.
+    char big[60];
+    memset(big, 'x', sizeof(big));
+    cache_add("http://big-item.com", big, sizeof(big));
+    assert((cache_find("http://big-item.com") != NULL) == (mode == CACHE_BUDGET_SHARED));
+    printf("  - Large object handling matches the budget mode.\n");
 
-    // Clean up all cache resources
-    cache_destroy();
+    printf("Test Passed!\n\n");
+}
 
-    printf("--- All tests finished successfully. ---\nPress Enter to exit.\n");
-    getchar(); // Pauses the console window so you can see the output
-    return 0;
-}
\ No newline at end of file
+/**
+ * @brief Tests size-class rounding, chunk reuse and accounting in the slab allocator.
+ */
+void test_slab_allocator() {
+    printf("Running test: test_slab_allocator...\n");
+
+    slab_t* slab = slab_create(4096, 1.25f);
+    assert(slab != NULL);
+
+    // Requests round up to a class; a freed chunk is reused for the same class.
+    assert(slab_chunk_size(slab, 1) == SLAB_MIN_CHUNK_SIZE);
+    assert(slab_chunk_size(slab, 100) >= 100);
+    void* a = slab_alloc(slab, 100);
+    slab_free(slab, a, 100);
+    void* b = slab_alloc(slab, 90);
+    assert(a == b);
+    printf("  - Chunks are rounded to size classes and reused.\n");
+
+    // Anything larger than a page is allocated individually.
+    void* large = slab_alloc(slab, 10000);
+    assert(large != NULL);
+
+    slab_stats_t stats;
+    slab_get_stats(slab, &stats);
+    assert(stats.page_count == 1 && stats.large_count == 1);
+    assert(stats.requested_bytes == 90 + 10000);
+    assert(stats.used_bytes == slab_chunk_size(slab, 90) + 10000);
+    assert(stats.reserved_bytes == 4096 + 10000);
+    printf("  - Accounting matches the pages and objects handed out.\n");
+
+    slab_free(slab, b, 90);
+    slab_free(slab, large, 10000);
+    slab_get_stats(slab, &stats);
+    assert(stats.used_bytes == 0 && stats.requested_bytes == 0 && stats.large_count == 0);
+
+    slab_destroy(slab);
+    printf("Test Passed!\n\n");
+}
+
+#define TIMER_TEST_COUNT 2000
+
+static unsigned long long timer_window_start; // Ticks before this were covered by earlier advances.
+static unsigned long long timer_window_end;   // Tick the current advance moves to.
+static int timer_fired[TIMER_TEST_COUNT];
+
+static void record_timer(void* context, cache_element* element) {
+    cache_element* base = (cache_element*)context;
+    // Every timer fires in the first advance that covers its due tick.
+    assert(element->expires_at <= timer_window_end && element->expires_at >= timer_window_start);
+    timer_fired[element - base]++;
+}
+
+/**
+ * @brief Tests that the timer wheel fires every timer exactly once, on time, across all levels.
+ */
+void test_timer_wheel() {
+    printf("Running test: test_timer_wheel...\n");
+
+    static cache_element elements[TIMER_TEST_COUNT];
+    static cache_timer_wheel_t wheel;
+    unsigned long long start = 1000;
+    cache_timer_init(&wheel, start);
+
+    // Spread due times from "already due" to far beyond the wheel's span.
+    unsigned long long spans[] = { 0, 64, 4096, 262144, 1ull << 24, 1ull << 36, 1ull << 40 };
+    unsigned int seed = 12345;
+    for (int i = 0; i < TIMER_TEST_COUNT; i++) {
+        memset(&elements[i], 0, sizeof(elements[i]));
+        seed = seed * 1103515245u + 12345u;
+        unsigned long long span = spans[(seed >> 16) % 7];
+        seed = seed * 1103515245u + 12345u;
+        unsigned long long offset = span ? ((unsigned long long)seed * 2654435761u) % span : 0;
+        elements[i].expires_at = start + offset;
+        timer_fired[i] = 0;
+        cache_timer_schedule(&wheel, &elements[i]);
+    }
+
+    // Cancel every tenth timer.
+    for (int i = 5; i < TIMER_TEST_COUNT; i += 10)
+        cache_timer_cancel(&wheel, &elements[i]);
+
+    // Advance in uneven steps until far past the last timer, with a small expiry budget.
+    timer_window_start = start;
+    size_t total = 0;
+    for (unsigned long long now = start; now < start + (1ull << 41); ) {
+        // Steps range from a single tick to 2^37 ticks.
+        seed = seed * 1103515245u + 12345u;
+        int magnitude = (int)((seed >> 16) % 38);
+        seed = seed * 1103515245u + 12345u;
+        now += 1 + (seed * 0x9E3779B97F4A7C15ull) % (1ull << magnitude);
+        timer_window_end = now;
+        size_t fired;
+        while ((fired = cache_timer_advance(&wheel, now, 50, record_timer, elements)) == 50)
+            total += fired;
+        total += fired;
+        timer_window_start = now + 1;
+    }
+
+    for (int i = 0; i < TIMER_TEST_COUNT; i++)
+        assert(timer_fired[i] == (i % 10 == 5 ? 0 : 1));
+    assert(total == TIMER_TEST_COUNT - TIMER_TEST_COUNT / 10 && wheel.count == 0);
+    printf("  - %zu timers fired exactly once, none early or late; cancelled ones never fired.\n", total);
+
+    printf("Test Passed!\n\n");
+}
+
+/**
+ * @brief Tests that the latency histogram reports percentiles within its bucket precision.
+ */
+void test_histogram_percentiles() {
+    printf("Running test: test_histogram_percentiles...\n");
+
+    static cache_histogram_t histogram;
+    cache_histogram_reset(&histogram);
+    assert(cache_histogram_percentile(&histogram, 50.0) == 0);
+
+    for (unsigned long long v = 1; v <= 10000; v++)
+        cache_histogram_record(&histogram, v);
+    assert(histogram.total == 10000 && histogram.max == 10000);
+
+    // Buckets are ~3% wide, and reported values are bucket upper bounds.
+    unsigned long long p50 = cache_histogram_percentile(&histogram, 50.0);
+    unsigned long long p99 = cache_histogram_percentile(&histogram, 99.0);
+    assert(p50 >= 5000 && p50 <= 5000 + 5000 / 16);
+    assert(p99 >= 9900 && p99 <= 10000);
+    assert(cache_histogram_percentile(&histogram, 100.0) == 10000);
+    printf("  - p50=%llu p99=%llu for a uniform 1..10000 series.\n", p50, p99);
+
+    static cache_histogram_t other;
+    cache_histogram_reset(&other);
+    cache_histogram_record(&other, 1ull << 40);
+    cache_histogram_merge(&histogram, &other);
+    assert(histogram.total == 10001 && histogram.max == 1ull << 40);
+    assert(cache_histogram_percentile(&histogram, 100.0) == 1ull << 40);
+    printf("  - Merging keeps counts and the maximum.\n");
+
+    printf("Test Passed!\n\n");
+}
+
+/**
+ * @brief Tests that a slab-backed cache behaves like the default one and reports exact usage.
+ * @note Expects TEST_CACHE_BYTES = 100 and a cache configured with use_slab.
+ */
+void test_slab_cache() {
+    printf("Running test: test_slab_cache...\n");
+
+    cache_add("http://slab1.com", "first slab payload", 18);
+    cache_add("http://slab2.com", "second slab payload", 19);
+
+    cache_element* found = cache_find("http://slab1.com");
+    assert(found != NULL && found->len == 18 && memcmp(found->data, "first slab payload", 18) == 0);
+    printf("  - Items stored in slab memory are readable.\n");
+
+    cache_memory_stats_t stats;
+    cache_get_memory_stats(&stats);
+    assert(stats.element_count == 2 && stats.payload_bytes == 37);
+    // Each element is one header+URL chunk and one payload chunk.
+    size_t headers = 2 * sizeof(cache_element) + sizeof("http://slab1.com") + sizeof("http://slab2.com");
+    assert(stats.slab_requested_bytes == headers + 37);
+    assert(stats.slab_used_bytes >= stats.slab_requested_bytes);
+    assert(stats.slab_reserved_bytes >= stats.slab_used_bytes);
+    printf("  - Slab accounting covers headers, URLs and payloads exactly.\n");
+
+    // Evicting both frees their chunks.
+    char filler[90];
+    memset(filler, 'f', sizeof(filler));
+    cache_add("http://filler.com", filler, sizeof(filler));
+    cache_get_memory_stats(&stats);
+    assert(stats.element_count == 1);
+    assert(stats.slab_requested_bytes == sizeof(cache_element) + sizeof("http://filler.com") + 90);
+    printf("  - Evicted elements returned their chunks.\n");
+
+    printf("Test Passed!\n\n");
+}
+
+/**
+ * @brief Tests that two instances keep separate contents and budgets.
+ */
+void test_multiple_instances() {
+    printf("Running test: test_multiple_instances...\n");
+
+    cache_config_t config = { 0 };
+    config.max_bytes = 50;
+    proxy_cache_t* small = proxy_cache_create(&config);
+    config.max_bytes = 1000;
+    config.shard_count = 4;
+    proxy_cache_t* large = proxy_cache_create(&config);
+    assert(small != NULL && large != NULL);
+
+    proxy_cache_add(small, "http://shared-url.com", "small copy", 10);
+    proxy_cache_add(large, "http://shared-url.com", "large copy", 10);
+    cache_element* found = proxy_cache_find(small, "http://shared-url.com");
+    assert(found != NULL && memcmp(found->data, "small copy", 10) == 0);
+    found = proxy_cache_find(large, "http://shared-url.com");
+    assert(found != NULL && memcmp(found->data, "large copy", 10) == 0);
+    assert(cache_find("http://shared-url.com") == NULL); // The default instance is separate too.
+    printf("  - The same URL holds different data in each instance.\n");
+
+    char block[45];
+    memset(block, 'b', sizeof(block));
+    proxy_cache_add(small, "http://block.com", block, sizeof(block));
+    proxy_cache_add(large, "http://block.com", block, sizeof(block));
+    assert(proxy_cache_find(small, "http://shared-url.com") == NULL); // 10 + 45 > 50
+    assert(proxy_cache_find(large, "http://shared-url.com") != NULL);
+    printf("  - Each instance evicts against its own budget.\n");
+
+    proxy_cache_destroy(small);
+    proxy_cache_destroy(large);
+    printf("Test Passed!\n\n");
+}
+
+/**
+ * @brief Tests that shrinking the budget at runtime is enforced a bounded batch at a time.
+ */
+void test_budget_shrink() {
+    printf("Running test: test_budget_shrink...\n");
+
+    cache_config_t config = { 0 };
+    config.max_bytes = 1000;
+    proxy_cache_t* cache = proxy_cache_create(&config);
+    assert(cache != NULL && proxy_cache_get_budget(cache) == 1000);
+
+    char url[64];
+    for (int i = 0; i < 100; i++) {
+        sprintf_s(url, sizeof(url), "http://shrink%d.com", i);
+        proxy_cache_add(cache, url, "0123456789", 10);
+    }
+
+    proxy_cache_set_budget(cache, 100);
+    assert(proxy_cache_get_budget(cache) == 100);
+
+    // One write must not pay for the whole shrink: it evicts a bounded batch.
+    proxy_cache_add(cache, "http://shrink-new.com", "0123456789", 10);
+    cache_memory_stats_t stats;
+    proxy_cache_get_memory_stats(cache, &stats);
+    assert(stats.payload_bytes > 100 && stats.payload_bytes < 1000);
+    assert(proxy_cache_find(cache, "http://shrink-new.com") != NULL);
+    printf("  - A write after the shrink evicted only a batch (%zu bytes left).\n", stats.payload_bytes);
+
+    int rounds = 0;
+    while (proxy_cache_maintain(cache) > 0)
+        rounds++;
+    proxy_cache_get_memory_stats(cache, &stats);
+    assert(rounds > 1 && stats.payload_bytes <= 100);
+    assert(proxy_cache_find(cache, "http://shrink-new.com") != NULL); // MRU survives
+    printf("  - Maintenance drained the excess in %d rounds.\n", rounds + 1);
+
+    // Growing takes effect at once.
+    proxy_cache_set_budget(cache, 200);
+    for (int i = 0; i < 20; i++) {
+        sprintf_s(url, sizeof(url), "http://grow%d.com", i);
+        proxy_cache_add(cache, url, "0123456789", 10);
+    }
+    proxy_cache_get_memory_stats(cache, &stats);
+    assert(stats.payload_bytes == 200);
+    printf("  - A larger budget is usable immediately.\n");
+
+    proxy_cache_destroy(cache);
+    printf("Test Passed!\n\n");
+}
+
+/**
+ * @brief Runs a hot set through a one-hit scan and returns how many hot items survived.
+ * @details 20 hot 10-byte items are each read a few times, then 500 one-hit items are
+ * written through a 1000-byte instance using 'policy'.
+ */
+static int run_scan_workload(cache_policy_kind_t policy) {
+    cache_config_t config = { 0 };
+    config.max_bytes = 1000;
+    config.policy = policy;
+    proxy_cache_t* cache = proxy_cache_create(&config);
+    assert(cache != NULL);
+
+    char url[64];
+    for (int i = 0; i < 20; i++) {
+        sprintf_s(url, sizeof(url), "http://hot%d.com", i);
+        proxy_cache_add(cache, url, "hot-object", 10);
+    }
+    for (int round = 0; round < 3; round++) {
+        for (int i = 0; i < 20; i++) {
+            sprintf_s(url, sizeof(url), "http://hot%d.com", i);
+            assert(proxy_cache_find(cache, url) != NULL);
+        }
+    }
+
+    for (int i = 0; i < 500; i++) {
+        sprintf_s(url, sizeof(url), "http://scan%d.com", i);
+        proxy_cache_add(cache, url, "scan-items", 10);
+    }
+
+    int survivors = 0;
+    for (int i = 0; i < 20; i++) {
+        sprintf_s(url, sizeof(url), "http://hot%d.com", i);
+        if (proxy_cache_find(cache, url) != NULL)
+            survivors++;
+    }
+
+    cache_memory_stats_t stats;
+    proxy_cache_get_memory_stats(cache, &stats);
+    assert(stats.payload_bytes <= 1000);
+
+    proxy_cache_destroy(cache);
+    return survivors;
+}
+
+/**
+ * @brief Tests that SLRU and W-TinyLFU keep a hot set through a scan that flushes plain LRU.
+ */
+void test_scan_resistance() {
+    printf("Running test: test_scan_resistance...\n");
+
+    assert(run_scan_workload(CACHE_POLICY_LRU) == 0);
+    printf("  - LRU lost the whole hot set to the scan.\n");
+
+    assert(run_scan_workload(CACHE_POLICY_SLRU) == 20);
+    printf("  - SLRU kept the hot set in its protected segment.\n");
+
+    assert(run_scan_workload(CACHE_POLICY_TINYLFU) == 20);
+    printf("  - W-TinyLFU refused to admit the one-hit items.\n");
+
+    // A list-policy hit relinks the element by its links, size, segment and hash alone.
+    assert(offsetof(cache_element, url_len) + sizeof(size_t) <= 64);
+    assert(offsetof(cache_element, key_hash) + sizeof(unsigned long long) <= 64);
+    assert(offsetof(cache_element, expires_at) + sizeof(unsigned long long) <= 64);
+    assert(offsetof(cache_element, prev) + sizeof(cache_element*) <= 64);
+    assert(offsetof(cache_element, len) + sizeof(size_t) <= 64);
+    assert(offsetof(cache_element, referenced) + sizeof(int) <= 64);
+    assert(offsetof(cache_element, segment) < 64);
+    printf("  - The fields a hit touches share the element's first 64 bytes.\n");
+
+    printf("Test Passed!\n\n");
+}
+
+/**
+ * @brief Runs 40 small hot items and two large objects through a 1000-byte instance.
+ * @return How many of the small items survived the second large insert.
+ */
+static int run_mixed_size_workload(cache_policy_kind_t policy) {
+    cache_config_t config = { 0 };
+    config.max_bytes = 1000;
+    config.policy = policy;
+    proxy_cache_t* cache = proxy_cache_create(&config);
+    assert(cache != NULL);
+
+    char url[64];
+    for (int i = 0; i < 40; i++) {
+        sprintf_s(url, sizeof(url), "http://small%d.com", i);
+        proxy_cache_add(cache, url, "small-json", 10);
+        assert(proxy_cache_find(cache, url) != NULL);
+    }
+
+    static char image[500];
+    memset(image, 'i', sizeof(image));
+    proxy_cache_add(cache, "http://image1.com", image, sizeof(image)); // 900 bytes in use
+    proxy_cache_add(cache, "http://image2.com", image, sizeof(image)); // Needs 400 more
+    assert(proxy_cache_find(cache, "http://image2.com") != NULL);
+
+    int survivors = 0;
+    for (int i = 0; i < 40; i++) {
+        sprintf_s(url, sizeof(url), "http://small%d.com", i);
+        if (proxy_cache_find(cache, url) != NULL)
+            survivors++;
+    }
+    if (policy == CACHE_POLICY_GDSF)
+        assert(proxy_cache_find(cache, "http://image1.com") == NULL);
+
+    proxy_cache_destroy(cache);
+    return survivors;
+}
+
+/**
+ * @brief Tests that GDSF evicts one large object instead of many small popular ones.
+ */
+void test_size_aware_eviction() {
+    printf("Running test: test_size_aware_eviction...\n");
+
+    assert(run_mixed_size_workload(CACHE_POLICY_LRU) == 0);
+    printf("  - LRU evicted all 40 small items to make room.\n");
+
+    assert(run_mixed_size_workload(CACHE_POLICY_GDSF) == 40);
+    printf("  - GDSF evicted the older large object and kept every small item.\n");
+
+    // A victim spared by a second chance leaves L alone; only a real eviction ages the policy.
+    cache_policy_t policy;
+    assert(cache_policy_init(&policy, CACHE_POLICY_GDSF, 4) == 0);
+    cache_element large, small;
+    memset(&large, 0, sizeof(large));
+    memset(&small, 0, sizeof(small));
+    large.len = 100;
+    small.len = 10;
+    assert(cache_policy_insert(&policy, &large) == 0 && cache_policy_insert(&policy, &small) == 0);
+    assert(cache_policy_victim(&policy) == &large);
+    cache_policy_hit(&policy, &large);
+    assert(policy.inflation == 0.0);
+    assert(cache_policy_victim(&policy) == &large);
+    cache_policy_evict(&policy, &large);
+    cache_policy_remove(&policy, &large);
+    assert(policy.inflation == large.priority && cache_policy_victim(&policy) == &small);
+    cache_policy_destroy(&policy);
+    printf("  - GDSF inflation only rises when a victim is actually evicted.\n");
+
+    printf("Test Passed!\n\n");
+}
+
+/**
+ * @brief Tests that TTL'd elements stop being served on time and are reclaimed later.
+ */
+void test_ttl_expiry() {
+    printf("Running test: test_ttl_expiry...\n");
+
+    cache_config_t config = { 0 };
+    config.max_bytes = 1000;
+    config.default_ttl_ms = 30;
+    proxy_cache_t* cache = proxy_cache_create(&config);
+    assert(cache != NULL);
+
+    proxy_cache_add(cache, "http://default-ttl.com", "0123456789", 10);
+    proxy_cache_add_ttl(cache, "http://short.com", 16, "0123456789", 10, 30);
+    proxy_cache_add_ttl(cache, "http://forever.com", 18, "0123456789", 10, 0);
+    proxy_cache_add_ttl(cache, "http://long.com", 15, "0123456789", 10, 60000);
+    assert(proxy_cache_find(cache, "http://short.com") != NULL);
+    assert(proxy_cache_find(cache, "http://default-ttl.com") != NULL);
+
+    Sleep(60);
+
+    // Lookups stop serving expired elements before they are reclaimed.
+    assert(proxy_cache_find(cache, "http://short.com") == NULL);
+    assert(proxy_cache_find(cache, "http://default-ttl.com") == NULL);
+    assert(proxy_cache_find(cache, "http://forever.com") != NULL);
+    assert(proxy_cache_find(cache, "http://long.com") != NULL);
+    cache_memory_stats_t memory;
+    proxy_cache_get_memory_stats(cache, &memory);
+    assert(memory.payload_bytes == 40);
+    printf("  - Expired elements are misses but still hold their bytes.\n");
+
+    proxy_cache_maintain(cache);
+    proxy_cache_get_memory_stats(cache, &memory);
+    assert(memory.payload_bytes == 20);
+    cache_stats_t stats;
+    proxy_cache_get_stats(cache, &stats);
+    assert(stats.expirations == 2 && stats.evictions == 0 && stats.element_count == 2);
+    printf("  - The timer wheel reclaimed them.\n");
+
+    // Rewriting an element replaces its TTL.
+    proxy_cache_add_ttl(cache, "http://long.com", 15, "fresh", 5, 20);
+    Sleep(40);
+    proxy_cache_add(cache, "http://trigger.com", "x", 1); // Writes reclaim expired elements too.
+    assert(proxy_cache_find(cache, "http://long.com") == NULL);
+    proxy_cache_get_stats(cache, &stats);
+    assert(stats.expirations == 3);
+    printf("  - Updates reset the TTL and writes reclaim expired elements.\n");
+
+    proxy_cache_destroy(cache);
+    printf("Test Passed!\n\n");
+}
+
+/**
+ * @brief Tests that a snapshot restores contents, eviction order and TTLs without copying payloads.
+ */
+void test_snapshot_restore() {
+    printf("Running test: test_snapshot_restore...\n");
+    const char* path = "test_snapshot.bin";
+
+    cache_config_t config = { 0 };
+    config.max_bytes = 100;
+    proxy_cache_t* source = proxy_cache_create(&config);
+    assert(source != NULL);
+    proxy_cache_add(source, "http://a.com", "aaaaaaaaaaaaaaaaaaaa", 20);
+    proxy_cache_add(source, "http://b.com", "bbbbbbbbbbbbbbbbbbbb", 20);
+    proxy_cache_add(source, "http://c.com", "cccccccccccccccccccc", 20);
+    proxy_cache_add_ttl(source, "http://ttl.com", 14, "0123456789", 10, 60000);
+    assert(proxy_cache_find(source, "http://a.com") != NULL); // LRU order is now b, c, ttl, a.
+    assert(proxy_cache_snapshot(source, path) == 0);
+    assert(proxy_cache_snapshot(source, path) == 0); // Replacing an existing snapshot.
+
+    proxy_cache_t* restored = proxy_cache_create(&config);
+    assert(restored != NULL);
+    assert(proxy_cache_load(restored, path) == 0);
+    cache_element* found = proxy_cache_find(restored, "http://c.com");
+    assert(found != NULL && found->len == 20 && memcmp(found->data, "cccccccccccccccccccc", 20) == 0);
+    assert(found->data_free != NULL); // Adopted from the mapping, not copied.
+    found = proxy_cache_find(restored, "http://ttl.com");
+    assert(found != NULL && found->expires_at != 0);
+    printf("  - Payloads are served straight from the mapped snapshot, TTLs kept.\n");
+
+    // Restored in file order: b is still the LRU element.
+    proxy_cache_add(restored, "http://new.com", "0123456789012345678901234567890123456789", 40);
+    assert(proxy_cache_find(restored, "http://b.com") == NULL);
+    assert(proxy_cache_find(restored, "http://a.com") != NULL);
+    printf("  - The eviction order survives the restart.\n");
+
+    proxy_cache_add(restored, "http://a.com", "fresh", 5);
+    found = proxy_cache_find(restored, "http://a.com");
+    assert(found != NULL && found->data_free == NULL && memcmp(found->data, "fresh", 5) == 0);
+    printf("  - Overwritten entries move off the mapping.\n");
+    proxy_cache_destroy(restored);
+
+    FILE* file = fopen(path, "wb");
+    assert(file != NULL);
+    fputs("not a snapshot, just some text!!", file);
+    fclose(file);
+    proxy_cache_t* empty = proxy_cache_create(&config);
+    assert(proxy_cache_load(empty, path) == -1);
+    remove(path);
+    assert(proxy_cache_load(empty, path) == -1);
+    cache_stats_t stats;
+    proxy_cache_get_stats(empty, &stats);
+    assert(stats.element_count == 0);
+    printf("  - Missing or malformed files are rejected.\n");
+
+    proxy_cache_destroy(empty);
+    proxy_cache_destroy(source);
+    printf("Test Passed!\n\n");
+}
+
+/**
+ * @brief Waits until the disk tier's writer thread has written 'writes' records.
+ */
+static void wait_for_tier_writes(proxy_cache_t* cache, size_t writes) {
+    cache_stats_t stats;
+    for (int i = 0; i < 5000; i++) {
+        proxy_cache_get_stats(cache, &stats);
+        if (stats.tier_writes >= writes)
+            return;
+        Sleep(1);
+    }
+    assert(!"the disk tier did not write its queue");
+}
+
+/**
+ * @brief Tests that evicted elements spill to the disk tier and come back on a miss.
+ */
+void test_disk_tier() {
+    printf("Running test: test_disk_tier...\n");
+
+    cache_config_t config = { 0 };
+    config.max_bytes = 100;
+    config.tier_path = "test_tier.bin";
+    config.tier_bytes = 4096;
+    proxy_cache_t* cache = proxy_cache_create(&config);
+    assert(cache != NULL);
+
+    char url[64];
+    for (int i = 0; i < 10; i++) {
+        sprintf_s(url, sizeof(url), "http://tier%d.com", i);
+        proxy_cache_add(cache, url, "01234567890123456789", 20);
+    }
+    wait_for_tier_writes(cache, 5);
+    cache_stats_t stats;
+    proxy_cache_get_stats(cache, &stats);
+    assert(stats.evictions == 5 && stats.tier_entries == 5);
+
+    cache_element* found = proxy_cache_find(cache, "http://tier0.com");
+    assert(found != NULL && found->len == 20 && memcmp(found->data, "01234567890123456789", 20) == 0);
+    proxy_cache_get_stats(cache, &stats);
+    assert(stats.tier_hits == 1 && stats.misses == 1);
+    assert(proxy_cache_find(cache, "http://tier0.com") == found); // Promoted back to RAM.
+    printf("  - An evicted element is read back from disk and promoted.\n");
+
+    proxy_cache_add(cache, "http://tier1.com", "fresh", 5);
+    found = proxy_cache_find(cache, "http://tier1.com");
+    assert(found != NULL && found->len == 5 && memcmp(found->data, "fresh", 5) == 0);
+    printf("  - A write supersedes the copy on disk.\n");
+    proxy_cache_destroy(cache);
+
+    // Room for three 60-byte records: older ones are overwritten as the log wraps.
+    config.tier_bytes = 200;
+    cache = proxy_cache_create(&config);
+    assert(cache != NULL);
+    for (int i = 0; i < 10; i++) {
+        sprintf_s(url, sizeof(url), "http://wrap%d.com", i);
+        proxy_cache_add(cache, url, "01234567890123456789", 20);
+    }
+    wait_for_tier_writes(cache, 5);
+    proxy_cache_get_stats(cache, &stats);
+    assert(stats.tier_entries == 3);
+    assert(proxy_cache_find(cache, "http://wrap0.com") == NULL);
+    assert(proxy_cache_find(cache, "http://wrap4.com") != NULL);
+    printf("  - The log wraps around, dropping its oldest records.\n");
+    proxy_cache_destroy(cache);
+
+    printf("Test Passed!\n\n");
+}
+
+/**
+ * @brief Tests that removed elements are freed by the reclaimer thread and that
+ * crossing the high watermark evicts down to the low one ahead of writes.
+ */
+void test_background_reclaim() {
+    printf("Running test: test_background_reclaim...\n");
+
+    cache_config_t config = { 0 };
+    config.max_bytes = 100;
+    config.background_reclaim = 1;
+    proxy_cache_t* cache = proxy_cache_create(&config);
+    assert(cache != NULL);
+
+    char url[64];
+    cache_element* pinned = NULL;
+    for (int i = 0; i < 10; i++) {
+        sprintf_s(url, sizeof(url), "http://reclaim%d.com", i);
+        proxy_cache_add(cache, url, "01234567890123456789", 20);
+        if (i == 0)
+            pinned = proxy_cache_acquire(cache, url);
+    }
+    cache_stats_t stats;
+    for (int i = 0; i < 5000; i++) {
+        proxy_cache_get_stats(cache, &stats);
+        if (stats.reclaimed >= 5)
+            break;
+        Sleep(1);
+    }
+    assert(stats.evictions == 5 && stats.reclaimed == 5);
+    assert(pinned != NULL && memcmp(pinned->data, "01234567890123456789", 20) == 0);
+    cache_release(pinned);
+    printf("  - Evicted elements are freed off the writing thread; handles stay valid.\n");
+    proxy_cache_destroy(cache);
+
+    config.high_watermark = 80;
+    config.low_watermark = 50;
+    cache = proxy_cache_create(&config);
+    assert(cache != NULL);
+    for (int i = 0; i < 9; i++) {
+        sprintf_s(url, sizeof(url), "http://mark%d.com", i);
+        proxy_cache_add(cache, url, "0123456789", 10);
+    }
+    for (int i = 0; i < 5000; i++) {
+        proxy_cache_get_stats(cache, &stats);
+        if (stats.payload_bytes <= 50)
+            break;
+        Sleep(1);
+    }
+    assert(stats.payload_bytes == 50 && stats.pre_evictions == 4 && stats.evictions == 4);
+    assert(proxy_cache_find(cache, "http://mark0.com") == NULL);
+    assert(proxy_cache_find(cache, "http://mark8.com") != NULL);
+    printf("  - Crossing the high watermark evicts the oldest elements down to the low one.\n");
+    proxy_cache_destroy(cache);
+
+    // Stop writing as soon as a map resize starts: only maintain() or the reclaimer can finish it.
+    config.max_bytes = 1 << 20;
+    config.initial_capacity = 16;
+    config.high_watermark = 0;
+    config.low_watermark = 0;
+    config.background_reclaim = 0;
+    cache = proxy_cache_create(&config);
+    int added = 0;
+    do {
+        sprintf_s(url, sizeof(url), "http://grow%d.com", added++);
+        proxy_cache_add(cache, url, "x", 1);
+        proxy_cache_get_stats(cache, &stats);
+    } while (stats.map_resizing == 0);
+    for (int i = 0; i < 100 && stats.map_resizing; i++) {
+        proxy_cache_maintain(cache);
+        proxy_cache_get_stats(cache, &stats);
+    }
+    assert(stats.map_resizing == 0 && stats.element_count == (size_t)added);
+    proxy_cache_destroy(cache);
+
+    config.background_reclaim = 1;
+    cache = proxy_cache_create(&config);
+    for (added = 0; added < 1000; added++) {
+        sprintf_s(url, sizeof(url), "http://grow%d.com", added);
+        proxy_cache_add(cache, url, "x", 1);
+    }
+    for (int i = 0; i < 5000; i++) {
+        proxy_cache_get_stats(cache, &stats);
+        if (stats.map_resizing == 0)
+            break;
+        Sleep(1);
+    }
+    assert(stats.map_resizing == 0 && proxy_cache_find(cache, "http://grow0.com") != NULL);
+    printf("  - Map resizes left in flight are finished by maintain() or the reclaimer.\n");
+    proxy_cache_destroy(cache);
+
+    printf("Test Passed!\n\n");
+}
+
+/**
+ * @brief Tests the LZ4 block codec on compressible, incompressible and corrupt input.
+ */
+void test_lz4_codec() {
+    printf("Running test: test_lz4_codec...\n");
+
+    static char text[4096], packed[4096 + 64], unpacked[4096];
+    for (size_t i = 0; i < sizeof(text); i++)
+        text[i] = "<div class=\"item\">hello</div>\n"[i % 31];
+    size_t packed_len = cache_lz4_compress(text, sizeof(text), packed, sizeof(packed));
+    assert(packed_len > 0 && packed_len < sizeof(text) / 10);
+    assert(cache_lz4_decompress(packed, packed_len, unpacked, sizeof(unpacked)) == 0);
+    assert(memcmp(text, unpacked, sizeof(text)) == 0);
+    printf("  - Repetitive text round-trips at a fraction of its size.\n");
+
+    unsigned int state = 12345;
+    for (size_t i = 0; i < sizeof(text); i++) {
+        state = state * 1103515245u + 12345u;
+        text[i] = (char)(state >> 24);
+    }
+    assert(cache_lz4_compress(text, sizeof(text), packed, sizeof(text) - sizeof(text) / 8) == 0);
+    packed_len = cache_lz4_compress(text, sizeof(text), packed, sizeof(packed));
+    assert(packed_len > 0);
+    assert(cache_lz4_decompress(packed, packed_len, unpacked, sizeof(unpacked)) == 0);
+    assert(memcmp(text, unpacked, sizeof(text)) == 0);
+    printf("  - Random bytes do not fit a smaller buffer but still round-trip.\n");
+
+    assert(cache_lz4_decompress(packed, packed_len, unpacked, sizeof(unpacked) - 1) == -1);
+    assert(cache_lz4_decompress(packed, packed_len - 1, unpacked, sizeof(unpacked)) == -1);
+    const char bad_offset[] = { 0x14, 'a', 0x10, 0x00 }; // One literal, then a match 16 bytes back.
+    assert(cache_lz4_decompress(bad_offset, sizeof(bad_offset), unpacked, 9) == -1);
+    printf("  - Truncated blocks, wrong sizes and bad offsets are rejected.\n");
+
+    printf("Test Passed!\n\n");
+}
+
+/**
+ * @brief Tests that compressed instances store LZ4 blocks, account for their stored
+ * size and hand them out either encoded or decoded.
+ */
+void test_compressed_storage() {
+    printf("Running test: test_compressed_storage...\n");
+
+    char page[1000], decoded[1000];
+    for (size_t i = 0; i < sizeof(page); i++)
+        page[i] = "{\"id\": 42, \"name\": \"cache\"}, "[i % 30];
+
+    cache_config_t config = { 0 };
+    config.max_bytes = 1000;
+    config.compression = CACHE_ENCODING_LZ4;
+    proxy_cache_t* cache = proxy_cache_create(&config);
+    assert(cache != NULL);
+
+    char url[64];
+    for (int i = 0; i < 5; i++) {
+        sprintf_s(url, sizeof(url), "http://json%d.com", i);
+        proxy_cache_add(cache, url, page, sizeof(page));
+    }
+    cache_stats_t stats;
+    proxy_cache_get_stats(cache, &stats);
+    assert(stats.element_count == 5 && stats.evictions == 0 && stats.compressed == 5);
+    printf("  - Five 1000-byte objects fit a 1000-byte budget once compressed.\n");
+
+    cache_element* found = proxy_cache_find(cache, "http://json0.com");
+    assert(found != NULL && found->encoding == CACHE_ENCODING_LZ4);
+    assert(found->raw_len == sizeof(page) && found->len < sizeof(page) / 4);
+    assert(cache_lz4_decompress(found->data, found->len, decoded, sizeof(decoded)) == 0);
+    assert(cache_element_decode(found, decoded, sizeof(decoded) - 1) == 0);
+    assert(cache_element_decode(found, decoded, sizeof(decoded)) == sizeof(page));
+    assert(memcmp(decoded, page, sizeof(page)) == 0);
+    printf("  - Lookups return the LZ4 block as stored, or the original on demand.\n");
+
+    proxy_cache_add(cache, "http://small.com", "tiny", 4);
+    found = proxy_cache_find(cache, "http://small.com");
+    assert(found != NULL && found->encoding == CACHE_ENCODING_IDENTITY && found->raw_len == 4);
+    assert(cache_element_decode(found, decoded, sizeof(decoded)) == 4 && memcmp(decoded, "tiny", 4) == 0);
+    printf("  - Small payloads are stored as given.\n");
+
+    assert(proxy_cache_snapshot(cache, "test_snapshot.bin") == 0);
+    config.compression = CACHE_ENCODING_IDENTITY;
+    proxy_cache_t* restored = proxy_cache_create(&config);
+    assert(restored != NULL && proxy_cache_load(restored, "test_snapshot.bin") == 0);
+    remove("test_snapshot.bin");
+    found = proxy_cache_find(restored, "http://json3.com");
+    assert(found != NULL && found->encoding == CACHE_ENCODING_LZ4);
+    assert(cache_element_decode(found, decoded, sizeof(decoded)) == sizeof(page));
+    assert(memcmp(decoded, page, sizeof(page)) == 0);
+    printf("  - Snapshots keep payloads compressed.\n");
+
+    proxy_cache_destroy(restored);
+    proxy_cache_destroy(cache);
+    printf("Test Passed!\n\n");
+}
+
+/**
+ * @brief Tests streamed adds: chunks land in the final buffer, the expected size is
+ * reserved against the budget up front and aborted or oversized streams leave no trace.
+ */
+void test_streaming_add() {
+    printf("Running test: test_streaming_add...\n");
+
+    char chunk[100];
+    memset(chunk, 'v', sizeof(chunk));
+    cache_config_t config = { 0 };
+    config.max_bytes = 1000;
+    proxy_cache_t* cache = proxy_cache_create(&config);
+    assert(cache != NULL);
+
+    cache_writer_t* writer = proxy_cache_begin_add(cache, "http://video.com/seg1", 21, 600, 0);
+    assert(writer != NULL);
+    for (int i = 0; i < 6; i++)
+        assert(cache_append(writer, chunk, sizeof(chunk)) == 0);
+    cache_stats_t stats;
+    proxy_cache_get_stats(cache, &stats);
+    assert(stats.reserved_bytes == 600 && stats.element_count == 0);
+    assert(proxy_cache_find(cache, "http://video.com/seg1") == NULL);
+    assert(cache_commit(writer) == 0);
+    cache_element* found = proxy_cache_find(cache, "http://video.com/seg1");
+    assert(found != NULL && found->len == 600 && found->data[599] == 'v');
+    proxy_cache_get_stats(cache, &stats);
+    assert(stats.reserved_bytes == 0 && stats.payload_bytes == 600);
+    printf("  - Chunks are invisible until commit, then stored as one object.\n");
+
+    char url[64];
+    for (int i = 0; i < 3; i++) {
+        sprintf_s(url, sizeof(url), "http://small%d.com", i);
+        proxy_cache_add(cache, url, chunk, sizeof(chunk));
+    }
+    writer = proxy_cache_begin_add(cache, "http://video.com/seg2", 21, 400, 0);
+    assert(writer != NULL && proxy_cache_find(cache, "http://video.com/seg1") == NULL);
+    for (int i = 0; i < 4; i++) {
+        sprintf_s(url, sizeof(url), "http://other%d.com", i);
+        proxy_cache_add(cache, url, chunk, sizeof(chunk));
+    }
+    proxy_cache_get_stats(cache, &stats);
+    assert(stats.reserved_bytes == 400 && stats.payload_bytes == 600);
+    assert(proxy_cache_find(cache, "http://small0.com") == NULL);
+    printf("  - The expected size is reserved at begin; later adds evict instead of claiming it.\n");
+
+    cache_abort(writer);
+    proxy_cache_get_stats(cache, &stats);
+    assert(stats.reserved_bytes == 0 && proxy_cache_find(cache, "http://video.com/seg2") == NULL);
+    printf("  - Aborting returns the reservation and caches nothing.\n");
+
+    writer = proxy_cache_begin_add(cache, "http://chunked.com", 18, 0, 0);
+    assert(writer != NULL);
+    assert(cache_append(writer, "hello, ", 7) == 0 && cache_append(writer, "world", 5) == 0);
+    assert(cache_commit(writer) == 0);
+    found = proxy_cache_find(cache, "http://chunked.com");
+    assert(found != NULL && found->len == 12 && memcmp(found->data, "hello, world", 12) == 0);
+    printf("  - Streams of unknown length grow their buffer as chunks arrive.\n");
+
+    size_t rejections = stats.rejections;
+    assert(proxy_cache_begin_add(cache, "http://huge.com", 15, 1001, 0) == NULL);
+    writer = proxy_cache_begin_add(cache, "http://huge.com", 15, 0, 0);
+    int appended = 0;
+    while (appended < 20 && cache_append(writer, chunk, sizeof(chunk)) == 0)
+        appended++;
+    assert(appended == 10 && cache_append(writer, "x", 1) == -1);
+    assert(cache_commit(writer) == -1 && proxy_cache_find(cache, "http://huge.com") == NULL);
+    proxy_cache_get_stats(cache, &stats);
+    assert(stats.rejections == rejections + 2 && stats.reserved_bytes == 0);
+    printf("  - Streams that outgrow the budget are rejected.\n");
+    proxy_cache_destroy(cache);
+
+    config.shard_count = 2;
+    config.budget_mode = CACHE_BUDGET_SHARED;
+    cache = proxy_cache_create(&config);
+    writer = proxy_cache_begin_add(cache, "http://video.com/seg3", 21, 800, 0);
+    assert(writer != NULL && proxy_cache_begin_add(cache, "http://video.com/seg4", 21, 800, 0) == NULL);
+    cache_abort(writer);
+    char* page = malloc(1000);
+    memset(page, 'p', 1000);
+    assert(proxy_cache_add_adopt(cache, "http://full.com", page, 1000, NULL) == 0);
+    proxy_cache_get_stats(cache, &stats);
+    assert(stats.evictions == 0 && stats.payload_bytes == 1000);
+    printf("  - With a shared budget, reservations come out of the common pool.\n");
+
+    proxy_cache_destroy(cache);
+    printf("Test Passed!\n\n");
+}
+
+/**
+ * @brief Tests an instance with NUMA placement: shards and slabs work as usual, and
+ * front caches serve thread-local replicas that go stale with the original.
+ * @details Nodes this machine lacks fall back to the default placement, so two nodes
+ * can be requested anywhere.
+ */
+void test_numa_placement() {
+    printf("Running test: test_numa_placement...\n");
+
+    cache_config_t config = { 0 };
+    config.max_bytes = 1 << 20;
+    config.shard_count = 4;
+    config.use_slab = 1;
+    config.front_caches = 1;
+    config.numa_nodes = CACHE_NUMA_ALL_NODES;
+    proxy_cache_t* cache = proxy_cache_create(&config);
+    assert(cache != NULL);
+    proxy_cache_destroy(cache);
+
+    config.numa_nodes = 2;
+    cache = proxy_cache_create(&config);
+    assert(cache != NULL);
+    char url[64];
+    for (int i = 0; i < 100; i++) {
+        sprintf_s(url, sizeof(url), "http://numa%d.com", i);
+        proxy_cache_add(cache, url, url, strlen(url));
+    }
+    for (int i = 0; i < 100; i++) {
+        sprintf_s(url, sizeof(url), "http://numa%d.com", i);
+        cache_element* found = proxy_cache_find(cache, url);
+        assert(found != NULL && found->len == strlen(url) && memcmp(found->data, url, found->len) == 0);
+    }
+    cache_memory_stats_t memory;
+    proxy_cache_get_memory_stats(cache, &memory);
+    assert(memory.element_count == 100 && memory.slab_reserved_bytes > 0);
+    printf("  - Shards and slabs placed on nodes serve adds and lookups as usual.\n");
+
+    cache_front_t* front = proxy_cache_front_create(cache, 16);
+    assert(front != NULL);
+    cache_element* shared = proxy_cache_find(cache, "http://numa7.com");
+    cache_element* local = cache_front_find(front, "http://numa7.com", 16);
+    assert(local != NULL && local != shared && local->len == shared->len);
+    assert(memcmp(local->data, shared->data, local->len) == 0);
+    assert(cache_front_find(front, "http://numa7.com", 16) == local);
+    cache_element* pinned = cache_front_acquire(front, "http://numa7.com", 16);
+    assert(pinned == local);
+    printf("  - Front caches hand out a thread-local replica of small objects.\n");
+
+    proxy_cache_add(cache, "http://numa7.com", "updated", 7);
+    local = cache_front_find(front, "http://numa7.com", 16);
+    assert(local != NULL && local->len == 7 && memcmp(local->data, "updated", 7) == 0);
+    assert(pinned->len == 16 && memcmp(pinned->data, "http://numa7.com", 16) == 0);
+    cache_release(pinned);
+    printf("  - Updates make replicas stale; pinned replicas stay valid.\n");
+
+    size_t big_len = CACHE_FRONT_REPLICA_BYTES + 1;
+    char* big = malloc(big_len);
+    memset(big, 'b', big_len);
+    assert(proxy_cache_add_adopt(cache, "http://numa-big.com", big, big_len, NULL) == 0);
+    shared = proxy_cache_find(cache, "http://numa-big.com");
+    assert(cache_front_find(front, "http://numa-big.com", 19) == shared);
+    printf("  - Large objects are pinned, not copied.\n");
+
+    cache_front_destroy(front);
+    proxy_cache_destroy(cache);
+    printf("Test Passed!\n\n");
+}
+
+/**
+ * @brief Tests that footprint accounting charges metadata to the budget and reports it apart.
+ */
+void test_footprint_accounting() {
+    printf("Running test: test_footprint_accounting...\n");
+
+    // Tiny payloads: the metadata is many times the payload.
+    cache_config_t config = { 0 };
+    config.max_bytes = 8 * 1024;
+    proxy_cache_t* payload_only = proxy_cache_create(&config);
+    config.accounting = CACHE_ACCOUNT_FOOTPRINT;
+    proxy_cache_t* footprint = proxy_cache_create(&config);
+    config.use_slab = 1;
+    proxy_cache_t* slab_footprint = proxy_cache_create(&config);
+    assert(payload_only != NULL && footprint != NULL && slab_footprint != NULL);
+
+    char url[64];
+    for (int i = 0; i < 200; i++) {
+        sprintf_s(url, sizeof(url), "http://tiny%d.com", i);
+        proxy_cache_add(payload_only, url, "x", 1);
+        proxy_cache_add(footprint, url, "x", 1);
+        proxy_cache_add(slab_footprint, url, "x", 1);
+    }
+
+    cache_stats_t stats;
+    proxy_cache_get_stats(payload_only, &stats);
+    assert(stats.element_count == 200 && stats.payload_bytes == 200);
+    assert(stats.overhead_bytes > 200 * sizeof(cache_element));
+    printf("  - Payload accounting holds %zu elements: %zu payload bytes, %zu bytes of metadata.\n",
+        stats.element_count, stats.payload_bytes, stats.overhead_bytes);
+
+    proxy_cache_t* instances[] = { footprint, slab_footprint };
+    for (int i = 0; i < 2; i++) {
+        proxy_cache_get_stats(instances[i], &stats);
+        assert(stats.element_count > 0 && stats.element_count < 200);
+        assert(stats.payload_bytes == stats.element_count);
+        assert(stats.payload_bytes + stats.overhead_bytes <= config.max_bytes);
+        assert(stats.overhead_bytes >= stats.element_count * sizeof(cache_element));
+        assert(proxy_cache_check(instances[i]) == 0);
+    }
+    printf("  - Footprint accounting keeps payload plus metadata (%zu elements) within the budget.\n",
+        stats.element_count);
+
+    // An update re-charges the new footprint; the totals stay consistent.
+    char big[1024];
+    memset(big, 'b', sizeof(big));
+    proxy_cache_add(footprint, "http://tiny199.com", big, sizeof(big));
+    proxy_cache_get_stats(footprint, &stats);
+    assert(stats.payload_bytes + stats.overhead_bytes <= config.max_bytes);
+    assert(proxy_cache_check(footprint) == 0);
+    cache_element* found = proxy_cache_find(footprint, "http://tiny199.com");
+    assert(found != NULL && found->len == sizeof(big));
+    printf("  - Updates are charged their new footprint.\n");
+
+    // An object whose payload fits the budget but whose footprint does not is turned
+    // away before anything is evicted for it, whichever add path it takes.
+    cache_config_t small = { 0 };
+    small.max_bytes = 4096;
+    small.accounting = CACHE_ACCOUNT_FOOTPRINT;
+    proxy_cache_t* tight = proxy_cache_create(&small);
+    assert(tight != NULL);
+    for (int i = 0; i < 8; i++) {
+        sprintf_s(url, sizeof(url), "http://hot%d.com", i);
+        proxy_cache_add(tight, url, "hot", 3);
+    }
+    char near_budget[4000];
+    memset(near_budget, 'n', sizeof(near_budget));
+    proxy_cache_add(tight, "http://big.com", near_budget, sizeof(near_budget));
+    cache_item_t item = { "http://big.com", 14, near_budget, sizeof(near_budget), 0 };
+    assert(proxy_cache_add_many(tight, &item, 1) == 0);
+    assert(proxy_cache_begin_add(tight, "http://big.com", 14, sizeof(near_budget), 0) == NULL);
+    assert(proxy_cache_find(tight, "http://big.com") == NULL);
+    proxy_cache_get_stats(tight, &stats);
+    assert(stats.element_count == 8 && stats.evictions == 0 && stats.rejections == 3);
+    for (int i = 0; i < 8; i++) {
+        sprintf_s(url, sizeof(url), "http://hot%d.com", i);
+        assert(proxy_cache_find(tight, url) != NULL);
+    }
+
+    // A streaming add that fits reserves its footprint, not just its payload.
+    cache_writer_t* writer = proxy_cache_begin_add(tight, "http://stream.com", 17, 100, 0);
+    assert(writer != NULL);
+    proxy_cache_get_stats(tight, &stats);
+    assert(stats.reserved_bytes > 100 + sizeof(cache_element));
+    cache_abort(writer);
+    proxy_cache_get_stats(tight, &stats);
+    assert(stats.reserved_bytes == 0 && proxy_cache_check(tight) == 0);
+    proxy_cache_destroy(tight);
+    printf("  - Objects too large by footprint are rejected without evicting anything.\n");
+
+    proxy_cache_destroy(payload_only);
+    proxy_cache_destroy(footprint);
+    proxy_cache_destroy(slab_footprint);
+    printf("Test Passed!\n\n");
+}
+
+// Set by blocking_free() once it runs; blocking_free() returns once the test sets the other flag.
+static volatile int blocking_free_entered;
+static volatile int blocking_free_released;
+
+/**
+ * @brief Adopted-buffer free function that holds up its caller, which holds the shard lock.
+ */
+static void blocking_free(void* buffer) {
+    cache_atomic_store_int(&blocking_free_entered, 1);
+    while (!cache_atomic_load_int(&blocking_free_released))
+        Sleep(1);
+    free(buffer);
+}
+
+static void update_blocked_key(void* arg) {
+    proxy_cache_add_key((proxy_cache_t*)arg, "http://blocked.com", 18, "new", 3);
+}
+
+static volatile int async_done;
+static volatile int async_failed;
+
+static void count_async_add(void* context, int result) {
+    (void)context;
+    cache_atomic_fetch_add_int(result == 0 ? &async_done : &async_failed, 1);
+}
+
+/**
+ * @brief Tests the lookups that never wait and the adds queued for shard owner threads.
+ */
+void test_async_api() {
+    printf("Running test: test_async_api...\n");
+
+    // Replacing an adopted payload frees it under the shard lock, which blocking_free() stalls.
+    cache_config_t config = { 0 };
+    config.max_bytes = 1 << 20;
+    proxy_cache_t* cache = proxy_cache_create(&config);
+    assert(cache != NULL);
+    char* buffer = malloc(3);
+    assert(buffer != NULL);
+    memcpy(buffer, "old", 3);
+    assert(proxy_cache_add_adopt_key(cache, "http://blocked.com", 18, buffer, 3, blocking_free) == 0);
+
+    cache_element* element = (cache_element*)1;
+    assert(proxy_cache_try_find_key(cache, "http://missing.com", 18, &element) == 0 && element == NULL);
+
+    blocking_free_entered = 0;
+    blocking_free_released = 0;
+    test_thread_t writer;
+    start_thread(&writer, update_blocked_key, cache);
+    while (!cache_atomic_load_int(&blocking_free_entered))
+        Sleep(1);
+    assert(proxy_cache_try_find_key(cache, "http://blocked.com", 18, &element) == CACHE_BUSY && element == NULL);
+    assert(proxy_cache_try_acquire_key(cache, "http://other.com", 16, &element) == CACHE_BUSY && element == NULL);
+    cache_atomic_store_int(&blocking_free_released, 1);
+    join_thread(&writer);
+
+    assert(proxy_cache_try_acquire_key(cache, "http://blocked.com", 18, &element) == 0);
+    assert(element != NULL && element->len == 3 && memcmp(element->data, "new", 3) == 0);
+    cache_release(element);
+    cache_stats_t stats;
+    proxy_cache_get_stats(cache, &stats);
+    assert(stats.busy == 2 && stats.hits == 1 && stats.misses == 1);
+    printf("  - Try lookups return CACHE_BUSY instead of waiting for a held shard lock.\n");
+    proxy_cache_destroy(cache);
+
+    // Queued adds, applied by two owner threads for four shards.
+    config.shard_count = 4;
+    config.owner_threads = 2;
+    cache = proxy_cache_create(&config);
+    assert(cache != NULL);
+    async_done = 0;
+    async_failed = 0;
+    char url[64];
+    for (int i = 0; i < 200; i++) {
+        sprintf_s(url, sizeof(url), "http://async%d.com", i);
+        assert(proxy_cache_add_async(cache, url, strlen(url), url, strlen(url), 0, count_async_add, NULL) == 0);
+    }
+    // Several versions of one key: the owner applies them in queue order.
+    for (int i = 0; i < 50; i++) {
+        int length = sprintf_s(url, sizeof(url), "version %d", i);
+        assert(proxy_cache_add_async(cache, "http://versions.com", 19, url, (size_t)length, 0, NULL, NULL) == 0);
+    }
+    assert(proxy_cache_add_async(cache, "http://huge.com", 15, url, (size_t)config.max_bytes, 0, NULL, NULL) == -1);
+    proxy_cache_flush_async(cache);
+
+    assert(cache_atomic_load_int(&async_done) == 200 && cache_atomic_load_int(&async_failed) == 0);
+    for (int i = 0; i < 200; i++) {
+        sprintf_s(url, sizeof(url), "http://async%d.com", i);
+        assert(proxy_cache_try_acquire_key(cache, url, strlen(url), &element) == 0);
+        assert(element != NULL && element->len == strlen(url) && memcmp(element->data, url, element->len) == 0);
+        cache_release(element);
+    }
+    assert(proxy_cache_try_find_key(cache, "http://versions.com", 19, &element) == 0);
+    assert(element != NULL && element->len == 10 && memcmp(element->data, "version 49", 10) == 0);
+    proxy_cache_get_stats(cache, &stats);
+    assert(stats.async_adds == 250 && stats.async_pending == 0 && stats.rejections == 1);
+    printf("  - Owner threads applied %zu queued adds in order and reported each completion.\n", stats.async_adds);
+
+    // Adds still queued at destruction are applied first, and need no owners on an instance without them.
+    for (int i = 0; i < 20; i++)
+        assert(proxy_cache_add_async(cache, "http://late.com", 15, "late", 4, 0, count_async_add, NULL) == 0);
+    proxy_cache_destroy(cache);
+    assert(cache_atomic_load_int(&async_done) == 220);
+    assert(cache_add_async("http://none.com", 15, "x", 1, NULL, NULL) == -1);
+    printf("  - Destroying an instance drains its queues first.\n");
+    printf("Test Passed!\n\n");
+}
+
+/**
+ * @brief Tests sampled access tracing, trace dumps and the SHARDS miss-ratio estimate.
+ */
+void test_access_trace() {
+    printf("Running test: test_access_trace...\n");
+
+    // Every key traced: 100 adds of 100 bytes, a find of each and one miss.
+    cache_config_t config = { 0 };
+    config.max_bytes = 1 << 20;
+    config.trace_sample = 1;
+    proxy_cache_t* cache = proxy_cache_create(&config);
+    assert(cache != NULL);
+    char url[64], payload[100];
+    memset(payload, 'p', sizeof(payload));
+    for (int i = 0; i < 100; i++) {
+        sprintf_s(url, sizeof(url), "http://trace%d.com", i);
+        proxy_cache_add(cache, url, payload, sizeof(payload));
+    }
+    for (int i = 0; i < 100; i++) {
+        sprintf_s(url, sizeof(url), "http://trace%d.com", i);
+        assert(proxy_cache_find(cache, url) != NULL);
+    }
+    assert(proxy_cache_find(cache, "http://untraced.com") == NULL);
+    cache_stats_t stats;
+    proxy_cache_get_stats(cache, &stats);
+    assert(stats.traced == 201);
+
+    const char* path = "test_trace.bin";
+    assert(proxy_cache_dump_trace(cache, path) == 0);
+    cache_trace_record_t* records = NULL;
+    size_t count = 0;
+    unsigned int sample = 0;
+    assert(cache_trace_read(path, &records, &count, &sample) == 0);
+    assert(count == 201 && sample == 1);
+    for (size_t i = 0; i < 100; i++) {
+        assert(records[i].op == CACHE_TRACE_ADD && records[i].hit == 1 && records[i].size == 100);
+        assert(records[100 + i].op == CACHE_TRACE_FIND && records[100 + i].hit == 1);
+        assert(records[100 + i].hash == records[i].hash && records[100 + i].size == 100);
+    }
+    assert(records[200].op == CACHE_TRACE_FIND && records[200].hit == 0 && records[200].size == 0);
+    free(records);
+    remove(path);
+    printf("  - Dumped %zu records and read them back in order.\n", count);
+
+    // Looping over 10,000 bytes: an LRU cache of that size hits every reuse, a smaller one none.
+    for (int pass = 0; pass < 2; pass++) {
+        for (int i = 0; i < 100; i++) {
+            sprintf_s(url, sizeof(url), "http://trace%d.com", i);
+            proxy_cache_find(cache, url);
+        }
+    }
+    size_t budgets[] = { 5000, 9999, 10000, 20000 };
+    double ratios[4];
+    assert(proxy_cache_estimate_mrc(cache, budgets, 4, ratios) == 301);
+    assert(ratios[0] * 301 > 300.5 && ratios[1] * 301 > 300.5);  // All 300 reuses and the miss.
+    assert(ratios[2] * 301 < 1.5 && ratios[3] * 301 < 1.5);      // Only the key never seen.
+    proxy_cache_destroy(cache);
+    printf("  - The exact curve steps from 1 to 0 at the loop's size.\n");
+
+    // 1 key in 10 sampled: the estimate of a 200,000-byte loop still steps at about that size.
+    config.trace_sample = 10;
+    cache = proxy_cache_create(&config);
+    assert(cache != NULL);
+    for (int i = 0; i < 2000; i++) {
+        sprintf_s(url, sizeof(url), "http://loop%d.com", i);
+        proxy_cache_add(cache, url, payload, sizeof(payload));
+    }
+    for (int pass = 0; pass < 2; pass++) {
+        for (int i = 0; i < 2000; i++) {
+            sprintf_s(url, sizeof(url), "http://loop%d.com", i);
+            proxy_cache_find(cache, url);
+        }
+    }
+    proxy_cache_get_stats(cache, &stats);
+    assert(stats.traced > 3 * 2000 / 10 / 2 && stats.traced < 3 * 2000 * 2 / 10);
+    size_t loop_budgets[] = { 100000, 400000 };
+    assert(proxy_cache_estimate_mrc(cache, loop_budgets, 2, ratios) == stats.traced * 2 / 3);
+    assert(ratios[0] == 1.0 && ratios[1] == 0.0);
+    printf("  - Sampled %zu of 6000 operations; the estimate still steps between 100 and 400 KB.\n",
+        stats.traced);
+    proxy_cache_destroy(cache);
+
+    // A full ring keeps the newest records.
+    config.trace_sample = 1;
+    config.trace_records = 16;
+    cache = proxy_cache_create(&config);
+    assert(cache != NULL);
+    for (int i = 0; i < 100; i++) {
+        sprintf_s(url, sizeof(url), "http://ring%d.com", i);
+        proxy_cache_add(cache, url, payload, (size_t)i + 1);
+    }
+    assert(proxy_cache_dump_trace(cache, path) == 0);
+    assert(cache_trace_read(path, &records, &count, NULL) == 0);
+    assert(count == 16);
+    for (size_t i = 0; i < count; i++)
+        assert(records[i].size == 85 + i);
+    free(records);
+    remove(path);
+    proxy_cache_destroy(cache);
+
+    // Without tracing there is nothing to dump or estimate.
+    config.trace_sample = 0;
+    cache = proxy_cache_create(&config);
+    assert(cache != NULL);
+    assert(proxy_cache_dump_trace(cache, path) == -1);
+    assert(proxy_cache_estimate_mrc(cache, budgets, 4, ratios) == 0 && ratios[0] == 1.0);
+    proxy_cache_destroy(cache);
+    printf("  - A full ring keeps the newest records; untraced instances report nothing.\n");
+    printf("Test Passed!\n\n");
+}
+
+/**
+ * @brief Tests that a front cache answers repeat lookups itself, keeps hot keys
+ * against conflicting ones and notices updates and evictions.
+ */
+void test_front_cache() {
+    printf("Running test: test_front_cache...\n");
+
+    cache_config_t config = { 0 };
+    config.max_bytes = 100;
+    proxy_cache_t* cache = proxy_cache_create(&config);
+    assert(cache != NULL && proxy_cache_front_create(cache, 0) == NULL);
+    proxy_cache_destroy(cache);
+
+    config.front_caches = 1;
+    cache = proxy_cache_create(&config);
+    cache_front_t* front = proxy_cache_front_create(cache, 1); // One slot: every key conflicts.
+    assert(front != NULL);
+
+    proxy_cache_add(cache, "http://hot.com", "hot-v1", 6);
+    proxy_cache_add(cache, "http://cold.com", "cold", 4);
+    for (int i = 0; i < 3; i++) {
+        cache_element* found = cache_front_find(front, "http://hot.com", 14);
+        assert(found != NULL && memcmp(found->data, "hot-v1", 6) == 0);
+    }
+    cache_front_stats_t front_stats;
+    cache_stats_t stats;
+    cache_front_get_stats(front, &front_stats);
+    proxy_cache_get_stats(cache, &stats);
+    assert(front_stats.hits == 2 && front_stats.misses == 1 && stats.hits == 1);
+    printf("  - Repeat lookups are answered without the shared cache.\n");
+
+    assert(cache_front_find(front, "http://cold.com", 15) != NULL);
+    assert(cache_front_find(front, "http://cold.com", 15) != NULL);
+    assert(cache_front_find(front, "http://hot.com", 14) != NULL);
+    cache_front_get_stats(front, &front_stats);
+    assert(front_stats.hits == 3);
+    printf("  - An occasional key does not displace a hot one.\n");
+
+    proxy_cache_add(cache, "http://hot.com", "hot-v2", 6);
+    cache_element* handle = cache_front_acquire(front, "http://hot.com", 14);
+    assert(handle != NULL && memcmp(handle->data, "hot-v2", 6) == 0);
+    cache_front_get_stats(front, &front_stats);
+    assert(front_stats.stale == 1);
+    printf("  - Updating a key makes its front copy stale.\n");
+
+    for (int i = 0; i < 10; i++) {
+        char url[64];
+        sprintf_s(url, sizeof(url), "http://filler%d.com", i);
+        proxy_cache_add(cache, url, "0123456789012345678901234", 25);
+    }
+    assert(cache_front_find(front, "http://hot.com", 14) == NULL);
+    assert(memcmp(handle->data, "hot-v2", 6) == 0); // Still pinned by the caller.
+    cache_release(handle);
+    printf("  - Evicted keys miss, even though the front held a handle.\n");
+
+    cache_front_destroy(front);
+    proxy_cache_destroy(cache);
+    printf("Test Passed!\n\n");
+}
+
+/**
+ * @brief Tests that the statistics surface counts hits, misses, writes and evictions.
+ */
+void test_cache_stats() {
+    printf("Running test: test_cache_stats...\n");
+
+    cache_config_t config = { 0 };
+    config.max_bytes = 100;
+    config.shard_count = 2;
+    config.track_latency = 1;
+    proxy_cache_t* cache = proxy_cache_create(&config);
+    assert(cache != NULL);
+
+    char url[64];
+    for (int i = 0; i < 12; i++) {
+        sprintf_s(url, sizeof(url), "http://stats%d.com", i);
+        proxy_cache_add(cache, url, "0123456789", 10);
+    }
+    proxy_cache_add(cache, "http://stats11.com", "9876543210", 10); // Update
+    static char big[200];
+    proxy_cache_add(cache, "http://too-big.com", big, sizeof(big));   // Rejected
+
+    assert(proxy_cache_find(cache, "http://stats11.com") != NULL);
+    assert(proxy_cache_find(cache, "http://missing.com") == NULL);
+
+    cache_stats_t stats;
+    proxy_cache_get_stats(cache, &stats);
+    assert(stats.hits == 1 && stats.misses == 1);
+    assert(stats.inserts == 12 && stats.updates == 1 && stats.rejections == 1);
+    assert(stats.element_count + stats.evictions == 12);
+    assert(stats.bytes_evicted == stats.evictions * 10);
+    assert(stats.payload_bytes == stats.element_count * 10 && stats.payload_bytes <= 100);
+    assert(stats.budget_bytes == 100);
+    printf("  - Counted %zu hits, %zu misses, %zu inserts, %zu evictions.\n",
+        stats.hits, stats.misses, stats.inserts, stats.evictions);
+
+    assert(stats.map_capacity >= stats.element_count);
+    assert(stats.map_mean_probe_groups >= 1.0 && stats.map_max_probe_groups >= 1);
+    assert(stats.lookup_samples == 2);
+    assert(stats.lookup_p50_ns <= stats.lookup_p99_ns && stats.lookup_p99_ns <= stats.lookup_max_ns);
+    printf("  - Map and latency diagnostics are populated (p99 %llu ns).\n", stats.lookup_p99_ns);
+
+    proxy_cache_destroy(cache);
+    printf("Test Passed!\n\n");
+}
+
+static volatile LONG loader_calls;
+
+/**
+ * @brief Test loader: returns "loaded:<key>" after a short delay, or fails for "fail".
+ * @details 'context' points at the payload size to produce (0 selects the text itself).
+ */
+static int slow_loader(void* context, const char* key, size_t key_len,
+    char** buffer, size_t* length, cache_free_fn* buffer_free) {
+    InterlockedIncrement(&loader_calls);
+    Sleep(20); // Gives concurrent callers time to pile up behind this load.
+    if (key_len == 4 && memcmp(key, "fail", 4) == 0)
+        return -1;
+
+    size_t size = context ? *(size_t*)context : 0;
+    char* body = malloc(size ? size : key_len + 7);
+    assert(body != NULL);
+    if (size) {
+        memset(body, 'x', size);
+    }
+    else {
+        memcpy(body, "loaded:", 7);
+        memcpy(body + 7, key, key_len);
+        size = key_len + 7;
+    }
+    *buffer = body;
+    *length = size;
+    *buffer_free = NULL;
+    return 0;
+}
+
+static cache_element* loaded_elements[NUM_THREADS];
+
+static void get_or_load_worker(void* arg) {
+    int thread_id = *(int*)arg;
+    loaded_elements[thread_id] = cache_get_or_load("http://hot.com", 14, slow_loader, NULL);
+}
+
+/**
+ * @brief Tests that concurrent misses on one key share a single loader call.
+ * @note Expects TEST_CACHE_BYTES = 100.
+ */
+void test_get_or_load() {
+    printf("Running test: test_get_or_load...\n");
+    loader_calls = 0;
+
+    test_thread_t threads[NUM_THREADS];
+    int thread_ids[NUM_THREADS];
+    for (int i = 0; i < NUM_THREADS; i++) {
+        thread_ids[i] = i;
+        start_thread(&threads[i], get_or_load_worker, &thread_ids[i]);
+    }
+    for (int i = 0; i < NUM_THREADS; i++)
+        join_thread(&threads[i]);
+
+    assert(loader_calls == 1);
+    for (int i = 0; i < NUM_THREADS; i++) {
+        assert(loaded_elements[i] == loaded_elements[0]);
+        cache_release(loaded_elements[i]);
+    }
+    cache_element* found = cache_find("http://hot.com");
+    assert(found != NULL && found->len == 21 && memcmp(found->data, "loaded:http://hot.com", 21) == 0);
+    printf("  - %d concurrent misses made one loader call.\n", NUM_THREADS);
+
+    cache_element* hit = cache_get_or_load("http://hot.com", 14, slow_loader, NULL);
+    assert(hit == found && loader_calls == 1);
+    cache_release(hit);
+
+    assert(cache_get_or_load("fail", 4, slow_loader, NULL) == NULL);
+    assert(loader_calls == 2);
+    printf("  - Hits skip the loader and failed loads return NULL.\n");
+
+    // An object over the budget is still returned to the caller, just not cached.
+    size_t big = TEST_CACHE_BYTES * 2;
+    cache_element* detached = cache_get_or_load("http://big.com", 14, slow_loader, &big);
+    assert(detached != NULL && detached->len == big && detached->data[0] == 'x');
+    assert(cache_find("http://big.com") == NULL);
+    cache_release(detached);
+    printf("  - Uncacheable objects are handed out without being stored.\n");
+
+    cache_stats_t stats;
+    cache_get_stats(&stats);
+    assert(stats.loads == 3 && stats.coalesced <= NUM_THREADS - 1);
+    printf("  - %zu callers waited on another caller's load.\n", stats.coalesced);
+    printf("Test Passed!\n\n");
+}
+
+/**
+ * @brief The function executed by each concurrent thread to hammer the cache.
+ */
+static void thread_worker(void* arg) {
+    int thread_id = *(int*)arg;
+    cache_front_t* front = cache_front_create(16); // NULL unless the cache allows front caches.
+
+    for (int i = 0; i < OPERATIONS_PER_THREAD; i++) {
+        char url[64];
+        char data[64];
+
+        // Create a unique URL and data for each operation to avoid collisions between threads
+        sprintf_s(url, sizeof(url), "http://thread%d-item%d.com", thread_id, i);
+        sprintf_s(data, sizeof(data), "data from thread %d, op %d", thread_id, i);
+
+        // Hammer the cache with add and find operations
+        cache_add(url, data, strlen(data));
+        cache_find(url);
+
+        // One key every thread reads through its front cache while thread 0 keeps rewriting it.
+        if (front) {
+            if (thread_id == 0 && i % 16 == 0)
+                cache_add("http://front-hot.com", "front-hot", 9);
+            cache_element* hot = cache_front_find(front, "http://front-hot.com", 20);
+            assert(hot == NULL || memcmp(hot->data, "front-hot", 9) == 0);
+        }
+    }
+    cache_front_destroy(front);
+}
+
+/**
+ * @brief Spawns multiple threads to test concurrent access to the cache.
+ */
+void test_thread_safety() {
+    printf("Running test: test_thread_safety with %d threads...\n", NUM_THREADS);
+
+    test_thread_t threads[NUM_THREADS];
+    int thread_ids[NUM_THREADS];
+
+    // Launch all threads
+    for (int i = 0; i < NUM_THREADS; i++) {
+        thread_ids[i] = i;
+        start_thread(&threads[i], thread_worker, &thread_ids[i]);
+    }
+
+    // Wait for all threads to complete their execution (this also releases their handles)
+    for (int i = 0; i < NUM_THREADS; i++)
+        join_thread(&threads[i]);
+
+    printf("  - All threads finished execution.\n");
+
+    // The primary success condition is that the program did not crash due to race conditions
+    // or deadlock. test_stress_scaling() also checks the bookkeeping under contention.
+
+    printf("Test Passed!\n\n");
+}
+
+
+typedef struct stress_worker {
+    proxy_cache_t* cache;
+    int thread_id;
+} stress_worker_t;
+
+/**
+ * @brief Mixes adds, overwrites, pinned and unpinned lookups and maintenance over a few shared keys.
+ * @details Every payload starts with its own key, so a pinned element whose bytes do not
+ * match the key it was looked up by has been freed or torn under the reader.
+ */
+static void stress_worker(void* arg) {
+    stress_worker_t* worker = (stress_worker_t*)arg;
+    unsigned int state = 2463534242u + (unsigned int)worker->thread_id * 7919u;
+
+    for (int i = 0; i < STRESS_OPERATIONS; i++) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+
+        char url[32];
+        char data[400];
+        int url_len = sprintf_s(url, sizeof(url), "http://stress%u.com", state % STRESS_KEYS);
+        unsigned int op = (state >> 8) % 10;
+
+        if (op < 4) {
+            cache_element* element = proxy_cache_acquire_key(worker->cache, url, (size_t)url_len);
+            if (element) {
+                assert(element->len >= (size_t)url_len && memcmp(element->data, url, (size_t)url_len) == 0);
+                cache_release(element);
+            }
+        }
+        else if (op < 6) {
+            proxy_cache_find_key(worker->cache, url, (size_t)url_len);
+        }
+        else if (op < 9) {
+            size_t len = (size_t)url_len + (state >> 16) % (sizeof(data) - (size_t)url_len);
+            memcpy(data, url, (size_t)url_len);
+            memset(data + url_len, 'a' + worker->thread_id, len - (size_t)url_len);
+            if (op == 8)
+                proxy_cache_add_ttl(worker->cache, url, (size_t)url_len, data, len, 1);
+            else
+                proxy_cache_add_key(worker->cache, url, (size_t)url_len, data, len);
+        }
+        else if (worker->thread_id == 0) {
+            proxy_cache_maintain(worker->cache);
+            assert(proxy_cache_check(worker->cache) == 0);
+        }
+    }
+}
+
+/**
+ * @brief Runs the stress mix against every shard lock kind, with one shard and with eight.
+ * @details Checks the shard invariants while the workers run and once they are done,
+ * and prints each configuration's throughput for comparing lock kinds and shard counts.
+ */
+void test_stress_scaling() {
+    printf("Running test: test_stress_scaling with %d threads...\n", NUM_THREADS);
+
+    static const struct {
+        cache_lock_kind_t kind;
+        const char* name;
+    } kinds[] = {
+        { CACHE_LOCK_MUTEX, "mutex" },
+        { CACHE_LOCK_RWLOCK, "rwlock" },
+        { CACHE_LOCK_SPIN, "spin" },
+        { CACHE_LOCK_ADAPTIVE, "adaptive" },
+    };
+    static const size_t shard_counts[] = { 1, 8 };
+
+    for (size_t k = 0; k < sizeof(kinds) / sizeof(kinds[0]); k++) {
+        for (size_t s = 0; s < sizeof(shard_counts) / sizeof(shard_counts[0]); s++) {
+            cache_config_t config = { 0 };
+            config.max_bytes = STRESS_CACHE_BYTES;
+            config.shard_count = shard_counts[s];
+            config.lock_kind = kinds[k].kind;
+            if (shard_counts[s] > 1)
+                config.accounting = CACHE_ACCOUNT_FOOTPRINT; // Checks the metadata totals under contention too.
+            // A reader/writer lock only pays off when hits take it shared.
+            if (kinds[k].kind == CACHE_LOCK_RWLOCK)
+                config.lookup_mode = CACHE_LOOKUP_READ_MOSTLY;
+            proxy_cache_t* cache = proxy_cache_create(&config);
+            assert(cache != NULL);
+
+            test_thread_t threads[NUM_THREADS];
+            stress_worker_t workers[NUM_THREADS];
+            unsigned long long start = cache_now_ns();
+            for (int i = 0; i < NUM_THREADS; i++) {
+                workers[i].cache = cache;
+                workers[i].thread_id = i;
+                start_thread(&threads[i], stress_worker, &workers[i]);
+            }
+            for (int i = 0; i < NUM_THREADS; i++)
+                join_thread(&threads[i]);
+            unsigned long long elapsed_ns = cache_now_ns() - start;
+
+            assert(proxy_cache_check(cache) == 0);
+            cache_stats_t stats;
+            proxy_cache_get_stats(cache, &stats);
+            assert(stats.payload_bytes <= STRESS_CACHE_BYTES && stats.element_count <= STRESS_KEYS);
+            printf("  - %-8s x %zu shard(s): %.0f ops/sec, %zu contended acquisitions.\n", kinds[k].name,
+                shard_counts[s], (double)NUM_THREADS * STRESS_OPERATIONS * 1e9 / (double)(elapsed_ns ? elapsed_ns : 1),
+                stats.lock_contended);
+            proxy_cache_destroy(cache);
+        }
+    }
+    printf("Test Passed!\n\n");
+}
+
+/**
+ * @brief Replaces the default cache with a fresh one built from 'config' and a TEST_CACHE_BYTES budget.
+ */
+static void reset_cache(cache_config_t config) {
+    config.max_bytes = TEST_CACHE_BYTES;
+    cache_destroy();
+    cache_init_config(&config);
+}
+
+/**
+ * @brief Main entry point for the test executable.
+ */
+int main(void) {
+    printf("--- Cache Test Suite Initializing ---\n");
+
+    test_map_growth_and_erase();
+    test_map_prehashed();
+    test_slab_allocator();
+    test_histogram_percentiles();
+    test_timer_wheel();
+
+    // Run all our tests in a clean environment for each test group
+    cache_config_t defaults = { 0 };
+    reset_cache(defaults);
+    test_add_and_find();
+
+    // Re-initialize the cache to ensure eviction tests start with an empty state
+    reset_cache(defaults);
+    test_lru_eviction();
+
+    // Re-initialize again for the update test
+    reset_cache(defaults);
+    test_update_item();
+
+    // Pinned handles
+    reset_cache(defaults);
+    test_acquire_release();
+
+    reset_cache(defaults);
+    test_add_adopt();
+
+    reset_cache(defaults);
+    test_binary_keys();
+
+    // Single-flight loads
+    reset_cache(defaults);
+    test_get_or_load();
+
+    // Slab-backed storage
+    cache_config_t slab_config = { 0 };
+    slab_config.use_slab = 1;
+    reset_cache(slab_config);
+    test_slab_cache();
+
+    // Sharded caches with both budget modes
+    cache_config_t sharded = { 0 };
+    sharded.shard_count = 4;
+    reset_cache(sharded);
+    test_sharded_budget(CACHE_BUDGET_SPLIT);
+
+    sharded.budget_mode = CACHE_BUDGET_SHARED;
+    reset_cache(sharded);
+    test_sharded_budget(CACHE_BUDGET_SHARED);
+
+    reset_cache(sharded);
+    test_batch_api();
+
+    // Read-mostly lookups with lazily applied LRU order
+    cache_config_t read_mostly = { 0 };
+    read_mostly.lookup_mode = CACHE_LOOKUP_READ_MOSTLY;
+    reset_cache(read_mostly);
+    test_read_mostly_second_chance();
+
+    // Independent instances and runtime budgets
+    reset_cache(defaults);
+    test_multiple_instances();
+    test_budget_shrink();
+
+    // Eviction policies
+    test_scan_resistance();
+    test_size_aware_eviction();
+
+    // Statistics
+    test_cache_stats();
+
+    // Expiry
+    test_ttl_expiry();
+
+    // Warm restarts
+    test_snapshot_restore();
+
+    // Disk tier
+    test_disk_tier();
+
+    // Deferred frees and watermark eviction
+    test_background_reclaim();
+
+    // Compressed storage
+    test_lz4_codec();
+    test_compressed_storage();
+
+    // Streamed adds
+    test_streaming_add();
+
+    // Per-thread front caches
+    test_front_cache();
+
+    // NUMA placement
+    test_numa_placement();
+
+    // Metadata-inclusive budgets
+    test_footprint_accounting();
+
+    // Non-blocking lookups and queued adds
+    test_async_api();
+
+    // Access traces and miss-ratio curves
+    test_access_trace();
+
+    // Re-initialize for the final thread-safety tests
+    reset_cache(defaults);
+    test_thread_safety();
+
+    sharded.shard_count = 8;
+    sharded.background_reclaim = 1; // Pre-eviction races with writers for the shard locks.
+    sharded.high_watermark = 90;
+    reset_cache(sharded);
+    test_thread_safety();
+
+    read_mostly.shard_count = 4;
+    read_mostly.track_latency = 1;
+    read_mostly.front_caches = 1;
+    read_mostly.numa_nodes = 2; // Front caches hand out thread-local replicas.
+    reset_cache(read_mostly);
+    test_thread_safety();
+
+    slab_config.shard_count = 4;
+    slab_config.tier_path = "test_tier.bin"; // Spills and promotions race with slab-backed frees.
+    slab_config.tier_bytes = 64 * 1024;
+    reset_cache(slab_config);
+    test_thread_safety();
+
+    cache_config_t tinylfu = { 0 };
+    tinylfu.policy = CACHE_POLICY_TINYLFU;
+    tinylfu.shard_count = 4;
+    tinylfu.lookup_mode = CACHE_LOOKUP_READ_MOSTLY;
+    reset_cache(tinylfu);
+    test_thread_safety();
+
+    cache_config_t gdsf = { 0 };
+    gdsf.policy = CACHE_POLICY_GDSF;
+    gdsf.shard_count = 4;
+    gdsf.budget_mode = CACHE_BUDGET_SHARED;
+    gdsf.default_ttl_ms = 2; // Keeps the timer wheels busy expiring under contention.
+    reset_cache(gdsf);
+    test_thread_safety();
+
+    cache_config_t adaptive = { 0 };
+    adaptive.shard_count = 4;
+    adaptive.lock_kind = CACHE_LOCK_ADAPTIVE;
+    adaptive.background_reclaim = 1;
+    reset_cache(adaptive);
+    test_thread_safety();
+
+    // Invariants and throughput per lock kind
+    test_stress_scaling();
+
+    // Clean up all cache resources
+    cache_destroy();
+
+    printf("--- All tests finished successfully. ---\nPress Enter to exit.\n");
+    getchar(); // Pauses the console window so you can see the output
+    return 0;
+}